@@ -0,0 +1,176 @@
+#include "AllocationCounter.h"
+#include "BenchUtil.h"
+#include "CommandBuffer.h"
+#include "FrameArena.h"
+#include "JobSystem.h"
+#include "Pool.h"
+#include "Transform.h"
+
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+using namespace GLPractice;
+
+static const unsigned OBJECT_COUNT = 4096;
+static const unsigned FRAME_COUNT = 200;
+// frames before the buffers reached their size
+static const unsigned WARM_UP_FRAMES = 3;
+static const unsigned TASK_SIZE = 256;
+static const size_t ARENA_SIZE = 1 << 20;
+
+// a long lived object, like a mesh or a renderer
+struct Object {
+    Transform transform;
+    float color[4];
+    unsigned drawCount;
+};
+
+// what a frame does with its transient data: visible objects, sort keys
+// and draw commands of them
+struct Frame {
+    unsigned* visible;
+    uint64_t* keys;
+    unsigned visibleCount;
+};
+
+static unsigned cull(const std::vector<PoolHandle>& handles, const Pool<Object>& objects,
+        unsigned frame, unsigned* visible, uint64_t* keys) {
+    unsigned count = 0;
+    for(unsigned i = 0; i < handles.size(); i++) {
+        const Object& object = objects.at(handles[i]);
+        if((i + frame) % 3 == 0)
+            continue;
+        visible[count] = i;
+        keys[count] = (uint64_t) (object.transform.translation.z * 1000.0f);
+        count++;
+    }
+    return count;
+}
+
+int main() {
+    Pool<Object> objects(OBJECT_COUNT);
+    std::vector<PoolHandle> handles;
+    for(unsigned i = 0; i < OBJECT_COUNT; i++) {
+        Object object = Object();
+        object.transform.translation = Vector3{ (float) (i % 64), 0.0f, (float) (i / 64) };
+        handles.push_back(objects.create(object));
+    }
+
+    // the same transient data from the heap each frame
+    uint64_t allocations = allocationCount();
+    Clock::time_point start = Clock::now();
+    for(unsigned frame = 0; frame < FRAME_COUNT; frame++) {
+        std::unique_ptr<unsigned[]> visible(new unsigned[OBJECT_COUNT]);
+        std::unique_ptr<uint64_t[]> keys(new uint64_t[OBJECT_COUNT]);
+        cull(handles, objects, frame, visible.get(), keys.get());
+    }
+    double heapMs = elapsedMs(start);
+    uint64_t heapAllocations = allocationCount() - allocations;
+
+    FrameArena arena(ARENA_SIZE);
+    allocations = allocationCount();
+    start = Clock::now();
+    for(unsigned frame = 0; frame < FRAME_COUNT; frame++) {
+        arena.reset();
+        unsigned* visible = arena.allocate<unsigned>(OBJECT_COUNT);
+        uint64_t* keys = arena.allocate<uint64_t>(OBJECT_COUNT);
+        cull(handles, objects, frame, visible, keys);
+    }
+    double arenaMs = elapsedMs(start);
+    uint64_t arenaAllocations = allocationCount() - allocations;
+
+    std::cout << FRAME_COUNT << " frames of transient data for " << OBJECT_COUNT << " objects" << std::endl
+        << "  heap:  " << heapMs / FRAME_COUNT << " ms per frame, " << heapAllocations << " allocations" << std::endl
+        << "  arena: " << arenaMs / FRAME_COUNT << " ms per frame, " << arenaAllocations << " allocations, "
+        << arena.highWater() << " bytes" << std::endl;
+
+    // objects created and destroyed, a pool against new and delete
+    std::vector<Object*> pointers(OBJECT_COUNT);
+    start = Clock::now();
+    for(unsigned round = 0; round < FRAME_COUNT; round++) {
+        for(unsigned i = 0; i < OBJECT_COUNT; i++)
+            pointers[i] = new Object();
+        for(unsigned i = 0; i < OBJECT_COUNT; i++)
+            delete pointers[i];
+    }
+    double newMs = elapsedMs(start);
+
+    Pool<Object> churn(OBJECT_COUNT);
+    std::vector<PoolHandle> churnHandles(OBJECT_COUNT);
+    allocations = allocationCount();
+    start = Clock::now();
+    for(unsigned round = 0; round < FRAME_COUNT; round++) {
+        for(unsigned i = 0; i < OBJECT_COUNT; i++)
+            churnHandles[i] = churn.create();
+        for(unsigned i = 0; i < OBJECT_COUNT; i++)
+            churn.destroy(churnHandles[i]);
+    }
+    double poolMs = elapsedMs(start);
+    uint64_t poolAllocations = allocationCount() - allocations;
+    std::cout << "  new and delete: " << newMs / FRAME_COUNT << " ms per round" << std::endl
+        << "  pool:           " << poolMs / FRAME_COUNT << " ms per round, " << poolAllocations
+        << " allocations" << std::endl;
+
+    // a handle outlives its object without reaching the next one in its slot
+    PoolHandle stale = churn.create();
+    churn.destroy(stale);
+    PoolHandle reused = churn.create();
+    if(arenaAllocations != 0 || poolAllocations != 0 || churn.get(stale) || !churn.get(reused) ||
+            reused.index != stale.index || churn.size() != 1 || objects.get(PoolHandle())) {
+        std::cerr << "ERROR: arena or pool allocated memory or handles are wrong" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // a whole frame: culling into the arena, recording on the workers,
+    // replaying, nothing of it may allocate once the buffers reached their size
+    JobSystem jobs(4);
+    ParallelFor parallelFor = [&jobs](unsigned count, const std::function<void(unsigned)>& task) {
+        jobs.parallelFor(count, task);
+    };
+    CommandList commands;
+    Frame frame;
+    CommandList::RecordTask recordTask = [&frame, &objects, &handles](unsigned task, CommandBuffer& buffer) {
+        buffer.bindProgram(1);
+        unsigned last = std::min((task + 1) * TASK_SIZE, frame.visibleCount);
+        for(unsigned i = task * TASK_SIZE; i < last; i++) {
+            const Object& object = objects.at(handles[frame.visible[i]]);
+            float16 model = MatrixToFloatV(object.transform.toMatrix());
+            buffer.setUniformMatrix4(0, model.v);
+            buffer.drawElements(36, 0, 0);
+        }
+    };
+    struct CountDraws {
+        unsigned draws;
+        void bindProgram(uint32_t) { }
+        void bindVertexArray(uint32_t) { }
+        void bindMeshBuffers(const CommandBuffer::BindMeshBuffers&) { }
+        void setUniformMatrix4(const CommandBuffer::UniformMatrix4&) { }
+        void setUniformVec4(const CommandBuffer::UniformVec4&) { }
+        void drawElements(const CommandBuffer::DrawElements&) { draws++; }
+    } counter = { 0 };
+
+    uint64_t steadyAllocations = 0;
+    for(unsigned f = 0; f < FRAME_COUNT; f++) {
+        if(f == WARM_UP_FRAMES)
+            steadyAllocations = allocationCount();
+
+        arena.reset();
+        frame.visible = arena.allocate<unsigned>(OBJECT_COUNT);
+        frame.keys = arena.allocate<uint64_t>(OBJECT_COUNT);
+        frame.visibleCount = cull(handles, objects, f, frame.visible, frame.keys);
+        unsigned taskCount = (frame.visibleCount + TASK_SIZE - 1) / TASK_SIZE;
+        commands.record(f, taskCount, recordTask, parallelFor);
+        commands.replay(counter);
+    }
+    steadyAllocations = allocationCount() - steadyAllocations;
+    std::cout << "  steady frame loop: " << steadyAllocations << " allocations in "
+        << FRAME_COUNT - WARM_UP_FRAMES << " frames, " << counter.draws << " draws" << std::endl;
+    if(steadyAllocations != 0) {
+        std::cerr << "ERROR: the steady frame loop allocated memory" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
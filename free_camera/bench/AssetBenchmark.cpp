@@ -0,0 +1,152 @@
+#include "AssetReader.h"
+#include "BenchUtil.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace GLPractice;
+
+static const unsigned FILE_COUNT = 2000;
+static const size_t MIN_FILE_SIZE = 512;
+static const size_t MAX_FILE_SIZE = 16 << 10;
+// one file is larger than the buffers
+static const size_t LARGE_FILE_SIZE = 1 << 20;
+static const unsigned BUFFER_COUNT = 64;
+static const size_t BUFFER_SIZE = 64 << 10;
+static const unsigned ROUND_COUNT = 5;
+
+static uint64_t hashBytes(const uint8_t* data, size_t size) {
+    uint64_t hash = 14695981039346656037ull;
+    for(size_t i = 0; i < size; i++)
+        hash = (hash ^ data[i]) * 1099511628211ull;
+    return hash;
+}
+
+struct AssetFile {
+    std::string path;
+    uint64_t hash;
+};
+
+// the way GLShader::shaderFromFile used to read, one blocking file at a time
+static bool readStreams(const std::vector<AssetFile>& files) {
+    bool same = true;
+    for(const AssetFile& file : files) {
+        std::ifstream f(file.path.c_str(), std::ios::in | std::ios::binary);
+        std::stringstream buffer;
+        buffer << f.rdbuf();
+        std::string contents = buffer.str();
+        same = same && hashBytes((const uint8_t*) contents.data(), contents.size()) == file.hash;
+    }
+    return same;
+}
+
+struct ReadResult {
+    double ms;
+    uint64_t systemCalls;
+    bool same;
+    bool usedRing;
+};
+
+static ReadResult readBatched(const std::vector<AssetFile>& files, bool useRing) {
+    ReadResult result = { 0.0, 0, true, false };
+    Clock::time_point start = Clock::now();
+    AssetReader reader(BUFFER_COUNT, BUFFER_SIZE, useRing);
+    for(unsigned i = 0; i < files.size(); i++) {
+        reader.read(files[i].path, [&result, &files, i](const AssetReader::File& file) {
+            result.same = result.same && file.error == 0 && hashBytes(file.data, file.size) == files[i].hash;
+        });
+    }
+    reader.wait();
+    result.ms = elapsedMs(start);
+    result.systemCalls = reader.systemCallCount();
+    result.usedRing = reader.usesRing();
+    return result;
+}
+
+int main() {
+    char directory[] = "/tmp/AssetBenchmarkXXXXXX";
+    if(!mkdtemp(directory)) {
+        std::cerr << "ERROR: failed to create a directory for the files" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    srand(1);
+    std::vector<AssetFile> files(FILE_COUNT);
+    std::vector<uint8_t> data(LARGE_FILE_SIZE);
+    size_t totalSize = 0;
+    for(unsigned i = 0; i < FILE_COUNT; i++) {
+        size_t size = i == FILE_COUNT / 2 ? LARGE_FILE_SIZE :
+            MIN_FILE_SIZE + (size_t) rand() % (MAX_FILE_SIZE - MIN_FILE_SIZE);
+        for(size_t b = 0; b < size; b++)
+            data[b] = (uint8_t) rand();
+        files[i].path = std::string(directory) + "/asset" + std::to_string(i);
+        files[i].hash = hashBytes(data.data(), size);
+        std::ofstream f(files[i].path.c_str(), std::ios::out | std::ios::binary);
+        f.write((const char*) data.data(), size);
+        totalSize += size;
+    }
+
+    // from the page cache, what is left is the cost of the system calls
+    std::cout << FILE_COUNT << " files, " << totalSize / 1024 << " KB" << std::endl;
+    double streamMs = 0.0;
+    bool same = true;
+    for(unsigned round = 0; round < ROUND_COUNT; round++) {
+        Clock::time_point start = Clock::now();
+        same = readStreams(files) && same;
+        streamMs += elapsedMs(start);
+    }
+    std::cout << "  ifstream:     " << streamMs / ROUND_COUNT << " ms" << std::endl;
+
+    for(int useRing = 0; useRing < 2; useRing++) {
+        ReadResult total = { 0.0, 0, true, false };
+        for(unsigned round = 0; round < ROUND_COUNT; round++) {
+            ReadResult result = readBatched(files, useRing != 0);
+            total.ms += result.ms;
+            total.systemCalls = result.systemCalls;
+            total.same = total.same && result.same;
+            total.usedRing = result.usedRing;
+        }
+        same = same && total.same;
+        if(useRing && !total.usedRing) {
+            std::cout << "  io_uring:     not available, read with threads" << std::endl;
+            continue;
+        }
+        std::cout << (total.usedRing ? "  io_uring:     " : "  pread thread: ") << total.ms / ROUND_COUNT
+            << " ms, " << total.systemCalls << " system calls" << std::endl;
+    }
+
+    // a missing file is handed out with its error, the others still are
+    AssetReader reader(2, BUFFER_SIZE);
+    int missingError = 0;
+    unsigned handedOut = 0;
+    reader.read(std::string(directory) + "/missing", [&missingError, &handedOut](const AssetReader::File& file) {
+        missingError = file.error;
+        handedOut++;
+    });
+    reader.read(files.front().path, [&handedOut](const AssetReader::File&) {
+        handedOut++;
+    });
+    reader.wait();
+
+    for(const AssetFile& file : files)
+        unlink(file.path.c_str());
+    rmdir(directory);
+
+    if(!same) {
+        std::cerr << "ERROR: a file was read wrong" << std::endl;
+        return EXIT_FAILURE;
+    }
+    if(missingError == 0 || handedOut != 2 || reader.pendingCount() != 0) {
+        std::cerr << "ERROR: a missing file was not reported" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,22 @@
+# ifndef BENCH_UTIL_H
+# define BENCH_UTIL_H
+
+#include <stdlib.h>
+#include <chrono>
+
+namespace GLPractice {
+
+typedef std::chrono::steady_clock Clock;
+
+inline double elapsedMs(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+// from rand(), so srand() makes the runs repeatable
+inline float randomFloat(float min, float max) {
+    return min + (float) rand() / RAND_MAX * (max - min);
+}
+
+} // namespace GLPractice
+
+#endif // BENCH_UTIL_H
@@ -0,0 +1,177 @@
+#include "BenchUtil.h"
+#include "CommandBuffer.h"
+#include "JobSystem.h"
+#include "Transform.h"
+
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+using namespace GLPractice;
+
+static const unsigned DRAW_COUNT = 100000;
+static const unsigned TASK_SIZE = 256;
+static const unsigned FRAME_COUNT = 50;
+
+// made up GL names, nothing is drawn
+static const uint32_t PROGRAM = 3;
+static const uint32_t VAO = 7;
+static const int32_t MODEL_LOCATION = 2;
+static const int32_t COLOR_LOCATION = 4;
+static const uint32_t INDEX_COUNT = 36;
+
+// stands in for the GL calls, hashing everything it is given in order
+struct HashVisitor {
+    uint64_t hash;
+    unsigned programBinds;
+    unsigned draws;
+
+    void add(const void* data, size_t size) {
+        for(size_t i = 0; i < size; i++)
+            hash = (hash ^ ((const uint8_t*) data)[i]) * 1099511628211ull;
+    }
+    void bindProgram(uint32_t program) {
+        add(&program, sizeof(program));
+        programBinds++;
+    }
+    void bindVertexArray(uint32_t vao) {
+        add(&vao, sizeof(vao));
+    }
+    void bindMeshBuffers(const CommandBuffer::BindMeshBuffers& command) {
+        add(&command, sizeof(command));
+    }
+    void setUniformMatrix4(const CommandBuffer::UniformMatrix4& command) {
+        add(&command, sizeof(command));
+    }
+    void setUniformVec4(const CommandBuffer::UniformVec4& command) {
+        add(&command, sizeof(command));
+    }
+    void drawElements(const CommandBuffer::DrawElements& command) {
+        add(&command, sizeof(command));
+        draws++;
+    }
+};
+
+static HashVisitor replay(const CommandList& commands) {
+    HashVisitor visitor = { 14695981039346656037ull, 0, 0 };
+    commands.replay(visitor);
+    return visitor;
+}
+
+static size_t capacity(const CommandList& commands) {
+    size_t bytes = 0;
+    for(unsigned i = 0; i < commands.bufferCount(); i++)
+        bytes += commands.buffer(i).capacity();
+    return bytes;
+}
+
+int main() {
+    srand(1);
+    TransformArray transforms;
+    transforms.resize(DRAW_COUNT);
+    std::vector<float> colors(DRAW_COUNT * 4);
+    for(unsigned i = 0; i < DRAW_COUNT; i++) {
+        transforms.translation[i] = Vector3{ randomFloat(-100.0f, 100.0f), randomFloat(-10.0f, 10.0f),
+            randomFloat(-100.0f, 100.0f) };
+        transforms.rotation[i] = QuaternionFromAxisAngle(Vector3{ 0.0f, 1.0f, 0.0f }, randomFloat(0.0f, 2.0f * PI));
+        transforms.scale[i] = Vector3{ 1.0f, 1.0f, 1.0f };
+        for(unsigned c = 0; c < 4; c++)
+            colors[i * 4 + c] = randomFloat(0.0f, 1.0f);
+    }
+
+    // one draw per object with its own model matrix and color
+    unsigned taskCount = (DRAW_COUNT + TASK_SIZE - 1) / TASK_SIZE;
+    CommandList::RecordTask recordTask = [&](unsigned task, CommandBuffer& buffer) {
+        buffer.bindProgram(PROGRAM);
+        buffer.bindVertexArray(VAO);
+        unsigned last = std::min((task + 1) * TASK_SIZE, DRAW_COUNT);
+        Transform transform;
+        for(unsigned i = task * TASK_SIZE; i < last; i++) {
+            transform.scale = transforms.scale[i];
+            transform.rotation = transforms.rotation[i];
+            transform.translation = transforms.translation[i];
+            float16 model = MatrixToFloatV(transform.toMatrix());
+            buffer.bindProgram(PROGRAM);
+            buffer.setUniformMatrix4(MODEL_LOCATION, model.v);
+            buffer.setUniformVec4(COLOR_LOCATION, &colors[i * 4]);
+            buffer.drawElements(INDEX_COUNT, 0, 0);
+        }
+    };
+
+    std::cout << DRAW_COUNT << " draws in " << taskCount << " buffers" << std::endl;
+
+    CommandList serial;
+    serial.record(0, taskCount, recordTask);
+    HashVisitor expected = replay(serial);
+    size_t serialCapacity = capacity(serial);
+
+    double serialMs = 0.0;
+    for(unsigned frame = 0; frame < FRAME_COUNT; frame++) {
+        Clock::time_point start = Clock::now();
+        serial.record(frame + 1, taskCount, recordTask);
+        serialMs += elapsedMs(start);
+    }
+    double replayMs = 0.0;
+    for(unsigned frame = 0; frame < FRAME_COUNT; frame++) {
+        Clock::time_point start = Clock::now();
+        replay(serial);
+        replayMs += elapsedMs(start);
+    }
+    std::cout << "  recorded on one thread: " << serialMs / FRAME_COUNT << " ms, "
+        << serial.commandCount() << " commands, " << capacity(serial) << " bytes" << std::endl
+        << "  replayed: " << replayMs / FRAME_COUNT << " ms" << std::endl;
+
+    // the buffers reached their size in the first frame and kept it
+    bool grew = capacity(serial) != serialCapacity;
+
+    unsigned maxThreads = std::max(4u, std::thread::hardware_concurrency());
+    for(unsigned threadCount = 1; threadCount <= maxThreads; threadCount *= 2) {
+        JobSystem jobs(threadCount);
+        ParallelFor parallelFor = [&jobs](unsigned count, const std::function<void(unsigned)>& task) {
+            jobs.parallelFor(count, task);
+        };
+
+        CommandList commands;
+        commands.record(0, taskCount, recordTask, parallelFor);
+        size_t firstCapacity = capacity(commands);
+        double ms = 0.0;
+        for(unsigned frame = 0; frame < FRAME_COUNT; frame++) {
+            Clock::time_point start = Clock::now();
+            commands.record(frame + 1, taskCount, recordTask, parallelFor);
+            ms += elapsedMs(start);
+        }
+        grew = grew || capacity(commands) != firstCapacity;
+        std::cout << "  recorded on " << threadCount << " threads: " << ms / FRAME_COUNT << " ms" << std::endl;
+
+        HashVisitor result = replay(commands);
+        if(result.hash != expected.hash || result.draws != DRAW_COUNT || result.programBinds != taskCount) {
+            std::cerr << "ERROR: commands recorded on " << threadCount
+                << " threads differ from the ones recorded on one" << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    if(grew) {
+        std::cerr << "ERROR: recording the same draws again allocated memory" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // an unchanged scene replays the buffers it has
+    unsigned recordCount = serial.recordCount();
+    Clock::time_point start = Clock::now();
+    bool recorded = serial.record(FRAME_COUNT, taskCount, recordTask);
+    double reuseMs = elapsedMs(start);
+    std::cout << "  unchanged scene: " << reuseMs << " ms" << std::endl;
+    if(recorded || serial.recordCount() != recordCount || replay(serial).hash != expected.hash) {
+        std::cerr << "ERROR: an unchanged scene was recorded again" << std::endl;
+        return EXIT_FAILURE;
+    }
+    serial.invalidate();
+    if(!serial.record(FRAME_COUNT, taskCount, recordTask)) {
+        std::cerr << "ERROR: invalidated commands were not recorded again" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,100 @@
+#include "BenchUtil.h"
+#include "BVH.h"
+#include "Culling.h"
+
+#include <cstdlib>
+#include <iostream>
+
+using namespace GLPractice;
+
+// spheres scattered in a cube around the camera, a few percent of them visible
+static void fillSpheres(SphereArray& spheres, unsigned count, float range) {
+    spheres.resize(count);
+    for(unsigned i = 0; i < count; i++) {
+        BoundingSphere sphere;
+        sphere.center.x = randomFloat(-range, range);
+        sphere.center.y = randomFloat(-range, range);
+        sphere.center.z = randomFloat(-range, range);
+        sphere.radius = randomFloat(0.5f, 1.5f);
+        spheres.set(i, sphere);
+    }
+}
+
+template<typename CullFunc>
+static double measure(CullFunc cull, const Frustum& frustum, const SphereArray& spheres,
+        std::vector<uint32_t>& visible, unsigned& visibleCount, unsigned repeat) {
+    Clock::time_point start = Clock::now();
+    for(unsigned r = 0; r < repeat; r++)
+        visibleCount = cull(frustum, spheres, visible.data());
+    return elapsedMs(start) / repeat;
+}
+
+int main() {
+    Matrix view = MatrixLookAt(Vector3Zero(), Vector3{ 0.0f, 0.0f, 1.0f }, Vector3{ 0.0f, 1.0f, 0.0f });
+    Matrix projection = MatrixPerspective(45.0f * DEG2RAD, 4.0f / 3.0f, 0.1f, 100.0f);
+    Frustum frustum = Frustum::fromMatrix(MatrixMultiply(view, projection));
+
+    const unsigned counts[] { 100000, 1000000 };
+    for(unsigned count : counts) {
+        SphereArray spheres;
+        fillSpheres(spheres, count, 100.0f);
+        std::vector<uint32_t> visible(count);
+        unsigned repeat = 20000000 / count;
+
+        unsigned scalarCount = 0;
+        unsigned simdCount = 0;
+        double scalarMs = measure(cullSpheresScalar, frustum, spheres, visible, scalarCount, repeat);
+        double simdMs = measure(cullSpheres, frustum, spheres, visible, simdCount, repeat);
+
+        std::cout << count << " spheres, " << simdCount << " visible" << std::endl
+            << "  scalar: " << scalarMs << " ms" << std::endl
+            << "  simd:   " << simdMs << " ms (" << scalarMs / simdMs << "x)" << std::endl;
+
+        if(scalarCount != simdCount) {
+            std::cerr << "ERROR: scalar and simd results differ" << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        // the same objects as boxes in a BVH, against a flat box loop
+        std::vector<BoundingBox> boxes(count);
+        for(unsigned i = 0; i < count; i++) {
+            BoundingSphere sphere = spheres.get(i);
+            Vector3 radius = { sphere.radius, sphere.radius, sphere.radius };
+            boxes[i].min = Vector3Subtract(sphere.center, radius);
+            boxes[i].max = Vector3Add(sphere.center, radius);
+        }
+
+        Clock::time_point buildStart = Clock::now();
+        BVH bvh;
+        bvh.build(boxes.data(), count);
+        double buildMs = elapsedMs(buildStart);
+
+        auto cullBoxes = [&](const Frustum& frustum, const SphereArray&, uint32_t* result) {
+            unsigned visibleCount = 0;
+            for(unsigned i = 0; i < count; i++) {
+                result[visibleCount] = i;
+                visibleCount += frustum.intersects(boxes[i]) ? 1 : 0;
+            }
+            return visibleCount;
+        };
+        auto cullBVH = [&](const Frustum& frustum, const SphereArray&, uint32_t* result) {
+            return bvh.cullFrustum(frustum, result);
+        };
+
+        unsigned boxCount = 0;
+        unsigned bvhCount = 0;
+        double boxMs = measure(cullBoxes, frustum, spheres, visible, boxCount, repeat);
+        double bvhMs = measure(cullBVH, frustum, spheres, visible, bvhCount, repeat);
+
+        std::cout << "  boxes:  " << boxMs << " ms, " << boxCount << " visible" << std::endl
+            << "  bvh:    " << bvhMs << " ms (" << boxMs / bvhMs << "x), built in "
+            << buildMs << " ms, depth " << bvh.depth() << std::endl;
+
+        if(boxCount != bvhCount) {
+            std::cerr << "ERROR: box and bvh results differ" << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,151 @@
+#include "BenchUtil.h"
+#include "Culling.h"
+#include "EntityStore.h"
+#include "SceneComponents.h"
+#include "Transform.h"
+
+#include <math.h>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+using namespace GLPractice;
+
+static const unsigned ENTITY_COUNT = 200000;
+static const unsigned FRAME_COUNT = 100;
+
+// the same scene as one struct per object holding everything
+struct SceneObject {
+    std::string name;
+    Transform transform;
+    bool hasMesh;
+    MeshRef mesh;
+    BoundingSphere bounds;
+    BoundingBox box;
+    RenderFlags flags;
+    Color color;
+};
+
+static const BoundingSphere MESH_SPHERES[] {
+    { { 0.5f, 0.5f, 0.5f }, 0.87f },
+    { { 0.0f, 0.0f, 0.0f }, 1.0f },
+};
+
+int main() {
+    srand(1);
+    std::vector<SceneObject> objects(ENTITY_COUNT);
+    EntityStore store;
+    for(unsigned i = 0; i < ENTITY_COUNT; i++) {
+        SceneObject& object = objects[i];
+        object.name = "object " + std::to_string(i);
+        object.transform.translation = Vector3{ randomFloat(-200.0f, 200.0f), randomFloat(-10.0f, 10.0f),
+            randomFloat(-200.0f, 200.0f) };
+        object.transform.rotation = QuaternionFromAxisAngle(Vector3{ 0.0f, 1.0f, 0.0f },
+            randomFloat(0.0f, 2.0f * PI));
+        // a quarter of the objects are only transforms, like lights or empty groups
+        object.hasMesh = i % 4 != 0;
+        object.mesh.mesh = i % 2;
+        object.flags.flags = i % 3 == 0 ? RENDER_OCCLUDER : RENDER_INSTANCED | RENDER_OCCLUDER;
+        object.color = Color{ { 1.0f, 1.0f, 1.0f, 1.0f } };
+
+        uint32_t entity = store.create();
+        store.add<Transform>(entity, object.transform);
+        store.add<Color>(entity, object.color);
+        if(object.hasMesh) {
+            store.add<MeshRef>(entity, object.mesh);
+            store.add<BoundingSphere>(entity);
+            store.add<RenderFlags>(entity, object.flags);
+        }
+    }
+
+    Matrix projection = MatrixPerspective(45.0f * DEG2RAD, 4.0f / 3.0f, 0.1f, 100.0f);
+    Frustum frustum = Frustum::fromMatrix(projection * MatrixLookAt(Vector3Zero(),
+        Vector3{ 0.0f, 0.0f, 1.0f }, Vector3{ 0.0f, 1.0f, 0.0f }));
+
+    // world bounds of everything with a mesh, then the visible ones in the frustum
+    double objectBoundsMs = 0.0;
+    double objectCullMs = 0.0;
+    unsigned objectVisible = 0;
+    for(unsigned frame = 0; frame < FRAME_COUNT; frame++) {
+        Clock::time_point start = Clock::now();
+        for(SceneObject& object : objects) {
+            if(!object.hasMesh)
+                continue;
+            const Transform& t = object.transform;
+            object.bounds = transformSphere(MESH_SPHERES[object.mesh.mesh], t.scale, t.rotation, t.translation);
+        }
+        objectBoundsMs += elapsedMs(start);
+
+        start = Clock::now();
+        objectVisible = 0;
+        for(const SceneObject& object : objects) {
+            if(object.hasMesh && (object.flags.flags & RENDER_INSTANCED) && frustum.intersects(object.bounds))
+                objectVisible++;
+        }
+        objectCullMs += elapsedMs(start);
+    }
+
+    double storeBoundsMs = 0.0;
+    double storeCullMs = 0.0;
+    unsigned storeVisible = 0;
+    for(unsigned frame = 0; frame < FRAME_COUNT; frame++) {
+        Clock::time_point start = Clock::now();
+        store.each<Transform, MeshRef, BoundingSphere>([](uint32_t, const Transform& t,
+                    const MeshRef& mesh, BoundingSphere& bounds) {
+            bounds = transformSphere(MESH_SPHERES[mesh.mesh], t.scale, t.rotation, t.translation);
+        });
+        storeBoundsMs += elapsedMs(start);
+
+        // the bounds and flags were added together, so their arrays line up
+        start = Clock::now();
+        storeVisible = 0;
+        ComponentPool<BoundingSphere>& bounds = store.pool<BoundingSphere>();
+        ComponentPool<RenderFlags>& flags = store.pool<RenderFlags>();
+        for(unsigned i = 0; i < bounds.size(); i++) {
+            if((flags.data()[i].flags & RENDER_INSTANCED) && frustum.intersects(bounds.data()[i]))
+                storeVisible++;
+        }
+        storeCullMs += elapsedMs(start);
+    }
+
+    std::cout << ENTITY_COUNT << " entities, " << store.pool<MeshRef>().size() << " with a mesh" << std::endl
+        << "  one struct per object: bounds " << objectBoundsMs / FRAME_COUNT << " ms, culling "
+        << objectCullMs / FRAME_COUNT << " ms per frame" << std::endl
+        << "  component arrays:      bounds " << storeBoundsMs / FRAME_COUNT << " ms, culling "
+        << storeCullMs / FRAME_COUNT << " ms per frame" << std::endl
+        << "  " << storeVisible << " visible" << std::endl;
+    if(storeVisible != objectVisible) {
+        std::cerr << "ERROR: " << objectVisible << " objects visible but " << storeVisible
+            << " entities" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // destroying entities and reusing their ids keeps every query right
+    for(uint32_t entity = 0; entity < ENTITY_COUNT; entity += 3)
+        store.destroy(entity);
+    for(uint32_t entity = 0; entity < ENTITY_COUNT; entity += 6) {
+        uint32_t created = store.create();
+        store.add<Transform>(created);
+        store.add<MeshRef>(created, MeshRef{ 1 });
+    }
+    unsigned expected = 0;
+    for(uint32_t i = 0; i < ENTITY_COUNT; i++) {
+        if(i % 3 != 0 && objects[i].hasMesh)
+            expected++;
+    }
+    unsigned matched = 0;
+    bool stale = false;
+    store.each<MeshRef, BoundingSphere>([&](uint32_t entity, const MeshRef& mesh, const BoundingSphere& bounds) {
+        const BoundingSphere& original = objects[entity].bounds;
+        if(entity % 3 == 0 || mesh.mesh != objects[entity].mesh.mesh || bounds.radius != original.radius)
+            stale = true;
+        matched++;
+    });
+    if(matched != expected || stale || store.entityCount() != ENTITY_COUNT - (ENTITY_COUNT + 2) / 3
+            + (ENTITY_COUNT + 5) / 6) {
+        std::cerr << "ERROR: queries are wrong after destroying entities" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,114 @@
+#include "BenchUtil.h"
+#include "FrameGraph.h"
+
+#include <math.h>
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+using namespace GLPractice;
+
+static const unsigned FRAME_COUNT = 50;
+
+// busy for about the given time, like a system doing its work
+static void spin(double ms) {
+    Clock::time_point start = Clock::now();
+    volatile float sink = 0.0f;
+    while(elapsedMs(start) < ms)
+        sink = sink + sqrtf(sink + 1.0f);
+}
+
+struct TaskDesc {
+    const char* name;
+    double ms;
+    std::vector<std::string> reads;
+    std::vector<std::string> writes;
+    bool mainThread;
+};
+
+// a frame like the one of the app: input, transforms, then culling, levels
+// of detail and particles side by side, the uploads on the GL thread
+static const std::vector<TaskDesc> TASKS {
+    { "input", 0.1, {}, { "camera" }, true },
+    { "transforms", 0.5, {}, { "worldMatrices" }, false },
+    { "uniforms", 0.1, { "camera", "worldMatrices" }, { "gpu" }, true },
+    { "cull", 1.0, { "camera", "worldMatrices" }, { "visible" }, false },
+    { "lod", 0.8, { "camera", "worldMatrices" }, { "lodLevels" }, false },
+    { "particles", 0.8, {}, { "particles" }, false },
+    { "uploadVisible", 0.2, { "visible" }, { "gpu" }, true },
+    { "uploadLod", 0.2, { "lodLevels" }, { "gpu" }, true },
+    { "uploadParticles", 0.2, { "particles" }, { "gpu" }, true },
+};
+
+int main() {
+    std::thread::id mainThread = std::this_thread::get_id();
+    std::atomic<unsigned> clock(0);
+    std::vector<unsigned> starts(TASKS.size());
+    std::vector<unsigned> ends(TASKS.size());
+    std::atomic<bool> wrongThread(false);
+
+    double serialMs = 0.0;
+    for(const TaskDesc& desc : TASKS)
+        serialMs += desc.ms;
+
+    std::cout << TASKS.size() << " tasks, " << serialMs << " ms of work one after another" << std::endl;
+
+    unsigned maxThreads = std::max(4u, std::thread::hardware_concurrency());
+    for(unsigned threadCount = 1; threadCount <= maxThreads; threadCount *= 2) {
+        JobSystem jobs(threadCount);
+        FrameGraph graph;
+        for(unsigned i = 0; i < TASKS.size(); i++) {
+            const TaskDesc& desc = TASKS[i];
+            graph.addTask(desc.name, [&, i]() {
+                starts[i] = clock++;
+                if(TASKS[i].mainThread && std::this_thread::get_id() != mainThread)
+                    wrongThread = true;
+                spin(TASKS[i].ms);
+                ends[i] = clock++;
+            }, desc.reads, desc.writes, desc.mainThread);
+        }
+
+        for(unsigned frame = 0; frame < FRAME_COUNT; frame++) {
+            graph.execute(jobs);
+
+            for(unsigned task = 0; task < graph.taskCount(); task++) {
+                for(unsigned dependency : graph.dependencies(task)) {
+                    if(ends[dependency] > starts[task]) {
+                        std::cerr << "ERROR: " << graph.taskName(task) << " started before "
+                            << graph.taskName(dependency) << " was done" << std::endl;
+                        return EXIT_FAILURE;
+                    }
+                }
+            }
+        }
+        if(wrongThread) {
+            std::cerr << "ERROR: a main thread task ran on a worker" << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        std::cout << "  " << threadCount << " threads: " << graph.averageFrameMs() << " ms per frame" << std::endl;
+        if(threadCount == 1) {
+            for(unsigned task = 0; task < graph.taskCount(); task++)
+                std::cout << "    " << graph.taskName(task) << " (depth " << graph.depth(task) << "): "
+                    << graph.averageTaskMs(task) << " ms" << std::endl;
+        }
+    }
+
+    // a skipped task keeps the order of the others
+    JobSystem jobs(2);
+    FrameGraph graph;
+    std::vector<int> order;
+    graph.addTask("first", [&]() { order.push_back(1); }, {}, { "data" });
+    unsigned skipped = graph.addTask("skipped", [&]() { order.push_back(2); }, { "data" }, { "data" });
+    graph.addTask("last", [&]() { order.push_back(3); }, { "data" }, {});
+    graph.setEnabled(skipped, false);
+    graph.execute(jobs);
+    if(order != std::vector<int>{ 1, 3 } || graph.depth(graph.findTask("last")) != 2) {
+        std::cerr << "ERROR: skipping a task broke the order" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
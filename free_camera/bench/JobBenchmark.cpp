@@ -0,0 +1,181 @@
+#include "BenchUtil.h"
+#include "JobSystem.h"
+
+#include <math.h>
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+using namespace GLPractice;
+
+static const unsigned TASK_COUNT = 4096;
+static const unsigned RUN_COUNT = 20;
+static const unsigned STEAL_ITEM_COUNT = 200000;
+static const unsigned CHAIN_COUNT = 1000;
+// more than the ring of jobs of a thread holds
+static const unsigned QUEUED_JOB_COUNT = 20000;
+
+// tasks of uneven length, the later ones up to 16 times longer
+static float work(unsigned task) {
+    float sum = 0.0f;
+    unsigned length = (task % 16 + 1) * 200;
+    for(unsigned i = 0; i < length; i++)
+        sum += sqrtf((float) (task + i));
+    return sum;
+}
+
+static double timeParallelFor(const ParallelFor& parallelFor, std::vector<float>& results) {
+    Clock::time_point start = Clock::now();
+    for(unsigned run = 0; run < RUN_COUNT; run++)
+        parallelFor(TASK_COUNT, [&results](unsigned task) { results[task] = work(task); });
+    return elapsedMs(start) / RUN_COUNT;
+}
+
+// the owner pushes and pops while thieves steal, every item must be taken once
+static bool checkDeque(unsigned thiefCount) {
+    JobDeque deque;
+    std::vector<std::atomic<unsigned> > taken(STEAL_ITEM_COUNT);
+    for(std::atomic<unsigned>& count : taken)
+        count = 0;
+    std::atomic<bool> done(false);
+
+    auto take = [&taken](Job* job) {
+        taken[(uintptr_t) job - 1]++;
+    };
+
+    std::vector<std::thread> thieves;
+    for(unsigned i = 0; i < thiefCount; i++) {
+        thieves.emplace_back([&]() {
+            while(!done.load()) {
+                Job* job = deque.steal();
+                if(job)
+                    take(job);
+            }
+        });
+    }
+
+    for(uintptr_t item = 0; item < STEAL_ITEM_COUNT; item++) {
+        while(!deque.push((Job*) (item + 1))) {
+            Job* job = deque.pop();
+            if(job)
+                take(job);
+        }
+        if(item % 3 == 0) {
+            Job* job = deque.pop();
+            if(job)
+                take(job);
+        }
+    }
+    for(Job* job = deque.pop(); job; job = deque.pop())
+        take(job);
+
+    done = true;
+    for(std::thread& thief : thieves)
+        thief.join();
+
+    for(std::atomic<unsigned>& count : taken) {
+        if(count != 1)
+            return false;
+    }
+    return true;
+}
+
+int main() {
+    if(!checkDeque(3)) {
+        std::cerr << "ERROR: the deque lost or duplicated jobs" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::vector<float> expected(TASK_COUNT);
+    std::vector<float> results(TASK_COUNT);
+    double serialMs = timeParallelFor(serialFor, expected);
+    double threadMs = timeParallelFor(threadFor, results);
+    if(results != expected) {
+        std::cerr << "ERROR: threadFor results differ" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    unsigned coreCount = std::max(1u, std::thread::hardware_concurrency());
+    std::cout << TASK_COUNT << " uneven tasks, " << coreCount << " cores" << std::endl
+        << "  serialFor: " << serialMs << " ms" << std::endl
+        << "  threadFor: " << threadMs << " ms" << std::endl;
+
+    // from one thread up to twice the cores, at least 4
+    unsigned maxThreads = std::max(4u, 2 * coreCount);
+    for(unsigned threadCount = 1; threadCount <= maxThreads; threadCount *= 2) {
+        JobSystem jobs(threadCount);
+        ParallelFor parallelFor = [&jobs](unsigned taskCount, const std::function<void(unsigned)>& task) {
+            jobs.parallelFor(taskCount, task);
+        };
+        std::fill(results.begin(), results.end(), 0.0f);
+        double ms = timeParallelFor(parallelFor, results);
+        std::cout << "  JobSystem with " << threadCount << " threads: " << ms << " ms, "
+            << serialMs / ms << "x" << std::endl;
+        if(results != expected) {
+            std::cerr << "ERROR: JobSystem results differ" << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    // chains of three jobs, each starting after the one before
+    JobSystem jobs(4);
+    std::vector<unsigned> values(CHAIN_COUNT);
+    std::vector<JobCounter> firsts(CHAIN_COUNT);
+    std::vector<JobCounter> seconds(CHAIN_COUNT);
+    JobCounter all;
+    Clock::time_point start = Clock::now();
+    for(unsigned chain = 0; chain < CHAIN_COUNT; chain++) {
+        unsigned* value = &values[chain];
+        // the later jobs wait on the counter of the one before, if it has not run yet
+        jobs.run([value]() { *value = 1; }, &firsts[chain]);
+        jobs.run([value]() { *value *= 3; }, &seconds[chain], &firsts[chain]);
+        jobs.run([value]() { *value += 2; }, &all, &seconds[chain]);
+    }
+    jobs.wait(all);
+    double chainMs = elapsedMs(start);
+    for(unsigned value : values) {
+        if(value != 5) {
+            std::cerr << "ERROR: dependent jobs ran out of order" << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+    std::cout << "  " << CHAIN_COUNT << " chains of 3 dependent jobs: " << chainMs << " ms" << std::endl;
+
+    // a parallelFor inside the jobs of another
+    std::atomic<unsigned> innerCount(0);
+    jobs.parallelFor(64, [&](unsigned) {
+        jobs.parallelFor(64, [&](unsigned) { innerCount++; });
+    });
+    if(innerCount != 64 * 64) {
+        std::cerr << "ERROR: nested parallelFor missed tasks" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // more jobs waiting at once than a thread keeps in its ring,
+    // the ones over it come from the heap instead of taking a slot in use
+    JobSystem single(1);
+    JobCounter queued;
+    std::atomic<unsigned> queuedCount(0);
+    for(unsigned i = 0; i < QUEUED_JOB_COUNT; i++)
+        single.run([&queuedCount]() { queuedCount++; }, &queued);
+    single.wait(queued);
+    if(queuedCount != QUEUED_JOB_COUNT) {
+        std::cerr << "ERROR: jobs queued beyond the ring were lost" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // a thread which is no worker hands its jobs over
+    std::atomic<unsigned> foreignCount(0);
+    std::thread foreign([&]() {
+        jobs.parallelFor(256, [&](unsigned) { foreignCount++; });
+    });
+    foreign.join();
+    if(foreignCount != 256) {
+        std::cerr << "ERROR: parallelFor from another thread missed tasks" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,132 @@
+#include "BenchUtil.h"
+#include "JobSystem.h"
+#include "LODManager.h"
+
+#include <cstdlib>
+#include <iostream>
+
+using namespace GLPractice;
+
+static const unsigned OBJECT_COUNT = 100000;
+static const unsigned FRAME_COUNT = 300;
+static const float FOV = 45.0f * DEG2RAD;
+static const float VIEWPORT_HEIGHT = 600.0f;
+
+// a subdivided icosahedron of radius 1, the error is how far
+// the flat triangles get inside the sphere
+static const LODLevel SPHERE_LEVELS[] {
+    { 0.0011f, 5120 },
+    { 0.0045f, 1280 },
+    { 0.0178f, 320 },
+    { 0.0658f, 80 },
+    { 0.2053f, 20 },
+};
+
+static void fillObjects(LODManager& manager) {
+    srand(1);
+    unsigned chain = manager.addChain(SPHERE_LEVELS, sizeof(SPHERE_LEVELS) / sizeof(LODLevel));
+    for(unsigned i = 0; i < OBJECT_COUNT; i++) {
+        BoundingSphere bounds;
+        bounds.center = Vector3{ randomFloat(-200.0f, 200.0f), randomFloat(-5.0f, 5.0f),
+            randomFloat(-200.0f, 200.0f) };
+        bounds.radius = randomFloat(0.5f, 2.0f);
+        manager.addObject(chain, bounds, bounds.radius);
+    }
+}
+
+// level changes while the camera goes back and forth by a unit
+static unsigned long countOscillationChanges(float hysteresis) {
+    LODManager manager;
+    fillObjects(manager);
+    manager.setHysteresis(hysteresis);
+
+    unsigned long changes = 0;
+    for(unsigned frame = 0; frame < 100; frame++) {
+        Vector3 eye = { 0.0f, 0.0f, frame % 2 == 0 ? 0.0f : 1.0f };
+        manager.update(eye, FOV, VIEWPORT_HEIGHT);
+        // the first one moves everything away from the finest level
+        if(frame > 0)
+            changes += manager.levelChangeCount();
+    }
+    return changes;
+}
+
+int main() {
+    LODManager manager;
+    fillObjects(manager);
+
+    // walking forward through the objects
+    double updateMs = 0.0;
+    unsigned long triangles = 0;
+    unsigned long saved = 0;
+    unsigned long changes = 0;
+    for(unsigned frame = 0; frame < FRAME_COUNT; frame++) {
+        Vector3 eye = { 0.0f, 0.0f, -100.0f + frame * 0.5f };
+        Clock::time_point start = Clock::now();
+        manager.update(eye, FOV, VIEWPORT_HEIGHT);
+        updateMs += elapsedMs(start);
+
+        triangles += manager.triangleCount();
+        saved += manager.trianglesSaved();
+        if(frame > 0)
+            changes += manager.levelChangeCount();
+    }
+
+    std::cout << OBJECT_COUNT << " objects, " << FRAME_COUNT << " frames" << std::endl
+        << "  update: " << updateMs / FRAME_COUNT << " ms per frame" << std::endl
+        << "  " << triangles / FRAME_COUNT << " triangles per frame, " << saved / FRAME_COUNT
+        << " saved (" << 100.0 * saved / (triangles + saved) << "%), "
+        << changes / (FRAME_COUNT - 1) << " level changes per frame" << std::endl;
+
+    // the same walk with the objects spread over the job system
+    LODManager jobManager;
+    fillObjects(jobManager);
+    double jobUpdateMs = 0.0;
+    unsigned long jobTriangles = 0;
+    for(unsigned frame = 0; frame < FRAME_COUNT; frame++) {
+        Vector3 eye = { 0.0f, 0.0f, -100.0f + frame * 0.5f };
+        Clock::time_point start = Clock::now();
+        jobManager.update(eye, FOV, VIEWPORT_HEIGHT, jobFor);
+        jobUpdateMs += elapsedMs(start);
+        jobTriangles += jobManager.triangleCount();
+    }
+    std::cout << "  update with jobFor: " << jobUpdateMs / FRAME_COUNT << " ms per frame on "
+        << JobSystem::get().threadCount() << " threads" << std::endl;
+    for(unsigned i = 0; i < OBJECT_COUNT; i++) {
+        if(jobManager.level(i) != manager.level(i) || jobTriangles != triangles) {
+            std::cerr << "ERROR: the levels picked with jobFor differ" << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    // a camera standing still changes nothing
+    Vector3 eye = { 0.0f, 0.0f, 50.0f };
+    manager.update(eye, FOV, VIEWPORT_HEIGHT);
+    manager.update(eye, FOV, VIEWPORT_HEIGHT);
+    if(manager.levelChangeCount() != 0) {
+        std::cerr << "ERROR: levels changed without the camera moving" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // a lower quality draws less
+    uint64_t fullQuality = manager.triangleCount();
+    manager.setQualityBias(2.0f);
+    manager.update(eye, FOV, VIEWPORT_HEIGHT);
+    std::cout << "  quality bias 2: " << manager.triangleCount() << " triangles instead of "
+        << fullQuality << std::endl;
+    if(manager.triangleCount() >= fullQuality) {
+        std::cerr << "ERROR: the quality bias did not lower the detail" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    unsigned long withoutHysteresis = countOscillationChanges(0.0f);
+    unsigned long withHysteresis = countOscillationChanges(0.2f);
+    std::cout << "  camera moving back and forth: " << withoutHysteresis
+        << " level changes without hysteresis, " << withHysteresis << " with" << std::endl;
+    if(withHysteresis >= withoutHysteresis) {
+        std::cerr << "ERROR: hysteresis did not reduce the level changes" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
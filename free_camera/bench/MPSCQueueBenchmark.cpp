@@ -0,0 +1,109 @@
+#include "BenchUtil.h"
+#include "MPSCQueue.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace GLPractice;
+
+static const unsigned PRODUCER_COUNT = 4;
+static const unsigned ITEMS_PER_PRODUCER = 500000;
+static const size_t CAPACITY = 4096;
+
+// like a GL object queued for deletion, the producer and its own count
+struct Item {
+    uint32_t producer;
+    uint32_t sequence;
+};
+
+int main() {
+    // a full queue refuses values and takes them again once popped
+    MPSCQueue<Item> small(4);
+    unsigned pushed = 0;
+    while(small.push(Item{ 0, pushed }))
+        pushed++;
+    Item item;
+    bool popped = small.pop(item) && item.sequence == 0;
+    if(pushed != 4 || !popped || !small.push(Item{ 0, 4 })) {
+        std::cerr << "ERROR: a full queue behaves wrong" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // each producer's values arrive once and in the order they were pushed
+    MPSCQueue<Item> queue(CAPACITY);
+    std::atomic<unsigned> fullCount(0);
+    std::vector<std::thread> producers;
+    Clock::time_point start = Clock::now();
+    for(unsigned p = 0; p < PRODUCER_COUNT; p++) {
+        producers.emplace_back([&queue, &fullCount, p]() {
+            for(uint32_t i = 0; i < ITEMS_PER_PRODUCER; i++) {
+                while(!queue.push(Item{ p, i })) {
+                    fullCount++;
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+
+    std::vector<uint32_t> next(PRODUCER_COUNT, 0);
+    bool outOfOrder = false;
+    unsigned received = 0;
+    while(received < PRODUCER_COUNT * ITEMS_PER_PRODUCER) {
+        if(!queue.pop(item)) {
+            std::this_thread::yield();
+            continue;
+        }
+        if(item.producer >= PRODUCER_COUNT || item.sequence != next[item.producer]++)
+            outOfOrder = true;
+        received++;
+    }
+    for(std::thread& producer : producers)
+        producer.join();
+    double queueMs = elapsedMs(start);
+
+    // the same with a vector under a lock, swapped out by the consumer
+    std::mutex mutex;
+    std::vector<Item> shared;
+    std::vector<Item> taken;
+    producers.clear();
+    start = Clock::now();
+    for(unsigned p = 0; p < PRODUCER_COUNT; p++) {
+        producers.emplace_back([&mutex, &shared, p]() {
+            for(uint32_t i = 0; i < ITEMS_PER_PRODUCER; i++) {
+                std::lock_guard<std::mutex> lock(mutex);
+                shared.push_back(Item{ p, i });
+            }
+        });
+    }
+    unsigned lockedReceived = 0;
+    while(lockedReceived < PRODUCER_COUNT * ITEMS_PER_PRODUCER) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            taken.swap(shared);
+        }
+        lockedReceived += taken.size();
+        taken.clear();
+        std::this_thread::yield();
+    }
+    for(std::thread& producer : producers)
+        producer.join();
+    double lockedMs = elapsedMs(start);
+
+    std::cout << PRODUCER_COUNT << " producers, " << ITEMS_PER_PRODUCER << " values each" << std::endl
+        << "  lock-free queue:   " << queueMs << " ms, full " << fullCount.load() << " times" << std::endl
+        << "  vector under lock: " << lockedMs << " ms" << std::endl;
+
+    bool lost = false;
+    for(uint32_t count : next)
+        lost = lost || count != ITEMS_PER_PRODUCER;
+    if(outOfOrder || lost || queue.pop(item)) {
+        std::cerr << "ERROR: values were lost, repeated or reordered" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,160 @@
+#include "BenchUtil.h"
+#include "OcclusionBuffer.h"
+
+#include <cstdlib>
+#include <iostream>
+
+using namespace GLPractice;
+
+static const unsigned OCCLUDER_COUNT = 2000;
+static const unsigned BOX_COUNT = 100000;
+static const unsigned REPEAT = 20;
+static const float WALL_DISTANCE = 20.0f;
+
+// the same cube as the viewer draws
+static const float CUBE_POSITIONS[] {
+    0.0f, 0.0f, 0.0f,
+    1.0f, 0.0f, 0.0f,
+    1.0f, 0.0f, 1.0f,
+    0.0f, 0.0f, 1.0f,
+    0.0f, 1.0f, 0.0f,
+    1.0f, 1.0f, 0.0f,
+    1.0f, 1.0f, 1.0f,
+    0.0f, 1.0f, 1.0f,
+};
+
+static const uint32_t CUBE_INDICES[] {
+    7, 3, 2,  7, 2, 6,
+    6, 2, 5,  5, 2, 1,
+    4, 5, 1,  4, 1, 0,
+    7, 4, 3,  3, 4, 0,
+    4, 7, 6,  4, 6, 5,
+    3, 0, 2,  2, 0, 1,
+};
+
+static const float WALL_POSITIONS[] {
+    -1.0f, -1.0f, 0.0f,
+    1.0f, -1.0f, 0.0f,
+    1.0f, 1.0f, 0.0f,
+    -1.0f, 1.0f, 0.0f,
+};
+
+static const uint32_t WALL_INDICES[] { 0, 1, 2, 0, 2, 3 };
+
+static BoundingBox cubeBox(const Vector3& position, float size) {
+    BoundingBox box;
+    box.min = position;
+    box.max = Vector3Add(position, Vector3{ size, size, size });
+    return box;
+}
+
+int main() {
+    Matrix view = MatrixLookAt(Vector3Zero(), Vector3{ 0.0f, 0.0f, 1.0f }, Vector3{ 0.0f, 1.0f, 0.0f });
+    Matrix projection = MatrixPerspective(60.0f * DEG2RAD, 4.0f / 3.0f, 0.1f, 200.0f);
+    Matrix viewProjection = MatrixMultiply(view, projection);
+
+    // a wall hiding the middle of the screen, and small cubes scattered
+    // in front of it as extra occluder work
+    Matrix wallModel = MatrixMultiply(MatrixScale(8.0f, 8.0f, 1.0f),
+            MatrixTranslate(0.0f, 0.0f, WALL_DISTANCE));
+    std::vector<Matrix> occluderModels(OCCLUDER_COUNT);
+    for(Matrix& model : occluderModels) {
+        model = MatrixTranslate(randomFloat(-30.0f, 30.0f), randomFloat(-20.0f, 20.0f),
+                randomFloat(5.0f, WALL_DISTANCE - 2.0f));
+    }
+
+    // boxes behind the wall, half of them well inside its outline
+    std::vector<BoundingBox> boxes(BOX_COUNT);
+    for(unsigned i = 0; i < BOX_COUNT; i++) {
+        float depth = randomFloat(WALL_DISTANCE + 1.0f, 150.0f);
+        float spread = i % 2 == 0 ? 6.0f * depth / WALL_DISTANCE : depth;
+        boxes[i] = cubeBox(Vector3{ randomFloat(-spread, spread), randomFloat(-spread, spread), depth },
+                randomFloat(0.1f, 1.0f));
+    }
+    std::vector<uint32_t> candidates(BOX_COUNT);
+    for(unsigned i = 0; i < BOX_COUNT; i++)
+        candidates[i] = i;
+    std::vector<uint32_t> visible[2] { std::vector<uint32_t>(BOX_COUNT), std::vector<uint32_t>(BOX_COUNT) };
+
+    OcclusionBuffer buffer(256, 128);
+    const char* names[2] { "serial", "threads" };
+    const ParallelFor parallelFors[2] { serialFor, threadFor };
+    unsigned visibleCounts[2] = { 0, 0 };
+
+    std::cout << OCCLUDER_COUNT << " occluder cubes and a wall, " << BOX_COUNT << " boxes tested, "
+        << buffer.width() << "x" << buffer.height() << " depth" << std::endl;
+
+    for(unsigned p = 0; p < 2; p++) {
+        double rasterizeMs = 0.0;
+        double testMs = 0.0;
+        for(unsigned r = 0; r < REPEAT; r++) {
+            Clock::time_point start = Clock::now();
+            buffer.begin(viewProjection);
+            buffer.addOccluder(WALL_POSITIONS, WALL_INDICES, 6, wallModel);
+            for(const Matrix& model : occluderModels)
+                buffer.addOccluder(CUBE_POSITIONS, CUBE_INDICES, 36, model);
+            buffer.rasterize(parallelFors[p]);
+            rasterizeMs += elapsedMs(start);
+
+            start = Clock::now();
+            visibleCounts[p] = buffer.cullBoxes(boxes.data(), candidates.data(), BOX_COUNT,
+                    visible[p].data(), parallelFors[p]);
+            testMs += elapsedMs(start);
+        }
+
+        std::cout << "  " << names[p] << ": " << rasterizeMs / REPEAT << " ms rasterize ("
+            << buffer.triangleCount() << " triangles), " << testMs / REPEAT << " ms test, "
+            << visibleCounts[p] << " visible" << std::endl;
+    }
+
+    // the threaded tasks keep the order of the candidates, the same
+    // as testing them one at a time
+    std::vector<uint32_t> expected;
+    for(unsigned i = 0; i < BOX_COUNT; i++) {
+        if(buffer.isVisible(boxes[i]))
+            expected.push_back(i);
+    }
+    visible[1].resize(visibleCounts[1]);
+    if(visibleCounts[0] != visibleCounts[1] || visible[1] != expected) {
+        std::cerr << "ERROR: serial and threaded results differ" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // visible may be the candidates themselves
+    unsigned inPlaceCount = buffer.cullBoxes(boxes.data(), candidates.data(), BOX_COUNT,
+            candidates.data(), threadFor);
+    candidates.resize(inPlaceCount);
+    if(candidates != expected) {
+        std::cerr << "ERROR: culling the candidates in place went wrong" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // boxes well inside the outline of the wall have to be hidden,
+    // boxes in front of everything have to stay
+    buffer.begin(viewProjection);
+    buffer.addOccluder(WALL_POSITIONS, WALL_INDICES, 6, wallModel);
+    buffer.rasterize();
+    for(unsigned i = 0; i < BOX_COUNT; i += 2) {
+        const BoundingBox& box = boxes[i];
+        bool insideWall = fabsf(box.min.x) * WALL_DISTANCE / box.min.z < 7.0f &&
+            fabsf(box.max.x) * WALL_DISTANCE / box.min.z < 7.0f &&
+            fabsf(box.min.y) * WALL_DISTANCE / box.min.z < 7.0f &&
+            fabsf(box.max.y) * WALL_DISTANCE / box.min.z < 7.0f;
+        if(insideWall && buffer.isVisible(box)) {
+            std::cerr << "ERROR: box behind the wall is visible" << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+    for(unsigned i = 0; i < 1000; i++) {
+        float depth = randomFloat(1.0f, WALL_DISTANCE - 1.0f);
+        float spread = 0.3f * depth;
+        BoundingBox box = cubeBox(Vector3{ randomFloat(-spread, spread), randomFloat(-spread, spread), depth },
+                0.1f);
+        if(!buffer.isVisible(box)) {
+            std::cerr << "ERROR: box in front of the wall is hidden" << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,152 @@
+#include "BenchUtil.h"
+#include "SceneGraph.h"
+
+#include <math.h>
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+
+using namespace GLPractice;
+
+// a few roots, each with children a couple of levels deep
+static const unsigned ROOT_COUNT = 16;
+static const unsigned CHILD_COUNT = 10;
+static const unsigned DEPTH = 4;
+static const unsigned FRAME_COUNT = 100;
+
+static Transform randomTransform() {
+    Transform transform;
+    transform.translation = Vector3{ randomFloat(-5.0f, 5.0f), randomFloat(-5.0f, 5.0f),
+        randomFloat(-5.0f, 5.0f) };
+    transform.rotation = QuaternionFromAxisAngle(Vector3{ 0.0f, 1.0f, 0.0f },
+        randomFloat(0.0f, 2.0f * PI));
+    float scale = randomFloat(0.5f, 1.5f);
+    transform.scale = Vector3{ scale, scale, scale };
+    return transform;
+}
+
+static void addChildren(SceneGraph& graph, uint32_t parent, unsigned depth,
+        std::vector<uint32_t>& nodes) {
+    if(depth == 0)
+        return;
+    for(unsigned i = 0; i < CHILD_COUNT; i++) {
+        uint32_t node = graph.addNode(parent, randomTransform());
+        nodes.push_back(node);
+        addChildren(graph, node, depth - 1, nodes);
+    }
+}
+
+// world matrix by walking up to the root
+static Matrix naiveWorldMatrix(const SceneGraph& graph, uint32_t node) {
+    Matrix world = graph.getLocalTransform(node).toMatrix();
+    for(uint32_t parent = graph.getParent(node); parent != SceneGraph::NO_NODE;
+            parent = graph.getParent(parent))
+        world = graph.getLocalTransform(parent).toMatrix() * world;
+    return world;
+}
+
+static bool checkWorldMatrices(const SceneGraph& graph, const std::vector<uint32_t>& nodes) {
+    for(uint32_t node : nodes) {
+        float16 expected = MatrixToFloatV(naiveWorldMatrix(graph, node));
+        float16 actual = MatrixToFloatV(graph.getWorldMatrix(node));
+        for(unsigned i = 0; i < 16; i++) {
+            if(fabsf(actual.v[i] - expected.v[i]) > 1e-3f * (1.0f + fabsf(expected.v[i])))
+                return false;
+        }
+    }
+    return true;
+}
+
+static double timeFrames(SceneGraph& graph, const std::vector<uint32_t>& moved,
+        const ParallelFor& parallelFor) {
+    double ms = 0.0;
+    for(unsigned frame = 0; frame < FRAME_COUNT; frame++) {
+        for(uint32_t node : moved) {
+            Transform local = graph.getLocalTransform(node);
+            local.translation.y += 0.01f;
+            graph.setLocalTransform(node, local);
+        }
+        Clock::time_point start = Clock::now();
+        graph.update(parallelFor);
+        ms += elapsedMs(start);
+    }
+    return ms / FRAME_COUNT;
+}
+
+int main() {
+    srand(1);
+    SceneGraph graph;
+    std::vector<uint32_t> nodes;
+    std::vector<uint32_t> roots;
+    for(unsigned i = 0; i < ROOT_COUNT; i++) {
+        uint32_t root = graph.addNode(SceneGraph::NO_NODE, randomTransform());
+        roots.push_back(root);
+        nodes.push_back(root);
+        addChildren(graph, root, DEPTH, nodes);
+    }
+
+    Clock::time_point start = Clock::now();
+    graph.update();
+    std::cout << graph.nodeCount() << " nodes in " << graph.levelCount() << " levels" << std::endl
+        << "  first update with reordering: " << elapsedMs(start) << " ms" << std::endl;
+    if(!checkWorldMatrices(graph, nodes)) {
+        std::cerr << "ERROR: world matrices differ from the ones of the parent chain" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // moving every root recomputes everything, moving a few leaves almost nothing
+    double allMs = timeFrames(graph, roots, serialFor);
+    unsigned allCount = graph.updatedCount();
+    double allThreadedMs = timeFrames(graph, roots, threadFor);
+    std::vector<uint32_t> leaves(nodes.end() - 100, nodes.end());
+    double leavesMs = timeFrames(graph, leaves, serialFor);
+    unsigned leavesCount = graph.updatedCount();
+    double idleMs = timeFrames(graph, std::vector<uint32_t>(), serialFor);
+
+    std::cout << "  all roots moved: " << allMs << " ms per frame, " << allThreadedMs
+        << " ms on threads, " << allCount << " nodes updated" << std::endl
+        << "  100 leaves moved: " << leavesMs << " ms per frame, " << leavesCount
+        << " nodes updated" << std::endl
+        << "  nothing moved: " << idleMs << " ms per frame" << std::endl;
+    if(allCount != graph.nodeCount() || leavesCount != leaves.size() || graph.updatedCount() != 0) {
+        std::cerr << "ERROR: wrong number of nodes updated" << std::endl;
+        return EXIT_FAILURE;
+    }
+    if(!checkWorldMatrices(graph, nodes)) {
+        std::cerr << "ERROR: world matrices differ after moving nodes" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // moving a subtree to another root and removing one, the nodes were
+    // added depth first so a root's subtree follows it
+    unsigned subtreeSize = nodes.size() / ROOT_COUNT;
+    uint32_t moved = nodes[1];
+    graph.setParent(moved, roots[1]);
+    graph.removeNode(roots[2]);
+    graph.update();
+
+    std::vector<uint32_t> remaining(nodes.begin(), nodes.begin() + 2 * subtreeSize);
+    remaining.insert(remaining.end(), nodes.begin() + 3 * subtreeSize, nodes.end());
+    if(graph.nodeCount() != remaining.size()) {
+        std::cerr << "ERROR: removing a root did not remove its subtree" << std::endl;
+        return EXIT_FAILURE;
+    }
+    if(!checkWorldMatrices(graph, remaining)) {
+        std::cerr << "ERROR: world matrices differ after changing the hierarchy" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    bool threw = false;
+    try {
+        graph.setParent(roots[1], moved);
+    }
+    catch(const std::runtime_error&) {
+        threw = true;
+    }
+    if(!threw) {
+        std::cerr << "ERROR: a cycle was not refused" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,271 @@
+#include "BenchUtil.h"
+#include "BVH.h"
+#include "Culling.h"
+#include "SpatialHash.h"
+
+#include <cstdlib>
+#include <iostream>
+
+using namespace GLPractice;
+
+static const unsigned OBJECT_COUNT = 100000;
+static const unsigned FRAME_COUNT = 30;
+static const unsigned RADIUS_QUERY_COUNT = 16;
+static const float WORLD_RANGE = 200.0f;
+
+// how the objects move every frame
+enum Motion {
+    MOTION_STATIC,
+    // every object a small random step
+    MOTION_JITTER,
+    // every object along its own constant velocity
+    MOTION_FLOW,
+    // a tenth of the objects to a random place
+    MOTION_TELEPORT,
+    MOTION_COUNT
+};
+
+static const char* MOTION_NAMES[MOTION_COUNT] { "static", "jitter", "flow", "teleport" };
+
+static Vector3 randomVector(float range) {
+    return Vector3{ randomFloat(-range, range), randomFloat(-range, range), randomFloat(-range, range) };
+}
+
+static void move(Motion motion, std::vector<Vector3>& positions, const std::vector<Vector3>& velocities) {
+    for(unsigned i = 0; i < positions.size(); i++) {
+        switch(motion) {
+            case MOTION_JITTER:
+                positions[i] = Vector3Add(positions[i], randomVector(0.2f));
+                break;
+            case MOTION_FLOW:
+                positions[i] = Vector3Add(positions[i], velocities[i]);
+                break;
+            case MOTION_TELEPORT:
+                if(i % 10 == 0)
+                    positions[i] = randomVector(WORLD_RANGE);
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+static BoundingBox sphereBox(const Vector3& center, float radius) {
+    BoundingBox box;
+    box.min = Vector3Subtract(center, Vector3{ radius, radius, radius });
+    box.max = Vector3Add(center, Vector3{ radius, radius, radius });
+    return box;
+}
+
+// time spent keeping the structure up to date and querying it, per frame
+struct Timing {
+    double updateMs;
+    double queryMs;
+    unsigned found;
+};
+
+template<typename Structure>
+static Timing run(Motion motion, Structure& structure, const Frustum& frustum,
+        const std::vector<Vector3>& startPositions, const std::vector<Vector3>& velocities,
+        const std::vector<float>& radii, const std::vector<Vector3>& queryCenters) {
+    srand(1);
+    std::vector<Vector3> positions = startPositions;
+    std::vector<uint32_t> result(OBJECT_COUNT);
+    Timing timing = { 0.0, 0.0, 0 };
+
+    structure.init(positions, radii);
+    for(unsigned frame = 0; frame < FRAME_COUNT; frame++) {
+        move(motion, positions, velocities);
+
+        Clock::time_point start = Clock::now();
+        structure.update(positions, radii);
+        timing.updateMs += elapsedMs(start);
+
+        start = Clock::now();
+        timing.found = structure.cull(frustum, result.data());
+        for(const Vector3& center : queryCenters)
+            timing.found += structure.queryRadius(center, 10.0f, result.data());
+        timing.queryMs += elapsedMs(start);
+    }
+
+    timing.updateMs /= FRAME_COUNT;
+    timing.queryMs /= FRAME_COUNT;
+    return timing;
+}
+
+// the flat SIMD loop over all spheres
+struct BruteForce {
+    SphereArray spheres;
+
+    void init(const std::vector<Vector3>& positions, const std::vector<float>& radii) {
+        update(positions, radii);
+    }
+
+    void update(const std::vector<Vector3>& positions, const std::vector<float>& radii) {
+        spheres.resize(positions.size());
+        for(unsigned i = 0; i < positions.size(); i++) {
+            spheres.x[i] = positions[i].x;
+            spheres.y[i] = positions[i].y;
+            spheres.z[i] = positions[i].z;
+            spheres.radius[i] = radii[i];
+        }
+    }
+
+    unsigned cull(const Frustum& frustum, uint32_t* result) {
+        return cullSpheres(frustum, spheres, result);
+    }
+
+    unsigned queryRadius(const Vector3& center, float radius, uint32_t* result) {
+        unsigned count = 0;
+        for(unsigned i = 0; i < spheres.size(); i++) {
+            float dx = spheres.x[i] - center.x;
+            float dy = spheres.y[i] - center.y;
+            float dz = spheres.z[i] - center.z;
+            float distance = radius + spheres.radius[i];
+            result[count] = i;
+            count += dx * dx + dy * dy + dz * dz <= distance * distance ? 1 : 0;
+        }
+        return count;
+    }
+};
+
+// the BVH built once, then refit or incrementally updated
+struct BVHStructure {
+    BVH bvh;
+    bool refit;
+    std::vector<BoundingBox> boxes;
+
+    explicit BVHStructure(bool refit): refit(refit) { }
+
+    void init(const std::vector<Vector3>& positions, const std::vector<float>& radii) {
+        boxes.resize(positions.size());
+        for(unsigned i = 0; i < positions.size(); i++)
+            boxes[i] = sphereBox(positions[i], radii[i]);
+
+        bvh.clear();
+        if(refit) {
+            bvh.build(boxes.data(), boxes.size());
+            return;
+        }
+
+        bvh.setMargin(0.5f);
+        for(unsigned i = 0; i < boxes.size(); i++)
+            bvh.insert(i, boxes[i]);
+    }
+
+    void update(const std::vector<Vector3>& positions, const std::vector<float>& radii) {
+        for(unsigned i = 0; i < positions.size(); i++)
+            boxes[i] = sphereBox(positions[i], radii[i]);
+
+        if(refit) {
+            bvh.refit(boxes.data());
+            return;
+        }
+
+        for(unsigned i = 0; i < boxes.size(); i++)
+            bvh.update(i, boxes[i]);
+    }
+
+    unsigned cull(const Frustum& frustum, uint32_t* result) {
+        return bvh.cullFrustum(frustum, result);
+    }
+
+    unsigned queryRadius(const Vector3& center, float radius, uint32_t* result) {
+        return bvh.queryBox(sphereBox(center, radius), result);
+    }
+};
+
+struct HashStructure {
+    SpatialHash grid;
+
+    // a few objects per cell at this density,
+    // so most moves stay inside their cell
+    HashStructure(): grid(16.0f) { }
+
+    void init(const std::vector<Vector3>& positions, const std::vector<float>& radii) {
+        grid.clear();
+        update(positions, radii);
+    }
+
+    void update(const std::vector<Vector3>& positions, const std::vector<float>& radii) {
+        for(unsigned i = 0; i < positions.size(); i++)
+            grid.update(i, positions[i], radii[i]);
+    }
+
+    unsigned cull(const Frustum& frustum, uint32_t* result) {
+        return grid.cullFrustum(frustum, result);
+    }
+
+    unsigned queryRadius(const Vector3& center, float radius, uint32_t* result) {
+        return grid.queryRadius(center, radius, result);
+    }
+};
+
+static void print(const char* name, const Timing& timing) {
+    std::cout << "  " << name << timing.updateMs << " ms update, "
+        << timing.queryMs << " ms query, "
+        << timing.updateMs + timing.queryMs << " ms total" << std::endl;
+}
+
+int main() {
+    Matrix view = MatrixLookAt(Vector3Zero(), Vector3{ 0.0f, 0.0f, 1.0f }, Vector3{ 0.0f, 1.0f, 0.0f });
+    Matrix projection = MatrixPerspective(45.0f * DEG2RAD, 4.0f / 3.0f, 0.1f, 100.0f);
+    Frustum frustum = Frustum::fromMatrix(MatrixMultiply(view, projection));
+
+    std::vector<Vector3> positions(OBJECT_COUNT);
+    std::vector<Vector3> velocities(OBJECT_COUNT);
+    std::vector<float> radii(OBJECT_COUNT);
+    for(unsigned i = 0; i < OBJECT_COUNT; i++) {
+        positions[i] = randomVector(WORLD_RANGE);
+        velocities[i] = randomVector(0.5f);
+        radii[i] = 0.5f + (float) rand() / RAND_MAX;
+    }
+
+    std::vector<Vector3> queryCenters(RADIUS_QUERY_COUNT);
+    for(Vector3& center : queryCenters)
+        center = randomVector(WORLD_RANGE);
+
+    std::cout << OBJECT_COUNT << " objects, frustum cull and " << RADIUS_QUERY_COUNT
+        << " radius queries per frame" << std::endl;
+
+    for(unsigned m = 0; m < MOTION_COUNT; m++) {
+        Motion motion = (Motion) m;
+
+        BruteForce brute;
+        BVHStructure bvhRefit(true);
+        BVHStructure bvhUpdate(false);
+        HashStructure hash;
+
+        Timing bruteTiming = run(motion, brute, frustum, positions, velocities, radii, queryCenters);
+        Timing refitTiming = run(motion, bvhRefit, frustum, positions, velocities, radii, queryCenters);
+        Timing updateTiming = run(motion, bvhUpdate, frustum, positions, velocities, radii, queryCenters);
+        Timing hashTiming = run(motion, hash, frustum, positions, velocities, radii, queryCenters);
+
+        std::cout << MOTION_NAMES[motion] << ":" << std::endl;
+        print("brute force:  ", bruteTiming);
+        print("bvh refit:    ", refitTiming);
+        print("bvh reinsert: ", updateTiming);
+        print("spatial hash: ", hashTiming);
+
+        // both test the exact spheres, so they have to agree
+        if(bruteTiming.found != hashTiming.found) {
+            std::cerr << "ERROR: brute force and spatial hash results differ" << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    // cells 2^21 apart once shared a key, far objects are each found once
+    SpatialHash far(1.0f);
+    far.insert(0, Vector3{ 0.5f, 0.5f, 0.5f }, 0.5f);
+    far.insert(1, Vector3{ 2097152.5f, 0.5f, 0.5f }, 0.5f);
+    far.insert(2, Vector3{ 1.0e12f, -1.0e12f, 0.5f }, 0.5f);
+    uint32_t found[3];
+    unsigned nearCount = far.queryRadius(Vector3{ 0.5f, 0.5f, 0.5f }, 1.0f, found);
+    unsigned farCount = far.queryRadius(Vector3{ 1.0e12f, -1.0e12f, 0.5f }, 1.0f, found);
+    if(nearCount != 1 || farCount != 1 || found[0] != 2) {
+        std::cerr << "ERROR: objects far apart were mixed up by the spatial hash" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
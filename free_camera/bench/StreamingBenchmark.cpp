@@ -0,0 +1,138 @@
+#include "BenchUtil.h"
+#include "StagingRing.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <deque>
+#include <iostream>
+#include <string.h>
+#include <vector>
+
+using namespace GLPractice;
+
+static const unsigned MESH_COUNT = 200;
+static const size_t MIN_MESH_SIZE = 4 << 10;
+static const size_t MAX_MESH_SIZE = 512 << 10;
+static const size_t STAGING_SIZE = 1 << 20;
+static const size_t FRAME_BUDGET = 64 << 10;
+static const unsigned MAX_STAGED = 64;
+// frames the GPU is behind, a fence signals this many frames after it was placed
+static const unsigned FENCE_LATENCY = 2;
+
+struct StreamedMesh {
+    size_t size;
+    size_t stagingOffset;
+    size_t copied;
+};
+
+// the meshes finished in a frame, released once the GPU got past it
+struct Fence {
+    unsigned frame;
+    unsigned first;
+    unsigned count;
+};
+
+// each mesh fills its staging space with its own byte, the space
+// must still hold it while the copies from there may be in flight
+static bool holds(const std::vector<uint8_t>& staging, const StreamedMesh& mesh, unsigned index) {
+    for(size_t i = 0; i < mesh.size; i++) {
+        if(staging[mesh.stagingOffset + i] != (uint8_t) index)
+            return false;
+    }
+    return true;
+}
+
+int main() {
+    srand(1);
+    std::vector<StreamedMesh> meshes(MESH_COUNT);
+    size_t totalSize = 0;
+    for(StreamedMesh& mesh : meshes) {
+        mesh.size = MIN_MESH_SIZE + (size_t) rand() % (MAX_MESH_SIZE - MIN_MESH_SIZE);
+        mesh.stagingOffset = StagingRing::NO_SPACE;
+        mesh.copied = 0;
+        totalSize += mesh.size;
+    }
+    // stands in for the buffers of the meshes
+    std::vector<uint8_t> destination(MAX_MESH_SIZE);
+
+    // everything uploaded in the frame it was requested
+    Clock::time_point start = Clock::now();
+    std::vector<uint8_t> source(MAX_MESH_SIZE, 1);
+    for(const StreamedMesh& mesh : meshes)
+        memcpy(destination.data(), source.data(), mesh.size);
+    double allAtOnceMs = elapsedMs(start);
+
+    StagingRing ring(STAGING_SIZE, MAX_STAGED);
+    std::vector<uint8_t> staging(STAGING_SIZE);
+    std::deque<Fence> fences;
+    unsigned staged = 0;
+    unsigned finished = 0;
+    unsigned frame = 0;
+    size_t maxFrameBytes = 0;
+    size_t maxUsed = 0;
+    double maxFrameMs = 0.0;
+    bool intact = true;
+    while(finished < MESH_COUNT) {
+        frame++;
+        start = Clock::now();
+
+        // the space of frames the GPU finished is reused
+        while(!fences.empty() && fences.front().frame + FENCE_LATENCY <= frame) {
+            const Fence& fence = fences.front();
+            for(unsigned i = fence.first; i < fence.first + fence.count; i++) {
+                intact = intact && holds(staging, meshes[i], i);
+                ring.releaseOldest();
+            }
+            fences.pop_front();
+        }
+
+        // loaded meshes go to the staging buffer in order, while there is space
+        while(staged < MESH_COUNT) {
+            StreamedMesh& mesh = meshes[staged];
+            size_t offset = ring.allocate(mesh.size);
+            if(offset == StagingRing::NO_SPACE)
+                break;
+            mesh.stagingOffset = offset;
+            memset(&staging[offset], (uint8_t) staged, mesh.size);
+            staged++;
+        }
+        maxUsed = std::max(maxUsed, ring.used());
+
+        // at most the budget is copied out, splitting meshes across frames
+        size_t budget = FRAME_BUDGET;
+        unsigned first = finished;
+        while(finished < staged && budget > 0) {
+            StreamedMesh& mesh = meshes[finished];
+            size_t size = std::min(budget, mesh.size - mesh.copied);
+            intact = intact && staging[mesh.stagingOffset + mesh.copied] == (uint8_t) finished;
+            memcpy(&destination[mesh.copied], &staging[mesh.stagingOffset + mesh.copied], size);
+            mesh.copied += size;
+            budget -= size;
+            if(mesh.copied < mesh.size)
+                break;
+            finished++;
+        }
+        if(finished > first)
+            fences.push_back(Fence{ frame, first, finished - first });
+
+        maxFrameBytes = std::max(maxFrameBytes, FRAME_BUDGET - budget);
+        maxFrameMs = std::max(maxFrameMs, elapsedMs(start));
+    }
+
+    std::cout << MESH_COUNT << " meshes, " << totalSize / 1024 << " KB" << std::endl
+        << "  all at once: 1 frame of " << totalSize / 1024 << " KB, " << allAtOnceMs << " ms" << std::endl
+        << "  streamed:    " << frame << " frames of at most " << maxFrameBytes / 1024 << " KB, "
+        << maxFrameMs << " ms, staging " << maxUsed / 1024 << " of " << STAGING_SIZE / 1024
+        << " KB used at most" << std::endl;
+
+    if(maxFrameBytes > FRAME_BUDGET || maxUsed > ring.capacity()) {
+        std::cerr << "ERROR: a frame went over its budget or the staging buffer overflowed" << std::endl;
+        return EXIT_FAILURE;
+    }
+    if(!intact) {
+        std::cerr << "ERROR: staging space was reused while copies from it were in flight" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,117 @@
+#include "BenchUtil.h"
+#include "TripleBuffer.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace GLPractice;
+
+static const unsigned FRAME_COUNT = 200000;
+static const unsigned PAYLOAD_SIZE = 1024;
+
+// every value of a snapshot is its frame number, a torn one would mix two
+struct Snapshot {
+    uint64_t frame;
+    std::vector<uint64_t> payload;
+
+    Snapshot(): frame(0) { }
+
+    void write(uint64_t number) {
+        frame = number;
+        payload.assign(PAYLOAD_SIZE, number);
+    }
+
+    bool isConsistent() const {
+        for(uint64_t value : payload) {
+            if(value != frame)
+                return false;
+        }
+        return true;
+    }
+};
+
+int main() {
+    // the writer publishes as fast as it can while the reader takes the newest
+    TripleBuffer<Snapshot> frames;
+    std::atomic<bool> done(false);
+    bool torn = false;
+    bool backwards = false;
+    unsigned long readCount = 0;
+    uint64_t lastFrame = 0;
+
+    Clock::time_point start = Clock::now();
+    std::thread reader([&]() {
+        for(;;) {
+            // once done is seen, the next update gets the last snapshot
+            bool finished = done.load();
+            if(!frames.update()) {
+                if(finished)
+                    break;
+                continue;
+            }
+            const Snapshot& snapshot = frames.front();
+            if(!snapshot.isConsistent())
+                torn = true;
+            if(snapshot.frame <= lastFrame)
+                backwards = true;
+            lastFrame = snapshot.frame;
+            readCount++;
+        }
+    });
+    for(uint64_t frame = 1; frame <= FRAME_COUNT; frame++) {
+        frames.back().write(frame);
+        frames.publish();
+    }
+    done = true;
+    reader.join();
+    double tripleMs = elapsedMs(start);
+
+    // the same with the snapshot copied in and out under a lock
+    std::mutex mutex;
+    Snapshot shared;
+    done = false;
+    unsigned long lockedReadCount = 0;
+    start = Clock::now();
+    std::thread lockedReader([&]() {
+        Snapshot local;
+        uint64_t last = 0;
+        while(!done.load()) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                local = shared;
+            }
+            if(local.frame != last) {
+                last = local.frame;
+                lockedReadCount++;
+            }
+        }
+    });
+    Snapshot written;
+    for(uint64_t frame = 1; frame <= FRAME_COUNT; frame++) {
+        written.write(frame);
+        std::lock_guard<std::mutex> lock(mutex);
+        shared = written;
+    }
+    done = true;
+    lockedReader.join();
+    double lockedMs = elapsedMs(start);
+
+    std::cout << FRAME_COUNT << " snapshots of " << PAYLOAD_SIZE * sizeof(uint64_t) << " bytes" << std::endl
+        << "  triple buffer: " << tripleMs << " ms, " << readCount << " read" << std::endl
+        << "  copies under a lock: " << lockedMs << " ms, " << lockedReadCount << " read" << std::endl;
+
+    if(torn || backwards) {
+        std::cerr << "ERROR: the reader got a torn or older snapshot" << std::endl;
+        return EXIT_FAILURE;
+    }
+    if(lastFrame != FRAME_COUNT) {
+        std::cerr << "ERROR: the reader missed the last snapshot" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,95 @@
+#include "BenchUtil.h"
+#include "Culling.h"
+#include "VisibilityCache.h"
+
+#include <cstdlib>
+#include <iostream>
+
+using namespace GLPractice;
+
+static const unsigned SPHERE_COUNT = 200000;
+static const unsigned FRAME_COUNT = 600;
+// a teleport every this many frames
+static const unsigned TELEPORT_INTERVAL = 200;
+// spheres moving each frame, the rest is static
+static const unsigned MOVING_COUNT = 500;
+
+int main() {
+    SphereArray spheres;
+    spheres.resize(SPHERE_COUNT);
+    for(unsigned i = 0; i < SPHERE_COUNT; i++) {
+        BoundingSphere sphere;
+        sphere.center = Vector3{ randomFloat(-200.0f, 200.0f), randomFloat(-10.0f, 10.0f),
+            randomFloat(-200.0f, 200.0f) };
+        sphere.radius = randomFloat(0.5f, 1.5f);
+        spheres.set(i, sphere);
+    }
+
+    Matrix projection = MatrixPerspective(45.0f * DEG2RAD, 4.0f / 3.0f, 0.1f, 100.0f);
+    VisibilityCache cache(1.0f, 2.0f * DEG2RAD);
+    cache.setSpheres(spheres);
+
+    std::vector<uint32_t> visible(SPHERE_COUNT);
+    std::vector<uint32_t> cachedVisible(SPHERE_COUNT);
+    std::vector<uint8_t> flags(SPHERE_COUNT, 0);
+
+    Vector3 eye = Vector3Zero();
+    float yaw = 0.0f;
+    double fullMs = 0.0;
+    double cachedMs = 0.0;
+    unsigned long testedCount = 0;
+
+    // walking forward while turning slowly, as the viewer does
+    for(unsigned frame = 0; frame < FRAME_COUNT; frame++) {
+        if(frame > 0 && frame % TELEPORT_INTERVAL == 0)
+            eye = Vector3{ randomFloat(-100.0f, 100.0f), 0.0f, randomFloat(-100.0f, 100.0f) };
+
+        Quaternion rotation = QuaternionFromAxisAngle(Vector3{ 0.0f, 1.0f, 0.0f }, yaw);
+        Vector3 forward = Vector3RotateByQuaternion(Vector3{ 0.0f, 0.0f, 1.0f }, rotation);
+        Matrix view = MatrixLookAt(eye, Vector3Add(eye, forward), Vector3{ 0.0f, 1.0f, 0.0f });
+        Frustum frustum = Frustum::fromMatrix(MatrixMultiply(view, projection));
+
+        for(unsigned i = 0; i < MOVING_COUNT; i++) {
+            unsigned object = rand() % SPHERE_COUNT;
+            BoundingSphere sphere = spheres.get(object);
+            sphere.center.x += randomFloat(-1.0f, 1.0f);
+            sphere.center.z += randomFloat(-1.0f, 1.0f);
+            spheres.set(object, sphere);
+            cache.update(object, sphere);
+        }
+
+        Clock::time_point start = Clock::now();
+        unsigned fullCount = cullSpheres(frustum, spheres, visible.data());
+        fullMs += elapsedMs(start);
+
+        start = Clock::now();
+        unsigned cachedCount = cache.cull(frustum, eye, rotation, projection, cachedVisible.data());
+        cachedMs += elapsedMs(start);
+        testedCount += cache.testedCount();
+
+        // the same set, in another order
+        bool same = fullCount == cachedCount;
+        for(unsigned i = 0; i < fullCount; i++)
+            flags[visible[i]] = 1;
+        for(unsigned i = 0; same && i < cachedCount; i++)
+            same = flags[cachedVisible[i]] == 1;
+        for(unsigned i = 0; i < fullCount; i++)
+            flags[visible[i]] = 0;
+        if(!same) {
+            std::cerr << "ERROR: cached and full results differ in frame " << frame << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        eye = Vector3Add(eye, Vector3Scale(forward, 0.05f));
+        yaw += 0.2f * DEG2RAD;
+    }
+
+    std::cout << SPHERE_COUNT << " spheres, " << MOVING_COUNT << " moving, " << FRAME_COUNT << " frames"
+        << std::endl
+        << "  full:   " << fullMs / FRAME_COUNT << " ms per frame" << std::endl
+        << "  cached: " << cachedMs / FRAME_COUNT << " ms per frame (" << fullMs / cachedMs << "x), "
+        << testedCount / FRAME_COUNT << " spheres tested per frame, "
+        << cache.fullPassCount() << " full passes" << std::endl;
+
+    return EXIT_SUCCESS;
+}
@@ -1,6 +1,6 @@
 #version 330
 
-in vec3 pos;
+layout(location = 0) in vec3 pos;
 out vec4 vertColor;
 
 uniform mat4 model;
@@ -0,0 +1,16 @@
+#version 330
+
+// same pos location as vShader.vert, so both programs can share a VAO
+layout(location = 0) in vec3 pos;
+layout(location = 1) in mat4 instanceModel;
+layout(location = 5) in vec4 instanceColor;
+out vec4 vertColor;
+
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+
+void main(){
+    gl_Position = projection * view * model * instanceModel * vec4(pos, 1.0f);
+    vertColor = vec4(clamp(pos, 0.0f, 1.0f), 1.0f) * instanceColor;
+}
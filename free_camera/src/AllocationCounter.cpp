@@ -0,0 +1,43 @@
+#include "AllocationCounter.h"
+
+#include <stdlib.h>
+#include <atomic>
+#include <new>
+
+using namespace GLPractice;
+
+static std::atomic<uint64_t> s_allocationCount(0);
+static std::atomic<uint64_t> s_allocatedBytes(0);
+static thread_local uint64_t t_allocationCount = 0;
+
+// the array, nothrow and sized forms of the standard library end up here
+void* operator new(size_t size) {
+    s_allocationCount.fetch_add(1, std::memory_order_relaxed);
+    s_allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+    t_allocationCount++;
+
+    void* memory = malloc(size ? size : 1);
+    if(!memory)
+        throw std::bad_alloc();
+    return memory;
+}
+
+void operator delete(void* memory) noexcept {
+    free(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept {
+    free(memory);
+}
+
+uint64_t GLPractice::allocationCount() {
+    return s_allocationCount.load(std::memory_order_relaxed);
+}
+
+uint64_t GLPractice::allocatedBytes() {
+    return s_allocatedBytes.load(std::memory_order_relaxed);
+}
+
+uint64_t GLPractice::threadAllocationCount() {
+    return t_allocationCount;
+}
@@ -0,0 +1,19 @@
+# ifndef ALLOCATION_COUNTER_H
+# define ALLOCATION_COUNTER_H
+
+#include <stdint.h>
+
+namespace GLPractice {
+
+// heap allocations through operator new, counted by the replacements of the
+// global operators in AllocationCounter.cpp. the difference between two
+// calls is what the code between them allocated, which is 0 for a frame
+// loop running in steady state
+uint64_t allocationCount();
+uint64_t allocatedBytes();
+// the allocations of the calling thread only
+uint64_t threadAllocationCount();
+
+} // namespace GLPractice
+
+#endif // ALLOCATION_COUNTER_H
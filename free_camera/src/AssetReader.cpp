@@ -0,0 +1,470 @@
+#include "AssetReader.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <stdexcept>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define ASSET_READER_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#endif
+#endif
+
+using namespace GLPractice;
+
+// threads reading without a ring, enough to keep a disk busy
+static const unsigned READ_THREAD_COUNT = 4;
+
+#ifdef ASSET_READER_IO_URING
+
+// the submission and completion queues shared with the kernel, the reader
+// thread is the only one filling the first and emptying the second
+class AssetReader::Ring {
+    public:
+        // NULL when the kernel has no io_uring or refuses one
+        static Ring* create(uint8_t* buffers, size_t bufferSize, unsigned bufferCount);
+        ~Ring();
+
+        // into the registered buffer of the slot when fixed
+        void prepareRead(unsigned slot, int fd, uint8_t* data, size_t size, uint64_t offset, bool fixed);
+        // submits the prepared reads and waits for minComplete of them,
+        // false when there was nothing to do
+        bool enter(unsigned minComplete);
+        bool popCompletion(unsigned& slot, int& result);
+
+        bool registeredBuffers() const { return _registered; }
+
+    private:
+        Ring();
+
+        int _fd;
+        void* _sqRing;
+        size_t _sqRingSize;
+        void* _cqRing;
+        size_t _cqRingSize;
+        io_uring_sqe* _sqes;
+        size_t _sqesSize;
+        unsigned* _sqTail;
+        unsigned _sqMask;
+        unsigned* _sqArray;
+        unsigned* _cqHead;
+        unsigned* _cqTail;
+        unsigned _cqMask;
+        io_uring_cqe* _cqes;
+        unsigned _prepared;
+        bool _registered;
+        // of the reads into memory which is not registered
+        std::vector<iovec> _iovecs;
+};
+
+AssetReader::Ring::Ring():
+    _fd(-1),
+    _sqRing(MAP_FAILED),
+    _sqRingSize(0),
+    _cqRing(MAP_FAILED),
+    _cqRingSize(0),
+    _sqes((io_uring_sqe*) MAP_FAILED),
+    _sqesSize(0),
+    _prepared(0),
+    _registered(false)
+{ }
+
+AssetReader::Ring* AssetReader::Ring::create(uint8_t* buffers, size_t bufferSize, unsigned bufferCount) {
+    // a slot has one read in flight at a time, so neither queue fills up
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    int fd = (int) syscall(__NR_io_uring_setup, bufferCount, &params);
+    if(fd < 0)
+        return NULL;
+
+    std::unique_ptr<Ring> ring(new Ring());
+    ring->_fd = fd;
+    ring->_sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->_cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool singleMap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if(singleMap)
+        ring->_sqRingSize = ring->_cqRingSize = std::max(ring->_sqRingSize, ring->_cqRingSize);
+
+    ring->_sqRing = mmap(NULL, ring->_sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+            fd, IORING_OFF_SQ_RING);
+    if(ring->_sqRing == MAP_FAILED)
+        return NULL;
+    if(singleMap) {
+        ring->_cqRing = ring->_sqRing;
+    }
+    else {
+        ring->_cqRing = mmap(NULL, ring->_cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                fd, IORING_OFF_CQ_RING);
+        if(ring->_cqRing == MAP_FAILED)
+            return NULL;
+    }
+    ring->_sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    ring->_sqes = (io_uring_sqe*) mmap(NULL, ring->_sqesSize, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if(ring->_sqes == MAP_FAILED)
+        return NULL;
+
+    uint8_t* sq = (uint8_t*) ring->_sqRing;
+    ring->_sqTail = (unsigned*) (sq + params.sq_off.tail);
+    ring->_sqMask = *(unsigned*) (sq + params.sq_off.ring_mask);
+    ring->_sqArray = (unsigned*) (sq + params.sq_off.array);
+    uint8_t* cq = (uint8_t*) ring->_cqRing;
+    ring->_cqHead = (unsigned*) (cq + params.cq_off.head);
+    ring->_cqTail = (unsigned*) (cq + params.cq_off.tail);
+    ring->_cqMask = *(unsigned*) (cq + params.cq_off.ring_mask);
+    ring->_cqes = (io_uring_cqe*) (cq + params.cq_off.cqes);
+    ring->_iovecs.resize(bufferCount);
+
+    // registered buffers are pinned once instead of for every read, they
+    // count against the locked memory limit, without them reads still work
+    std::vector<iovec> registered(bufferCount);
+    for(unsigned i = 0; i < bufferCount; i++) {
+        registered[i].iov_base = buffers + i * bufferSize;
+        registered[i].iov_len = bufferSize;
+    }
+    ring->_registered = syscall(__NR_io_uring_register, fd, IORING_REGISTER_BUFFERS,
+            registered.data(), bufferCount) == 0;
+
+    return ring.release();
+}
+
+AssetReader::Ring::~Ring() {
+    if(_sqes != MAP_FAILED)
+        munmap(_sqes, _sqesSize);
+    if(_cqRing != MAP_FAILED && _cqRing != _sqRing)
+        munmap(_cqRing, _cqRingSize);
+    if(_sqRing != MAP_FAILED)
+        munmap(_sqRing, _sqRingSize);
+    if(_fd >= 0)
+        close(_fd);
+}
+
+void AssetReader::Ring::prepareRead(unsigned slot, int fd, uint8_t* data, size_t size,
+        uint64_t offset, bool fixed) {
+    // a read may return less, the rest is read again anyway
+    size = std::min(size, (size_t) 1 << 30);
+
+    unsigned tail = *_sqTail;
+    unsigned index = tail & _sqMask;
+    io_uring_sqe& sqe = _sqes[index];
+    memset(&sqe, 0, sizeof(sqe));
+    sqe.fd = fd;
+    sqe.off = offset;
+    sqe.user_data = slot;
+    if(fixed) {
+        sqe.opcode = IORING_OP_READ_FIXED;
+        sqe.addr = (uint64_t) (uintptr_t) data;
+        sqe.len = size;
+        sqe.buf_index = slot;
+    }
+    else {
+        _iovecs[slot].iov_base = data;
+        _iovecs[slot].iov_len = size;
+        sqe.opcode = IORING_OP_READV;
+        sqe.addr = (uint64_t) (uintptr_t) &_iovecs[slot];
+        sqe.len = 1;
+    }
+    _sqArray[index] = index;
+
+    // the kernel sees the entry once it sees the tail
+    __atomic_store_n(_sqTail, tail + 1, __ATOMIC_RELEASE);
+    _prepared++;
+}
+
+bool AssetReader::Ring::enter(unsigned minComplete) {
+    if(_prepared == 0 && minComplete == 0)
+        return false;
+
+    unsigned flags = minComplete > 0 ? IORING_ENTER_GETEVENTS : 0;
+    int result = (int) syscall(__NR_io_uring_enter, _fd, _prepared, minComplete, flags, NULL, 0);
+    if(result < 0) {
+        // tried again by the next call
+        if(errno == EINTR || errno == EAGAIN || errno == EBUSY)
+            return true;
+        throw std::runtime_error(std::string("io_uring_enter failed: ") + strerror(errno));
+    }
+    _prepared -= std::min((unsigned) result, _prepared);
+    return true;
+}
+
+bool AssetReader::Ring::popCompletion(unsigned& slot, int& result) {
+    unsigned head = *_cqHead;
+    if(head == __atomic_load_n(_cqTail, __ATOMIC_ACQUIRE))
+        return false;
+
+    const io_uring_cqe& cqe = _cqes[head & _cqMask];
+    slot = (unsigned) cqe.user_data;
+    result = cqe.res;
+    // the kernel may reuse the entry from now on
+    __atomic_store_n(_cqHead, head + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+#else
+
+class AssetReader::Ring {
+};
+
+#endif // ASSET_READER_IO_URING
+
+AssetReader::AssetReader(unsigned bufferCount, size_t bufferSize, bool useRing):
+    _bufferSize(bufferSize),
+    _buffers(new uint8_t[bufferCount * bufferSize]),
+    _slots(bufferCount),
+    _pendingCount(0),
+    _ringReadCount(0),
+    _dropping(false),
+    _systemCallCount(0),
+    _stop(false)
+{
+    if(bufferCount == 0)
+        throw std::runtime_error("asset reader needs a buffer");
+
+    // the first slots are taken first
+    for(unsigned i = bufferCount; i > 0; i--)
+        _freeSlots.push_back(i - 1);
+    for(Slot& slot : _slots)
+        slot.fd = -1;
+
+#ifdef ASSET_READER_IO_URING
+    if(useRing)
+        _ring.reset(Ring::create(_buffers.get(), bufferSize, bufferCount));
+#endif
+
+    // no more threads than reads in flight
+    if(!_ring) {
+        for(unsigned i = 0; i < std::min(READ_THREAD_COUNT, bufferCount); i++)
+            _threads.emplace_back(&AssetReader::readerMain, this);
+    }
+}
+
+AssetReader::~AssetReader() {
+    // the reads in flight still write into the buffers
+    _dropping = true;
+    _pendingCount -= _queued.size();
+    _queued.clear();
+    wait();
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stop = true;
+    }
+    _readable.notify_all();
+    for(std::thread& thread : _threads)
+        thread.join();
+}
+
+void AssetReader::read(const std::string& path, const Callback& callback) {
+    Request request = { path, callback };
+    _queued.push_back(std::move(request));
+    _pendingCount++;
+}
+
+void AssetReader::startQueued() {
+    while(!_queued.empty() && !_freeSlots.empty()) {
+        unsigned index = _freeSlots.back();
+        _freeSlots.pop_back();
+        Slot& slot = _slots[index];
+        slot.path.swap(_queued.front().path);
+        slot.callback.swap(_queued.front().callback);
+        _queued.pop_front();
+        slot.size = 0;
+        slot.done = 0;
+        slot.data = _buffers.get() + index * _bufferSize;
+        slot.error = 0;
+
+        slot.fd = open(slot.path.c_str(), O_RDONLY | O_CLOEXEC);
+        struct stat status;
+        if(slot.fd < 0 || fstat(slot.fd, &status) != 0) {
+            slot.error = errno;
+        }
+        else if(status.st_size > 0) {
+            slot.size = status.st_size;
+            if(slot.size > _bufferSize) {
+                slot.largeData.resize(slot.size);
+                slot.data = slot.largeData.data();
+            }
+        }
+        _systemCallCount += slot.fd < 0 ? 1 : 2;
+
+        if(slot.error != 0 || slot.size == 0) {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _finished.push_back(index);
+            continue;
+        }
+        submit(index);
+    }
+}
+
+void AssetReader::submit(unsigned index) {
+    Slot& slot = _slots[index];
+#ifdef ASSET_READER_IO_URING
+    if(_ring) {
+        bool fixed = _ring->registeredBuffers() && slot.largeData.empty();
+        _ring->prepareRead(index, slot.fd, slot.data + slot.done, slot.size - slot.done, slot.done, fixed);
+        _ringReadCount++;
+        return;
+    }
+#endif
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _toRead.push_back(index);
+    }
+    _readable.notify_one();
+}
+
+void AssetReader::reapRing(bool wait) {
+#ifdef ASSET_READER_IO_URING
+    if(_ring->enter(wait && _ringReadCount > 0 ? 1 : 0))
+        _systemCallCount++;
+
+    unsigned index;
+    int result;
+    while(_ring->popCompletion(index, result)) {
+        _ringReadCount--;
+        Slot& slot = _slots[index];
+        if(result == -EINTR || result == -EAGAIN) {
+            submit(index);
+            continue;
+        }
+
+        if(result < 0)
+            slot.error = -result;
+        else if(result == 0)
+            // the file got shorter since it was opened
+            slot.size = slot.done;
+        else
+            slot.done += result;
+
+        if(slot.error == 0 && slot.done < slot.size) {
+            submit(index);
+            continue;
+        }
+        std::lock_guard<std::mutex> lock(_mutex);
+        _finished.push_back(index);
+    }
+#endif
+}
+
+void AssetReader::readerMain() {
+    for(;;) {
+        unsigned index;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _readable.wait(lock, [this]() { return _stop || !_toRead.empty(); });
+            if(_stop)
+                return;
+            index = _toRead.front();
+            _toRead.pop_front();
+        }
+
+        Slot& slot = _slots[index];
+        while(slot.done < slot.size) {
+            ssize_t result = pread(slot.fd, slot.data + slot.done, slot.size - slot.done, slot.done);
+            _systemCallCount++;
+            if(result < 0) {
+                if(errno == EINTR)
+                    continue;
+                slot.error = errno;
+                break;
+            }
+            if(result == 0) {
+                slot.size = slot.done;
+                break;
+            }
+            slot.done += result;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _finished.push_back(index);
+        }
+        _readFinished.notify_one();
+    }
+}
+
+unsigned AssetReader::finishReads() {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _handing.swap(_finished);
+    }
+
+    unsigned count = _handing.size();
+    for(unsigned i = 0; i < count; i++) {
+        unsigned index = _handing[i];
+        Slot& slot = _slots[index];
+        Callback callback;
+        callback.swap(slot.callback);
+        File file = { slot.path.c_str(), slot.data, slot.error == 0 ? slot.size : 0, slot.error };
+
+        try {
+            if(!_dropping)
+                callback(file);
+        }
+        catch(...) {
+            // the files after it are not handed out, their reads are done
+            for(unsigned j = i; j < count; j++)
+                releaseSlot(_handing[j]);
+            _handing.clear();
+            throw;
+        }
+        releaseSlot(index);
+    }
+    _handing.clear();
+    return count;
+}
+
+void AssetReader::releaseSlot(unsigned index) {
+    Slot& slot = _slots[index];
+    if(slot.fd >= 0) {
+        close(slot.fd);
+        _systemCallCount++;
+        slot.fd = -1;
+    }
+    slot.callback = Callback();
+    std::vector<uint8_t>().swap(slot.largeData);
+    _freeSlots.push_back(index);
+    _pendingCount--;
+}
+
+unsigned AssetReader::poll() {
+    startQueued();
+    if(_ring)
+        reapRing(false);
+    return finishReads();
+}
+
+void AssetReader::wait() {
+    while(_pendingCount > 0) {
+        startQueued();
+        if(_ring) {
+            reapRing(true);
+        }
+        else {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _readFinished.wait(lock, [this]() { return !_finished.empty(); });
+        }
+        finishReads();
+    }
+}
+
+unsigned AssetReader::pendingCount() const {
+    return _pendingCount;
+}
+
+bool AssetReader::usesRing() const {
+    return (bool) _ring;
+}
+
+uint64_t AssetReader::systemCallCount() const {
+    return _systemCallCount;
+}
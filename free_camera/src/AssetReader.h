@@ -0,0 +1,121 @@
+# ifndef ASSET_READER_H
+# define ASSET_READER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace GLPractice {
+
+// reads whole files, many at a time, into buffers allocated once. on Linux
+// the reads go through an io_uring: all reads waiting for a buffer are
+// submitted with a single system call, straight into the buffers registered
+// with the kernel. without io_uring a few threads read the files with pread.
+// either way the files are handed to the callbacks of their reads by poll()
+// and wait(), on the one thread using the reader
+class AssetReader {
+    public:
+        // the contents of a file, only valid during the callback.
+        // error is 0 or the errno value of the failed open or read
+        struct File {
+            const char* path;
+            const uint8_t* data;
+            size_t size;
+            int error;
+        };
+        typedef std::function<void(const File& file)> Callback;
+
+        // files up to bufferSize bytes are read into one of the buffers,
+        // larger ones into memory of their own. at most bufferCount reads
+        // are in flight, useRing false reads with the threads anyway
+        AssetReader(unsigned bufferCount, size_t bufferSize, bool useRing = true);
+        // waits for the reads in flight without handing them out
+        ~AssetReader();
+
+        // queued until a buffer is free
+        void read(const std::string& path, const Callback& callback);
+        // starts the queued reads and hands out the finished ones
+        // without waiting, returns how many were handed out
+        unsigned poll();
+        // hands out files until every read was
+        void wait();
+
+        // read() calls not handed out yet
+        unsigned pendingCount() const;
+        // false when the threads read
+        bool usesRing() const;
+        // made for the files so far, opening and closing them included
+        uint64_t systemCallCount() const;
+
+        AssetReader(const AssetReader&) = delete;
+        AssetReader& operator=(const AssetReader&) = delete;
+
+    private:
+        // the io_uring, only defined where there is one
+        class Ring;
+
+        struct Request {
+            std::string path;
+            Callback callback;
+        };
+
+        // a read in flight, slot i reads into buffer i
+        struct Slot {
+            std::string path;
+            Callback callback;
+            int fd;
+            size_t size;
+            size_t done;
+            uint8_t* data;
+            // of a file larger than the buffers
+            std::vector<uint8_t> largeData;
+            int error;
+        };
+
+        // opens the files of the queued reads while there are free slots
+        void startQueued();
+        // the rest of the file of the slot
+        void submit(unsigned slot);
+        // the completions of the ring, waiting for one when wait is set
+        void reapRing(bool wait);
+        void readerMain();
+        // calls the callbacks of the finished reads
+        unsigned finishReads();
+        void releaseSlot(unsigned slot);
+
+        size_t _bufferSize;
+        std::unique_ptr<uint8_t[]> _buffers;
+        std::vector<Slot> _slots;
+        std::vector<unsigned> _freeSlots;
+        std::deque<Request> _queued;
+        unsigned _pendingCount;
+        // submitted to the ring and not completed yet
+        unsigned _ringReadCount;
+        // the callbacks are not called once the reader is destroyed
+        bool _dropping;
+        std::unique_ptr<Ring> _ring;
+        std::atomic<uint64_t> _systemCallCount;
+
+        // the threads reading without a ring take slots from _toRead,
+        // both ways put finished slots into _finished
+        std::vector<std::thread> _threads;
+        std::mutex _mutex;
+        std::condition_variable _readable;
+        std::condition_variable _readFinished;
+        std::deque<unsigned> _toRead;
+        std::vector<unsigned> _finished;
+        std::vector<unsigned> _handing;
+        bool _stop;
+};
+
+} // namespace GLPractice
+
+#endif // ASSET_READER_H
@@ -0,0 +1,531 @@
+#include "BVH.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+using namespace GLPractice;
+
+// centroid bins tried per split in build()
+static const unsigned SAH_BIN_COUNT = 16;
+
+static float surfaceArea(const BoundingBox& box) {
+    Vector3 size = Vector3Subtract(box.max, box.min);
+    return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+}
+
+static bool contains(const BoundingBox& outer, const BoundingBox& inner) {
+    return outer.min.x <= inner.min.x && outer.min.y <= inner.min.y && outer.min.z <= inner.min.z &&
+        outer.max.x >= inner.max.x && outer.max.y >= inner.max.y && outer.max.z >= inner.max.z;
+}
+
+static bool overlaps(const BoundingBox& a, const BoundingBox& b) {
+    return a.min.x <= b.max.x && a.min.y <= b.max.y && a.min.z <= b.max.z &&
+        a.max.x >= b.min.x && a.max.y >= b.min.y && a.max.z >= b.min.z;
+}
+
+static float component(const Vector3& v, unsigned axis) {
+    return axis == 0 ? v.x : (axis == 1 ? v.y : v.z);
+}
+
+// entry distance of the ray into the box, or a negative value on a miss
+static float rayBoxDistance(const BoundingBox& box, const Vector3& origin,
+        const Vector3& inverseDirection, float maxDistance) {
+    float t0x = (box.min.x - origin.x) * inverseDirection.x;
+    float t1x = (box.max.x - origin.x) * inverseDirection.x;
+    float t0y = (box.min.y - origin.y) * inverseDirection.y;
+    float t1y = (box.max.y - origin.y) * inverseDirection.y;
+    float t0z = (box.min.z - origin.z) * inverseDirection.z;
+    float t1z = (box.max.z - origin.z) * inverseDirection.z;
+
+    float entry = fmaxf(fmaxf(fminf(t0x, t1x), fminf(t0y, t1y)), fmaxf(fminf(t0z, t1z), 0.0f));
+    float exit = fminf(fminf(fmaxf(t0x, t1x), fmaxf(t0y, t1y)), fminf(fmaxf(t0z, t1z), maxDistance));
+    return entry <= exit ? entry : -1.0f;
+}
+
+BVH::BVH():
+    _root(-1),
+    _margin(0.1f),
+    _orderDirty(false)
+{ }
+
+void BVH::clear() {
+    _nodes.clear();
+    _freeNodes.clear();
+    _leaves.clear();
+    _order.clear();
+    _orderDirty = false;
+    _root = -1;
+}
+
+void BVH::setMargin(float margin) {
+    _margin = margin;
+}
+
+int32_t BVH::allocateNode() {
+    if(!_freeNodes.empty()) {
+        int32_t index = _freeNodes.back();
+        _freeNodes.pop_back();
+        return index;
+    }
+
+    _nodes.push_back(BVHNode());
+    return _nodes.size() - 1;
+}
+
+void BVH::freeNode(int32_t index) {
+    _nodes[index].parent = -1;
+    _nodes[index].left = -1;
+    _nodes[index].right = -1;
+    _nodes[index].object = -1;
+    _freeNodes.push_back(index);
+}
+
+void BVH::build(const BoundingBox* boxes, unsigned count) {
+    clear();
+    if(count == 0)
+        return;
+
+    _nodes.reserve(2 * count - 1);
+    _leaves.assign(count, -1);
+
+    std::vector<BVHBuildItem> items(count);
+    for(unsigned i = 0; i < count; i++) {
+        items[i].box = boxes[i];
+        items[i].centroid = Vector3Multiply(Vector3Add(boxes[i].min, boxes[i].max), 0.5f);
+        items[i].object = i;
+    }
+
+    _root = buildNode(items.data(), count, -1);
+}
+
+int32_t BVH::buildNode(BVHBuildItem* items, unsigned count, int32_t parent) {
+    int32_t index = allocateNode();
+    BVHNode node;
+    node.parent = parent;
+    node.left = -1;
+    node.right = -1;
+    node.object = -1;
+    node.bounds = items[0].box;
+
+    BoundingBox centroidBounds;
+    centroidBounds.min = centroidBounds.max = items[0].centroid;
+    for(unsigned i = 1; i < count; i++) {
+        node.bounds = mergeBoxes(node.bounds, items[i].box);
+        centroidBounds.min = Vector3Min(centroidBounds.min, items[i].centroid);
+        centroidBounds.max = Vector3Max(centroidBounds.max, items[i].centroid);
+    }
+
+    if(count == 1) {
+        node.object = items[0].object;
+        _leaves[items[0].object] = index;
+        _nodes[index] = node;
+        return index;
+    }
+
+    // split along the axis where the centroids spread the most
+    Vector3 extent = Vector3Subtract(centroidBounds.max, centroidBounds.min);
+    unsigned axis = 0;
+    if(extent.y > component(extent, axis))
+        axis = 1;
+    if(extent.z > component(extent, axis))
+        axis = 2;
+
+    float axisMin = component(centroidBounds.min, axis);
+    float axisExtent = component(extent, axis);
+    unsigned leftCount = count / 2;
+
+    if(axisExtent > 0.0f) {
+        BoundingBox binBounds[SAH_BIN_COUNT];
+        unsigned binCounts[SAH_BIN_COUNT] = {};
+        float binScale = SAH_BIN_COUNT / axisExtent;
+
+        for(unsigned i = 0; i < count; i++) {
+            unsigned bin = std::min(SAH_BIN_COUNT - 1,
+                    (unsigned) ((component(items[i].centroid, axis) - axisMin) * binScale));
+            const BoundingBox& box = items[i].box;
+            binBounds[bin] = binCounts[bin] == 0 ? box : mergeBoxes(binBounds[bin], box);
+            binCounts[bin]++;
+        }
+
+        // area times count of both sides for every split between two bins,
+        // the right side accumulated from the back first
+        float rightCosts[SAH_BIN_COUNT];
+        BoundingBox accumulated;
+        unsigned accumulatedCount = 0;
+        for(unsigned bin = SAH_BIN_COUNT - 1; bin > 0; bin--) {
+            if(binCounts[bin] > 0) {
+                accumulated = accumulatedCount == 0 ? binBounds[bin] : mergeBoxes(accumulated, binBounds[bin]);
+                accumulatedCount += binCounts[bin];
+            }
+            rightCosts[bin] = accumulatedCount == 0 ? 0.0f : surfaceArea(accumulated) * accumulatedCount;
+        }
+
+        float bestCost = INFINITY;
+        unsigned bestSplit = 0;
+        accumulatedCount = 0;
+        for(unsigned bin = 0; bin + 1 < SAH_BIN_COUNT; bin++) {
+            if(binCounts[bin] > 0) {
+                accumulated = accumulatedCount == 0 ? binBounds[bin] : mergeBoxes(accumulated, binBounds[bin]);
+                accumulatedCount += binCounts[bin];
+            }
+            if(accumulatedCount == 0 || accumulatedCount == count)
+                continue;
+
+            float cost = surfaceArea(accumulated) * accumulatedCount + rightCosts[bin + 1];
+            if(cost < bestCost) {
+                bestCost = cost;
+                bestSplit = bin + 1;
+            }
+        }
+
+        if(bestSplit > 0) {
+            BVHBuildItem* middle = std::partition(items, items + count, [&](const BVHBuildItem& item) {
+                return (component(item.centroid, axis) - axisMin) * binScale < bestSplit;
+            });
+            leftCount = middle - items;
+        }
+    }
+
+    // identical centroids or a failed partition, split at the median
+    if(leftCount == 0 || leftCount == count) {
+        leftCount = count / 2;
+        std::nth_element(items, items + leftCount, items + count,
+                [&](const BVHBuildItem& a, const BVHBuildItem& b) {
+            return component(a.centroid, axis) < component(b.centroid, axis);
+        });
+    }
+
+    _nodes[index] = node;
+    int32_t left = buildNode(items, leftCount, index);
+    int32_t right = buildNode(items + leftCount, count - leftCount, index);
+    _nodes[index].left = left;
+    _nodes[index].right = right;
+    return index;
+}
+
+void BVH::insert(uint32_t object, const BoundingBox& box) {
+    if(object >= _leaves.size())
+        _leaves.resize(object + 1, -1);
+
+    if(_leaves[object] >= 0)
+        throw std::runtime_error("object is already in the BVH");
+
+    Vector3 margin = { _margin, _margin, _margin };
+    int32_t leaf = allocateNode();
+    _nodes[leaf].bounds.min = Vector3Subtract(box.min, margin);
+    _nodes[leaf].bounds.max = Vector3Add(box.max, margin);
+    _nodes[leaf].parent = -1;
+    _nodes[leaf].left = -1;
+    _nodes[leaf].right = -1;
+    _nodes[leaf].object = object;
+    _leaves[object] = leaf;
+
+    insertLeaf(leaf);
+    _orderDirty = true;
+}
+
+void BVH::remove(uint32_t object) {
+    if(object >= _leaves.size() || _leaves[object] < 0)
+        throw std::runtime_error("object is not in the BVH");
+
+    int32_t leaf = _leaves[object];
+    removeLeaf(leaf);
+    freeNode(leaf);
+    _leaves[object] = -1;
+    _orderDirty = true;
+}
+
+bool BVH::update(uint32_t object, const BoundingBox& box) {
+    if(object >= _leaves.size() || _leaves[object] < 0)
+        throw std::runtime_error("object is not in the BVH");
+
+    int32_t leaf = _leaves[object];
+    if(contains(_nodes[leaf].bounds, box))
+        return false;
+
+    remove(object);
+    insert(object, box);
+    return true;
+}
+
+void BVH::insertLeaf(int32_t leaf) {
+    if(_root < 0) {
+        _root = leaf;
+        return;
+    }
+
+    // walk down to the sibling that grows the tree area the least,
+    // counting the growth of all nodes on the way
+    const BoundingBox& box = _nodes[leaf].bounds;
+    int32_t sibling = _root;
+    while(!_nodes[sibling].isLeaf()) {
+        const BVHNode& node = _nodes[sibling];
+        float area = surfaceArea(node.bounds);
+        float combinedArea = surfaceArea(mergeBoxes(node.bounds, box));
+
+        // pairing with this node makes a new parent,
+        // going further down grows this node instead
+        float cost = 2.0f * combinedArea;
+        float inheritedCost = 2.0f * (combinedArea - area);
+
+        float childCosts[2];
+        int32_t children[2] = { node.left, node.right };
+        for(unsigned i = 0; i < 2; i++) {
+            const BVHNode& child = _nodes[children[i]];
+            float childCost = surfaceArea(mergeBoxes(child.bounds, box)) + inheritedCost;
+            if(!child.isLeaf())
+                childCost -= surfaceArea(child.bounds);
+            childCosts[i] = childCost;
+        }
+
+        if(cost < childCosts[0] && cost < childCosts[1])
+            break;
+
+        sibling = childCosts[0] < childCosts[1] ? children[0] : children[1];
+    }
+
+    int32_t oldParent = _nodes[sibling].parent;
+    int32_t newParent = allocateNode();
+    _nodes[newParent].parent = oldParent;
+    _nodes[newParent].left = sibling;
+    _nodes[newParent].right = leaf;
+    _nodes[newParent].object = -1;
+    _nodes[newParent].bounds = mergeBoxes(_nodes[sibling].bounds, _nodes[leaf].bounds);
+    _nodes[sibling].parent = newParent;
+    _nodes[leaf].parent = newParent;
+
+    if(oldParent < 0) {
+        _root = newParent;
+    }
+    else {
+        if(_nodes[oldParent].left == sibling)
+            _nodes[oldParent].left = newParent;
+        else
+            _nodes[oldParent].right = newParent;
+    }
+
+    refitAncestors(oldParent);
+}
+
+void BVH::removeLeaf(int32_t leaf) {
+    if(leaf == _root) {
+        _root = -1;
+        return;
+    }
+
+    // the sibling takes the place of the parent
+    int32_t parent = _nodes[leaf].parent;
+    int32_t grandParent = _nodes[parent].parent;
+    int32_t sibling = _nodes[parent].left == leaf ? _nodes[parent].right : _nodes[parent].left;
+
+    _nodes[sibling].parent = grandParent;
+    if(grandParent < 0) {
+        _root = sibling;
+    }
+    else {
+        if(_nodes[grandParent].left == parent)
+            _nodes[grandParent].left = sibling;
+        else
+            _nodes[grandParent].right = sibling;
+    }
+
+    freeNode(parent);
+    refitAncestors(grandParent);
+}
+
+void BVH::refitAncestors(int32_t index) {
+    while(index >= 0) {
+        BVHNode& node = _nodes[index];
+        node.bounds = mergeBoxes(_nodes[node.left].bounds, _nodes[node.right].bounds);
+        index = node.parent;
+    }
+}
+
+void BVH::refitNode(BVHNode& node, const BoundingBox* boxes) {
+    if(node.isLeaf())
+        node.bounds = boxes[node.object];
+    else
+        node.bounds = mergeBoxes(_nodes[node.left].bounds, _nodes[node.right].bounds);
+}
+
+void BVH::refit(const BoundingBox* boxes) {
+    if(_root < 0)
+        return;
+
+    // build() stores the nodes depth first with no free ones in between,
+    // so going through them backwards updates children first
+    if(!_orderDirty && _order.empty()) {
+        for(unsigned i = _nodes.size(); i-- > 0;)
+            refitNode(_nodes[i], boxes);
+        return;
+    }
+
+    // after insert() or remove() the breadth first order is rebuilt once
+    // and reused until the tree shape changes again
+    if(_orderDirty) {
+        _order.clear();
+        _order.push_back(_root);
+        for(unsigned i = 0; i < _order.size(); i++) {
+            const BVHNode& node = _nodes[_order[i]];
+            if(!node.isLeaf()) {
+                _order.push_back(node.left);
+                _order.push_back(node.right);
+            }
+        }
+        _orderDirty = false;
+    }
+
+    for(unsigned i = _order.size(); i-- > 0;)
+        refitNode(_nodes[_order[i]], boxes);
+}
+
+unsigned BVH::cullFrustum(const Frustum& frustum, uint32_t* visible) const {
+    unsigned count = 0;
+    if(_root >= 0)
+        cullNode(_root, frustum, (1u << Frustum::PLANE_COUNT) - 1, visible, count);
+    return count;
+}
+
+void BVH::cullNode(int32_t index, const Frustum& frustum, unsigned planeMask,
+        uint32_t* visible, unsigned& count) const {
+    const BVHNode& node = _nodes[index];
+
+    for(unsigned i = 0; i < Frustum::PLANE_COUNT; i++) {
+        if(!(planeMask & (1u << i)))
+            continue;
+
+        // the corner furthest along the normal decides if the box is
+        // outside, the opposite corner if it is completely inside
+        const Plane& plane = frustum.planes[i];
+        Vector3 positive;
+        Vector3 negative;
+        positive.x = plane.normal.x >= 0.0f ? node.bounds.max.x : node.bounds.min.x;
+        positive.y = plane.normal.y >= 0.0f ? node.bounds.max.y : node.bounds.min.y;
+        positive.z = plane.normal.z >= 0.0f ? node.bounds.max.z : node.bounds.min.z;
+        negative.x = plane.normal.x >= 0.0f ? node.bounds.min.x : node.bounds.max.x;
+        negative.y = plane.normal.y >= 0.0f ? node.bounds.min.y : node.bounds.max.y;
+        negative.z = plane.normal.z >= 0.0f ? node.bounds.min.z : node.bounds.max.z;
+
+        if(Vector3DotProduct(plane.normal, positive) + plane.distance < 0.0f)
+            return;
+        if(Vector3DotProduct(plane.normal, negative) + plane.distance >= 0.0f)
+            planeMask &= ~(1u << i);
+    }
+
+    if(planeMask == 0) {
+        addSubtree(index, visible, count);
+        return;
+    }
+
+    if(node.isLeaf()) {
+        visible[count++] = node.object;
+        return;
+    }
+
+    cullNode(node.left, frustum, planeMask, visible, count);
+    cullNode(node.right, frustum, planeMask, visible, count);
+}
+
+void BVH::addSubtree(int32_t index, uint32_t* visible, unsigned& count) const {
+    const BVHNode& node = _nodes[index];
+    if(node.isLeaf()) {
+        visible[count++] = node.object;
+        return;
+    }
+
+    addSubtree(node.left, visible, count);
+    addSubtree(node.right, visible, count);
+}
+
+unsigned BVH::queryBox(const BoundingBox& box, uint32_t* result) const {
+    unsigned count = 0;
+    if(_root >= 0)
+        queryNode(_root, box, result, count);
+    return count;
+}
+
+void BVH::queryNode(int32_t index, const BoundingBox& box, uint32_t* result, unsigned& count) const {
+    const BVHNode& node = _nodes[index];
+    if(!overlaps(node.bounds, box))
+        return;
+
+    if(node.isLeaf()) {
+        result[count++] = node.object;
+        return;
+    }
+
+    queryNode(node.left, box, result, count);
+    queryNode(node.right, box, result, count);
+}
+
+bool BVH::raycast(const Vector3& origin, const Vector3& direction, float maxDistance,
+        uint32_t* object, float* distance) const {
+    if(_root < 0)
+        return false;
+
+    // divisions by zero give infinities, which the slab test handles
+    Vector3 inverseDirection;
+    inverseDirection.x = 1.0f / direction.x;
+    inverseDirection.y = 1.0f / direction.y;
+    inverseDirection.z = 1.0f / direction.z;
+
+    float closest = maxDistance;
+    int32_t hit = -1;
+    raycastNode(_root, origin, inverseDirection, closest, hit);
+    if(hit < 0)
+        return false;
+
+    if(object)
+        *object = hit;
+    if(distance)
+        *distance = closest;
+    return true;
+}
+
+void BVH::raycastNode(int32_t index, const Vector3& origin, const Vector3& inverseDirection,
+        float& closest, int32_t& hit) const {
+    const BVHNode& node = _nodes[index];
+    if(node.isLeaf()) {
+        float t = rayBoxDistance(node.bounds, origin, inverseDirection, closest);
+        if(t >= 0.0f && (hit < 0 || t < closest)) {
+            closest = t;
+            hit = node.object;
+        }
+        return;
+    }
+
+    // visit the nearer child first, so the further one
+    // is often skipped because of a closer hit
+    int32_t first = node.left;
+    int32_t second = node.right;
+    float firstDistance = rayBoxDistance(_nodes[first].bounds, origin, inverseDirection, closest);
+    float secondDistance = rayBoxDistance(_nodes[second].bounds, origin, inverseDirection, closest);
+    if(secondDistance >= 0.0f && (firstDistance < 0.0f || secondDistance < firstDistance)) {
+        std::swap(first, second);
+        std::swap(firstDistance, secondDistance);
+    }
+
+    if(firstDistance >= 0.0f)
+        raycastNode(first, origin, inverseDirection, closest, hit);
+    if(secondDistance >= 0.0f && (hit < 0 || secondDistance < closest))
+        raycastNode(second, origin, inverseDirection, closest, hit);
+}
+
+unsigned BVH::objectCount() const {
+    return _leaves.size();
+}
+
+unsigned BVH::depth() const {
+    return _root < 0 ? 0 : nodeDepth(_root);
+}
+
+unsigned BVH::nodeDepth(int32_t index) const {
+    const BVHNode& node = _nodes[index];
+    if(node.isLeaf())
+        return 1;
+    return 1 + std::max(nodeDepth(node.left), nodeDepth(node.right));
+}
+
+const std::vector<BVHNode>& BVH::nodes() const {
+    return _nodes;
+}
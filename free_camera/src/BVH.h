@@ -0,0 +1,109 @@
+# ifndef BVH_H
+# define BVH_H
+
+#include <stdint.h>
+#include <vector>
+#include "Culling.h"
+
+namespace GLPractice {
+
+// an object during BVH::build(), kept together and reordered
+// in place so each split reads memory front to back
+struct BVHBuildItem {
+    BoundingBox box;
+    Vector3 centroid;
+    uint32_t object;
+};
+
+// one node of the tree, leaves hold a single object
+struct BVHNode {
+    BoundingBox bounds;
+    int32_t parent;
+    // -1 for leaves
+    int32_t left;
+    int32_t right;
+    // -1 for inner nodes
+    int32_t object;
+
+    bool isLeaf() const {
+        return left < 0;
+    }
+};
+
+// bounding volume hierarchy over object boxes, stored in one flat node array
+//
+// build() makes a tree with the surface area heuristic for objects known
+// up front, the built nodes are in depth first order so a left child
+// follows its parent in memory. moving objects either keep the tree shape
+// with refit() or are reinserted by update() once they leave their fat box.
+class BVH {
+    public:
+        BVH();
+
+        // objects get the ids 0 .. count - 1
+        void build(const BoundingBox* boxes, unsigned count);
+        void clear();
+
+        // the leaf box is grown by the margin, so small moves
+        // don't need a reinsert in update()
+        void insert(uint32_t object, const BoundingBox& box);
+        void remove(uint32_t object);
+        // returns true if the object was reinserted
+        bool update(uint32_t object, const BoundingBox& box);
+
+        // set the leaves to boxes[object] and recompute the inner
+        // nodes, the tree shape stays, cheap but loses quality over time
+        void refit(const BoundingBox* boxes);
+
+        // the results need room for one entry per object id
+        //
+        // subtrees fully inside a plane skip it, fully inside
+        // the frustum they are added without further tests
+        unsigned cullFrustum(const Frustum& frustum, uint32_t* visible) const;
+        unsigned queryBox(const BoundingBox& box, uint32_t* result) const;
+
+        // closest object box hit by the ray within maxDistance,
+        // direction doesn't need to be normalized, distance is in its units
+        bool raycast(const Vector3& origin, const Vector3& direction, float maxDistance,
+                uint32_t* object, float* distance) const;
+
+        // one past the largest object id
+        unsigned objectCount() const;
+        unsigned depth() const;
+        const std::vector<BVHNode>& nodes() const;
+
+        void setMargin(float margin);
+
+    private:
+        int32_t allocateNode();
+        void freeNode(int32_t index);
+        int32_t buildNode(BVHBuildItem* items, unsigned count, int32_t parent);
+        void insertLeaf(int32_t leaf);
+        void removeLeaf(int32_t leaf);
+        void refitAncestors(int32_t index);
+        void refitNode(BVHNode& node, const BoundingBox* boxes);
+
+        void cullNode(int32_t index, const Frustum& frustum, unsigned planeMask,
+                uint32_t* visible, unsigned& count) const;
+        void addSubtree(int32_t index, uint32_t* visible, unsigned& count) const;
+        void queryNode(int32_t index, const BoundingBox& box, uint32_t* result, unsigned& count) const;
+        void raycastNode(int32_t index, const Vector3& origin, const Vector3& inverseDirection,
+                float& closest, int32_t& hit) const;
+        unsigned nodeDepth(int32_t index) const;
+
+        std::vector<BVHNode> _nodes;
+        std::vector<int32_t> _freeNodes;
+        // leaf node of each object id, -1 if not in the tree
+        std::vector<int32_t> _leaves;
+        // nodes in breadth first order, parents before children, reused by
+        // refit() after insert() or remove(), empty while the built order holds
+        std::vector<int32_t> _order;
+        int32_t _root;
+        float _margin;
+        // the tree shape changed since _order was made
+        bool _orderDirty;
+};
+
+} // namespace GLPractice
+
+#endif // BVH_H
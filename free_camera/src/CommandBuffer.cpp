@@ -0,0 +1,130 @@
+#include "CommandBuffer.h"
+
+using namespace GLPractice;
+
+CommandBuffer::CommandBuffer():
+    _size(0),
+    _commandCount(0),
+    _drawCount(0),
+    _program(0),
+    _vao(0)
+{ }
+
+void CommandBuffer::clear() {
+    _size = 0;
+    _commandCount = 0;
+    _drawCount = 0;
+    _program = 0;
+    _vao = 0;
+}
+
+void CommandBuffer::bindProgram(uint32_t program) {
+    if(program == _program)
+        return;
+    write(BIND_PROGRAM, BindObject{ program });
+    _program = program;
+}
+
+void CommandBuffer::bindVertexArray(uint32_t vao) {
+    if(vao == _vao)
+        return;
+    write(BIND_VERTEX_ARRAY, BindObject{ vao });
+    _vao = vao;
+}
+
+void CommandBuffer::bindMeshBuffers(uint32_t vbo, uint32_t ebo, int32_t vertexStride) {
+    write(BIND_MESH_BUFFERS, BindMeshBuffers{ vbo, ebo, vertexStride });
+}
+
+void CommandBuffer::setUniformMatrix4(int32_t location, const float* matrix) {
+    UniformMatrix4 uniform;
+    uniform.location = location;
+    memcpy(uniform.v, matrix, sizeof(uniform.v));
+    write(SET_UNIFORM_MATRIX4, uniform);
+}
+
+void CommandBuffer::setUniformVec4(int32_t location, const float* vec) {
+    UniformVec4 uniform;
+    uniform.location = location;
+    memcpy(uniform.v, vec, sizeof(uniform.v));
+    write(SET_UNIFORM_VEC4, uniform);
+}
+
+void CommandBuffer::drawElements(uint32_t indexCount, uint32_t firstIndex, int32_t baseVertex,
+        uint32_t instanceCount) {
+    write(DRAW_ELEMENTS, DrawElements{ indexCount, firstIndex, baseVertex, instanceCount });
+    _drawCount++;
+}
+
+unsigned CommandBuffer::commandCount() const {
+    return _commandCount;
+}
+
+unsigned CommandBuffer::drawCount() const {
+    return _drawCount;
+}
+
+size_t CommandBuffer::size() const {
+    return _size;
+}
+
+size_t CommandBuffer::capacity() const {
+    return _data.size();
+}
+
+CommandList::CommandList():
+    _taskCount(0),
+    _key(0),
+    _valid(false),
+    _recordCount(0)
+{ }
+
+bool CommandList::record(uint64_t key, unsigned taskCount, const RecordTask& task,
+        const ParallelFor& parallelFor) {
+    if(_valid && key == _key && taskCount == _taskCount)
+        return false;
+
+    // buffers of tasks not run this time keep their memory for later
+    if(_buffers.size() < taskCount)
+        _buffers.resize(taskCount);
+    _taskCount = taskCount;
+    parallelFor(taskCount, [&](unsigned i) {
+        _buffers[i].clear();
+        task(i, _buffers[i]);
+    });
+
+    _key = key;
+    _valid = true;
+    _recordCount++;
+    return true;
+}
+
+void CommandList::invalidate() {
+    _valid = false;
+}
+
+unsigned CommandList::bufferCount() const {
+    return _taskCount;
+}
+
+const CommandBuffer& CommandList::buffer(unsigned index) const {
+    return _buffers[index];
+}
+
+unsigned CommandList::commandCount() const {
+    unsigned count = 0;
+    for(unsigned i = 0; i < _taskCount; i++)
+        count += _buffers[i].commandCount();
+    return count;
+}
+
+unsigned CommandList::drawCount() const {
+    unsigned count = 0;
+    for(unsigned i = 0; i < _taskCount; i++)
+        count += _buffers[i].drawCount();
+    return count;
+}
+
+unsigned CommandList::recordCount() const {
+    return _recordCount;
+}
@@ -0,0 +1,186 @@
+# ifndef COMMAND_BUFFER_H
+# define COMMAND_BUFFER_H
+
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <functional>
+#include <vector>
+#include "Parallel.h"
+
+namespace GLPractice {
+
+// draw commands recorded into a flat block of memory without GL, so any
+// thread can record them, replayed later on the thread owning the context.
+// each command is a small header followed by its arguments, clearing keeps
+// the memory, so recording the same amount again does not allocate
+class CommandBuffer {
+    public:
+        enum Type {
+            BIND_PROGRAM,
+            BIND_VERTEX_ARRAY,
+            BIND_MESH_BUFFERS,
+            SET_UNIFORM_MATRIX4,
+            SET_UNIFORM_VEC4,
+            DRAW_ELEMENTS
+        };
+
+        struct Header {
+            uint16_t type;
+            // of the arguments following the header
+            uint16_t size;
+        };
+        struct BindObject {
+            uint32_t object;
+        };
+        // the vertex buffer goes to VERTEX_BINDING_MESH of the bound VAO
+        struct BindMeshBuffers {
+            uint32_t vbo;
+            uint32_t ebo;
+            int32_t vertexStride;
+        };
+        struct UniformMatrix4 {
+            int32_t location;
+            float v[16];
+        };
+        struct UniformVec4 {
+            int32_t location;
+            float v[4];
+        };
+        // unsigned int indices, instanced when instanceCount is not 1
+        struct DrawElements {
+            uint32_t indexCount;
+            uint32_t firstIndex;
+            int32_t baseVertex;
+            uint32_t instanceCount;
+        };
+
+        CommandBuffer();
+
+        // start recording again, keeping the memory
+        void clear();
+
+        // binds of the object bound last in this buffer are not recorded
+        void bindProgram(uint32_t program);
+        void bindVertexArray(uint32_t vao);
+        void bindMeshBuffers(uint32_t vbo, uint32_t ebo, int32_t vertexStride);
+        void setUniformMatrix4(int32_t location, const float* matrix);
+        void setUniformVec4(int32_t location, const float* vec);
+        void drawElements(uint32_t indexCount, uint32_t firstIndex, int32_t baseVertex,
+                uint32_t instanceCount = 1);
+
+        // calls the method of the visitor named after each command, in order
+        template<typename Visitor>
+        void replay(Visitor& visitor) const;
+
+        unsigned commandCount() const;
+        unsigned drawCount() const;
+        // bytes recorded and bytes kept
+        size_t size() const;
+        size_t capacity() const;
+
+    private:
+        template<typename Arguments>
+        void write(Type type, const Arguments& arguments);
+
+        std::vector<uint8_t> _data;
+        size_t _size;
+        unsigned _commandCount;
+        unsigned _drawCount;
+        // the state at the end of the recording so far
+        uint32_t _program;
+        uint32_t _vao;
+};
+
+// the buffers of one frame, each recorded by a single task so tasks on any
+// number of threads never share one, replayed in the order of the tasks.
+// a recording with the same key as the last one is skipped and the
+// buffers are replayed again as they are
+class CommandList {
+    public:
+        typedef std::function<void(unsigned task, CommandBuffer& buffer)> RecordTask;
+
+        CommandList();
+
+        // returns false when the key matched and nothing was recorded
+        bool record(uint64_t key, unsigned taskCount, const RecordTask& task,
+                const ParallelFor& parallelFor = serialFor);
+        // the next record() is done whatever its key
+        void invalidate();
+
+        template<typename Visitor>
+        void replay(Visitor& visitor) const;
+
+        unsigned bufferCount() const;
+        const CommandBuffer& buffer(unsigned index) const;
+        unsigned commandCount() const;
+        unsigned drawCount() const;
+        // record() calls that did record
+        unsigned recordCount() const;
+
+    private:
+        std::vector<CommandBuffer> _buffers;
+        unsigned _taskCount;
+        uint64_t _key;
+        bool _valid;
+        unsigned _recordCount;
+};
+
+template<typename Arguments>
+void CommandBuffer::write(Type type, const Arguments& arguments) {
+    static_assert(sizeof(Arguments) % sizeof(uint32_t) == 0, "commands stay 4 byte aligned");
+    Header header = { (uint16_t) type, (uint16_t) sizeof(Arguments) };
+    size_t end = _size + sizeof(Header) + sizeof(Arguments);
+    // only grows until the largest recording of the buffer was seen
+    if(end > _data.size())
+        _data.resize(std::max(end, 2 * _data.size()));
+    memcpy(&_data[_size], &header, sizeof(Header));
+    memcpy(&_data[_size + sizeof(Header)], &arguments, sizeof(Arguments));
+    _size = end;
+    _commandCount++;
+}
+
+template<typename Visitor>
+void CommandBuffer::replay(Visitor& visitor) const {
+    size_t offset = 0;
+    while(offset < _size) {
+        Header header;
+        memcpy(&header, &_data[offset], sizeof(Header));
+        const uint8_t* arguments = &_data[offset + sizeof(Header)];
+        offset += sizeof(Header) + header.size;
+
+        // the recorded arguments are 4 byte aligned
+        switch(header.type) {
+            case BIND_PROGRAM:
+                visitor.bindProgram(((const BindObject*) arguments)->object);
+                break;
+            case BIND_VERTEX_ARRAY:
+                visitor.bindVertexArray(((const BindObject*) arguments)->object);
+                break;
+            case BIND_MESH_BUFFERS:
+                visitor.bindMeshBuffers(*(const BindMeshBuffers*) arguments);
+                break;
+            case SET_UNIFORM_MATRIX4:
+                visitor.setUniformMatrix4(*(const UniformMatrix4*) arguments);
+                break;
+            case SET_UNIFORM_VEC4:
+                visitor.setUniformVec4(*(const UniformVec4*) arguments);
+                break;
+            case DRAW_ELEMENTS:
+                visitor.drawElements(*(const DrawElements*) arguments);
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+template<typename Visitor>
+void CommandList::replay(Visitor& visitor) const {
+    for(unsigned i = 0; i < _taskCount; i++)
+        _buffers[i].replay(visitor);
+}
+
+} // namespace GLPractice
+
+#endif // COMMAND_BUFFER_H
@@ -0,0 +1,275 @@
+#include "Culling.h"
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+using namespace GLPractice;
+
+static Plane makePlane(float a, float b, float c, float d) {
+    // normalized, so plane distances are in world units
+    float length = sqrtf(a * a + b * b + c * c);
+    Plane plane;
+    plane.normal.x = a / length;
+    plane.normal.y = b / length;
+    plane.normal.z = c / length;
+    plane.distance = d / length;
+    return plane;
+}
+
+Frustum Frustum::fromMatrix(const Matrix& m) {
+    // a point is inside when -w <= x, y, z <= w in clip space,
+    // each side gives one plane from the rows of the matrix,
+    // row i is (m[i], m[i + 4], m[i + 8], m[i + 12]) in column major order
+    Frustum frustum;
+    frustum.planes[PLANE_LEFT] = makePlane(m.m3 + m.m0, m.m7 + m.m4, m.m11 + m.m8, m.m15 + m.m12);
+    frustum.planes[PLANE_RIGHT] = makePlane(m.m3 - m.m0, m.m7 - m.m4, m.m11 - m.m8, m.m15 - m.m12);
+    frustum.planes[PLANE_BOTTOM] = makePlane(m.m3 + m.m1, m.m7 + m.m5, m.m11 + m.m9, m.m15 + m.m13);
+    frustum.planes[PLANE_TOP] = makePlane(m.m3 - m.m1, m.m7 - m.m5, m.m11 - m.m9, m.m15 - m.m13);
+    frustum.planes[PLANE_NEAR] = makePlane(m.m3 + m.m2, m.m7 + m.m6, m.m11 + m.m10, m.m15 + m.m14);
+    frustum.planes[PLANE_FAR] = makePlane(m.m3 - m.m2, m.m7 - m.m6, m.m11 - m.m10, m.m15 - m.m14);
+    return frustum;
+}
+
+bool Frustum::intersects(const BoundingSphere& sphere) const {
+    for(unsigned i = 0; i < PLANE_COUNT; i++) {
+        const Plane& plane = planes[i];
+        if(Vector3DotProduct(plane.normal, sphere.center) + plane.distance < -sphere.radius)
+            return false;
+    }
+    return true;
+}
+
+bool Frustum::intersects(const BoundingBox& box) const {
+    for(unsigned i = 0; i < PLANE_COUNT; i++) {
+        // the corner furthest along the normal is enough to decide
+        const Plane& plane = planes[i];
+        Vector3 corner;
+        corner.x = plane.normal.x >= 0.0f ? box.max.x : box.min.x;
+        corner.y = plane.normal.y >= 0.0f ? box.max.y : box.min.y;
+        corner.z = plane.normal.z >= 0.0f ? box.max.z : box.min.z;
+        if(Vector3DotProduct(plane.normal, corner) + plane.distance < 0.0f)
+            return false;
+    }
+    return true;
+}
+
+bool Frustum::contains(const BoundingBox& box) const {
+    for(unsigned i = 0; i < PLANE_COUNT; i++) {
+        // now the corner furthest against the normal
+        const Plane& plane = planes[i];
+        Vector3 corner;
+        corner.x = plane.normal.x >= 0.0f ? box.min.x : box.max.x;
+        corner.y = plane.normal.y >= 0.0f ? box.min.y : box.max.y;
+        corner.z = plane.normal.z >= 0.0f ? box.min.z : box.max.z;
+        if(Vector3DotProduct(plane.normal, corner) + plane.distance < 0.0f)
+            return false;
+    }
+    return true;
+}
+
+// the point on all three planes
+static Vector3 intersectPlanes(const Plane& a, const Plane& b, const Plane& c) {
+    Vector3 bc = Vector3CrossProduct(b.normal, c.normal);
+    Vector3 ca = Vector3CrossProduct(c.normal, a.normal);
+    Vector3 ab = Vector3CrossProduct(a.normal, b.normal);
+    float denominator = -Vector3DotProduct(a.normal, bc);
+
+    Vector3 point = Vector3Multiply(bc, a.distance);
+    point = Vector3Add(point, Vector3Multiply(ca, b.distance));
+    point = Vector3Add(point, Vector3Multiply(ab, c.distance));
+    return Vector3Divide(point, denominator);
+}
+
+BoundingBox Frustum::bounds() const {
+    BoundingBox box;
+    for(unsigned i = 0; i < 8; i++) {
+        const Plane& x = planes[(i & 1) ? PLANE_RIGHT : PLANE_LEFT];
+        const Plane& y = planes[(i & 2) ? PLANE_TOP : PLANE_BOTTOM];
+        const Plane& z = planes[(i & 4) ? PLANE_FAR : PLANE_NEAR];
+        Vector3 corner = intersectPlanes(x, y, z);
+        box.min = i == 0 ? corner : Vector3Min(box.min, corner);
+        box.max = i == 0 ? corner : Vector3Max(box.max, corner);
+    }
+    return box;
+}
+
+void SphereArray::resize(unsigned count) {
+    x.resize(count);
+    y.resize(count);
+    z.resize(count);
+    radius.resize(count);
+}
+
+void SphereArray::set(unsigned i, const BoundingSphere& sphere) {
+    x[i] = sphere.center.x;
+    y[i] = sphere.center.y;
+    z[i] = sphere.center.z;
+    radius[i] = sphere.radius;
+}
+
+BoundingSphere SphereArray::get(unsigned i) const {
+    BoundingSphere sphere;
+    sphere.center.x = x[i];
+    sphere.center.y = y[i];
+    sphere.center.z = z[i];
+    sphere.radius = radius[i];
+    return sphere;
+}
+
+BoundingBox GLPractice::computeBoundingBox(const float* positions, unsigned vertexCount) {
+    BoundingBox box;
+    box.min = Vector3Zero();
+    box.max = Vector3Zero();
+    if(vertexCount == 0)
+        return box;
+
+    box.min.x = box.max.x = positions[0];
+    box.min.y = box.max.y = positions[1];
+    box.min.z = box.max.z = positions[2];
+    for(unsigned i = 1; i < vertexCount; i++) {
+        Vector3 p;
+        p.x = positions[i * 3];
+        p.y = positions[i * 3 + 1];
+        p.z = positions[i * 3 + 2];
+        box.min = Vector3Min(box.min, p);
+        box.max = Vector3Max(box.max, p);
+    }
+    return box;
+}
+
+BoundingSphere GLPractice::computeBoundingSphere(const float* positions, unsigned vertexCount) {
+    // centered in the box, but only as large as the furthest vertex
+    BoundingBox box = computeBoundingBox(positions, vertexCount);
+
+    BoundingSphere sphere;
+    sphere.center = Vector3Multiply(Vector3Add(box.min, box.max), 0.5f);
+    sphere.radius = 0.0f;
+    for(unsigned i = 0; i < vertexCount; i++) {
+        Vector3 p;
+        p.x = positions[i * 3];
+        p.y = positions[i * 3 + 1];
+        p.z = positions[i * 3 + 2];
+        sphere.radius = fmaxf(sphere.radius, Vector3Distance(p, sphere.center));
+    }
+    return sphere;
+}
+
+BoundingSphere GLPractice::transformSphere(const BoundingSphere& sphere,
+        const Vector3& scale, const Quaternion& rotation, const Vector3& translation) {
+    BoundingSphere result;
+    result.center = Vector3RotateByQuaternion(Vector3MultiplyV(sphere.center, scale), rotation);
+    result.center = Vector3Add(result.center, translation);
+
+    float maxScale = fmaxf(fabsf(scale.x), fmaxf(fabsf(scale.y), fabsf(scale.z)));
+    result.radius = sphere.radius * maxScale;
+    return result;
+}
+
+BoundingBox GLPractice::transformBox(const BoundingBox& box,
+        const Vector3& scale, const Quaternion& rotation, const Vector3& translation) {
+    Vector3 center = Vector3Multiply(Vector3Add(box.min, box.max), 0.5f);
+    Vector3 extents = Vector3Multiply(Vector3Subtract(box.max, box.min), 0.5f);
+    center = Vector3Add(Vector3RotateByQuaternion(Vector3MultiplyV(center, scale), rotation), translation);
+    extents = Vector3MultiplyV(extents, scale);
+
+    // the rotated axes, each one adds its share of the extents
+    Vector3 axisX = Vector3RotateByQuaternion(Vector3{ fabsf(extents.x), 0.0f, 0.0f }, rotation);
+    Vector3 axisY = Vector3RotateByQuaternion(Vector3{ 0.0f, fabsf(extents.y), 0.0f }, rotation);
+    Vector3 axisZ = Vector3RotateByQuaternion(Vector3{ 0.0f, 0.0f, fabsf(extents.z) }, rotation);
+    Vector3 worldExtents;
+    worldExtents.x = fabsf(axisX.x) + fabsf(axisY.x) + fabsf(axisZ.x);
+    worldExtents.y = fabsf(axisX.y) + fabsf(axisY.y) + fabsf(axisZ.y);
+    worldExtents.z = fabsf(axisX.z) + fabsf(axisY.z) + fabsf(axisZ.z);
+
+    BoundingBox result;
+    result.min = Vector3Subtract(center, worldExtents);
+    result.max = Vector3Add(center, worldExtents);
+    return result;
+}
+
+BoundingBox GLPractice::mergeBoxes(const BoundingBox& a, const BoundingBox& b) {
+    BoundingBox result;
+    result.min = Vector3Min(a.min, b.min);
+    result.max = Vector3Max(a.max, b.max);
+    return result;
+}
+
+unsigned GLPractice::cullSpheresScalar(const Frustum& frustum, const SphereArray& spheres, uint32_t* visible) {
+    unsigned count = 0;
+    for(unsigned i = 0; i < spheres.size(); i++) {
+        // written every time and kept only when visible, avoiding a branch
+        visible[count] = i;
+        count += frustum.intersects(spheres.get(i)) ? 1 : 0;
+    }
+    return count;
+}
+
+unsigned GLPractice::cullSpheres(const Frustum& frustum, const SphereArray& spheres, uint32_t* visible) {
+    const float* xs = spheres.x.data();
+    const float* ys = spheres.y.data();
+    const float* zs = spheres.z.data();
+    const float* rs = spheres.radius.data();
+    unsigned size = spheres.size();
+    unsigned count = 0;
+    unsigned i = 0;
+
+#if defined(__AVX__)
+    for(; i + 8 <= size; i += 8) {
+        __m256 x = _mm256_loadu_ps(xs + i);
+        __m256 y = _mm256_loadu_ps(ys + i);
+        __m256 z = _mm256_loadu_ps(zs + i);
+        __m256 negRadius = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(rs + i));
+
+        __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        for(unsigned p = 0; p < Frustum::PLANE_COUNT; p++) {
+            const Plane& plane = frustum.planes[p];
+            __m256 distance = _mm256_add_ps(
+                    _mm256_add_ps(_mm256_mul_ps(x, _mm256_set1_ps(plane.normal.x)),
+                        _mm256_mul_ps(y, _mm256_set1_ps(plane.normal.y))),
+                    _mm256_add_ps(_mm256_mul_ps(z, _mm256_set1_ps(plane.normal.z)),
+                        _mm256_set1_ps(plane.distance)));
+            inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, negRadius, _CMP_GE_OQ));
+        }
+
+        unsigned mask = _mm256_movemask_ps(inside);
+        for(unsigned lane = 0; lane < 8; lane++) {
+            visible[count] = i + lane;
+            count += (mask >> lane) & 1;
+        }
+    }
+#elif defined(__SSE2__)
+    for(; i + 4 <= size; i += 4) {
+        __m128 x = _mm_loadu_ps(xs + i);
+        __m128 y = _mm_loadu_ps(ys + i);
+        __m128 z = _mm_loadu_ps(zs + i);
+        __m128 negRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(rs + i));
+
+        __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for(unsigned p = 0; p < Frustum::PLANE_COUNT; p++) {
+            const Plane& plane = frustum.planes[p];
+            __m128 distance = _mm_add_ps(
+                    _mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(plane.normal.x)),
+                        _mm_mul_ps(y, _mm_set1_ps(plane.normal.y))),
+                    _mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(plane.normal.z)),
+                        _mm_set1_ps(plane.distance)));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, negRadius));
+        }
+
+        unsigned mask = _mm_movemask_ps(inside);
+        for(unsigned lane = 0; lane < 4; lane++) {
+            visible[count] = i + lane;
+            count += (mask >> lane) & 1;
+        }
+    }
+#endif
+
+    // the remaining spheres
+    for(; i < size; i++) {
+        visible[count] = i;
+        count += frustum.intersects(spheres.get(i)) ? 1 : 0;
+    }
+    return count;
+}
@@ -0,0 +1,96 @@
+# ifndef CULLING_H
+# define CULLING_H
+
+#include <stdint.h>
+#include <vector>
+#include "../../thirdparty/raymath.h"
+
+namespace GLPractice {
+
+struct BoundingBox {
+    Vector3 min;
+    Vector3 max;
+};
+
+struct BoundingSphere {
+    Vector3 center;
+    float radius;
+};
+
+// points p with dot(normal, p) + distance >= 0 are on the inner side
+struct Plane {
+    Vector3 normal;
+    float distance;
+};
+
+struct Frustum {
+    public:
+        enum {
+            PLANE_LEFT,
+            PLANE_RIGHT,
+            PLANE_BOTTOM,
+            PLANE_TOP,
+            PLANE_NEAR,
+            PLANE_FAR,
+            PLANE_COUNT
+        };
+
+        Plane planes[PLANE_COUNT];
+
+        // planes of the clip volume of projection * view, in world space
+        static Frustum fromMatrix(const Matrix& viewProjection);
+
+        bool intersects(const BoundingSphere& sphere) const;
+        bool intersects(const BoundingBox& box) const;
+        // the whole box is inside, so its contents need no tests
+        bool contains(const BoundingBox& box) const;
+        // box around the eight corners
+        BoundingBox bounds() const;
+};
+
+// bounding spheres of many objects, one array per component (SoA),
+// so the culling kernel loads several spheres with one instruction
+struct SphereArray {
+    public:
+        std::vector<float> x;
+        std::vector<float> y;
+        std::vector<float> z;
+        std::vector<float> radius;
+
+        unsigned size() const {
+            return radius.size();
+        }
+
+        void resize(unsigned count);
+        void set(unsigned i, const BoundingSphere& sphere);
+        BoundingSphere get(unsigned i) const;
+};
+
+// bounds of points given as xyz float triples
+BoundingBox computeBoundingBox(const float* positions, unsigned vertexCount);
+BoundingSphere computeBoundingSphere(const float* positions, unsigned vertexCount);
+
+// the sphere after scaling, rotating and translating,
+// non-uniform scales grow the radius by the largest axis
+BoundingSphere transformSphere(const BoundingSphere& sphere,
+        const Vector3& scale, const Quaternion& rotation, const Vector3& translation);
+
+// box around the transformed box, translation plus the
+// absolute rotation and scale applied to the half extents
+BoundingBox transformBox(const BoundingBox& box,
+        const Vector3& scale, const Quaternion& rotation, const Vector3& translation);
+
+// smallest box around both
+BoundingBox mergeBoxes(const BoundingBox& a, const BoundingBox& b);
+
+// write the indices of the spheres intersecting the frustum into visible,
+// which needs room for spheres.size() entries, returns the visible count
+//
+// tests 4 spheres per iteration with SSE, 8 with AVX
+unsigned cullSpheres(const Frustum& frustum, const SphereArray& spheres, uint32_t* visible);
+// one sphere at a time, the reference for cullSpheres()
+unsigned cullSpheresScalar(const Frustum& frustum, const SphereArray& spheres, uint32_t* visible);
+
+} // namespace GLPractice
+
+#endif // CULLING_H
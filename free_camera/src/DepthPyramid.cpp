@@ -0,0 +1,152 @@
+#include "common.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+using namespace GLPractice;
+
+// threads of a workgroup in depthPyramid.comp, along x and y
+#define REDUCE_GROUP_SIZE 8
+
+static unsigned previousPowerOfTwo(unsigned value) {
+    unsigned result = 1;
+    while(result * 2 <= value)
+        result *= 2;
+    return result;
+}
+
+static GLuint createTexture(GLenum internalFormat, unsigned width, unsigned height, unsigned levelCount,
+        GLenum minFilter) {
+    GLuint texture;
+    glGenTextures(1, &texture);
+    GLStateCache::get().bindTexture(0, GL_TEXTURE_2D, texture);
+    glTexStorage2D(GL_TEXTURE_2D, levelCount, internalFormat, width, height);
+    // only read with texelFetch, but a level above 0 is
+    // undefined without a mipmap filter
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, minFilter);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    return texture;
+}
+
+DepthPyramid::DepthPyramid(GLProgram* reduceProgram):
+    _reduceProgram(reduceProgram),
+    _sourceLevelLocation(-1),
+    _framebufferWidth(0),
+    _framebufferHeight(0),
+    _width(0),
+    _height(0),
+    _levelCount(0),
+    _viewProjection(MatrixIdentity()),
+    _valid(false)
+{
+    if(!_reduceProgram)
+        throw std::runtime_error("reduceProgram is null in DepthPyramid constructor");
+
+    if(!GLCaps::get().computeShader)
+        throw std::runtime_error("DepthPyramid needs compute shaders of OpenGL 4.3");
+
+    _sourceLevelLocation = _reduceProgram->GetUniformLocation("sourceLevel");
+}
+
+void DepthPyramid::unload() {
+    _depthFramebuffer.reset();
+    _depthTexture.reset();
+    _pyramidTexture.reset();
+    _framebufferWidth = 0;
+    _framebufferHeight = 0;
+    _valid = false;
+}
+
+void DepthPyramid::resize(unsigned framebufferWidth, unsigned framebufferHeight) {
+    unload();
+
+    // the depth copy has the format of the default framebuffer,
+    // glBlitFramebuffer does not convert depth formats
+    _depthTexture.reset(createTexture(GL_DEPTH24_STENCIL8, framebufferWidth, framebufferHeight, 1, GL_NEAREST));
+
+    GLuint framebuffer;
+    glGenFramebuffers(1, &framebuffer);
+    _depthFramebuffer.reset(framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, _depthTexture.get(), 0);
+    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    if(status != GL_FRAMEBUFFER_COMPLETE)
+        throw std::runtime_error("depth copy framebuffer of DepthPyramid is incomplete");
+
+    _width = previousPowerOfTwo(framebufferWidth);
+    _height = previousPowerOfTwo(framebufferHeight);
+    _levelCount = 1;
+    for(unsigned size = std::max(_width, _height); size > 1; size /= 2)
+        _levelCount++;
+    _pyramidTexture.reset(createTexture(GL_R32F, _width, _height, _levelCount, GL_NEAREST_MIPMAP_NEAREST));
+
+    _framebufferWidth = framebufferWidth;
+    _framebufferHeight = framebufferHeight;
+}
+
+void DepthPyramid::capture(unsigned framebufferWidth, unsigned framebufferHeight, const Matrix& viewProjection) {
+    if(framebufferWidth == 0 || framebufferHeight == 0) {
+        _valid = false;
+        return;
+    }
+    if(framebufferWidth != _framebufferWidth || framebufferHeight != _framebufferHeight)
+        resize(framebufferWidth, framebufferHeight);
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, _depthFramebuffer.get());
+    glBlitFramebuffer(0, 0, framebufferWidth, framebufferHeight, 0, 0, framebufferWidth, framebufferHeight,
+            GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    GLStateCache& state = GLStateCache::get();
+    state.useProgram(_reduceProgram->getObjectId());
+
+    // level 0 reads the depth copy, every other level the one above it
+    unsigned width = _width;
+    unsigned height = _height;
+    for(unsigned level = 0; level < _levelCount; level++) {
+        if(level == 0) {
+            state.bindTexture(0, GL_TEXTURE_2D, _depthTexture.get());
+            glUniform1i(_sourceLevelLocation, 0);
+        }
+        else {
+            state.bindTexture(0, GL_TEXTURE_2D, _pyramidTexture.get());
+            glUniform1i(_sourceLevelLocation, level - 1);
+        }
+        glBindImageTexture(0, _pyramidTexture.get(), level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+
+        glDispatchCompute((width + REDUCE_GROUP_SIZE - 1) / REDUCE_GROUP_SIZE,
+                (height + REDUCE_GROUP_SIZE - 1) / REDUCE_GROUP_SIZE, 1);
+        // the next level and the culling pass fetch what was stored
+        glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+
+        width = std::max(width / 2, 1u);
+        height = std::max(height / 2, 1u);
+    }
+
+    _viewProjection = viewProjection;
+    _valid = true;
+}
+
+void DepthPyramid::invalidate() {
+    _valid = false;
+}
+
+bool DepthPyramid::isValid() const {
+    return _valid;
+}
+
+GLuint DepthPyramid::texture() const {
+    return _pyramidTexture.get();
+}
+
+unsigned DepthPyramid::levelCount() const {
+    return _levelCount;
+}
+
+const Matrix& DepthPyramid::viewProjection() const {
+    return _viewProjection;
+}
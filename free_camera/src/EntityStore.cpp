@@ -0,0 +1,52 @@
+#include "EntityStore.h"
+
+using namespace GLPractice;
+
+const uint32_t ComponentPoolBase::NO_INDEX;
+const uint32_t EntityStore::NO_ENTITY;
+
+unsigned GLPractice::nextComponentType() {
+    static unsigned typeCount = 0;
+    return typeCount++;
+}
+
+EntityStore::EntityStore():
+    _entityCount(0)
+{ }
+
+uint32_t EntityStore::create() {
+    uint32_t entity;
+    if(!_freeEntities.empty()) {
+        entity = _freeEntities.back();
+        _freeEntities.pop_back();
+    }
+    else {
+        entity = _alive.size();
+        _alive.push_back(0);
+    }
+
+    _alive[entity] = 1;
+    _entityCount++;
+    return entity;
+}
+
+void EntityStore::destroy(uint32_t entity) {
+    if(!isAlive(entity))
+        return;
+
+    for(std::unique_ptr<ComponentPoolBase>& components : _pools) {
+        if(components)
+            components->remove(entity);
+    }
+    _alive[entity] = 0;
+    _freeEntities.push_back(entity);
+    _entityCount--;
+}
+
+bool EntityStore::isAlive(uint32_t entity) const {
+    return entity < _alive.size() && _alive[entity];
+}
+
+unsigned EntityStore::entityCount() const {
+    return _entityCount;
+}
@@ -0,0 +1,196 @@
+# ifndef ENTITY_STORE_H
+# define ENTITY_STORE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <memory>
+#include <stdexcept>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+namespace GLPractice {
+
+// entities of one component type, kept as a sparse set: the components are
+// packed in one array in the order they were added, with the entity of each
+// next to it and the position of each entity in a sparse array.
+// removing moves the last component into the hole
+class ComponentPoolBase {
+    public:
+        virtual ~ComponentPoolBase() { }
+
+        unsigned size() const { return _entities.size(); }
+
+        bool has(uint32_t entity) const {
+            return entity < _indices.size() && _indices[entity] != NO_INDEX;
+        }
+
+        // position of the component of an entity that has one
+        uint32_t indexOf(uint32_t entity) const { return _indices[entity]; }
+
+        // owner of each component, in the order of the components
+        const std::vector<uint32_t>& entities() const { return _entities; }
+
+        virtual void remove(uint32_t entity) = 0;
+
+    protected:
+        static const uint32_t NO_INDEX = 0xffffffffu;
+
+        // the new position at the end
+        uint32_t insert(uint32_t entity) {
+            if(entity >= _indices.size())
+                _indices.resize(entity + 1, NO_INDEX);
+            _indices[entity] = _entities.size();
+            _entities.push_back(entity);
+            return _indices[entity];
+        }
+
+        // the last entity takes the position of the removed one
+        void erase(uint32_t entity) {
+            uint32_t index = _indices[entity];
+            uint32_t last = _entities.back();
+            _entities[index] = last;
+            _indices[last] = index;
+            _entities.pop_back();
+            _indices[entity] = NO_INDEX;
+        }
+
+        std::vector<uint32_t> _indices;
+        std::vector<uint32_t> _entities;
+};
+
+template<typename T>
+class ComponentPool: public ComponentPoolBase {
+    public:
+        // replaces the component if the entity already has one
+        T& add(uint32_t entity, const T& component) {
+            if(has(entity))
+                return _components[_indices[entity]] = component;
+            insert(entity);
+            _components.push_back(component);
+            return _components.back();
+        }
+
+        void remove(uint32_t entity) override {
+            if(!has(entity))
+                return;
+            _components[_indices[entity]] = std::move(_components.back());
+            _components.pop_back();
+            erase(entity);
+        }
+
+        // the entity must have the component
+        T& get(uint32_t entity) { return _components[_indices[entity]]; }
+        const T& get(uint32_t entity) const { return _components[_indices[entity]]; }
+
+        // all components, in the order of entities()
+        T* data() { return _components.data(); }
+        const T* data() const { return _components.data(); }
+
+    private:
+        std::vector<T> _components;
+};
+
+// a number for each component type, counting from 0 in the order the types are first used
+unsigned nextComponentType();
+
+template<typename T>
+unsigned componentType() {
+    static const unsigned type = nextComponentType();
+    return type;
+}
+
+// entities are ids with any set of components, each type stored in its
+// own ComponentPool, so a system streams through the arrays of the types
+// it needs and never touches the others. ids of destroyed entities are
+// reused
+class EntityStore {
+    public:
+        static const uint32_t NO_ENTITY = 0xffffffffu;
+
+        EntityStore();
+
+        uint32_t create();
+        // removes all components of the entity
+        void destroy(uint32_t entity);
+        bool isAlive(uint32_t entity) const;
+        unsigned entityCount() const;
+
+        // replaces the component if the entity already has one,
+        // throws if the entity was destroyed
+        template<typename T>
+        T& add(uint32_t entity, const T& component = T()) {
+            if(!isAlive(entity))
+                throw std::runtime_error("component added to a destroyed entity");
+            return pool<T>().add(entity, component);
+        }
+
+        template<typename T>
+        void remove(uint32_t entity) {
+            pool<T>().remove(entity);
+        }
+
+        template<typename T>
+        bool has(uint32_t entity) const {
+            const ComponentPool<T>* components = findPool<T>();
+            return components && components->has(entity);
+        }
+
+        // the entity must have the component
+        template<typename T>
+        T& get(uint32_t entity) {
+            return pool<T>().get(entity);
+        }
+
+        template<typename T>
+        ComponentPool<T>& pool() {
+            unsigned type = componentType<T>();
+            if(type >= _pools.size())
+                _pools.resize(type + 1);
+            if(!_pools[type])
+                _pools[type].reset(new ComponentPool<T>());
+            return static_cast<ComponentPool<T>&>(*_pools[type]);
+        }
+
+        // calls func(entity, components...) for every entity having all the
+        // given components, walking the smallest of their pools.
+        // components may be changed but none added or removed meanwhile
+        template<typename... Components, typename Func>
+        void each(Func func) {
+            std::tuple<ComponentPool<Components>*...> typed(&pool<Components>()...);
+            ComponentPoolBase* pools[] = { std::get<ComponentPool<Components>*>(typed)... };
+            ComponentPoolBase* smallest = pools[0];
+            for(ComponentPoolBase* components : pools) {
+                if(components->size() < smallest->size())
+                    smallest = components;
+            }
+
+            const std::vector<uint32_t>& entities = smallest->entities();
+            for(unsigned i = 0; i < entities.size(); i++) {
+                uint32_t entity = entities[i];
+                bool matches = true;
+                for(ComponentPoolBase* components : pools)
+                    matches = matches && components->has(entity);
+                if(matches)
+                    func(entity, std::get<ComponentPool<Components>*>(typed)->get(entity)...);
+            }
+        }
+
+    private:
+        template<typename T>
+        const ComponentPool<T>* findPool() const {
+            unsigned type = componentType<T>();
+            if(type >= _pools.size())
+                return NULL;
+            return static_cast<const ComponentPool<T>*>(_pools[type].get());
+        }
+
+        std::vector<std::unique_ptr<ComponentPoolBase> > _pools;
+        std::vector<uint8_t> _alive;
+        std::vector<uint32_t> _freeEntities;
+        unsigned _entityCount;
+};
+
+} // namespace GLPractice
+
+#endif // ENTITY_STORE_H
@@ -0,0 +1,48 @@
+#include "FrameArena.h"
+
+#include <stdint.h>
+#include <algorithm>
+#include <cstddef>
+#include <stdexcept>
+
+using namespace GLPractice;
+
+// the block itself is aligned for any type
+static const size_t BLOCK_ALIGNMENT = alignof(std::max_align_t);
+
+FrameArena::FrameArena(size_t capacity):
+    _memory(new char[capacity + BLOCK_ALIGNMENT]),
+    _capacity(capacity),
+    _offset(0),
+    _highWater(0)
+{ }
+
+void* FrameArena::allocate(size_t size, size_t alignment) {
+    uintptr_t base = ((uintptr_t) _memory.get() + BLOCK_ALIGNMENT - 1) & ~(uintptr_t) (BLOCK_ALIGNMENT - 1);
+    size_t offset = _offset.load(std::memory_order_relaxed);
+    size_t start;
+    do {
+        start = (offset + alignment - 1) & ~(alignment - 1);
+        if(start + size > _capacity)
+            throw std::runtime_error("frame arena is full");
+    } while(!_offset.compare_exchange_weak(offset, start + size, std::memory_order_relaxed));
+
+    return (void*) (base + start);
+}
+
+void FrameArena::reset() {
+    _highWater = std::max(_highWater, _offset.load());
+    _offset.store(0);
+}
+
+size_t FrameArena::used() const {
+    return _offset.load();
+}
+
+size_t FrameArena::highWater() const {
+    return std::max(_highWater, _offset.load());
+}
+
+size_t FrameArena::capacity() const {
+    return _capacity;
+}
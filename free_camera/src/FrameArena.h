@@ -0,0 +1,45 @@
+# ifndef FRAME_ARENA_H
+# define FRAME_ARENA_H
+
+#include <stddef.h>
+#include <atomic>
+#include <memory>
+
+namespace GLPractice {
+
+// memory for the data of a single frame: allocating moves an offset into a
+// block taken once, reset() at the start of a frame frees everything at
+// once. any thread can allocate, nothing is constructed or destructed, so
+// only use it for plain data
+class FrameArena {
+    public:
+        explicit FrameArena(size_t capacity);
+
+        // throws when the frame needs more than the capacity
+        void* allocate(size_t size, size_t alignment);
+        template<typename T>
+        T* allocate(size_t count) {
+            return static_cast<T*>(allocate(count * sizeof(T), alignof(T)));
+        }
+
+        // only once no thread uses the memory of the last frame any more
+        void reset();
+
+        size_t used() const;
+        // the most used by a frame since the arena was created
+        size_t highWater() const;
+        size_t capacity() const;
+
+        FrameArena(const FrameArena&) = delete;
+        FrameArena& operator=(const FrameArena&) = delete;
+
+    private:
+        std::unique_ptr<char[]> _memory;
+        size_t _capacity;
+        std::atomic<size_t> _offset;
+        size_t _highWater;
+};
+
+} // namespace GLPractice
+
+#endif // FRAME_ARENA_H
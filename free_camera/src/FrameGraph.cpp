@@ -0,0 +1,200 @@
+#include "FrameGraph.h"
+
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+
+using namespace GLPractice;
+
+typedef std::chrono::steady_clock Clock;
+
+static double elapsedMs(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+FrameGraph::FrameGraph():
+    _jobs(NULL),
+    _doneCount(0),
+    _frameMs(0.0),
+    _totalFrameMs(0.0),
+    _frameCount(0)
+{ }
+
+unsigned FrameGraph::addTask(const std::string& name, const std::function<void()>& function,
+        const std::vector<std::string>& reads, const std::vector<std::string>& writes,
+        bool mainThread) {
+    unsigned task = _tasks.size();
+    Task added;
+    added.name = name;
+    added.function = function;
+    added.mainThread = mainThread;
+    added.enabled = true;
+    added.depth = 0;
+    added.ms = 0.0;
+    added.totalMs = 0.0;
+    _tasks.push_back(added);
+
+    // reading waits for the last writer
+    for(const std::string& read : reads) {
+        unsigned resource = findResource(read);
+        if(_resources[resource].lastWriter >= 0)
+            addDependency(task, _resources[resource].lastWriter);
+        _resources[resource].readers.push_back(task);
+    }
+
+    // writing waits for the last writer and everyone reading since
+    for(const std::string& write : writes) {
+        unsigned resource = findResource(write);
+        if(_resources[resource].lastWriter >= 0)
+            addDependency(task, _resources[resource].lastWriter);
+        for(unsigned reader : _resources[resource].readers) {
+            if(reader != task)
+                addDependency(task, reader);
+        }
+        _resources[resource].lastWriter = task;
+        _resources[resource].readers.clear();
+    }
+
+    _remaining.reset(new std::atomic<unsigned>[_tasks.size()]);
+    return task;
+}
+
+unsigned FrameGraph::findResource(const std::string& name) {
+    for(unsigned i = 0; i < _resources.size(); i++) {
+        if(_resources[i].name == name)
+            return i;
+    }
+
+    Resource resource;
+    resource.name = name;
+    resource.lastWriter = -1;
+    _resources.push_back(resource);
+    return _resources.size() - 1;
+}
+
+void FrameGraph::addDependency(unsigned task, unsigned dependency) {
+    std::vector<unsigned>& dependencies = _tasks[task].dependencies;
+    if(std::find(dependencies.begin(), dependencies.end(), dependency) != dependencies.end())
+        return;
+
+    dependencies.push_back(dependency);
+    _tasks[dependency].dependents.push_back(task);
+    _tasks[task].depth = std::max(_tasks[task].depth, _tasks[dependency].depth + 1);
+}
+
+void FrameGraph::setEnabled(unsigned task, bool enabled) {
+    _tasks[task].enabled = enabled;
+}
+
+unsigned FrameGraph::findTask(const std::string& name) const {
+    for(unsigned i = 0; i < _tasks.size(); i++) {
+        if(_tasks[i].name == name)
+            return i;
+    }
+    throw std::runtime_error("no task named " + name + " in the FrameGraph");
+}
+
+void FrameGraph::execute(JobSystem& jobs) {
+    Clock::time_point start = Clock::now();
+    _jobs = &jobs;
+    _doneCount = 0;
+    _mainReady.clear();
+
+    // a task is added after all it depends on, so counting its
+    // dependencies down schedules the tasks in a topological order
+    for(unsigned i = 0; i < _tasks.size(); i++) {
+        _remaining[i] = _tasks[i].dependencies.size();
+        _tasks[i].ms = 0.0;
+    }
+    for(unsigned i = 0; i < _tasks.size(); i++) {
+        if(_tasks[i].dependencies.empty())
+            schedule(i);
+    }
+
+    // the main thread tasks run here, in between the jobs of the others
+    while(_doneCount.load() < _tasks.size()) {
+        int task = -1;
+        {
+            std::lock_guard<std::mutex> lock(_mainMutex);
+            if(!_mainReady.empty()) {
+                task = _mainReady.back();
+                _mainReady.pop_back();
+            }
+        }
+
+        if(task >= 0)
+            runTask(task);
+        else if(!jobs.runPending())
+            std::this_thread::yield();
+    }
+
+    for(Task& task : _tasks)
+        task.totalMs += task.ms;
+    _frameMs = elapsedMs(start);
+    _totalFrameMs += _frameMs;
+    _frameCount++;
+}
+
+void FrameGraph::schedule(unsigned task) {
+    if(_tasks[task].mainThread) {
+        std::lock_guard<std::mutex> lock(_mainMutex);
+        _mainReady.push_back(task);
+        return;
+    }
+    _jobs->run([this, task]() { runTask(task); });
+}
+
+void FrameGraph::runTask(unsigned task) {
+    Task& running = _tasks[task];
+    if(running.enabled) {
+        Clock::time_point start = Clock::now();
+        running.function();
+        running.ms = elapsedMs(start);
+    }
+
+    for(unsigned dependent : running.dependents) {
+        if(--_remaining[dependent] == 0)
+            schedule(dependent);
+    }
+    _doneCount++;
+}
+
+unsigned FrameGraph::taskCount() const {
+    return _tasks.size();
+}
+
+const std::string& FrameGraph::taskName(unsigned task) const {
+    return _tasks[task].name;
+}
+
+const std::vector<unsigned>& FrameGraph::dependencies(unsigned task) const {
+    return _tasks[task].dependencies;
+}
+
+unsigned FrameGraph::depth(unsigned task) const {
+    return _tasks[task].depth;
+}
+
+double FrameGraph::taskMs(unsigned task) const {
+    return _tasks[task].ms;
+}
+
+double FrameGraph::frameMs() const {
+    return _frameMs;
+}
+
+double FrameGraph::averageTaskMs(unsigned task) const {
+    return _frameCount > 0 ? _tasks[task].totalMs / _frameCount : 0.0;
+}
+
+double FrameGraph::averageFrameMs() const {
+    return _frameCount > 0 ? _totalFrameMs / _frameCount : 0.0;
+}
+
+void FrameGraph::resetTimings() {
+    for(Task& task : _tasks)
+        task.totalMs = 0.0;
+    _totalFrameMs = 0.0;
+    _frameCount = 0;
+}
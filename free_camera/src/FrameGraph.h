@@ -0,0 +1,95 @@
+# ifndef FRAME_GRAPH_H
+# define FRAME_GRAPH_H
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "JobSystem.h"
+
+namespace GLPractice {
+
+// the work of a frame as named tasks, each declaring the resources it reads
+// and writes. a task runs after the tasks added before it that write what
+// it reads, or read or write what it writes, so tasks touching different
+// data run at the same time on the workers of a JobSystem. tasks making GL
+// calls are marked to run on the thread calling execute()
+class FrameGraph {
+    public:
+        FrameGraph();
+
+        // resources are any names the tasks agree on, returns the task id
+        unsigned addTask(const std::string& name, const std::function<void()>& function,
+                const std::vector<std::string>& reads, const std::vector<std::string>& writes,
+                bool mainThread = false);
+        // skipped tasks still keep the order of the ones around them
+        void setEnabled(unsigned task, bool enabled);
+        // throws if there is no task of that name
+        unsigned findTask(const std::string& name) const;
+
+        // runs every enabled task once, returning when all are done
+        void execute(JobSystem& jobs);
+
+        unsigned taskCount() const;
+        const std::string& taskName(unsigned task) const;
+        // tasks it waits on, directly
+        const std::vector<unsigned>& dependencies(unsigned task) const;
+        // length of the longest chain of tasks before it
+        unsigned depth(unsigned task) const;
+
+        // of the last execute(), 0 for skipped tasks
+        double taskMs(unsigned task) const;
+        double frameMs() const;
+        // since the last resetTimings()
+        double averageTaskMs(unsigned task) const;
+        double averageFrameMs() const;
+        void resetTimings();
+
+        FrameGraph(const FrameGraph&) = delete;
+        FrameGraph& operator=(const FrameGraph&) = delete;
+
+    private:
+        struct Task {
+            std::string name;
+            std::function<void()> function;
+            bool mainThread;
+            bool enabled;
+            std::vector<unsigned> dependencies;
+            std::vector<unsigned> dependents;
+            unsigned depth;
+            double ms;
+            double totalMs;
+        };
+
+        // the tasks since the last writer of a resource
+        struct Resource {
+            std::string name;
+            int lastWriter;
+            std::vector<unsigned> readers;
+        };
+
+        unsigned findResource(const std::string& name);
+        void addDependency(unsigned task, unsigned dependency);
+        void schedule(unsigned task);
+        void runTask(unsigned task);
+
+        std::vector<Task> _tasks;
+        std::vector<Resource> _resources;
+
+        // state of execute()
+        JobSystem* _jobs;
+        std::unique_ptr<std::atomic<unsigned>[]> _remaining;
+        std::atomic<unsigned> _doneCount;
+        std::mutex _mainMutex;
+        std::vector<unsigned> _mainReady;
+
+        double _frameMs;
+        double _totalFrameMs;
+        unsigned _frameCount;
+};
+
+} // namespace GLPractice
+
+#endif // FRAME_GRAPH_H
@@ -0,0 +1,134 @@
+#include "common.h"
+
+using namespace GLPractice;
+
+// buffers are edited through this target on the bind path,
+// it is not used for drawing, so no VAO or vertex attrib is affected
+#define EDIT_BUFFER_TARGET GL_COPY_WRITE_BUFFER
+
+GLuint GLPractice::createBuffer() {
+    GLuint buffer;
+    if(GLCaps::get().directStateAccess)
+        glCreateBuffers(1, &buffer);
+    else
+        glGenBuffers(1, &buffer);
+    return buffer;
+}
+
+GLuint GLPractice::createVertexArray() {
+    GLuint vao;
+    if(GLCaps::get().directStateAccess)
+        glCreateVertexArrays(1, &vao);
+    else
+        glGenVertexArrays(1, &vao);
+    return vao;
+}
+
+void GLPractice::setBufferData(GLuint buffer, GLsizeiptr size, const void* data, GLenum usage) {
+    if(GLCaps::get().directStateAccess) {
+        glNamedBufferData(buffer, size, data, usage);
+        return;
+    }
+
+    GLStateCache::get().bindBuffer(EDIT_BUFFER_TARGET, buffer);
+    glBufferData(EDIT_BUFFER_TARGET, size, data, usage);
+}
+
+void GLPractice::setBufferSubData(GLuint buffer, GLintptr offset, GLsizeiptr size, const void* data) {
+    if(GLCaps::get().directStateAccess) {
+        glNamedBufferSubData(buffer, offset, size, data);
+        return;
+    }
+
+    GLStateCache::get().bindBuffer(EDIT_BUFFER_TARGET, buffer);
+    glBufferSubData(EDIT_BUFFER_TARGET, offset, size, data);
+}
+
+void GLPractice::setBufferStorage(GLuint buffer, GLsizeiptr size, const void* data, GLbitfield flags) {
+    if(GLCaps::get().directStateAccess) {
+        glNamedBufferStorage(buffer, size, data, flags);
+        return;
+    }
+
+    GLStateCache::get().bindBuffer(EDIT_BUFFER_TARGET, buffer);
+    glBufferStorage(EDIT_BUFFER_TARGET, size, data, flags);
+}
+
+void GLPractice::copyBufferSubData(GLuint source, GLuint destination, GLintptr sourceOffset,
+        GLintptr destinationOffset, GLsizeiptr size) {
+    if(GLCaps::get().directStateAccess) {
+        glCopyNamedBufferSubData(source, destination, sourceOffset, destinationOffset, size);
+        return;
+    }
+
+    GLStateCache& state = GLStateCache::get();
+    state.bindBuffer(GL_COPY_READ_BUFFER, source);
+    state.bindBuffer(EDIT_BUFFER_TARGET, destination);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, EDIT_BUFFER_TARGET, sourceOffset, destinationOffset, size);
+}
+
+void* GLPractice::mapBufferRange(GLuint buffer, GLintptr offset, GLsizeiptr length, GLbitfield access) {
+    if(GLCaps::get().directStateAccess)
+        return glMapNamedBufferRange(buffer, offset, length, access);
+
+    GLStateCache::get().bindBuffer(EDIT_BUFFER_TARGET, buffer);
+    return glMapBufferRange(EDIT_BUFFER_TARGET, offset, length, access);
+}
+
+void GLPractice::unmapBuffer(GLuint buffer) {
+    if(GLCaps::get().directStateAccess) {
+        glUnmapNamedBuffer(buffer);
+        return;
+    }
+
+    GLStateCache::get().bindBuffer(EDIT_BUFFER_TARGET, buffer);
+    glUnmapBuffer(EDIT_BUFFER_TARGET);
+}
+
+void GLPractice::setElementBuffer(GLuint vao, GLuint buffer) {
+    if(GLCaps::get().directStateAccess) {
+        glVertexArrayElementBuffer(vao, buffer);
+        return;
+    }
+
+    GLStateCache& state = GLStateCache::get();
+    state.bindVertexArray(vao);
+    state.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffer);
+}
+
+void GLPractice::setVertexAttrib(GLuint vao, GLuint location, GLuint buffer,
+        GLint components, GLsizei stride, GLintptr offset, GLuint divisor) {
+    if(GLCaps::get().directStateAccess) {
+        // each attrib gets the buffer binding point of its own location
+        glVertexArrayVertexBuffer(vao, location, buffer, offset, stride);
+        glVertexArrayAttribFormat(vao, location, components, GL_FLOAT, GL_FALSE, 0);
+        glVertexArrayAttribBinding(vao, location, location);
+        glVertexArrayBindingDivisor(vao, location, divisor);
+        return;
+    }
+
+    GLStateCache& state = GLStateCache::get();
+    state.bindVertexArray(vao);
+    state.bindBuffer(GL_ARRAY_BUFFER, buffer);
+    glVertexAttribPointer(location, components, GL_FLOAT, GL_FALSE, stride, (const void*) offset);
+    glVertexAttribDivisor(location, divisor);
+}
+
+void GLPractice::enableVertexAttrib(GLuint vao, GLuint location) {
+    if(GLCaps::get().directStateAccess) {
+        glEnableVertexArrayAttrib(vao, location);
+        return;
+    }
+
+    GLStateCache::get().bindVertexArray(vao);
+    glEnableVertexAttribArray(location);
+}
+
+void GLPractice::setInstanceModelAttrib(GLuint vao, GLuint location, GLuint buffer, GLuint firstInstance) {
+    // a mat4 attrib takes 4 locations, one for each column
+    for(GLuint column = 0; column < 4; column++) {
+        setVertexAttrib(vao, location + column, buffer, 4, sizeof(float16),
+                (firstInstance * 16 + column * 4) * sizeof(GLfloat), 1);
+        enableVertexAttrib(vao, location + column);
+    }
+}
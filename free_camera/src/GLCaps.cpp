@@ -0,0 +1,20 @@
+#include "common.h"
+
+using namespace GLPractice;
+
+static GLCaps s_caps = GLCaps();
+
+void GLCaps::detect() {
+    s_caps.separateShaderObjects = GLEW_VERSION_4_1 || GLEW_ARB_separate_shader_objects;
+    s_caps.baseInstance = GLEW_VERSION_4_2 || GLEW_ARB_base_instance;
+    s_caps.multiDrawIndirect = GLEW_VERSION_4_3 || GLEW_ARB_multi_draw_indirect;
+    s_caps.vertexAttribBinding = GLEW_VERSION_4_3 || GLEW_ARB_vertex_attrib_binding;
+    s_caps.directStateAccess = GLEW_VERSION_4_5 || GLEW_ARB_direct_state_access;
+    s_caps.computeShader = GLEW_VERSION_4_3 ||
+        (GLEW_ARB_compute_shader && GLEW_ARB_shader_storage_buffer_object);
+    s_caps.bufferStorage = GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage;
+}
+
+const GLCaps& GLCaps::get() {
+    return s_caps;
+}
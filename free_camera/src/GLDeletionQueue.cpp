@@ -0,0 +1,146 @@
+#include "common.h"
+
+using namespace GLPractice;
+
+const unsigned GLDeletionQueue::QUEUE_CAPACITY;
+const unsigned GLDeletionQueue::MAX_FRAMES;
+
+// how long endFrame() waits at a time for a fence when
+// the GPU is MAX_FRAMES behind, in nanoseconds
+static const GLuint64 FENCE_WAIT_TIMEOUT = 1000000;
+
+GLDeletionQueue& GLDeletionQueue::get() {
+    static GLDeletionQueue queue;
+    return queue;
+}
+
+GLDeletionQueue::GLDeletionQueue():
+    _queue(QUEUE_CAPACITY),
+    _overflowed(false),
+    _firstFrame(0),
+    _frameCount(0),
+    _deletedCount(0)
+{
+    for(Frame& frame : _frames)
+        frame.fence = 0;
+}
+
+void GLDeletionQueue::enqueue(Type type, GLuint id) {
+    Deletion deletion = { type, id };
+    if(_queue.push(deletion))
+        return;
+
+    std::lock_guard<std::mutex> lock(_overflowMutex);
+    _overflow.push_back(deletion);
+    _overflowed.store(true, std::memory_order_release);
+}
+
+void GLDeletionQueue::collect(std::vector<Deletion>& deletions) {
+    Deletion deletion;
+    while(_queue.pop(deletion))
+        deletions.push_back(deletion);
+
+    if(_overflowed.load(std::memory_order_acquire)) {
+        std::lock_guard<std::mutex> lock(_overflowMutex);
+        deletions.insert(deletions.end(), _overflow.begin(), _overflow.end());
+        _overflow.clear();
+        _overflowed.store(false, std::memory_order_relaxed);
+    }
+}
+
+void GLDeletionQueue::endFrame() {
+    // what the GPU is done with goes first, without waiting
+    while(_frameCount > 0 && retireFrame(false))
+        ;
+
+    // the GPU is too far behind, the oldest frame has to finish
+    // before its slot can take this one
+    if(_frameCount == MAX_FRAMES) {
+        while(!retireFrame(true))
+            ;
+    }
+
+    Frame& frame = _frames[(_firstFrame + _frameCount) % MAX_FRAMES];
+    collect(frame.deletions);
+    if(frame.deletions.empty())
+        return;
+
+    frame.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    _frameCount++;
+}
+
+bool GLDeletionQueue::retireFrame(bool wait) {
+    Frame& frame = _frames[_firstFrame];
+    GLenum result = glClientWaitSync(frame.fence, wait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0,
+            wait ? FENCE_WAIT_TIMEOUT : 0);
+    if(result == GL_TIMEOUT_EXPIRED)
+        return false;
+
+    // a failed wait would fail again, the objects are deleted anyway
+    glDeleteSync(frame.fence);
+    frame.fence = 0;
+    deleteObjects(frame.deletions);
+    _firstFrame = (_firstFrame + 1) % MAX_FRAMES;
+    _frameCount--;
+    return true;
+}
+
+void GLDeletionQueue::flush() {
+    while(_frameCount > 0)
+        retireFrame(true);
+
+    collect(_flushDeletions);
+    if(_flushDeletions.empty())
+        return;
+    glFinish();
+    deleteObjects(_flushDeletions);
+}
+
+void GLDeletionQueue::deleteObjects(std::vector<Deletion>& deletions) {
+    GLStateCache& state = GLStateCache::get();
+    for(const Deletion& deletion : deletions) {
+        GLuint id = deletion.id;
+        switch(deletion.type) {
+            case SHADER:
+                glDeleteShader(id);
+                break;
+            case PROGRAM:
+                state.forgetProgram(id);
+                glDeleteProgram(id);
+                break;
+            case BUFFER:
+                state.forgetBuffer(id);
+                glDeleteBuffers(1, &id);
+                break;
+            case VERTEX_ARRAY:
+                state.forgetVertexArray(id);
+                glDeleteVertexArrays(1, &id);
+                break;
+            case TEXTURE:
+                state.forgetTexture(id);
+                glDeleteTextures(1, &id);
+                break;
+            case QUERY:
+                glDeleteQueries(1, &id);
+                break;
+            case FRAMEBUFFER:
+                // framebuffer bindings are not cached
+                glDeleteFramebuffers(1, &id);
+                break;
+        }
+    }
+    _deletedCount += deletions.size();
+    // keeps the capacity for the next frame using the slot
+    deletions.clear();
+}
+
+unsigned GLDeletionQueue::pendingCount() const {
+    unsigned count = 0;
+    for(unsigned i = 0; i < _frameCount; i++)
+        count += _frames[(_firstFrame + i) % MAX_FRAMES].deletions.size();
+    return count;
+}
+
+unsigned GLDeletionQueue::deletedCount() const {
+    return _deletedCount;
+}
@@ -8,53 +8,49 @@ GLProgram::GLProgram(const GLuint* shaders, unsigned shaderCount){
     if(!shaders || shaderCount <= 0)
         throw std::runtime_error("no shader provided to create the program");
 
-    _objectId = glCreateProgram();
-    if(_objectId == 0)
+    _object.reset(glCreateProgram());
+    if(!_object)
         throw std::runtime_error("glCreateProgram failed");
 
     for(unsigned i = 0; i < shaderCount; i++){
         if(shaders[i])
-            glAttachShader(_objectId, shaders[i]);
+            glAttachShader(_object.get(), shaders[i]);
     }
 
-    glLinkProgram(_objectId);
-    glValidateProgram(_objectId);
+    glLinkProgram(_object.get());
+    glValidateProgram(_object.get());
 
     for(unsigned i = 0; i < shaderCount; i++){
         if(shaders[i])
-            glDetachShader(_objectId, shaders[i]);
+            glDetachShader(_object.get(), shaders[i]);
     }
 
     // check link error
     GLint status;
-    glGetProgramiv(_objectId, GL_LINK_STATUS, &status);
+    glGetProgramiv(_object.get(), GL_LINK_STATUS, &status);
     if(status == GL_FALSE){
-        std::string msg = "failed to link program: " + std::to_string(_objectId);
+        std::string msg = "failed to link program: " + std::to_string(_object.get());
 
         GLint infoLogLength;
-        glGetProgramiv(_objectId, GL_INFO_LOG_LENGTH, &infoLogLength);
+        glGetProgramiv(_object.get(), GL_INFO_LOG_LENGTH, &infoLogLength);
 
         GLchar infoLog[infoLogLength + 1];
-        glGetProgramInfoLog(_objectId, infoLogLength, NULL, infoLog);
-
-        glDeleteProgram(_objectId);
+        glGetProgramInfoLog(_object.get(), infoLogLength, NULL, infoLog);
 
         msg += "\n";
         msg += infoLog;
         throw std::runtime_error(msg);
     }
     // check validate error
-    glGetProgramiv(_objectId, GL_VALIDATE_STATUS, &status);
+    glGetProgramiv(_object.get(), GL_VALIDATE_STATUS, &status);
     if(status == GL_FALSE){
-        std::string msg = "failed to validate program: " + std::to_string(_objectId);
+        std::string msg = "failed to validate program: " + std::to_string(_object.get());
 
         GLint infoLogLength;
-        glGetProgramiv(_objectId, GL_INFO_LOG_LENGTH, &infoLogLength);
+        glGetProgramiv(_object.get(), GL_INFO_LOG_LENGTH, &infoLogLength);
 
         GLchar infoLog[infoLogLength + 1];
-        glGetProgramInfoLog(_objectId, infoLogLength, NULL, infoLog);
-
-        glDeleteProgram(_objectId);
+        glGetProgramInfoLog(_object.get(), infoLogLength, NULL, infoLog);
 
         msg += "\n";
         msg += infoLog;
@@ -62,20 +58,15 @@ GLProgram::GLProgram(const GLuint* shaders, unsigned shaderCount){
     }
 }
 
-GLProgram::~GLProgram(){
-    if(_objectId != 0)
-        glDeleteProgram(_objectId);
-}
-
 GLuint GLProgram::getObjectId() const {
-    return _objectId;
+    return _object.get();
 }
 
 GLint GLProgram::GetAttribLocation(const GLchar* attribName) const {
     if(!attribName)
         throw std::runtime_error("attribName is null");
 
-    GLint location = glGetAttribLocation(_objectId, attribName);
+    GLint location = glGetAttribLocation(_object.get(), attribName);
 
     if(location < 0)
         throw std::runtime_error("Attrib " + std::string(attribName) +
@@ -88,7 +79,7 @@ GLint GLProgram::GetUniformLocation(const GLchar* uniformName) const {
     if(!uniformName)
         throw std::runtime_error("uniformName is null");
 
-    GLint location = glGetUniformLocation(_objectId, uniformName);
+    GLint location = glGetUniformLocation(_object.get(), uniformName);
 
     if(location < 0)
         throw std::runtime_error("Uniform " + std::string(uniformName) +
@@ -96,3 +87,13 @@ GLint GLProgram::GetUniformLocation(const GLchar* uniformName) const {
 
     return location;
 }
+
+void GLProgram::setUniformMatrix4(GLint location, const GLfloat* value) const {
+    if(GLCaps::get().separateShaderObjects) {
+        glProgramUniformMatrix4fv(_object.get(), location, 1, GL_FALSE, value);
+        return;
+    }
+
+    GLStateCache::get().useProgram(_object.get());
+    glUniformMatrix4fv(location, 1, GL_FALSE, value);
+}
@@ -1,37 +1,36 @@
 #include "common.h"
 #include <stdexcept>
-#include <fstream>
-#include <sstream>
 
 using namespace GLPractice;
 
-GLShader::GLShader(const char* shaderCode, GLenum shaderType) {
+GLShader::GLShader(const char* shaderCode, GLenum shaderType):
+    GLShader(shaderCode, strlen(shaderCode), shaderType)
+{ }
+
+GLShader::GLShader(const char* shaderCode, GLint length, GLenum shaderType) {
     // create shader object
-    _objectId = glCreateShader(shaderType);
-    if(_objectId == 0)
+    _object.reset(glCreateShader(shaderType));
+    if(!_object)
         throw std::runtime_error("glCreateShader failed");
 
     // set shader code
-    GLint length = strlen(shaderCode);
     const GLchar* code = shaderCode;
-    glShaderSource(_objectId, 1, &code, &length);
+    glShaderSource(_object.get(), 1, &code, &length);
 
     // compile shader
-    glCompileShader(_objectId);
+    glCompileShader(_object.get());
 
     // check compile failure
     GLint status;
-    glGetShaderiv(_objectId, GL_COMPILE_STATUS, &status);
+    glGetShaderiv(_object.get(), GL_COMPILE_STATUS, &status);
     if(status == GL_FALSE) {
-        std::string msg = "failed to compile shader: " + std::to_string(_objectId);
+        std::string msg = "failed to compile shader: " + std::to_string(_object.get());
 
         GLint infoLogLength;
-        glGetShaderiv(_objectId, GL_INFO_LOG_LENGTH, &infoLogLength);
+        glGetShaderiv(_object.get(), GL_INFO_LOG_LENGTH, &infoLogLength);
 
         GLchar infoLog[infoLogLength + 1];
-        glGetShaderInfoLog(_objectId, infoLogLength, NULL, infoLog);
-
-        glDeleteShader(_objectId);
+        glGetShaderInfoLog(_object.get(), infoLogLength, NULL, infoLog);
 
         msg += "\n";
         msg += infoLog;
@@ -39,24 +38,26 @@ GLShader::GLShader(const char* shaderCode, GLenum shaderType) {
     }
 }
 
-GLShader::~GLShader(){
-    if(_objectId != 0)
-        glDeleteShader(_objectId);
-}
-
 GLuint GLShader::getObjectId() const {
-    return _objectId;
+    return _object.get();
 }
 
 GLShader GLShader::shaderFromFile(const char* filePath, GLenum shaderType){
-    std::ifstream f;
-    f.open(filePath, std::ios::in | std::ios::binary);
-    if(!f.is_open())
-        throw std::runtime_error(std::string("failed to open file: ") + filePath);
+    // compiled straight from the buffer it was read into
+    std::unique_ptr<GLShader> shader;
+    AssetReader reader(1, SHADER_BUFFER_SIZE);
+    reader.read(filePath, [&shader, shaderType](const AssetReader::File& file) {
+        shader.reset(new GLShader(shaderFromFile(file, shaderType)));
+    });
+    reader.wait();
+    return std::move(*shader);
+}
 
-    std::stringstream buffer;
-    buffer << f.rdbuf();
+GLShader GLShader::shaderFromFile(const AssetReader::File& file, GLenum shaderType) {
+    if(file.error != 0) {
+        throw std::runtime_error(std::string("failed to open file: ") + file.path + ": " +
+                strerror(file.error));
+    }
 
-    GLShader shader(buffer.str().c_str(), shaderType);
-    return shader;
+    return GLShader((const char*) file.data, file.size, shaderType);
 }
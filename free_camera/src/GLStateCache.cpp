@@ -0,0 +1,314 @@
+#include "common.h"
+
+using namespace GLPractice;
+
+// shadow value of a state which has to be set by the next call
+#define UNKNOWN_STATE 0xffffffffu
+
+PipelineState::PipelineState(bool depthTest, bool depthWrite, bool cullFace,
+        bool blend, GLenum blendSrc, GLenum blendDst):
+    _depthTest(depthTest),
+    _depthWrite(depthWrite),
+    _cullFace(cullFace),
+    _blend(blend),
+    _blendSrc(blendSrc),
+    _blendDst(blendDst)
+{ }
+
+PipelineState PipelineState::opaque() {
+    return PipelineState(true, true, true, false, GL_ONE, GL_ZERO);
+}
+
+PipelineState PipelineState::transparent() {
+    return PipelineState(true, false, true, true, GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+}
+
+static int bufferTargetSlot(GLenum target) {
+    switch(target) {
+        case GL_ARRAY_BUFFER:               return 0;
+        case GL_ELEMENT_ARRAY_BUFFER:       return 1;
+        case GL_DRAW_INDIRECT_BUFFER:       return 2;
+        case GL_DISPATCH_INDIRECT_BUFFER:   return 3;
+        case GL_SHADER_STORAGE_BUFFER:      return 4;
+        case GL_UNIFORM_BUFFER:             return 5;
+        case GL_PIXEL_UNPACK_BUFFER:        return 6;
+        case GL_COPY_READ_BUFFER:           return 7;
+        case GL_COPY_WRITE_BUFFER:          return 8;
+        case GL_ATOMIC_COUNTER_BUFFER:      return 9;
+        default:                            return -1;
+    }
+}
+
+// forget the states stored in the bound VAO
+static void forgetVertexArrayStates(GLuint* elementBuffer, GLuint* vertexBuffers, unsigned bindingCount) {
+    *elementBuffer = UNKNOWN_STATE;
+    for(unsigned i = 0; i < bindingCount; i++)
+        vertexBuffers[i] = UNKNOWN_STATE;
+}
+
+static int textureTargetSlot(GLenum target) {
+    switch(target) {
+        case GL_TEXTURE_2D:         return 0;
+        case GL_TEXTURE_2D_ARRAY:   return 1;
+        case GL_TEXTURE_CUBE_MAP:   return 2;
+        case GL_TEXTURE_3D:         return 3;
+        default:                    return -1;
+    }
+}
+
+static int capSlot(GLenum cap) {
+    switch(cap) {
+        case GL_DEPTH_TEST: return 0;
+        case GL_CULL_FACE:  return 1;
+        case GL_BLEND:      return 2;
+        default:            return -1;
+    }
+}
+
+GLStateCache& GLStateCache::get() {
+    static GLStateCache cache;
+    return cache;
+}
+
+GLStateCache::GLStateCache():
+    _issuedCallCount(0),
+    _skippedCallCount(0)
+{
+    // the defaults of a new context
+    _program = 0;
+    _vao = 0;
+    for(unsigned i = 0; i < MAX_BUFFER_TARGETS; i++)
+        _buffers[i] = 0;
+    for(unsigned i = 0; i < MAX_VERTEX_BUFFER_BINDINGS; i++) {
+        _vertexBuffers[i] = 0;
+        _vertexBufferOffsets[i] = 0;
+        _vertexBufferStrides[i] = 0;
+    }
+    _activeTextureUnit = 0;
+    for(unsigned unit = 0; unit < MAX_TEXTURE_UNITS; unit++) {
+        for(unsigned i = 0; i < MAX_TEXTURE_TARGETS; i++)
+            _textures[unit][i] = 0;
+    }
+    for(unsigned i = 0; i < MAX_CAPS; i++)
+        _caps[i] = GL_FALSE;
+    _depthWrite = GL_TRUE;
+    _colorWrite = GL_TRUE;
+    _depthFunc = GL_LESS;
+    _blendSrc = GL_ONE;
+    _blendDst = GL_ZERO;
+}
+
+bool GLStateCache::shouldSet(GLuint& shadow, GLuint value) {
+    if(shadow == value) {
+        _skippedCallCount++;
+        return false;
+    }
+    shadow = value;
+    _issuedCallCount++;
+    return true;
+}
+
+void GLStateCache::useProgram(GLuint program) {
+    if(shouldSet(_program, program))
+        glUseProgram(program);
+}
+
+void GLStateCache::bindVertexArray(GLuint vao) {
+    if(shouldSet(_vao, vao)) {
+        glBindVertexArray(vao);
+        forgetVertexArrayStates(&_buffers[bufferTargetSlot(GL_ELEMENT_ARRAY_BUFFER)],
+                _vertexBuffers, MAX_VERTEX_BUFFER_BINDINGS);
+    }
+}
+
+void GLStateCache::bindBuffer(GLenum target, GLuint buffer) {
+    int slot = bufferTargetSlot(target);
+    if(slot < 0) {
+        _issuedCallCount++;
+        glBindBuffer(target, buffer);
+        return;
+    }
+
+    if(shouldSet(_buffers[slot], buffer))
+        glBindBuffer(target, buffer);
+}
+
+void GLStateCache::bindBufferBase(GLenum target, GLuint index, GLuint buffer) {
+    // indexed bindings are not cached, they are only set when
+    // a compute pass starts, but the generic binding changes too
+    int slot = bufferTargetSlot(target);
+    if(slot >= 0)
+        _buffers[slot] = buffer;
+    _issuedCallCount++;
+    glBindBufferBase(target, index, buffer);
+}
+
+void GLStateCache::bindVertexBuffer(GLuint binding, GLuint buffer, GLintptr offset, GLsizei stride) {
+    if(binding >= MAX_VERTEX_BUFFER_BINDINGS) {
+        _issuedCallCount++;
+        glBindVertexBuffer(binding, buffer, offset, stride);
+        return;
+    }
+
+    if(_vertexBuffers[binding] == buffer &&
+            _vertexBufferOffsets[binding] == offset &&
+            _vertexBufferStrides[binding] == stride) {
+        _skippedCallCount++;
+        return;
+    }
+
+    _vertexBuffers[binding] = buffer;
+    _vertexBufferOffsets[binding] = offset;
+    _vertexBufferStrides[binding] = stride;
+    _issuedCallCount++;
+    glBindVertexBuffer(binding, buffer, offset, stride);
+}
+
+void GLStateCache::bindTexture(GLuint unit, GLenum target, GLuint texture) {
+    int slot = textureTargetSlot(target);
+    if(slot < 0 || unit >= MAX_TEXTURE_UNITS) {
+        _issuedCallCount += 2;
+        _activeTextureUnit = unit;
+        glActiveTexture(GL_TEXTURE0 + unit);
+        glBindTexture(target, texture);
+        return;
+    }
+
+    if(_textures[unit][slot] == texture) {
+        _skippedCallCount++;
+        return;
+    }
+
+    if(shouldSet(_activeTextureUnit, unit))
+        glActiveTexture(GL_TEXTURE0 + unit);
+
+    _textures[unit][slot] = texture;
+    _issuedCallCount++;
+    glBindTexture(target, texture);
+}
+
+void GLStateCache::setEnabled(GLenum cap, bool enabled) {
+    int slot = capSlot(cap);
+    if(slot < 0) {
+        _issuedCallCount++;
+        if(enabled)
+            glEnable(cap);
+        else
+            glDisable(cap);
+        return;
+    }
+
+    if(shouldSet(_caps[slot], enabled ? GL_TRUE : GL_FALSE)) {
+        if(enabled)
+            glEnable(cap);
+        else
+            glDisable(cap);
+    }
+}
+
+void GLStateCache::setDepthWrite(bool enabled) {
+    if(shouldSet(_depthWrite, enabled ? GL_TRUE : GL_FALSE))
+        glDepthMask(enabled ? GL_TRUE : GL_FALSE);
+}
+
+void GLStateCache::setColorWrite(bool enabled) {
+    if(shouldSet(_colorWrite, enabled ? GL_TRUE : GL_FALSE)) {
+        GLboolean mask = enabled ? GL_TRUE : GL_FALSE;
+        glColorMask(mask, mask, mask, mask);
+    }
+}
+
+void GLStateCache::setDepthFunc(GLenum func) {
+    if(shouldSet(_depthFunc, func))
+        glDepthFunc(func);
+}
+
+void GLStateCache::setBlendFunc(GLenum src, GLenum dst) {
+    if(_blendSrc == src && _blendDst == dst) {
+        _skippedCallCount++;
+        return;
+    }
+    _blendSrc = src;
+    _blendDst = dst;
+    _issuedCallCount++;
+    glBlendFunc(src, dst);
+}
+
+void GLStateCache::applyPipelineState(const PipelineState& state) {
+    setEnabled(GL_DEPTH_TEST, state.depthTest());
+    setDepthWrite(state.depthWrite());
+    setEnabled(GL_CULL_FACE, state.cullFace());
+    setEnabled(GL_BLEND, state.blend());
+    // the blend function is kept as it is while blending is off
+    if(state.blend())
+        setBlendFunc(state.blendSrc(), state.blendDst());
+}
+
+void GLStateCache::forgetProgram(GLuint program) {
+    // a deleted program stays in use until another one is used,
+    // the next useProgram() must reach GL in any case
+    if(_program == program)
+        _program = UNKNOWN_STATE;
+}
+
+void GLStateCache::forgetVertexArray(GLuint vao) {
+    if(_vao == vao) {
+        _vao = 0;
+        forgetVertexArrayStates(&_buffers[bufferTargetSlot(GL_ELEMENT_ARRAY_BUFFER)],
+                _vertexBuffers, MAX_VERTEX_BUFFER_BINDINGS);
+    }
+}
+
+void GLStateCache::forgetBuffer(GLuint buffer) {
+    for(unsigned i = 0; i < MAX_BUFFER_TARGETS; i++) {
+        if(_buffers[i] == buffer)
+            _buffers[i] = 0;
+    }
+    for(unsigned i = 0; i < MAX_VERTEX_BUFFER_BINDINGS; i++) {
+        if(_vertexBuffers[i] == buffer)
+            _vertexBuffers[i] = 0;
+    }
+}
+
+void GLStateCache::forgetTexture(GLuint texture) {
+    for(unsigned unit = 0; unit < MAX_TEXTURE_UNITS; unit++) {
+        for(unsigned i = 0; i < MAX_TEXTURE_TARGETS; i++) {
+            if(_textures[unit][i] == texture)
+                _textures[unit][i] = 0;
+        }
+    }
+}
+
+void GLStateCache::invalidate() {
+    _program = UNKNOWN_STATE;
+    _vao = UNKNOWN_STATE;
+    for(unsigned i = 0; i < MAX_BUFFER_TARGETS; i++)
+        _buffers[i] = UNKNOWN_STATE;
+    for(unsigned i = 0; i < MAX_VERTEX_BUFFER_BINDINGS; i++)
+        _vertexBuffers[i] = UNKNOWN_STATE;
+    _activeTextureUnit = UNKNOWN_STATE;
+    for(unsigned unit = 0; unit < MAX_TEXTURE_UNITS; unit++) {
+        for(unsigned i = 0; i < MAX_TEXTURE_TARGETS; i++)
+            _textures[unit][i] = UNKNOWN_STATE;
+    }
+    for(unsigned i = 0; i < MAX_CAPS; i++)
+        _caps[i] = UNKNOWN_STATE;
+    _depthWrite = UNKNOWN_STATE;
+    _colorWrite = UNKNOWN_STATE;
+    _depthFunc = UNKNOWN_STATE;
+    _blendSrc = UNKNOWN_STATE;
+    _blendDst = UNKNOWN_STATE;
+}
+
+unsigned GLStateCache::getIssuedCallCount() const {
+    return _issuedCallCount;
+}
+
+unsigned GLStateCache::getSkippedCallCount() const {
+    return _skippedCallCount;
+}
+
+void GLStateCache::resetCallCounts() {
+    _issuedCallCount = 0;
+    _skippedCallCount = 0;
+}
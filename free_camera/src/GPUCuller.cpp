@@ -0,0 +1,180 @@
+#include "common.h"
+
+#include <stdexcept>
+
+using namespace GLPractice;
+
+// threads of a workgroup in cullInstances.comp
+#define CULL_GROUP_SIZE 64
+
+// shader storage binding points of cullInstances.comp
+enum {
+    CULL_BINDING_BOUNDS = 0,
+    CULL_BINDING_MODELS = 1,
+    CULL_BINDING_COLORS = 2,
+    CULL_BINDING_VISIBLE_MODELS = 3,
+    CULL_BINDING_VISIBLE_COLORS = 4,
+    CULL_BINDING_COMMAND = 5
+};
+
+GPUCuller::GPUCuller(GeometryArena* arena, const MeshRange& range, GLProgram* cullProgram,
+        GLProgram* drawProgram):
+    _arena(arena),
+    _range(range),
+    _cullProgram(cullProgram),
+    _drawProgram(drawProgram),
+    _vao(0),
+    _instanceCountLocation(-1),
+    _frustumPlanesLocation(-1),
+    _hiZLocation(-1),
+    _depthViewProjectionLocation(-1),
+    _depthPyramidLevelsLocation(-1),
+    _instanceCount(0)
+{
+    if(!_arena)
+        throw std::runtime_error("arena is null in GPUCuller constructor");
+
+    if(!_cullProgram || !_drawProgram)
+        throw std::runtime_error("program is null in GPUCuller constructor");
+
+    // the outputs are drawn through a shared VAO, both came with GL 4.3
+    const GLCaps& caps = GLCaps::get();
+    if(!caps.computeShader || !caps.vertexAttribBinding)
+        throw std::runtime_error("GPUCuller needs compute shaders of OpenGL 4.3");
+
+    load();
+}
+
+void GPUCuller::load() {
+    if(!_arena->vbo())
+        _arena->load();
+
+    unload();
+
+    _instanceCountLocation = _cullProgram->GetUniformLocation("instanceCount");
+    _frustumPlanesLocation = _cullProgram->GetUniformLocation("frustumPlanes");
+    _hiZLocation = _cullProgram->GetUniformLocation("hiZ");
+    _depthViewProjectionLocation = _cullProgram->GetUniformLocation("depthViewProjection");
+    _depthPyramidLevelsLocation = _cullProgram->GetUniformLocation("depthPyramidLevels");
+
+    _boundsBuffer.reset(createBuffer());
+    _modelBuffer.reset(createBuffer());
+    _colorBuffer.reset(createBuffer());
+    _visibleModelBuffer.reset(createBuffer());
+    _visibleColorBuffer.reset(createBuffer());
+    _commandBuffer.reset(createBuffer());
+
+    // same layout as an instanced MeshRenderer with colors
+    GLint posLocation = _drawProgram->GetAttribLocation(VERT_SHADER_POS_ATTRIB_NAME);
+    GLint instanceModelLocation = _drawProgram->GetAttribLocation(VERT_SHADER_INSTANCE_MODEL_ATTRIB_NAME);
+    GLint instanceColorLocation = _drawProgram->GetAttribLocation(VERT_SHADER_INSTANCE_COLOR_ATTRIB_NAME);
+
+    VertexLayout layout;
+    layout.addAttrib(posLocation, 3, 0, VERTEX_BINDING_MESH);
+    for(GLuint column = 0; column < 4; column++) {
+        layout.addAttrib(instanceModelLocation + column, 4, column * 4 * sizeof(GLfloat),
+                VERTEX_BINDING_INSTANCE_MODEL);
+    }
+    layout.setBindingDivisor(VERTEX_BINDING_INSTANCE_MODEL, 1);
+    layout.addAttrib(instanceColorLocation, 4, 0, VERTEX_BINDING_INSTANCE_COLOR);
+    layout.setBindingDivisor(VERTEX_BINDING_INSTANCE_COLOR, 1);
+    _vao = VertexArrayCache::get().getVertexArray(layout);
+}
+
+void GPUCuller::unload() {
+    _boundsBuffer.reset();
+    _modelBuffer.reset();
+    _colorBuffer.reset();
+    _visibleModelBuffer.reset();
+    _visibleColorBuffer.reset();
+    _commandBuffer.reset();
+    _instanceCount = 0;
+}
+
+void GPUCuller::setInstances(const float16* models, const GLfloat* rgba, const SphereArray& spheres) {
+    _instanceCount = spheres.size();
+
+    _boundsData.resize(_instanceCount * 4);
+    for(unsigned i = 0; i < _instanceCount; i++) {
+        _boundsData[i * 4 + 0] = spheres.x[i];
+        _boundsData[i * 4 + 1] = spheres.y[i];
+        _boundsData[i * 4 + 2] = spheres.z[i];
+        _boundsData[i * 4 + 3] = spheres.radius[i];
+    }
+
+    setBufferData(_boundsBuffer.get(), _boundsData.size() * sizeof(GLfloat), _boundsData.data(), GL_STATIC_DRAW);
+    setBufferData(_modelBuffer.get(), _instanceCount * sizeof(float16), models, GL_STATIC_DRAW);
+    setBufferData(_colorBuffer.get(), _instanceCount * 4 * sizeof(GLfloat), rgba, GL_STATIC_DRAW);
+
+    // written and read by the GPU only
+    setBufferData(_visibleModelBuffer.get(), _instanceCount * sizeof(float16), NULL, GL_DYNAMIC_COPY);
+    setBufferData(_visibleColorBuffer.get(), _instanceCount * 4 * sizeof(GLfloat), NULL, GL_DYNAMIC_COPY);
+}
+
+unsigned GPUCuller::getInstanceCount() const {
+    return _instanceCount;
+}
+
+void GPUCuller::cull(const Frustum& frustum, const DepthPyramid* pyramid) {
+    // the shader counts the visible instances up from 0
+    DrawElementsIndirectCommand command;
+    command.count = _range.indexCount;
+    command.instanceCount = 0;
+    command.firstIndex = _range.firstIndex;
+    command.baseVertex = _range.baseVertex;
+    command.baseInstance = 0;
+    setBufferData(_commandBuffer.get(), sizeof(command), &command, GL_DYNAMIC_DRAW);
+
+    if(_instanceCount == 0)
+        return;
+
+    GLStateCache& state = GLStateCache::get();
+    state.useProgram(_cullProgram->getObjectId());
+
+    GLfloat planes[Frustum::PLANE_COUNT * 4];
+    for(unsigned i = 0; i < Frustum::PLANE_COUNT; i++) {
+        planes[i * 4 + 0] = frustum.planes[i].normal.x;
+        planes[i * 4 + 1] = frustum.planes[i].normal.y;
+        planes[i * 4 + 2] = frustum.planes[i].normal.z;
+        planes[i * 4 + 3] = frustum.planes[i].distance;
+    }
+    glUniform1ui(_instanceCountLocation, _instanceCount);
+    glUniform4fv(_frustumPlanesLocation, Frustum::PLANE_COUNT, planes);
+
+    bool hiZ = pyramid && pyramid->isValid();
+    glUniform1i(_hiZLocation, hiZ ? 1 : 0);
+    if(hiZ) {
+        float16 depthViewProjection = MatrixToFloatV(pyramid->viewProjection());
+        glUniformMatrix4fv(_depthViewProjectionLocation, 1, GL_FALSE, depthViewProjection.v);
+        glUniform1i(_depthPyramidLevelsLocation, pyramid->levelCount());
+        state.bindTexture(0, GL_TEXTURE_2D, pyramid->texture());
+    }
+
+    state.bindBufferBase(GL_SHADER_STORAGE_BUFFER, CULL_BINDING_BOUNDS, _boundsBuffer.get());
+    state.bindBufferBase(GL_SHADER_STORAGE_BUFFER, CULL_BINDING_MODELS, _modelBuffer.get());
+    state.bindBufferBase(GL_SHADER_STORAGE_BUFFER, CULL_BINDING_COLORS, _colorBuffer.get());
+    state.bindBufferBase(GL_SHADER_STORAGE_BUFFER, CULL_BINDING_VISIBLE_MODELS, _visibleModelBuffer.get());
+    state.bindBufferBase(GL_SHADER_STORAGE_BUFFER, CULL_BINDING_VISIBLE_COLORS, _visibleColorBuffer.get());
+    state.bindBufferBase(GL_SHADER_STORAGE_BUFFER, CULL_BINDING_COMMAND, _commandBuffer.get());
+
+    glDispatchCompute((_instanceCount + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+    // the draw reads the command and the instance attribs written above
+    glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+}
+
+void GPUCuller::render() {
+    if(_instanceCount == 0)
+        return;
+
+    GLStateCache& state = GLStateCache::get();
+    state.useProgram(_drawProgram->getObjectId());
+    state.bindVertexArray(_vao);
+    state.bindVertexBuffer(VERTEX_BINDING_MESH, _arena->vbo(), 0, 3 * sizeof(GLfloat));
+    state.bindVertexBuffer(VERTEX_BINDING_INSTANCE_MODEL, _visibleModelBuffer.get(), 0, sizeof(float16));
+    state.bindVertexBuffer(VERTEX_BINDING_INSTANCE_COLOR, _visibleColorBuffer.get(), 0, 4 * sizeof(GLfloat));
+    state.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, _arena->ebo());
+    state.bindBuffer(GL_DRAW_INDIRECT_BUFFER, _commandBuffer.get());
+
+    // the instance count never comes back to the CPU
+    glDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, 0);
+}
@@ -0,0 +1,69 @@
+#include "common.h"
+
+#include <stdexcept>
+
+using namespace GLPractice;
+
+GeometryArena::GeometryArena()
+{ }
+
+MeshRange GeometryArena::add(const Mesh& mesh) {
+    if(_vao)
+        throw std::runtime_error("can not add meshes to a loaded GeometryArena");
+
+    if(mesh.getVertexCount() <= 0 || mesh.getIndexCount() <= 0)
+        throw std::runtime_error("no mesh data to add to GeometryArena");
+
+    // indices of the mesh stay relative to its first vertex,
+    // baseVertex is added to them when drawing
+    MeshRange range;
+    range.firstIndex = _indexData.size();
+    range.indexCount = mesh.getIndexCount();
+    range.baseVertex = _vertexData.size() / 3;
+
+    _vertexData.resize(_vertexData.size() + mesh.getVertexCount());
+    mesh.getVertexData(_vertexData.data() + _vertexData.size() - mesh.getVertexCount());
+
+    _indexData.resize(_indexData.size() + mesh.getIndexCount());
+    mesh.getIndexData(_indexData.data() + _indexData.size() - mesh.getIndexCount());
+
+    return range;
+}
+
+void GeometryArena::load() {
+    if(_vertexData.empty() || _indexData.empty())
+        throw std::runtime_error("no mesh data in GeometryArena to load");
+
+    unload();
+
+    _vbo.reset(createBuffer());
+    setBufferData(_vbo.get(), _vertexData.size() * sizeof(GLfloat), _vertexData.data(), GL_STATIC_DRAW);
+
+    _ebo.reset(createBuffer());
+    setBufferData(_ebo.get(), _indexData.size() * sizeof(GLuint), _indexData.data(), GL_STATIC_DRAW);
+
+    // with vertex attrib binding the buffers are drawn through a VAO
+    // shared by all meshes of the same layout instead
+    if(!GLCaps::get().vertexAttribBinding) {
+        _vao.reset(createVertexArray());
+        setElementBuffer(_vao.get(), _ebo.get());
+    }
+}
+
+void GeometryArena::unload() {
+    _vao.reset();
+    _vbo.reset();
+    _ebo.reset();
+}
+
+GLuint GeometryArena::vao() const {
+    return _vao.get();
+}
+
+GLuint GeometryArena::vbo() const {
+    return _vbo.get();
+}
+
+GLuint GeometryArena::ebo() const {
+    return _ebo.get();
+}
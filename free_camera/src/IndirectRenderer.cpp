@@ -0,0 +1,159 @@
+#include "common.h"
+
+#include <stdexcept>
+
+using namespace GLPractice;
+
+IndirectRenderer::IndirectRenderer(GeometryArena* arena, GLProgram* program):
+    _arena(arena),
+    _shaderProgram(program),
+    _vao(0),
+    _instanceModelLocation(-1),
+    _instanceColorLocation(-1)
+{
+    if(!_arena)
+        throw std::runtime_error("arena is null in IndirectRenderer constructor");
+
+    if(!_shaderProgram)
+        throw std::runtime_error("shaderProgram is null in IndirectRenderer constructor");
+
+    load();
+}
+
+void IndirectRenderer::load() {
+    if(!_arena->vbo())
+        _arena->load();
+
+    unload();
+
+    _instanceModelLocation = _shaderProgram->GetAttribLocation(VERT_SHADER_INSTANCE_MODEL_ATTRIB_NAME);
+    _instanceColorLocation = glGetAttribLocation(_shaderProgram->getObjectId(),
+            VERT_SHADER_INSTANCE_COLOR_ATTRIB_NAME);
+
+    _drawDataBuffer.reset(createBuffer());
+    _commandBuffer.reset(createBuffer());
+
+    GLint posLocation = _shaderProgram->GetAttribLocation(VERT_SHADER_POS_ATTRIB_NAME);
+
+    if(GLCaps::get().vertexAttribBinding) {
+        // same layout as an instanced MeshRenderer without colors
+        VertexLayout layout;
+        layout.addAttrib(posLocation, 3, 0, VERTEX_BINDING_MESH);
+        for(GLuint column = 0; column < 4; column++) {
+            layout.addAttrib(_instanceModelLocation + column, 4, column * 4 * sizeof(GLfloat),
+                    VERTEX_BINDING_INSTANCE_MODEL);
+        }
+        layout.setBindingDivisor(VERTEX_BINDING_INSTANCE_MODEL, 1);
+        _vao = VertexArrayCache::get().getVertexArray(layout);
+        return;
+    }
+
+    _vao = _arena->vao();
+    setVertexAttrib(_vao, posLocation, _arena->vbo(), 3, 3 * sizeof(GLfloat), 0, 0);
+    enableVertexAttrib(_vao, posLocation);
+
+    setInstanceModelAttrib(_vao, _instanceModelLocation, _drawDataBuffer.get(), 0);
+}
+
+void IndirectRenderer::unload() {
+    _commandBuffer.reset();
+    _drawDataBuffer.reset();
+}
+
+void IndirectRenderer::clear() {
+    // keeps the capacity, so a steady frame loop does not allocate
+    _commands.clear();
+    _drawData.clear();
+}
+
+void IndirectRenderer::addDraw(const MeshRange& range, const float16& model) {
+    GLuint drawIndex = _drawData.size();
+    _drawData.push_back(model);
+
+    // consecutive draws of the same mesh become instances of one command
+    if(!_commands.empty()) {
+        DrawElementsIndirectCommand& last = _commands.back();
+        if(last.firstIndex == range.firstIndex &&
+                last.baseVertex == range.baseVertex &&
+                last.baseInstance + last.instanceCount == drawIndex) {
+            last.instanceCount++;
+            return;
+        }
+    }
+
+    DrawElementsIndirectCommand command;
+    command.count = range.indexCount;
+    command.instanceCount = 1;
+    command.firstIndex = range.firstIndex;
+    command.baseVertex = range.baseVertex;
+    command.baseInstance = drawIndex;
+    _commands.push_back(command);
+}
+
+unsigned IndirectRenderer::getDrawCount() const {
+    return _drawData.size();
+}
+
+unsigned IndirectRenderer::getCommandCount() const {
+    return _commands.size();
+}
+
+void IndirectRenderer::render() {
+    if(_commands.empty())
+        return;
+
+    const GLCaps& caps = GLCaps::get();
+    GLStateCache& state = GLStateCache::get();
+
+    // orphan and refill the per-draw data of this frame
+    setBufferData(_drawDataBuffer.get(), _drawData.size() * sizeof(float16), _drawData.data(), GL_STREAM_DRAW);
+
+    // setup defore drawing
+    state.useProgram(_shaderProgram->getObjectId());
+    state.bindVertexArray(_vao);
+
+    if(caps.vertexAttribBinding) {
+        state.bindVertexBuffer(VERTEX_BINDING_MESH, _arena->vbo(), 0, 3 * sizeof(GLfloat));
+        state.bindVertexBuffer(VERTEX_BINDING_INSTANCE_MODEL, _drawDataBuffer.get(), 0, sizeof(float16));
+        state.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, _arena->ebo());
+    }
+
+    if(_instanceColorLocation >= 0)
+        glVertexAttrib4f(_instanceColorLocation, 1.0f, 1.0f, 1.0f, 1.0f);
+
+    if(caps.multiDrawIndirect) {
+        setBufferData(_commandBuffer.get(), _commands.size() * sizeof(DrawElementsIndirectCommand),
+                _commands.data(), GL_STREAM_DRAW);
+        state.bindBuffer(GL_DRAW_INDIRECT_BUFFER, _commandBuffer.get());
+
+        glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, 0, _commands.size(), 0);
+    }
+    else if(caps.baseInstance) {
+        for(const DrawElementsIndirectCommand& command : _commands) {
+            glDrawElementsInstancedBaseVertexBaseInstance(GL_TRIANGLES, command.count, GL_UNSIGNED_INT,
+                    (const void*) (command.firstIndex * sizeof(GLuint)),
+                    command.instanceCount, command.baseVertex, command.baseInstance);
+        }
+    }
+    else {
+        // without baseInstance the instance attrib is moved to the first
+        // matrix of each command instead
+        for(const DrawElementsIndirectCommand& command : _commands) {
+            if(caps.vertexAttribBinding) {
+                state.bindVertexBuffer(VERTEX_BINDING_INSTANCE_MODEL, _drawDataBuffer.get(),
+                        command.baseInstance * sizeof(float16), sizeof(float16));
+            }
+            else {
+                setInstanceModelAttrib(_vao, _instanceModelLocation, _drawDataBuffer.get(),
+                        command.baseInstance);
+            }
+            glDrawElementsInstancedBaseVertex(GL_TRIANGLES, command.count, GL_UNSIGNED_INT,
+                    (const void*) (command.firstIndex * sizeof(GLuint)),
+                    command.instanceCount, command.baseVertex);
+        }
+        if(caps.vertexAttribBinding)
+            state.bindVertexBuffer(VERTEX_BINDING_INSTANCE_MODEL, _drawDataBuffer.get(), 0, sizeof(float16));
+        else
+            setInstanceModelAttrib(_vao, _instanceModelLocation, _drawDataBuffer.get(), 0);
+    }
+}
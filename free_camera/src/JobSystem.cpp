@@ -0,0 +1,329 @@
+#include "JobSystem.h"
+
+#include <algorithm>
+#include <chrono>
+
+using namespace GLPractice;
+
+struct GLPractice::Job {
+    std::function<void()> function;
+    JobCounter* counter;
+    // allocated by a thread which is not a worker, deleted once done
+    bool heapAllocated;
+    // a ring job which has not run yet, its slot is not reused until it did
+    std::atomic<bool> busy;
+};
+
+// the system the current thread works for, if any
+static thread_local JobSystem* t_system = NULL;
+static thread_local void* t_worker = NULL;
+
+// idle rounds a worker yields before going to sleep
+static const unsigned SPIN_COUNT = 64;
+
+const int64_t JobDeque::CAPACITY;
+const unsigned JobSystem::JOB_RING_SIZE;
+const unsigned JobSystem::CHUNKS_PER_THREAD;
+
+JobDeque::JobDeque():
+    _top(0),
+    _bottom(0)
+{
+    for(int64_t i = 0; i < CAPACITY; i++)
+        _jobs[i].store(NULL, std::memory_order_relaxed);
+}
+
+bool JobDeque::push(Job* job) {
+    int64_t bottom = _bottom.load(std::memory_order_relaxed);
+    int64_t top = _top.load(std::memory_order_acquire);
+    if(bottom - top >= CAPACITY)
+        return false;
+
+    _jobs[bottom & (CAPACITY - 1)].store(job, std::memory_order_relaxed);
+    // the job is written before thieves can see the new bottom
+    std::atomic_thread_fence(std::memory_order_release);
+    _bottom.store(bottom + 1, std::memory_order_relaxed);
+    return true;
+}
+
+Job* JobDeque::pop() {
+    int64_t bottom = _bottom.load(std::memory_order_relaxed) - 1;
+    _bottom.store(bottom, std::memory_order_relaxed);
+    // the bottom is taken before looking at the top, or a thief and
+    // the owner could both get the last job
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t top = _top.load(std::memory_order_relaxed);
+
+    if(top > bottom) {
+        // was empty
+        _bottom.store(bottom + 1, std::memory_order_relaxed);
+        return NULL;
+    }
+
+    Job* job = _jobs[bottom & (CAPACITY - 1)].load(std::memory_order_relaxed);
+    if(top == bottom) {
+        // the last job, the thieves may want it too
+        if(!_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst,
+                    std::memory_order_relaxed))
+            job = NULL;
+        _bottom.store(bottom + 1, std::memory_order_relaxed);
+    }
+    return job;
+}
+
+Job* JobDeque::steal() {
+    int64_t top = _top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t bottom = _bottom.load(std::memory_order_acquire);
+    if(top >= bottom)
+        return NULL;
+
+    Job* job = _jobs[top & (CAPACITY - 1)].load(std::memory_order_relaxed);
+    if(!_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst,
+                std::memory_order_relaxed))
+        return NULL;
+    return job;
+}
+
+JobCounter::JobCounter():
+    _count(0)
+{ }
+
+bool JobCounter::isDone() const {
+    return _count.load(std::memory_order_acquire) == 0;
+}
+
+JobSystem& JobSystem::get() {
+    static JobSystem system(std::max(1u, std::thread::hardware_concurrency()));
+    return system;
+}
+
+JobSystem::JobSystem(unsigned threadCount):
+    _sharedCount(0),
+    _sleepingCount(0),
+    _stop(false),
+    _previousSystem(t_system),
+    _previousWorker((Worker*) t_worker)
+{
+    threadCount = std::max(1u, threadCount);
+    for(unsigned i = 0; i < threadCount; i++) {
+        _workers.emplace_back(new Worker());
+        _workers.back()->ring.reset(new Job[JOB_RING_SIZE]);
+        for(unsigned j = 0; j < JOB_RING_SIZE; j++)
+            _workers.back()->ring[j].busy.store(false, std::memory_order_relaxed);
+        _workers.back()->next = 0;
+        _workers.back()->index = i;
+    }
+
+    // the calling thread is the first worker
+    t_system = this;
+    t_worker = _workers.front().get();
+    for(unsigned i = 1; i < threadCount; i++)
+        _threads.emplace_back(&JobSystem::workerMain, this, i);
+}
+
+JobSystem::~JobSystem() {
+    _stop.store(true);
+    {
+        std::lock_guard<std::mutex> lock(_sleepMutex);
+        _wakeUp.notify_all();
+    }
+    for(std::thread& thread : _threads)
+        thread.join();
+
+    t_system = _previousSystem;
+    t_worker = _previousWorker;
+}
+
+void JobSystem::workerMain(unsigned index) {
+    Worker* worker = _workers[index].get();
+    t_system = this;
+    t_worker = worker;
+
+    unsigned victim = worker->index;
+    unsigned idleCount = 0;
+    while(!_stop.load(std::memory_order_acquire)) {
+        Job* job = findJob(worker, victim);
+        if(job) {
+            execute(job);
+            idleCount = 0;
+            continue;
+        }
+
+        if(++idleCount < SPIN_COUNT) {
+            std::this_thread::yield();
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(_sleepMutex);
+        _sleepingCount++;
+        _wakeUp.wait_for(lock, std::chrono::milliseconds(1));
+        _sleepingCount--;
+        idleCount = 0;
+    }
+}
+
+JobSystem::Worker* JobSystem::currentWorker() const {
+    return t_system == this ? (Worker*) t_worker : NULL;
+}
+
+Job* JobSystem::allocateJob() {
+    // more jobs waiting than the ring holds, or jobs parked on a counter
+    // for long, leave the next slot taken, the new one goes to the heap
+    Worker* worker = currentWorker();
+    if(!worker || worker->ring[worker->next].busy.load(std::memory_order_acquire)) {
+        Job* job = new Job();
+        job->heapAllocated = true;
+        job->busy.store(true, std::memory_order_relaxed);
+        return job;
+    }
+
+    Job* job = &worker->ring[worker->next];
+    worker->next = (worker->next + 1) % JOB_RING_SIZE;
+    job->heapAllocated = false;
+    job->busy.store(true, std::memory_order_relaxed);
+    return job;
+}
+
+void JobSystem::push(Job* job) {
+    Worker* worker = currentWorker();
+    if(!worker || !worker->jobs.push(job)) {
+        std::lock_guard<std::mutex> lock(_sharedMutex);
+        _sharedJobs.push_back(job);
+        _sharedCount++;
+    }
+
+    if(_sleepingCount.load() > 0)
+        _wakeUp.notify_one();
+}
+
+Job* JobSystem::findJob(Worker* worker, unsigned& victim) {
+    if(worker) {
+        Job* job = worker->jobs.pop();
+        if(job)
+            return job;
+    }
+
+    if(_sharedCount.load(std::memory_order_relaxed) > 0) {
+        std::lock_guard<std::mutex> lock(_sharedMutex);
+        if(!_sharedJobs.empty()) {
+            Job* job = _sharedJobs.back();
+            _sharedJobs.pop_back();
+            _sharedCount--;
+            return job;
+        }
+    }
+
+    // the next victim starts after the last one, spreading the thieves
+    for(unsigned i = 0; i < _workers.size(); i++) {
+        victim = (victim + 1) % _workers.size();
+        if(_workers[victim].get() == worker)
+            continue;
+        Job* job = _workers[victim]->jobs.steal();
+        if(job)
+            return job;
+    }
+    return NULL;
+}
+
+void JobSystem::execute(Job* job) {
+    job->function();
+    // a ring job keeps nothing of its closure alive until it is reused
+    job->function = std::function<void()>();
+
+    JobCounter* counter = job->counter;
+    if(job->heapAllocated)
+        delete job;
+    else
+        job->busy.store(false, std::memory_order_release);
+    if(!counter)
+        return;
+
+    // under the lock, so a waiter seeing 0 can not free the counter before
+    // it is unlocked again
+    std::vector<Job*> ready;
+    {
+        std::lock_guard<std::mutex> lock(counter->_mutex);
+        if(--counter->_count == 0)
+            ready.swap(counter->_waiting);
+    }
+    for(Job* dependent : ready)
+        push(dependent);
+}
+
+void JobSystem::run(const std::function<void()>& function, JobCounter* counter,
+        JobCounter* dependency) {
+    Job* job = allocateJob();
+    job->function = function;
+    job->counter = counter;
+    if(counter)
+        counter->_count++;
+
+    if(dependency) {
+        std::lock_guard<std::mutex> lock(dependency->_mutex);
+        if(dependency->_count.load() > 0) {
+            dependency->_waiting.push_back(job);
+            return;
+        }
+    }
+    push(job);
+}
+
+void JobSystem::wait(JobCounter& counter) {
+    Worker* worker = currentWorker();
+    unsigned victim = worker ? worker->index : 0;
+    while(!counter.isDone()) {
+        Job* job = findJob(worker, victim);
+        if(job)
+            execute(job);
+        else
+            std::this_thread::yield();
+    }
+
+    // the last job may still hold the lock
+    std::lock_guard<std::mutex> lock(counter._mutex);
+}
+
+bool JobSystem::runPending() {
+    Worker* worker = currentWorker();
+    unsigned victim = worker ? worker->index : 0;
+    Job* job = findJob(worker, victim);
+    if(!job)
+        return false;
+    execute(job);
+    return true;
+}
+
+void JobSystem::parallelFor(unsigned taskCount, const std::function<void(unsigned)>& task) {
+    unsigned chunkCount = std::min(taskCount, threadCount() * CHUNKS_PER_THREAD);
+    if(chunkCount <= 1 || threadCount() == 1) {
+        serialFor(taskCount, task);
+        return;
+    }
+
+    // captured by reference, small enough for std::function to keep inline
+    struct Chunks {
+        unsigned taskCount;
+        unsigned chunkCount;
+        const std::function<void(unsigned)>* task;
+    } chunks = { taskCount, chunkCount, &task };
+
+    JobCounter counter;
+    for(unsigned chunk = 0; chunk < chunkCount; chunk++) {
+        run([&chunks, chunk]() {
+            unsigned first = (uint64_t) chunks.taskCount * chunk / chunks.chunkCount;
+            unsigned last = (uint64_t) chunks.taskCount * (chunk + 1) / chunks.chunkCount;
+            for(unsigned i = first; i < last; i++)
+                (*chunks.task)(i);
+        }, &counter);
+    }
+    wait(counter);
+}
+
+unsigned JobSystem::threadCount() const {
+    return _workers.size();
+}
+
+void GLPractice::jobFor(unsigned taskCount, const std::function<void(unsigned)>& task) {
+    JobSystem::get().parallelFor(taskCount, task);
+}
@@ -0,0 +1,134 @@
+# ifndef JOB_SYSTEM_H
+# define JOB_SYSTEM_H
+
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "Parallel.h"
+
+namespace GLPractice {
+
+struct Job;
+
+// fixed size Chase-Lev deque: the owning thread pushes and pops jobs at the
+// bottom without locking, any other thread steals from the top, the two
+// ends only compete with a compare and swap for the last job
+class JobDeque {
+    public:
+        static const int64_t CAPACITY = 4096;
+
+        JobDeque();
+
+        // owner only, false when full
+        bool push(Job* job);
+        // owner only, the job pushed last or NULL
+        Job* pop();
+        // any thread, the oldest job or NULL when empty or lost to another thread
+        Job* steal();
+
+    private:
+        std::atomic<int64_t> _top;
+        // the thieves and the owner write to separate cache lines
+        char _padding[64];
+        std::atomic<int64_t> _bottom;
+        std::atomic<Job*> _jobs[CAPACITY];
+};
+
+// number of jobs not finished yet, jobs waiting on it start once it gets to 0
+class JobCounter {
+    public:
+        JobCounter();
+
+        bool isDone() const;
+
+    private:
+        friend class JobSystem;
+
+        std::atomic<unsigned> _count;
+        // jobs depending on this counter, kept until it gets to 0
+        std::mutex _mutex;
+        std::vector<Job*> _waiting;
+};
+
+// a fixed pool of worker threads, each with a JobDeque of its own. new jobs
+// go to the deque of the thread creating them, a thread out of jobs steals
+// from the others. the thread creating the system is one of the workers and
+// runs jobs while it waits on a counter
+class JobSystem {
+    public:
+        // the system of jobFor(), with a thread per core
+        static JobSystem& get();
+
+        // threadCount includes the calling thread
+        explicit JobSystem(unsigned threadCount);
+        ~JobSystem();
+
+        // function runs on any thread once dependency, if given, is done,
+        // counter counts it from now until it returned
+        void run(const std::function<void()>& function, JobCounter* counter = NULL,
+                JobCounter* dependency = NULL);
+        // runs other jobs until the counter is done
+        void wait(JobCounter& counter);
+        // runs one waiting job on the calling thread, false if there was none
+        bool runPending();
+
+        // task(0) .. task(taskCount - 1) in chunks of consecutive tasks,
+        // a few for each thread so the faster ones can steal the rest
+        void parallelFor(unsigned taskCount, const std::function<void(unsigned)>& task);
+
+        unsigned threadCount() const;
+
+        JobSystem(const JobSystem&) = delete;
+        JobSystem& operator=(const JobSystem&) = delete;
+
+    private:
+        // the jobs a thread created, reused in turn
+        static const unsigned JOB_RING_SIZE = 8192;
+        // chunks of a parallelFor() for each thread
+        static const unsigned CHUNKS_PER_THREAD = 4;
+
+        struct Worker {
+            JobDeque jobs;
+            std::unique_ptr<Job[]> ring;
+            unsigned next;
+            unsigned index;
+        };
+
+        void workerMain(unsigned index);
+        Worker* currentWorker() const;
+        Job* allocateJob();
+        void push(Job* job);
+        Job* findJob(Worker* worker, unsigned& victim);
+        void execute(Job* job);
+
+        std::vector<std::unique_ptr<Worker> > _workers;
+        std::vector<std::thread> _threads;
+
+        // jobs from threads which are not workers
+        std::mutex _sharedMutex;
+        std::vector<Job*> _sharedJobs;
+        std::atomic<unsigned> _sharedCount;
+
+        // workers out of jobs sleep until new ones are pushed
+        // or for a millisecond at most
+        std::mutex _sleepMutex;
+        std::condition_variable _wakeUp;
+        std::atomic<unsigned> _sleepingCount;
+        std::atomic<bool> _stop;
+
+        // the system and worker of the thread before this system took it over
+        JobSystem* _previousSystem;
+        Worker* _previousWorker;
+};
+
+// tasks spread over the threads of JobSystem::get()
+void jobFor(unsigned taskCount, const std::function<void(unsigned)>& task);
+
+} // namespace GLPractice
+
+#endif // JOB_SYSTEM_H
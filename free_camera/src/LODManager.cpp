@@ -0,0 +1,153 @@
+#include "LODManager.h"
+
+#include <algorithm>
+#include <atomic>
+#include <stdexcept>
+
+using namespace GLPractice;
+
+const unsigned LODManager::TASK_SIZE;
+
+LODManager::LODManager():
+    _errorThreshold(1.0f),
+    _qualityBias(1.0f),
+    _hysteresis(0.2f),
+    _triangleCount(0),
+    _trianglesSaved(0),
+    _levelChangeCount(0)
+{ }
+
+unsigned LODManager::addChain(const LODLevel* levels, unsigned levelCount) {
+    if(!levels || levelCount == 0)
+        throw std::runtime_error("no levels given to LODManager::addChain");
+    if(levelCount > 256)
+        throw std::runtime_error("too many levels in a LOD chain");
+
+    Chain chain;
+    chain.firstLevel = _levels.size();
+    chain.levelCount = levelCount;
+    _levels.insert(_levels.end(), levels, levels + levelCount);
+    _chains.push_back(chain);
+    return _chains.size() - 1;
+}
+
+unsigned LODManager::addObject(unsigned chain, const BoundingSphere& bounds, float scale) {
+    if(chain >= _chains.size())
+        throw std::runtime_error("unknown chain in LODManager::addObject");
+
+    unsigned object = objectCount();
+    _objectChains.push_back(chain);
+    _bounds.resize(object + 1);
+    _scales.push_back(0.0f);
+    _objectLevels.push_back(0);
+    setBounds(object, bounds, scale);
+    return object;
+}
+
+void LODManager::setBounds(unsigned object, const BoundingSphere& bounds, float scale) {
+    _bounds.set(object, bounds);
+    _scales[object] = scale;
+}
+
+void LODManager::setErrorThreshold(float pixels) {
+    _errorThreshold = pixels;
+}
+
+void LODManager::setQualityBias(float bias) {
+    _qualityBias = bias;
+}
+
+void LODManager::setHysteresis(float fraction) {
+    _hysteresis = fraction;
+}
+
+float LODManager::getQualityBias() const {
+    return _qualityBias;
+}
+
+void LODManager::update(const Vector3& eye, float fov, float viewportHeight,
+        const ParallelFor& parallelFor) {
+    // pixels covered by one world unit at distance 1
+    float pixelsPerUnit = viewportHeight / (2.0f * tanf(fov * 0.5f));
+    float threshold = _errorThreshold * _qualityBias;
+
+    // each task sums up its objects, then adds them to the totals once
+    std::atomic<uint64_t> triangleCount(0);
+    std::atomic<uint64_t> trianglesSaved(0);
+    std::atomic<unsigned> levelChangeCount(0);
+    unsigned taskCount = (objectCount() + TASK_SIZE - 1) / TASK_SIZE;
+    parallelFor(taskCount, [&](unsigned task) {
+        unsigned first = task * TASK_SIZE;
+        unsigned last = std::min(objectCount(), first + TASK_SIZE);
+        uint64_t taskTriangleCount = 0;
+        uint64_t taskTrianglesSaved = 0;
+        unsigned taskLevelChangeCount = 0;
+        for(unsigned i = first; i < last; i++) {
+            const Chain& chain = _chains[_objectChains[i]];
+            const LODLevel* levels = &_levels[chain.firstLevel];
+            unsigned current = _objectLevels[i];
+            unsigned next = current;
+
+            BoundingSphere bounds = _bounds.get(i);
+            float distance = Vector3Distance(bounds.center, eye) - bounds.radius;
+            if(distance <= 0.0f) {
+                // the camera is inside the bounds
+                next = 0;
+            }
+            else {
+                // largest error of the mesh that stays under the threshold here,
+                // and the one a coarser level has to beat
+                float allowed = threshold * distance / (pixelsPerUnit * _scales[i]);
+                float coarserAllowed = allowed * (1.0f - _hysteresis);
+                if(levels[current].error > allowed) {
+                    while(next > 0 && levels[next].error > allowed)
+                        next--;
+                }
+                else {
+                    while(next + 1 < chain.levelCount && levels[next + 1].error <= coarserAllowed)
+                        next++;
+                }
+            }
+
+            if(next != current) {
+                _objectLevels[i] = next;
+                taskLevelChangeCount++;
+            }
+            taskTriangleCount += levels[next].triangleCount;
+            // a coarser level may have more triangles than the finest, nothing is saved then
+            if(levels[next].triangleCount < levels[0].triangleCount)
+                taskTrianglesSaved += levels[0].triangleCount - levels[next].triangleCount;
+        }
+        triangleCount += taskTriangleCount;
+        trianglesSaved += taskTrianglesSaved;
+        levelChangeCount += taskLevelChangeCount;
+    });
+
+    _triangleCount = triangleCount;
+    _trianglesSaved = trianglesSaved;
+    _levelChangeCount = levelChangeCount;
+}
+
+unsigned LODManager::objectCount() const {
+    return _objectChains.size();
+}
+
+unsigned LODManager::level(unsigned object) const {
+    return _objectLevels[object];
+}
+
+unsigned LODManager::chain(unsigned object) const {
+    return _objectChains[object];
+}
+
+uint64_t LODManager::triangleCount() const {
+    return _triangleCount;
+}
+
+uint64_t LODManager::trianglesSaved() const {
+    return _trianglesSaved;
+}
+
+unsigned LODManager::levelChangeCount() const {
+    return _levelChangeCount;
+}
@@ -0,0 +1,92 @@
+# ifndef LOD_MANAGER_H
+# define LOD_MANAGER_H
+
+#include <stdint.h>
+#include <vector>
+#include "Culling.h"
+#include "Parallel.h"
+
+namespace GLPractice {
+
+// one level of detail of a mesh
+struct LODLevel {
+    // largest distance between this level and the real surface, in
+    // local units of the mesh, so it scales with the object
+    float error;
+    uint32_t triangleCount;
+};
+
+// picks a level of detail for every object from the size its geometric
+// error has on screen
+//
+// the error of a level at distance d covers error * h / (2 * d * tan(fov / 2))
+// pixels on a screen h pixels high, the coarsest level staying under the
+// threshold is used. an object only goes to a coarser level once it is under
+// the threshold by the hysteresis margin, so one moving back and forth
+// around a switching distance does not keep changing
+class LODManager {
+    public:
+        static const unsigned TASK_SIZE = 1024;
+
+        LODManager();
+
+        // levels from the finest to the coarsest, returns the id of the chain
+        unsigned addChain(const LODLevel* levels, unsigned levelCount);
+        // an object drawn with one of the chains, starts at the finest level
+        unsigned addObject(unsigned chain, const BoundingSphere& bounds, float scale);
+        // bounds in world space, scale is the one of the error
+        void setBounds(unsigned object, const BoundingSphere& bounds, float scale);
+
+        // pixels of error allowed, 1 by default
+        void setErrorThreshold(float pixels);
+        // multiplies the threshold, above 1 coarser levels are used,
+        // for scaling the detail with the frame time
+        void setQualityBias(float bias);
+        // fraction of the threshold an object must be below before going
+        // coarser, 0.2 by default, 0 switches at the threshold both ways
+        void setHysteresis(float fraction);
+        float getQualityBias() const;
+
+        // select the level of every object for a camera at eye,
+        // fov is vertical in radians, viewportHeight in pixels,
+        // TASK_SIZE objects at a time go through parallelFor
+        void update(const Vector3& eye, float fov, float viewportHeight,
+                const ParallelFor& parallelFor = serialFor);
+
+        unsigned objectCount() const;
+        unsigned level(unsigned object) const;
+        unsigned chain(unsigned object) const;
+
+        // of the last update()
+        uint64_t triangleCount() const;
+        // against drawing every object at its finest level
+        uint64_t trianglesSaved() const;
+        unsigned levelChangeCount() const;
+
+    private:
+        struct Chain {
+            unsigned firstLevel;
+            unsigned levelCount;
+        };
+
+        std::vector<LODLevel> _levels;
+        std::vector<Chain> _chains;
+
+        // objects as one array per component
+        std::vector<uint32_t> _objectChains;
+        SphereArray _bounds;
+        std::vector<float> _scales;
+        std::vector<uint8_t> _objectLevels;
+
+        float _errorThreshold;
+        float _qualityBias;
+        float _hysteresis;
+
+        uint64_t _triangleCount;
+        uint64_t _trianglesSaved;
+        unsigned _levelChangeCount;
+};
+
+} // namespace GLPractice
+
+#endif // LOD_MANAGER_H
@@ -0,0 +1,110 @@
+# ifndef MPSC_QUEUE_H
+# define MPSC_QUEUE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <stdexcept>
+
+namespace GLPractice {
+
+// a fixed ring of values any number of threads push to without locks and a
+// single thread pops from. each cell has a sequence number telling whether
+// it is free for the push of a turn or holds the value of a turn for the
+// pop, so producers only compete with a compare and swap of the tail and
+// the consumer never waits on them
+template<typename T>
+class MPSCQueue {
+    public:
+        // capacity is a power of 2
+        explicit MPSCQueue(size_t capacity);
+
+        // any thread, false when the queue is full
+        bool push(const T& value);
+        // the consumer thread only, false when the queue is empty
+        bool pop(T& value);
+
+        size_t capacity() const;
+
+        MPSCQueue(const MPSCQueue&) = delete;
+        MPSCQueue& operator=(const MPSCQueue&) = delete;
+
+    private:
+        struct Cell {
+            std::atomic<size_t> sequence;
+            T value;
+        };
+
+        std::unique_ptr<Cell[]> _cells;
+        size_t _mask;
+        // the producers and the consumer write to separate cache lines
+        char _padding0[64];
+        std::atomic<size_t> _tail;
+        char _padding1[64];
+        size_t _head;
+};
+
+template<typename T>
+MPSCQueue<T>::MPSCQueue(size_t capacity):
+    _cells(new Cell[capacity]),
+    _mask(capacity - 1),
+    _tail(0),
+    _head(0)
+{
+    if(capacity == 0 || (capacity & (capacity - 1)) != 0)
+        throw std::runtime_error("queue capacity is not a power of 2");
+
+    // a cell is free for the push of turn i when its sequence is i
+    for(size_t i = 0; i < capacity; i++)
+        _cells[i].sequence.store(i, std::memory_order_relaxed);
+}
+
+template<typename T>
+bool MPSCQueue<T>::push(const T& value) {
+    size_t position = _tail.load(std::memory_order_relaxed);
+    Cell* cell;
+    for(;;) {
+        cell = &_cells[position & _mask];
+        size_t sequence = cell->sequence.load(std::memory_order_acquire);
+        intptr_t difference = (intptr_t) sequence - (intptr_t) position;
+        if(difference == 0) {
+            if(_tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                break;
+        }
+        else if(difference < 0) {
+            // the value of the last round was not popped yet
+            return false;
+        }
+        else {
+            // another producer took this turn
+            position = _tail.load(std::memory_order_relaxed);
+        }
+    }
+
+    cell->value = value;
+    cell->sequence.store(position + 1, std::memory_order_release);
+    return true;
+}
+
+template<typename T>
+bool MPSCQueue<T>::pop(T& value) {
+    Cell& cell = _cells[_head & _mask];
+    if(cell.sequence.load(std::memory_order_acquire) != _head + 1)
+        return false;
+
+    value = cell.value;
+    // free for the push of the next round
+    cell.sequence.store(_head + _mask + 1, std::memory_order_release);
+    _head++;
+    return true;
+}
+
+template<typename T>
+size_t MPSCQueue<T>::capacity() const {
+    return _mask + 1;
+}
+
+} // namespace GLPractice
+
+#endif // MPSC_QUEUE_H
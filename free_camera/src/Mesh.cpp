@@ -4,114 +4,114 @@
 
 using namespace GLPractice;
 
-Mesh::Mesh():
-    _vertexCount(0),
-    _indexCount(0),
-    _vertexData(NULL),
-    _indexData(NULL),
-    _vao(0),
-    _vbo(0),
-    _ebo(0)
-{ }
-
-Mesh::~Mesh() {
-    if(_vertexData)
-        delete[] _vertexData;
-    if(_indexData)
-        delete[] _indexData;
-
-    unload();
+Mesh::Mesh()
+{
+    _boundingBox = computeBoundingBox(NULL, 0);
+    _boundingSphere = computeBoundingSphere(NULL, 0);
 }
 
 void Mesh::setVertexData(const GLfloat* data, unsigned count) {
     if(!data || count <= 0)
         throw std::runtime_error("No vertex data");
 
-    if(_vertexData)
-        delete[] _vertexData;
+    _vertexData.assign(data, data + count);
 
-    _vertexCount = count;
-    _vertexData = new GLfloat[count];
-    memcpy(_vertexData, data, count * sizeof(float));
+    // positions are xyz triples
+    _boundingBox = computeBoundingBox(data, count / 3);
+    _boundingSphere = computeBoundingSphere(data, count / 3);
 }
 
 void Mesh::setIndexData(const GLuint* data, unsigned count) {
     if(!data || count <= 0)
         throw std::runtime_error("No index data");
 
-    if(_indexData)
-        delete[] _indexData;
+    _indexData.assign(data, data + count);
+}
 
-    _indexCount = count;
-    _indexData = new GLuint[count];
-    memcpy(_indexData, data, count * sizeof(unsigned));
+void Mesh::getVertexData(GLfloat* buf) const {
+    memcpy(buf, _vertexData.data(), _vertexData.size() * sizeof(GLfloat));
 }
 
-void Mesh::getVertexData(GLfloat* buf) {
-    memcpy(buf, _vertexData, _vertexCount * sizeof(float));
+void Mesh::getIndexData(GLuint* buf) const {
+    memcpy(buf, _indexData.data(), _indexData.size() * sizeof(GLuint));
 }
 
-void Mesh::getIndexData(GLuint* buf) {
-    memcpy(buf, _vertexData, _vertexCount * sizeof(unsigned));
+
+unsigned Mesh::getVertexCount() const {
+    return _vertexData.size();
 }
 
+unsigned Mesh::getIndexCount() const {
+    return _indexData.size();
+}
 
-unsigned Mesh::getVertexCount() {
-    return _vertexCount;
+const BoundingBox& Mesh::getBoundingBox() const {
+    return _boundingBox;
 }
 
-unsigned Mesh::getIndexCount() {
-    return _indexCount;
+const BoundingSphere& Mesh::getBoundingSphere() const {
+    return _boundingSphere;
 }
 
 void Mesh::load() {
-    if(!_vertexData)
+    if(_vertexData.empty())
+        throw std::runtime_error("no vertex data in mesh to load");
+
+    if(_indexData.empty())
+        throw std::runtime_error("no index data in mesh to load");
+
+    unload();
+
+    _vbo.reset(createBuffer());
+    setBufferData(_vbo.get(), _vertexData.size() * sizeof(GLfloat), _vertexData.data(), GL_STATIC_DRAW);
+
+    _ebo.reset(createBuffer());
+    setBufferData(_ebo.get(), _indexData.size() * sizeof(GLuint), _indexData.data(), GL_STATIC_DRAW);
+
+    setupVertexArray();
+}
+
+void Mesh::allocateBuffers() {
+    if(_vertexData.empty())
         throw std::runtime_error("no vertex data in mesh to load");
 
-    if(!_indexData)
+    if(_indexData.empty())
         throw std::runtime_error("no index data in mesh to load");
 
     unload();
 
-    glGenVertexArrays(1, &_vao);
-    glBindVertexArray(_vao);
+    _vbo.reset(createBuffer());
+    setBufferData(_vbo.get(), _vertexData.size() * sizeof(GLfloat), NULL, GL_STATIC_DRAW);
 
-    glGenBuffers(1, &_vbo);
-    glBindBuffer(GL_ARRAY_BUFFER, _vbo);
-    glBufferData(GL_ARRAY_BUFFER, _vertexCount * sizeof(GLfloat), _vertexData, GL_STATIC_DRAW);
+    _ebo.reset(createBuffer());
+    setBufferData(_ebo.get(), _indexData.size() * sizeof(GLuint), NULL, GL_STATIC_DRAW);
 
-    glGenBuffers(1, &_ebo);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _ebo);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, _indexCount * sizeof(GLuint), _indexData, GL_STATIC_DRAW);
+    setupVertexArray();
+}
 
-    glBindVertexArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+void Mesh::setupVertexArray() {
+    // with vertex attrib binding the buffers are drawn through a VAO
+    // shared by all meshes of the same layout instead
+    if(!GLCaps::get().vertexAttribBinding) {
+        _vao.reset(createVertexArray());
+        setElementBuffer(_vao.get(), _ebo.get());
+    }
 }
 
 void Mesh::unload() {
-    if(_vao) {
-        glDeleteVertexArrays(1, &_vao);
-        _vao = 0;
-    }
-    if(_vbo) {
-        glDeleteBuffers(1, &_vbo);
-        _vbo = 0;
-    }
-    if(_ebo) {
-        glDeleteBuffers(1, &_ebo);
-        _ebo = 0;
-    }
+    _vao.reset();
+    _vbo.reset();
+    _ebo.reset();
 }
 
-GLuint Mesh::vao() {
-    return _vao;
+GLuint Mesh::vao() const {
+    return _vao.get();
 }
 
-GLuint Mesh::vbo() {
-    return _vbo;
+GLuint Mesh::vbo() const {
+    return _vbo.get();
 }
 
-GLuint Mesh::ebo() {
-    return _ebo;
+GLuint Mesh::ebo() const {
+    return _ebo.get();
 }
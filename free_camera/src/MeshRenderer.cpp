@@ -5,7 +5,15 @@ using namespace GLPractice;
 
 MeshRenderer::MeshRenderer(Mesh* mesh, GLProgram* program):
     _mesh(mesh),
-    _shaderProgram(program)
+    _shaderProgram(program),
+    _vao(0),
+    _posLocation(-1),
+    _instanceModelLocation(-1),
+    _instanceColorLocation(-1),
+    _instanceCount(0),
+    _instanceCapacity(0),
+    _instanceColorCount(0),
+    _occlusionQueryIssued(false)
 {
     if(!_mesh)
         throw std::runtime_error("mesh is null in MeshRenderer constructor");
@@ -28,20 +36,292 @@ void MeshRenderer::load() {
         throw std::runtime_error("no shader program in MeshRenderer");
     }
 
-    if(!_mesh->vao() || !_mesh->vbo() || !_mesh->ebo()) {
+    if(!_mesh->vbo() || !_mesh->ebo()) {
         _mesh->load();
     }
 
-    glBindVertexArray(_mesh->vao());
-    glBindBuffer(GL_ARRAY_BUFFER, _mesh->vbo());
+    _posLocation = _shaderProgram->GetAttribLocation(VERT_SHADER_POS_ATTRIB_NAME);
 
-    glEnableVertexAttribArray(_shaderProgram->GetAttribLocation(VERT_SHADER_POS_ATTRIB_NAME));
-    glVertexAttribPointer(_shaderProgram->GetAttribLocation(VERT_SHADER_POS_ATTRIB_NAME), 3, GL_FLOAT, GL_FALSE, 0, 0);
+    // per-instance attributes are optional, so they are not looked up
+    // through GetAttribLocation which throws on missing attributes
+    _instanceModelLocation = glGetAttribLocation(_shaderProgram->getObjectId(),
+            VERT_SHADER_INSTANCE_MODEL_ATTRIB_NAME);
+    _instanceColorLocation = glGetAttribLocation(_shaderProgram->getObjectId(),
+            VERT_SHADER_INSTANCE_COLOR_ATTRIB_NAME);
 
-    glBindVertexArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    if(_instanceModelLocation >= 0) {
+        _instanceModelBuffer.reset(createBuffer());
+        _instanceCount = 0;
+        _instanceCapacity = 0;
+    }
+
+    if(_instanceColorLocation >= 0) {
+        _instanceColorBuffer.reset(createBuffer());
+        _instanceColorCount = 0;
+    }
+
+    if(GLCaps::get().vertexAttribBinding) {
+        _vao = VertexArrayCache::get().getVertexArray(vertexLayout());
+        return;
+    }
+
+    _vao = _mesh->vao();
+    setVertexAttrib(_vao, _posLocation, _mesh->vbo(), 3, 3 * sizeof(GLfloat), 0, 0);
+    enableVertexAttrib(_vao, _posLocation);
+
+    if(_instanceModelLocation >= 0)
+        setInstanceModelAttrib(_vao, _instanceModelLocation, _instanceModelBuffer.get(), 0);
+
+    // the array is enabled once colors are set,
+    // until then the constant value set in render() is used
+    if(_instanceColorLocation >= 0) {
+        setVertexAttrib(_vao, _instanceColorLocation, _instanceColorBuffer.get(),
+                4, 4 * sizeof(GLfloat), 0, 1);
+    }
+}
+
+VertexLayout MeshRenderer::vertexLayout() const {
+    VertexLayout layout;
+    layout.addAttrib(_posLocation, 3, 0, VERTEX_BINDING_MESH);
+
+    if(_instanceModelLocation >= 0) {
+        for(GLuint column = 0; column < 4; column++) {
+            layout.addAttrib(_instanceModelLocation + column, 4, column * 4 * sizeof(GLfloat),
+                    VERTEX_BINDING_INSTANCE_MODEL);
+        }
+        layout.setBindingDivisor(VERTEX_BINDING_INSTANCE_MODEL, 1);
+    }
+
+    if(_instanceColorLocation >= 0 && _instanceColorCount > 0) {
+        layout.addAttrib(_instanceColorLocation, 4, 0, VERTEX_BINDING_INSTANCE_COLOR);
+        layout.setBindingDivisor(VERTEX_BINDING_INSTANCE_COLOR, 1);
+    }
+
+    return layout;
 }
 
 void MeshRenderer::unload() {
+    _occlusionQuery.reset();
+    _occlusionQueryIssued = false;
+    _proxyVao.reset();
+    _proxyVbo.reset();
+    _proxyEbo.reset();
+    _instanceModelBuffer.reset();
+    _instanceColorBuffer.reset();
+    _instanceCount = 0;
+    _instanceCapacity = 0;
+    _instanceColorCount = 0;
+}
+
+bool MeshRenderer::isInstanced() const {
+    return _instanceModelLocation >= 0;
+}
+
+unsigned MeshRenderer::getInstanceCount() const {
+    return _instanceCount;
+}
+
+void MeshRenderer::updateInstances(const TransformArray& transforms) {
+    if(!isInstanced())
+        throw std::runtime_error("shader program of MeshRenderer has no instance attribs");
+
+    unsigned count = transforms.size();
+
+    GLuint buffer = _instanceModelBuffer.get();
+
+    // grow the buffer only when needed, otherwise the old storage
+    // is orphaned by the invalidate bit to avoid waiting for the GPU
+    if(count > _instanceCapacity) {
+        setBufferData(buffer, count * sizeof(float16), NULL, GL_STREAM_DRAW);
+        _instanceCapacity = count;
+    }
+
+    if(count > 0) {
+        void* dst = mapBufferRange(buffer, 0, count * sizeof(float16),
+                GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+        if(!dst)
+            throw std::runtime_error("failed to map instance buffer");
+
+        transforms.toMatrices((float16*) dst);
+        unmapBuffer(buffer);
+    }
+
+    _instanceCount = count;
+}
+
+void MeshRenderer::setInstanceColors(const GLfloat* rgba, unsigned instanceCount) {
+    if(_instanceColorLocation < 0)
+        throw std::runtime_error("shader program of MeshRenderer has no instance color attrib");
+
+    if(!rgba || instanceCount <= 0)
+        throw std::runtime_error("No instance color data");
+
+    setBufferData(_instanceColorBuffer.get(), instanceCount * 4 * sizeof(GLfloat), rgba, GL_DYNAMIC_DRAW);
+    bool hadColors = _instanceColorCount > 0;
+    _instanceColorCount = instanceCount;
+    if(hadColors)
+        return;
+
+    // the color attrib moves the renderer to another layout
+    if(GLCaps::get().vertexAttribBinding)
+        _vao = VertexArrayCache::get().getVertexArray(vertexLayout());
+    else
+        enableVertexAttrib(_vao, _instanceColorLocation);
+}
+
+void MeshRenderer::render() const {
+    if(_instanceColorCount > 0 && _instanceColorCount < _instanceCount)
+        throw std::runtime_error("less instance colors than instances in MeshRenderer");
+
+    // the draw is dropped by the GPU when the box of the last frame was hidden
+    bool conditional = _occlusionQuery && _occlusionQueryIssued;
+    if(conditional)
+        glBeginConditionalRender(_occlusionQuery.get(), GL_QUERY_NO_WAIT);
+
+    // setup defore drawing
+    GLStateCache& state = GLStateCache::get();
+    state.useProgram(_shaderProgram->getObjectId());
+    state.bindVertexArray(_vao);
+
+    // a shared VAO gets the buffers of this renderer,
+    // otherwise they are stored in the VAO of the mesh
+    if(GLCaps::get().vertexAttribBinding) {
+        state.bindVertexBuffer(VERTEX_BINDING_MESH, _mesh->vbo(), 0, 3 * sizeof(GLfloat));
+        if(isInstanced()) {
+            state.bindVertexBuffer(VERTEX_BINDING_INSTANCE_MODEL, _instanceModelBuffer.get(),
+                    0, sizeof(float16));
+        }
+        if(_instanceColorCount > 0) {
+            state.bindVertexBuffer(VERTEX_BINDING_INSTANCE_COLOR, _instanceColorBuffer.get(),
+                    0, 4 * sizeof(GLfloat));
+        }
+        state.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, _mesh->ebo());
+    }
+
+    if(isInstanced()) {
+        if(_instanceColorLocation >= 0 && _instanceColorCount == 0)
+            glVertexAttrib4f(_instanceColorLocation, 1.0f, 1.0f, 1.0f, 1.0f);
+
+        glDrawElementsInstanced(GL_TRIANGLES, _mesh->getIndexCount(), GL_UNSIGNED_INT, 0,
+                _instanceCount);
+    }
+    else {
+        glDrawElements(GL_TRIANGLES, _mesh->getIndexCount(), GL_UNSIGNED_INT, 0);
+    }
+
+    if(conditional)
+        glEndConditionalRender();
+}
+
+void MeshRenderer::setOcclusionQuery(bool enabled) {
+    if(enabled == hasOcclusionQuery())
+        return;
+
+    _occlusionQueryIssued = false;
+    if(!enabled) {
+        _occlusionQuery.reset();
+        return;
+    }
+
+    if(!_proxyVbo)
+        loadOcclusionProxy();
+    _occlusionQuery.reset(QueryPool::get().acquire());
+}
+
+bool MeshRenderer::hasOcclusionQuery() const {
+    return (bool) _occlusionQuery;
+}
+
+void MeshRenderer::loadOcclusionProxy() {
+    const BoundingBox& box = _mesh->getBoundingBox();
+    GLfloat corners[8 * 3];
+    for(unsigned i = 0; i < 8; i++) {
+        corners[i * 3 + 0] = i & 1 ? box.max.x : box.min.x;
+        corners[i * 3 + 1] = i & 2 ? box.max.y : box.min.y;
+        corners[i * 3 + 2] = i & 4 ? box.max.z : box.min.z;
+    }
+
+    // two triangles per face, the winding does not matter as
+    // the box is drawn without face culling
+    const GLuint indices[36] {
+        0, 1, 3,  0, 3, 2,
+        4, 6, 7,  4, 7, 5,
+        0, 4, 5,  0, 5, 1,
+        2, 3, 7,  2, 7, 6,
+        0, 2, 6,  0, 6, 4,
+        1, 5, 7,  1, 7, 3,
+    };
+
+    _proxyVbo.reset(createBuffer());
+    setBufferData(_proxyVbo.get(), sizeof(corners), corners, GL_STATIC_DRAW);
+    _proxyEbo.reset(createBuffer());
+    setBufferData(_proxyEbo.get(), sizeof(indices), indices, GL_STATIC_DRAW);
+
+    // the shared VAO of the renderer takes the box buffers in queryOcclusion()
+    if(GLCaps::get().vertexAttribBinding)
+        return;
+
+    // the instance colors are not needed, their constant value is used
+    _proxyVao.reset(createVertexArray());
+    setElementBuffer(_proxyVao.get(), _proxyEbo.get());
+    setVertexAttrib(_proxyVao.get(), _posLocation, _proxyVbo.get(), 3, 3 * sizeof(GLfloat), 0, 0);
+    enableVertexAttrib(_proxyVao.get(), _posLocation);
+    if(isInstanced())
+        setInstanceModelAttrib(_proxyVao.get(), _instanceModelLocation, _instanceModelBuffer.get(), 0);
+}
+
+void MeshRenderer::queryOcclusion() {
+    if(!_occlusionQuery)
+        return;
+
+    // without instances there is nothing to test,
+    // the next frame draws without a condition
+    if(isInstanced() && _instanceCount == 0) {
+        _occlusionQueryIssued = false;
+        return;
+    }
+
+    GLStateCache& state = GLStateCache::get();
+    state.useProgram(_shaderProgram->getObjectId());
+
+    if(GLCaps::get().vertexAttribBinding) {
+        state.bindVertexArray(_vao);
+        state.bindVertexBuffer(VERTEX_BINDING_MESH, _proxyVbo.get(), 0, 3 * sizeof(GLfloat));
+        if(isInstanced()) {
+            state.bindVertexBuffer(VERTEX_BINDING_INSTANCE_MODEL, _instanceModelBuffer.get(),
+                    0, sizeof(float16));
+        }
+        if(_instanceColorCount > 0) {
+            state.bindVertexBuffer(VERTEX_BINDING_INSTANCE_COLOR, _instanceColorBuffer.get(),
+                    0, 4 * sizeof(GLfloat));
+        }
+        state.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, _proxyEbo.get());
+    }
+    else {
+        state.bindVertexArray(_proxyVao.get());
+    }
+
+    // only the depth test counts, the box is not seen. with less or equal
+    // a box on the surface of the mesh passes where the mesh was drawn,
+    // without face culling a camera inside the box still sees its far side
+    state.setColorWrite(false);
+    state.setDepthWrite(false);
+    state.setEnabled(GL_CULL_FACE, false);
+    state.setDepthFunc(GL_LEQUAL);
+
+    glBeginQuery(GL_ANY_SAMPLES_PASSED, _occlusionQuery.get());
+    if(isInstanced()) {
+        if(_instanceColorLocation >= 0 && _instanceColorCount == 0)
+            glVertexAttrib4f(_instanceColorLocation, 1.0f, 1.0f, 1.0f, 1.0f);
+        glDrawElementsInstanced(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0, _instanceCount);
+    }
+    else {
+        glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
+    }
+    glEndQuery(GL_ANY_SAMPLES_PASSED);
+    _occlusionQueryIssued = true;
 
+    state.setColorWrite(true);
+    state.setDepthFunc(GL_LESS);
+    state.applyPipelineState(PipelineState::opaque());
 }
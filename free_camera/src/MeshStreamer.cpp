@@ -0,0 +1,236 @@
+#include "common.h"
+
+#include <algorithm>
+
+using namespace GLPractice;
+
+const unsigned MeshStreamer::MAX_STAGED;
+
+// how long unload() waits at a time for the fence of a copy, in nanoseconds
+static const GLuint64 FENCE_WAIT_TIMEOUT = 1000000;
+
+static const GLbitfield STAGING_FLAGS = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+MeshStreamer::MeshStreamer(size_t stagingSize, size_t frameBudget):
+    _frameBudget(frameBudget),
+    _stagingMemory(NULL),
+    _ring(stagingSize, MAX_STAGED),
+    _pendingCount(0),
+    _copiedBytes(0)
+{
+    if(frameBudget == 0)
+        throw std::runtime_error("mesh streaming needs a frame budget");
+}
+
+MeshStreamer::~MeshStreamer() {
+    // the jobs refer to the requests
+    if(!_jobs.isDone())
+        JobSystem::get().wait(_jobs);
+}
+
+void MeshStreamer::load() {
+    unload();
+
+    if(!GLCaps::get().bufferStorage)
+        return;
+
+    _staging.reset(createBuffer());
+    setBufferStorage(_staging.get(), _ring.capacity(), NULL, STAGING_FLAGS);
+    _stagingMemory = (uint8_t*) mapBufferRange(_staging.get(), 0, _ring.capacity(), STAGING_FLAGS);
+    if(!_stagingMemory)
+        throw std::runtime_error("failed to map the staging buffer");
+}
+
+void MeshStreamer::unload() {
+    if(!_jobs.isDone())
+        JobSystem::get().wait(_jobs);
+    retireCopies(true);
+
+    {
+        std::lock_guard<std::mutex> lock(_incomingMutex);
+        _incoming.clear();
+    }
+    _requests.clear();
+    _pendingCount = 0;
+    _ring = StagingRing(_ring.capacity(), MAX_STAGED);
+
+    if(_stagingMemory) {
+        unmapBuffer(_staging.get());
+        _stagingMemory = NULL;
+    }
+    _staging.reset();
+}
+
+void MeshStreamer::request(const LoadFunction& load, const ReadyFunction& ready) {
+    std::unique_ptr<Request> request(new Request());
+    request->load = load;
+    request->ready = ready;
+    request->state = LOADING;
+    request->size = 0;
+    request->stagingOffset = StagingRing::NO_SPACE;
+    request->copied = 0;
+
+    Request* loading = request.get();
+    bool keepData = !GLCaps::get().bufferStorage;
+    {
+        std::lock_guard<std::mutex> lock(_incomingMutex);
+        _incoming.push_back(std::move(request));
+    }
+    _pendingCount++;
+
+    JobSystem::get().run([loading, keepData]() {
+        loadRequest(loading, keepData);
+    }, &_jobs);
+}
+
+void MeshStreamer::loadRequest(Request* request, bool keepData) {
+    try {
+        request->load(request->mesh);
+        size_t vertexSize = request->mesh.getVertexCount() * sizeof(GLfloat);
+        size_t indexSize = request->mesh.getIndexCount() * sizeof(GLuint);
+        if(vertexSize == 0 || indexSize == 0)
+            throw std::runtime_error("streamed mesh has no data");
+        request->size = vertexSize + indexSize;
+
+        // what the copies read without a staging buffer
+        if(keepData) {
+            request->data.resize(request->size);
+            request->mesh.getVertexData((GLfloat*) &request->data[0]);
+            request->mesh.getIndexData((GLuint*) &request->data[vertexSize]);
+        }
+        request->state.store(LOADED, std::memory_order_release);
+    }
+    catch(...) {
+        request->error = std::current_exception();
+        request->state.store(FAILED, std::memory_order_release);
+    }
+}
+
+void MeshStreamer::update() {
+    _copiedBytes = 0;
+    retireCopies(false);
+
+    {
+        std::lock_guard<std::mutex> lock(_incomingMutex);
+        for(std::unique_ptr<Request>& request : _incoming)
+            _requests.push_back(std::move(request));
+        _incoming.clear();
+    }
+
+    if(_stagingMemory)
+        stageRequests();
+    copyRequests();
+}
+
+void MeshStreamer::stageRequests() {
+    // the ring gives space back in the order it was taken,
+    // so it is taken in the order the meshes are handed out
+    for(std::unique_ptr<Request>& request : _requests) {
+        if(request->stagingOffset != StagingRing::NO_SPACE)
+            continue;
+        if(request->state.load(std::memory_order_acquire) != LOADED)
+            return;
+
+        size_t offset = _ring.allocate(request->size);
+        if(offset == StagingRing::NO_SPACE)
+            return;
+        request->stagingOffset = offset;
+        request->state = STAGING;
+
+        Request* staging = request.get();
+        uint8_t* memory = _stagingMemory + offset;
+        JobSystem::get().run([staging, memory]() {
+            // the mapping is coherent, copies issued after
+            // the job finished see what it wrote
+            size_t vertexSize = staging->mesh.getVertexCount() * sizeof(GLfloat);
+            staging->mesh.getVertexData((GLfloat*) memory);
+            staging->mesh.getIndexData((GLuint*) (memory + vertexSize));
+            staging->state.store(STAGED, std::memory_order_release);
+        }, &_jobs);
+    }
+}
+
+void MeshStreamer::copyRequests() {
+    int ready = _stagingMemory ? STAGED : LOADED;
+    unsigned finishedCount = 0;
+    size_t budget = _frameBudget;
+    while(!_requests.empty() && budget > 0) {
+        Request& request = *_requests.front();
+        int state = request.state.load(std::memory_order_acquire);
+        if(state == FAILED) {
+            std::exception_ptr error = request.error;
+            _requests.pop_front();
+            _pendingCount--;
+            std::rethrow_exception(error);
+        }
+        if(state != ready)
+            break;
+
+        if(request.copied == 0)
+            request.mesh.allocateBuffers();
+
+        size_t size = std::min(budget, request.size - request.copied);
+        copyRange(request, request.copied, request.copied + size);
+        request.copied += size;
+        budget -= size;
+        _copiedBytes += size;
+        if(request.copied < request.size)
+            break;
+
+        request.ready(request.mesh);
+        _requests.pop_front();
+        _pendingCount--;
+        finishedCount++;
+    }
+
+    // the staging space of the meshes finished in this
+    // frame is free once the GPU made their last copies
+    if(_stagingMemory && finishedCount > 0) {
+        FencedCopies copies = { glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0), finishedCount };
+        _fences.push_back(copies);
+    }
+}
+
+void MeshStreamer::copyRange(Request& request, size_t begin, size_t end) {
+    size_t vertexSize = request.mesh.getVertexCount() * sizeof(GLfloat);
+    if(begin < vertexSize) {
+        size_t last = std::min(end, vertexSize);
+        copyToBuffer(request, request.mesh.vbo(), begin, begin, last - begin);
+        begin = last;
+    }
+    if(begin < end)
+        copyToBuffer(request, request.mesh.ebo(), begin, begin - vertexSize, end - begin);
+}
+
+void MeshStreamer::copyToBuffer(Request& request, GLuint buffer, size_t begin, size_t offset, size_t size) {
+    if(_stagingMemory)
+        copyBufferSubData(_staging.get(), buffer, request.stagingOffset + begin, offset, size);
+    else
+        setBufferSubData(buffer, offset, size, &request.data[begin]);
+}
+
+void MeshStreamer::retireCopies(bool wait) {
+    while(!_fences.empty()) {
+        FencedCopies& copies = _fences.front();
+        GLenum result = glClientWaitSync(copies.fence, wait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0,
+                wait ? FENCE_WAIT_TIMEOUT : 0);
+        if(result == GL_TIMEOUT_EXPIRED) {
+            if(!wait)
+                return;
+            continue;
+        }
+
+        glDeleteSync(copies.fence);
+        for(unsigned i = 0; i < copies.allocationCount; i++)
+            _ring.releaseOldest();
+        _fences.pop_front();
+    }
+}
+
+unsigned MeshStreamer::pendingCount() const {
+    return _pendingCount;
+}
+
+size_t MeshStreamer::copiedBytes() const {
+    return _copiedBytes;
+}
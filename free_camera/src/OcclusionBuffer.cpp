@@ -0,0 +1,433 @@
+#include "OcclusionBuffer.h"
+
+#include <string.h>
+#include <algorithm>
+#include <stdexcept>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+using namespace GLPractice;
+
+const unsigned OcclusionBuffer::TASK_SIZE;
+
+static ClipVertex transformPoint(const Matrix& m, float x, float y, float z) {
+    ClipVertex result;
+    result.x = m.m0 * x + m.m4 * y + m.m8 * z + m.m12;
+    result.y = m.m1 * x + m.m5 * y + m.m9 * z + m.m13;
+    result.z = m.m2 * x + m.m6 * y + m.m10 * z + m.m14;
+    result.w = m.m3 * x + m.m7 * y + m.m11 * z + m.m15;
+    return result;
+}
+
+#if defined(__SSE2__)
+static float minLane(__m128 v) {
+    v = _mm_min_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+    v = _mm_min_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+    return _mm_cvtss_f32(v);
+}
+
+static float maxLane(__m128 v) {
+    v = _mm_max_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+    v = _mm_max_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+    return _mm_cvtss_f32(v);
+}
+#endif
+
+static ClipVertex lerp(const ClipVertex& a, const ClipVertex& b, float t) {
+    ClipVertex result;
+    result.x = a.x + (b.x - a.x) * t;
+    result.y = a.y + (b.y - a.y) * t;
+    result.z = a.z + (b.z - a.z) * t;
+    result.w = a.w + (b.w - a.w) * t;
+    return result;
+}
+
+OcclusionBuffer::OcclusionBuffer(unsigned width, unsigned height) {
+    if(width == 0 || height == 0)
+        throw std::runtime_error("size of OcclusionBuffer must not be zero");
+
+    _tilesX = (width + TILE_WIDTH - 1) / TILE_WIDTH;
+    _tilesY = (height + TILE_HEIGHT - 1) / TILE_HEIGHT;
+    _width = _tilesX * TILE_WIDTH;
+    _height = _tilesY * TILE_HEIGHT;
+    _viewProjection = MatrixIdentity();
+    _depth.assign(_width * _height, 1.0f);
+    _tileMaxDepth.assign(_tilesX * _tilesY, 1.0f);
+    _tileTriangles.resize(_tilesX * _tilesY);
+}
+
+void OcclusionBuffer::begin(const Matrix& viewProjection) {
+    _viewProjection = viewProjection;
+    std::fill(_depth.begin(), _depth.end(), 1.0f);
+    std::fill(_tileMaxDepth.begin(), _tileMaxDepth.end(), 1.0f);
+    _triangles.clear();
+}
+
+void OcclusionBuffer::addOccluder(const float* positions, const uint32_t* indices, unsigned indexCount,
+        const Matrix& model) {
+    // raymath multiplies the other way around, this is projection * view * model
+    Matrix modelViewProjection = MatrixMultiply(model, _viewProjection);
+
+    for(unsigned i = 0; i + 2 < indexCount; i += 3) {
+        ClipVertex clip[3];
+        for(unsigned v = 0; v < 3; v++) {
+            const float* p = positions + indices[i + v] * 3;
+            clip[v] = transformPoint(modelViewProjection, p[0], p[1], p[2]);
+        }
+        addClippedTriangle(clip);
+    }
+}
+
+void OcclusionBuffer::addClippedTriangle(const ClipVertex* clip) {
+    // all corners outside the same side, nothing to draw
+    for(unsigned axis = 0; axis < 3; axis++) {
+        bool allBelow = true;
+        bool allAbove = true;
+        for(unsigned v = 0; v < 3; v++) {
+            float value = axis == 0 ? clip[v].x : (axis == 1 ? clip[v].y : clip[v].z);
+            allBelow = allBelow && value < -clip[v].w;
+            allAbove = allAbove && value > clip[v].w;
+        }
+        if(allBelow || allAbove)
+            return;
+    }
+
+    // cut away the part in front of the near plane, where z < -w,
+    // the other planes are handled by the screen bounds
+    ClipVertex polygon[4];
+    unsigned count = 0;
+    for(unsigned v = 0; v < 3; v++) {
+        const ClipVertex& a = clip[v];
+        const ClipVertex& b = clip[(v + 1) % 3];
+        float distanceA = a.z + a.w;
+        float distanceB = b.z + b.w;
+        if(distanceA >= 0.0f)
+            polygon[count++] = a;
+        if((distanceA >= 0.0f) != (distanceB >= 0.0f))
+            polygon[count++] = lerp(a, b, distanceA / (distanceA - distanceB));
+    }
+
+    if(count < 3)
+        return;
+
+    Vector3 screen[4];
+    for(unsigned v = 0; v < count; v++) {
+        float inverseW = 1.0f / polygon[v].w;
+        screen[v].x = (polygon[v].x * inverseW * 0.5f + 0.5f) * _width;
+        screen[v].y = (polygon[v].y * inverseW * 0.5f + 0.5f) * _height;
+        screen[v].z = polygon[v].z * inverseW * 0.5f + 0.5f;
+    }
+
+    addScreenTriangle(screen);
+    if(count == 4) {
+        Vector3 second[3] = { screen[0], screen[2], screen[3] };
+        addScreenTriangle(second);
+    }
+}
+
+void OcclusionBuffer::addScreenTriangle(const Vector3* screen) {
+    Vector3 v0 = screen[0];
+    Vector3 v1 = screen[1];
+    Vector3 v2 = screen[2];
+
+    // counter-clockwise so inside is where all edge functions are positive,
+    // both sides are drawn, back faces are hidden behind the front anyway
+    float area = (v1.x - v0.x) * (v2.y - v0.y) - (v2.x - v0.x) * (v1.y - v0.y);
+    if(fabsf(area) < 1e-6f)
+        return;
+    if(area < 0.0f) {
+        std::swap(v1, v2);
+        area = -area;
+    }
+
+    ScreenTriangle triangle;
+    triangle.minX = std::max(0, (int32_t) floorf(fminf(v0.x, fminf(v1.x, v2.x))));
+    triangle.minY = std::max(0, (int32_t) floorf(fminf(v0.y, fminf(v1.y, v2.y))));
+    triangle.maxX = std::min((int32_t) _width - 1, (int32_t) floorf(fmaxf(v0.x, fmaxf(v1.x, v2.x))));
+    triangle.maxY = std::min((int32_t) _height - 1, (int32_t) floorf(fmaxf(v0.y, fmaxf(v1.y, v2.y))));
+    if(triangle.minX > triangle.maxX || triangle.minY > triangle.maxY)
+        return;
+
+    const Vector3* vertices[3] = { &v0, &v1, &v2 };
+    for(unsigned e = 0; e < 3; e++) {
+        const Vector3& a = *vertices[e];
+        const Vector3& b = *vertices[(e + 1) % 3];
+        triangle.edgeA[e] = a.y - b.y;
+        triangle.edgeB[e] = b.x - a.x;
+        triangle.edgeC[e] = a.x * b.y - a.y * b.x;
+    }
+
+    // z / w changes linearly over the screen, so it is a plane
+    triangle.depthA = ((v1.z - v0.z) * (v2.y - v0.y) - (v2.z - v0.z) * (v1.y - v0.y)) / area;
+    triangle.depthB = ((v2.z - v0.z) * (v1.x - v0.x) - (v1.z - v0.z) * (v2.x - v0.x)) / area;
+    triangle.depthC = v0.z - triangle.depthA * v0.x - triangle.depthB * v0.y;
+
+    _triangles.push_back(triangle);
+}
+
+void OcclusionBuffer::rasterize(const ParallelFor& parallelFor) {
+    for(std::vector<uint32_t>& triangles : _tileTriangles)
+        triangles.clear();
+
+    for(unsigned i = 0; i < _triangles.size(); i++) {
+        const ScreenTriangle& triangle = _triangles[i];
+        for(int32_t ty = triangle.minY / TILE_HEIGHT; ty <= triangle.maxY / (int32_t) TILE_HEIGHT; ty++) {
+            for(int32_t tx = triangle.minX / TILE_WIDTH; tx <= triangle.maxX / (int32_t) TILE_WIDTH; tx++)
+                _tileTriangles[ty * _tilesX + tx].push_back(i);
+        }
+    }
+
+    // tiles don't share pixels, so they need no locking
+    parallelFor(_tilesX * _tilesY, [this](unsigned tile) {
+        rasterizeTile(tile);
+    });
+}
+
+void OcclusionBuffer::rasterizeTile(unsigned tile) {
+    int32_t tileX = (tile % _tilesX) * TILE_WIDTH;
+    int32_t tileY = (tile / _tilesX) * TILE_HEIGHT;
+
+    for(uint32_t index : _tileTriangles[tile]) {
+        const ScreenTriangle& triangle = _triangles[index];
+        // whole groups of 4, the edge functions reject the extra pixels
+        int32_t minX = std::max(tileX, triangle.minX) & ~3;
+        int32_t maxX = std::min(tileX + (int32_t) TILE_WIDTH - 1, triangle.maxX);
+        int32_t minY = std::max(tileY, triangle.minY);
+        int32_t maxY = std::min(tileY + (int32_t) TILE_HEIGHT - 1, triangle.maxY);
+
+#if defined(__SSE2__)
+        __m128 laneOffsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+        __m128 edgeA[3];
+        for(unsigned e = 0; e < 3; e++)
+            edgeA[e] = _mm_set1_ps(triangle.edgeA[e]);
+        __m128 depthA = _mm_set1_ps(triangle.depthA);
+
+        for(int32_t y = minY; y <= maxY; y++) {
+            float centerY = y + 0.5f;
+            __m128 edgeRow[3];
+            for(unsigned e = 0; e < 3; e++)
+                edgeRow[e] = _mm_set1_ps(triangle.edgeB[e] * centerY + triangle.edgeC[e]);
+            __m128 depthRow = _mm_set1_ps(triangle.depthB * centerY + triangle.depthC);
+
+            float* row = &_depth[y * _width];
+            for(int32_t x = minX; x <= maxX; x += 4) {
+                __m128 centerX = _mm_add_ps(_mm_set1_ps((float) x), laneOffsets);
+                __m128 inside = _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgeA[0], centerX), edgeRow[0]), _mm_setzero_ps());
+                inside = _mm_and_ps(inside,
+                        _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgeA[1], centerX), edgeRow[1]), _mm_setzero_ps()));
+                inside = _mm_and_ps(inside,
+                        _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgeA[2], centerX), edgeRow[2]), _mm_setzero_ps()));
+                if(_mm_movemask_ps(inside) == 0)
+                    continue;
+
+                __m128 depth = _mm_add_ps(_mm_mul_ps(depthA, centerX), depthRow);
+                __m128 old = _mm_loadu_ps(row + x);
+                __m128 nearest = _mm_min_ps(old, depth);
+                _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearest), _mm_andnot_ps(inside, old)));
+            }
+        }
+#else
+        for(int32_t y = minY; y <= maxY; y++) {
+            float centerY = y + 0.5f;
+            float* row = &_depth[y * _width];
+            for(int32_t x = minX; x <= maxX; x++) {
+                float centerX = x + 0.5f;
+                bool inside = true;
+                for(unsigned e = 0; e < 3; e++)
+                    inside = inside && triangle.edgeA[e] * centerX + triangle.edgeB[e] * centerY + triangle.edgeC[e] >= 0.0f;
+                if(!inside)
+                    continue;
+
+                float depth = triangle.depthA * centerX + triangle.depthB * centerY + triangle.depthC;
+                row[x] = fminf(row[x], depth);
+            }
+        }
+#endif
+    }
+
+    float maxDepth = 0.0f;
+    for(int32_t y = tileY; y < tileY + (int32_t) TILE_HEIGHT; y++) {
+        const float* row = &_depth[y * _width];
+        for(int32_t x = tileX; x < tileX + (int32_t) TILE_WIDTH; x++)
+            maxDepth = fmaxf(maxDepth, row[x]);
+    }
+    _tileMaxDepth[tile] = maxDepth;
+}
+
+bool OcclusionBuffer::isVisible(const BoundingBox& box) const {
+    float minX;
+    float minY;
+    float maxX;
+    float maxY;
+    float minDepth;
+
+#if defined(__SSE2__)
+    // the 8 corners as 2 groups of 4, the near ones then the far ones,
+    // x and y go through the lanes the same way in both
+    const Matrix& m = _viewProjection;
+    __m128 cornerX = _mm_setr_ps(box.min.x, box.max.x, box.min.x, box.max.x);
+    __m128 cornerY = _mm_setr_ps(box.min.y, box.min.y, box.max.y, box.max.y);
+    __m128 partX = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(m.m0), cornerX), _mm_mul_ps(_mm_set1_ps(m.m4), cornerY));
+    __m128 partY = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(m.m1), cornerX), _mm_mul_ps(_mm_set1_ps(m.m5), cornerY));
+    __m128 partZ = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(m.m2), cornerX), _mm_mul_ps(_mm_set1_ps(m.m6), cornerY));
+    __m128 partW = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(m.m3), cornerX), _mm_mul_ps(_mm_set1_ps(m.m7), cornerY));
+
+    __m128 half = _mm_set1_ps(0.5f);
+    __m128 width = _mm_set1_ps((float) _width);
+    __m128 height = _mm_set1_ps((float) _height);
+    __m128 screenMinX = _mm_set1_ps(INFINITY);
+    __m128 screenMinY = _mm_set1_ps(INFINITY);
+    __m128 screenMaxX = _mm_set1_ps(-INFINITY);
+    __m128 screenMaxY = _mm_set1_ps(-INFINITY);
+    __m128 screenMinDepth = _mm_set1_ps(INFINITY);
+    for(unsigned group = 0; group < 2; group++) {
+        __m128 cornerZ = _mm_set1_ps(group == 0 ? box.min.z : box.max.z);
+        __m128 clipX = _mm_add_ps(_mm_add_ps(partX, _mm_mul_ps(_mm_set1_ps(m.m8), cornerZ)), _mm_set1_ps(m.m12));
+        __m128 clipY = _mm_add_ps(_mm_add_ps(partY, _mm_mul_ps(_mm_set1_ps(m.m9), cornerZ)), _mm_set1_ps(m.m13));
+        __m128 clipZ = _mm_add_ps(_mm_add_ps(partZ, _mm_mul_ps(_mm_set1_ps(m.m10), cornerZ)), _mm_set1_ps(m.m14));
+        __m128 clipW = _mm_add_ps(_mm_add_ps(partW, _mm_mul_ps(_mm_set1_ps(m.m11), cornerZ)), _mm_set1_ps(m.m15));
+
+        // a corner in front of the near plane, can't be projected
+        __m128 inFront = _mm_or_ps(_mm_cmplt_ps(clipZ, _mm_sub_ps(_mm_setzero_ps(), clipW)),
+                _mm_cmple_ps(clipW, _mm_setzero_ps()));
+        if(_mm_movemask_ps(inFront) != 0)
+            return true;
+
+        __m128 inverseW = _mm_div_ps(_mm_set1_ps(1.0f), clipW);
+        __m128 x = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(_mm_mul_ps(clipX, inverseW), half), half), width);
+        __m128 y = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(_mm_mul_ps(clipY, inverseW), half), half), height);
+        __m128 depth = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(clipZ, inverseW), half), half);
+        screenMinX = _mm_min_ps(screenMinX, x);
+        screenMinY = _mm_min_ps(screenMinY, y);
+        screenMaxX = _mm_max_ps(screenMaxX, x);
+        screenMaxY = _mm_max_ps(screenMaxY, y);
+        screenMinDepth = _mm_min_ps(screenMinDepth, depth);
+    }
+    minX = minLane(screenMinX);
+    minY = minLane(screenMinY);
+    maxX = maxLane(screenMaxX);
+    maxY = maxLane(screenMaxY);
+    minDepth = minLane(screenMinDepth);
+#else
+    minX = INFINITY;
+    minY = INFINITY;
+    maxX = -INFINITY;
+    maxY = -INFINITY;
+    minDepth = INFINITY;
+
+    for(unsigned i = 0; i < 8; i++) {
+        ClipVertex clip = transformPoint(_viewProjection,
+                (i & 1) ? box.max.x : box.min.x,
+                (i & 2) ? box.max.y : box.min.y,
+                (i & 4) ? box.max.z : box.min.z);
+
+        // a corner in front of the near plane, can't be projected
+        if(clip.z < -clip.w || clip.w <= 0.0f)
+            return true;
+
+        float inverseW = 1.0f / clip.w;
+        float x = (clip.x * inverseW * 0.5f + 0.5f) * _width;
+        float y = (clip.y * inverseW * 0.5f + 0.5f) * _height;
+        minX = fminf(minX, x);
+        minY = fminf(minY, y);
+        maxX = fmaxf(maxX, x);
+        maxY = fmaxf(maxY, y);
+        minDepth = fminf(minDepth, clip.z * inverseW * 0.5f + 0.5f);
+    }
+#endif
+
+    // every pixel the box touches, even partly
+    int32_t pixelMinX = std::max(0, (int32_t) floorf(minX));
+    int32_t pixelMinY = std::max(0, (int32_t) floorf(minY));
+    int32_t pixelMaxX = std::min((int32_t) _width - 1, (int32_t) floorf(maxX));
+    int32_t pixelMaxY = std::min((int32_t) _height - 1, (int32_t) floorf(maxY));
+    if(pixelMinX > pixelMaxX || pixelMinY > pixelMaxY)
+        return false;
+
+    for(int32_t ty = pixelMinY / TILE_HEIGHT; ty <= pixelMaxY / (int32_t) TILE_HEIGHT; ty++) {
+        for(int32_t tx = pixelMinX / TILE_WIDTH; tx <= pixelMaxX / (int32_t) TILE_WIDTH; tx++) {
+            // the whole tile is nearer than the box
+            if(minDepth > _tileMaxDepth[ty * _tilesX + tx])
+                continue;
+
+            int32_t startX = std::max(pixelMinX, tx * (int32_t) TILE_WIDTH);
+            int32_t endX = std::min(pixelMaxX, (tx + 1) * (int32_t) TILE_WIDTH - 1);
+            int32_t startY = std::max(pixelMinY, ty * (int32_t) TILE_HEIGHT);
+            int32_t endY = std::min(pixelMaxY, (ty + 1) * (int32_t) TILE_HEIGHT - 1);
+
+#if defined(__SSE2__)
+            __m128 boxDepth = _mm_set1_ps(minDepth);
+            __m128i laneIndices = _mm_setr_epi32(0, 1, 2, 3);
+            __m128i firstLane = _mm_set1_epi32(startX - 1);
+            __m128i lastLane = _mm_set1_epi32(endX + 1);
+            for(int32_t y = startY; y <= endY; y++) {
+                const float* row = &_depth[y * _width];
+                for(int32_t x = startX & ~3; x <= endX; x += 4) {
+                    // lanes outside startX .. endX don't count
+                    __m128i lanes = _mm_add_epi32(_mm_set1_epi32(x), laneIndices);
+                    __m128i inRange = _mm_and_si128(_mm_cmpgt_epi32(lanes, firstLane),
+                            _mm_cmplt_epi32(lanes, lastLane));
+                    __m128 notHidden = _mm_cmple_ps(boxDepth, _mm_loadu_ps(row + x));
+                    if(_mm_movemask_ps(_mm_and_ps(notHidden, _mm_castsi128_ps(inRange))) != 0)
+                        return true;
+                }
+            }
+#else
+            for(int32_t y = startY; y <= endY; y++) {
+                const float* row = &_depth[y * _width];
+                for(int32_t x = startX; x <= endX; x++) {
+                    if(minDepth <= row[x])
+                        return true;
+                }
+            }
+#endif
+        }
+    }
+
+    return false;
+}
+
+unsigned OcclusionBuffer::cullBoxes(const BoundingBox* boxes, const uint32_t* candidates, unsigned count,
+        uint32_t* visible, const ParallelFor& parallelFor) {
+    // each task keeps its visible candidates at the start of its own part
+    // of visible, it only reads candidates from that part so visible may
+    // still be candidates. the parts are moved together afterwards
+    unsigned taskCount = (count + TASK_SIZE - 1) / TASK_SIZE;
+    _taskVisibleCounts.resize(taskCount);
+    parallelFor(taskCount, [&](unsigned task) {
+        unsigned first = task * TASK_SIZE;
+        unsigned last = std::min(count, first + TASK_SIZE);
+        unsigned taskVisibleCount = 0;
+        for(unsigned i = first; i < last; i++) {
+            uint32_t candidate = candidates[i];
+            if(isVisible(boxes[candidate]))
+                visible[first + taskVisibleCount++] = candidate;
+        }
+        _taskVisibleCounts[task] = taskVisibleCount;
+    });
+
+    unsigned visibleCount = 0;
+    for(unsigned task = 0; task < taskCount; task++) {
+        memmove(visible + visibleCount, visible + task * TASK_SIZE, _taskVisibleCounts[task] * sizeof(uint32_t));
+        visibleCount += _taskVisibleCounts[task];
+    }
+    return visibleCount;
+}
+
+unsigned OcclusionBuffer::width() const {
+    return _width;
+}
+
+unsigned OcclusionBuffer::height() const {
+    return _height;
+}
+
+const float* OcclusionBuffer::depth() const {
+    return _depth.data();
+}
+
+unsigned OcclusionBuffer::triangleCount() const {
+    return _triangles.size();
+}
@@ -0,0 +1,99 @@
+# ifndef OCCLUSION_BUFFER_H
+# define OCCLUSION_BUFFER_H
+
+#include <stdint.h>
+#include <vector>
+#include "Culling.h"
+#include "Parallel.h"
+
+namespace GLPractice {
+
+// a point in clip space, before the division by w
+struct ClipVertex {
+    float x;
+    float y;
+    float z;
+    float w;
+};
+
+// low resolution depth buffer filled on the CPU with a few large occluders,
+// objects whose box is behind it everywhere are not drawn
+//
+// the screen is cut into tiles, the occluder triangles are sorted into the
+// tiles they touch and each tile is rasterized as its own task, 4 pixels
+// at a time with SSE. depth is z / w of the clip space, 1 is the far plane.
+class OcclusionBuffer {
+    public:
+        // width is rounded up to TILE_WIDTH, height to TILE_HEIGHT
+        static const unsigned TILE_WIDTH = 32;
+        static const unsigned TILE_HEIGHT = 16;
+        // boxes tested by each task of cullBoxes()
+        static const unsigned TASK_SIZE = 1024;
+
+        OcclusionBuffer(unsigned width, unsigned height);
+
+        // clears the buffer and drops the occluders of the last frame
+        void begin(const Matrix& viewProjection);
+
+        // triangles of xyz positions, moved to world space by model
+        void addOccluder(const float* positions, const uint32_t* indices, unsigned indexCount,
+                const Matrix& model);
+
+        // draws the occluders added since begin(), one task per tile
+        void rasterize(const ParallelFor& parallelFor = serialFor);
+
+        // false if the box is behind the occluders at every pixel it covers,
+        // boxes crossing the near plane are always visible
+        bool isVisible(const BoundingBox& box) const;
+
+        // keeps the candidates whose boxes[candidate] is visible, in order,
+        // visible may be the same array as candidates. TASK_SIZE candidates
+        // at a time go through parallelFor
+        unsigned cullBoxes(const BoundingBox* boxes, const uint32_t* candidates, unsigned count,
+                uint32_t* visible, const ParallelFor& parallelFor = serialFor);
+
+        unsigned width() const;
+        unsigned height() const;
+        // row major from the bottom row, width() * height() values
+        const float* depth() const;
+        unsigned triangleCount() const;
+
+    private:
+        // a triangle after projection, in pixels and with
+        // the edge functions ready for the rasterizer
+        struct ScreenTriangle {
+            float edgeA[3];
+            float edgeB[3];
+            float edgeC[3];
+            // depth = depthA * x + depthB * y + depthC
+            float depthA;
+            float depthB;
+            float depthC;
+            int32_t minX;
+            int32_t minY;
+            int32_t maxX;
+            int32_t maxY;
+        };
+
+        void addClippedTriangle(const ClipVertex* clip);
+        void addScreenTriangle(const Vector3* screen);
+        void rasterizeTile(unsigned tile);
+
+        unsigned _width;
+        unsigned _height;
+        unsigned _tilesX;
+        unsigned _tilesY;
+        Matrix _viewProjection;
+        std::vector<float> _depth;
+        // farthest depth in each tile, to reject boxes without reading pixels
+        std::vector<float> _tileMaxDepth;
+        std::vector<ScreenTriangle> _triangles;
+        // triangle indices touching each tile
+        std::vector<std::vector<uint32_t> > _tileTriangles;
+        // visible candidates found by each task of cullBoxes()
+        std::vector<unsigned> _taskVisibleCounts;
+};
+
+} // namespace GLPractice
+
+#endif // OCCLUSION_BUFFER_H
@@ -0,0 +1,37 @@
+#include "Parallel.h"
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+using namespace GLPractice;
+
+void GLPractice::serialFor(unsigned taskCount, const std::function<void(unsigned)>& task) {
+    for(unsigned i = 0; i < taskCount; i++)
+        task(i);
+}
+
+void GLPractice::threadFor(unsigned taskCount, const std::function<void(unsigned)>& task) {
+    unsigned threadCount = std::min(taskCount, std::max(1u, std::thread::hardware_concurrency()));
+    if(threadCount <= 1) {
+        serialFor(taskCount, task);
+        return;
+    }
+
+    std::atomic<unsigned> next(0);
+    auto work = [&]() {
+        for(unsigned i = next++; i < taskCount; i = next++)
+            task(i);
+    };
+
+    // the calling thread works too
+    std::vector<std::thread> threads;
+    threads.reserve(threadCount - 1);
+    for(unsigned i = 1; i < threadCount; i++)
+        threads.emplace_back(work);
+    work();
+
+    for(std::thread& thread : threads)
+        thread.join();
+}
@@ -0,0 +1,21 @@
+# ifndef PARALLEL_H
+# define PARALLEL_H
+
+#include <functional>
+
+namespace GLPractice {
+
+// runs task(0) .. task(taskCount - 1), returning once all are done,
+// systems that can split their work take one of these to stay
+// independent of how it is spread over threads
+typedef std::function<void(unsigned taskCount, const std::function<void(unsigned)>& task)> ParallelFor;
+
+// all tasks in order on the calling thread
+void serialFor(unsigned taskCount, const std::function<void(unsigned)>& task);
+
+// tasks taken one at a time by a thread per core, started for this call only
+void threadFor(unsigned taskCount, const std::function<void(unsigned)>& task);
+
+} // namespace GLPractice
+
+#endif // PARALLEL_H
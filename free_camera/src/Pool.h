@@ -0,0 +1,163 @@
+# ifndef POOL_H
+# define POOL_H
+
+#include <stdint.h>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace GLPractice {
+
+// refers to an object of a Pool, a handle of a destroyed object stays
+// invalid even once its slot holds another object. the default handle
+// is never valid
+struct PoolHandle {
+    uint32_t index;
+    uint32_t generation;
+
+    PoolHandle(): index(0), generation(0) { }
+    PoolHandle(uint32_t index, uint32_t generation): index(index), generation(generation) { }
+
+    bool operator==(const PoolHandle& other) const {
+        return index == other.index && generation == other.generation;
+    }
+    bool operator!=(const PoolHandle& other) const { return !(*this == other); }
+};
+
+// a fixed number of slots allocated once, objects are created in free slots
+// and never move, so pointers to them stay valid until they are destroyed.
+// not thread safe: create(), destroy() and clear() must not run at the same
+// time as any other call, get() and at() may run on many threads together
+template<typename T>
+class Pool {
+    public:
+        explicit Pool(unsigned capacity);
+        ~Pool();
+
+        // throws when every slot is taken
+        template<typename... Args>
+        PoolHandle create(Args&&... args);
+        // nothing happens for a handle which is not valid
+        void destroy(PoolHandle handle);
+        void clear();
+
+        bool isValid(PoolHandle handle) const;
+        // NULL for a handle which is not valid
+        T* get(PoolHandle handle);
+        const T* get(PoolHandle handle) const;
+        // throws for a handle which is not valid
+        T& at(PoolHandle handle);
+        const T& at(PoolHandle handle) const;
+
+        unsigned size() const;
+        unsigned capacity() const;
+
+        Pool(const Pool&) = delete;
+        Pool& operator=(const Pool&) = delete;
+
+    private:
+        typedef typename std::aligned_storage<sizeof(T), alignof(T)>::type Slot;
+
+        T* object(uint32_t index) { return reinterpret_cast<T*>(&_slots[index]); }
+        const T* object(uint32_t index) const { return reinterpret_cast<const T*>(&_slots[index]); }
+
+        std::unique_ptr<Slot[]> _slots;
+        // odd while the slot holds an object
+        std::vector<uint32_t> _generations;
+        std::vector<uint32_t> _free;
+        unsigned _capacity;
+};
+
+template<typename T>
+Pool<T>::Pool(unsigned capacity):
+    _slots(new Slot[capacity]),
+    _generations(capacity, 0),
+    _capacity(capacity)
+{
+    // the first slots are taken first
+    _free.reserve(capacity);
+    for(unsigned i = capacity; i > 0; i--)
+        _free.push_back(i - 1);
+}
+
+template<typename T>
+Pool<T>::~Pool() {
+    clear();
+}
+
+template<typename T>
+template<typename... Args>
+PoolHandle Pool<T>::create(Args&&... args) {
+    if(_free.empty())
+        throw std::runtime_error("pool is full");
+
+    uint32_t index = _free.back();
+    new(object(index)) T(std::forward<Args>(args)...);
+    _free.pop_back();
+    return PoolHandle(index, ++_generations[index]);
+}
+
+template<typename T>
+void Pool<T>::destroy(PoolHandle handle) {
+    if(!isValid(handle))
+        return;
+
+    object(handle.index)->~T();
+    _generations[handle.index]++;
+    _free.push_back(handle.index);
+}
+
+template<typename T>
+void Pool<T>::clear() {
+    for(uint32_t i = 0; i < _capacity; i++) {
+        if(_generations[i] & 1)
+            destroy(PoolHandle(i, _generations[i]));
+    }
+}
+
+template<typename T>
+bool Pool<T>::isValid(PoolHandle handle) const {
+    return handle.index < _capacity && (handle.generation & 1) &&
+        _generations[handle.index] == handle.generation;
+}
+
+template<typename T>
+T* Pool<T>::get(PoolHandle handle) {
+    return isValid(handle) ? object(handle.index) : NULL;
+}
+
+template<typename T>
+const T* Pool<T>::get(PoolHandle handle) const {
+    return isValid(handle) ? object(handle.index) : NULL;
+}
+
+template<typename T>
+T& Pool<T>::at(PoolHandle handle) {
+    if(!isValid(handle))
+        throw std::runtime_error("invalid pool handle");
+    return *object(handle.index);
+}
+
+template<typename T>
+const T& Pool<T>::at(PoolHandle handle) const {
+    if(!isValid(handle))
+        throw std::runtime_error("invalid pool handle");
+    return *object(handle.index);
+}
+
+template<typename T>
+unsigned Pool<T>::size() const {
+    return _capacity - _free.size();
+}
+
+template<typename T>
+unsigned Pool<T>::capacity() const {
+    return _capacity;
+}
+
+} // namespace GLPractice
+
+#endif // POOL_H
@@ -0,0 +1,34 @@
+#include "common.h"
+
+using namespace GLPractice;
+
+QueryPool& QueryPool::get() {
+    static QueryPool pool;
+    return pool;
+}
+
+QueryPool::QueryPool() { }
+
+GLuint QueryPool::acquire() {
+    if(!_freeQueries.empty()) {
+        GLuint query = _freeQueries.back();
+        _freeQueries.pop_back();
+        return query;
+    }
+
+    GLuint query;
+    glGenQueries(1, &query);
+    _queries.emplace_back(query);
+    return query;
+}
+
+void QueryPool::release(GLuint query) {
+    // queries released after clear() are already deleted
+    if(!_queries.empty())
+        _freeQueries.push_back(query);
+}
+
+void QueryPool::clear() {
+    _freeQueries.clear();
+    _queries.clear();
+}
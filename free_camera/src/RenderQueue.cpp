@@ -0,0 +1,196 @@
+#include "common.h"
+
+using namespace GLPractice;
+
+#define KEY_PASS_SHIFT 62
+#define KEY_DEPTH_BITS 28
+#define KEY_PROGRAM_BITS 10
+#define KEY_MATERIAL_BITS 12
+#define KEY_VAO_BITS 12
+
+static uint64_t keyField(uint64_t value, unsigned bits) {
+    return value & ((uint64_t(1) << bits) - 1);
+}
+
+void GLPractice::radixSort(uint64_t* keys, uint32_t* values, size_t count,
+        uint64_t* tmpKeys, uint32_t* tmpValues) {
+    // LSD radix sort with 8 bit digits, a digit that is the same for
+    // every key is skipped, so short or sparse keys are cheap to sort
+    uint64_t* srcKeys = keys;
+    uint32_t* srcValues = values;
+    uint64_t* dstKeys = tmpKeys;
+    uint32_t* dstValues = tmpValues;
+
+    for(unsigned shift = 0; shift < 64; shift += 8) {
+        size_t histogram[256] = { 0 };
+        for(size_t i = 0; i < count; i++)
+            histogram[(srcKeys[i] >> shift) & 0xff]++;
+
+        if(count == 0 || histogram[(srcKeys[0] >> shift) & 0xff] == count)
+            continue;
+
+        size_t offset = 0;
+        for(unsigned digit = 0; digit < 256; digit++) {
+            size_t digitCount = histogram[digit];
+            histogram[digit] = offset;
+            offset += digitCount;
+        }
+
+        for(size_t i = 0; i < count; i++) {
+            size_t dst = histogram[(srcKeys[i] >> shift) & 0xff]++;
+            dstKeys[dst] = srcKeys[i];
+            dstValues[dst] = srcValues[i];
+        }
+
+        uint64_t* swapKeys = srcKeys;
+        srcKeys = dstKeys;
+        dstKeys = swapKeys;
+        uint32_t* swapValues = srcValues;
+        srcValues = dstValues;
+        dstValues = swapValues;
+    }
+
+    if(srcKeys != keys) {
+        memcpy(keys, srcKeys, count * sizeof(uint64_t));
+        memcpy(values, srcValues, count * sizeof(uint32_t));
+    }
+}
+
+RenderQueue::RenderQueue():
+    _programBindCount(0),
+    _vertexArrayBindCount(0)
+{ }
+
+void RenderQueue::clear() {
+    // keeps the capacity, so a steady frame loop does not allocate
+    _keys.clear();
+    _order.clear();
+    _items.clear();
+}
+
+uint64_t RenderQueue::makeKey(Pass pass, GLuint program, GLuint material, GLuint vao, float depth) {
+    uint64_t maxDepth = (uint64_t(1) << KEY_DEPTH_BITS) - 1;
+    uint64_t quantizedDepth = (uint64_t) (Clamp(depth, 0.0f, 1.0f) * maxDepth);
+
+    uint64_t state = keyField(program, KEY_PROGRAM_BITS) << (KEY_MATERIAL_BITS + KEY_VAO_BITS) |
+        keyField(material, KEY_MATERIAL_BITS) << KEY_VAO_BITS |
+        keyField(vao, KEY_VAO_BITS);
+
+    uint64_t key = (uint64_t) pass << KEY_PASS_SHIFT;
+    if(pass == PASS_TRANSPARENT) {
+        // far objects first, so blending composes back to front
+        key |= (maxDepth - quantizedDepth) << (KEY_PROGRAM_BITS + KEY_MATERIAL_BITS + KEY_VAO_BITS);
+        key |= state;
+    }
+    else {
+        key |= state << KEY_DEPTH_BITS;
+        key |= quantizedDepth;
+    }
+    return key;
+}
+
+void RenderQueue::push(Pass pass, GLuint material, float depth, const DrawItem& item) {
+    _keys.push_back(makeKey(pass, item.program, material, item.vao, depth));
+    _order.push_back(_items.size());
+    _items.push_back(item);
+}
+
+void RenderQueue::sort() {
+    _sortKeys.resize(_keys.size());
+    _sortOrder.resize(_order.size());
+    radixSort(_keys.data(), _order.data(), _keys.size(), _sortKeys.data(), _sortOrder.data());
+}
+
+void RenderQueue::submit() {
+    GLStateCache& state = GLStateCache::get();
+    GLuint program = 0;
+    GLuint vao = 0;
+    uint64_t pass = PASS_TRANSPARENT + 1;
+
+    _programBindCount = 0;
+    _vertexArrayBindCount = 0;
+
+    for(size_t i = 0; i < _order.size(); i++) {
+        const DrawItem& item = _items[_order[i]];
+
+        uint64_t itemPass = _keys[i] >> KEY_PASS_SHIFT;
+        if(itemPass != pass) {
+            // transparent draws blend over the opaque ones
+            // without hiding each other in the depth buffer
+            state.applyPipelineState(itemPass == PASS_TRANSPARENT ?
+                    PipelineState::transparent() : PipelineState::opaque());
+            pass = itemPass;
+        }
+
+        if(item.program != program) {
+            state.useProgram(item.program);
+            program = item.program;
+            _programBindCount++;
+        }
+        if(item.vao != vao) {
+            state.bindVertexArray(item.vao);
+            vao = item.vao;
+            _vertexArrayBindCount++;
+        }
+        if(item.vbo) {
+            state.bindVertexBuffer(VERTEX_BINDING_MESH, item.vbo, 0, item.vertexStride);
+            state.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, item.ebo);
+        }
+
+        glUniformMatrix4fv(item.modelLocation, 1, GL_FALSE, item.model.v);
+        glDrawElementsBaseVertex(GL_TRIANGLES, item.indexCount, GL_UNSIGNED_INT,
+                (const void*) (item.firstIndex * sizeof(GLuint)), item.baseVertex);
+    }
+
+    // leave the default states for the draws outside of the queue
+    if(pass == PASS_TRANSPARENT)
+        state.applyPipelineState(PipelineState::opaque());
+}
+
+unsigned RenderQueue::size() const {
+    return _items.size();
+}
+
+unsigned RenderQueue::getProgramBindCount() const {
+    return _programBindCount;
+}
+
+unsigned RenderQueue::getVertexArrayBindCount() const {
+    return _vertexArrayBindCount;
+}
+
+// the GL calls of the recorded commands
+struct CommandSubmitter {
+    GLStateCache& state;
+
+    void bindProgram(uint32_t program) {
+        state.useProgram(program);
+    }
+    void bindVertexArray(uint32_t vao) {
+        state.bindVertexArray(vao);
+    }
+    void bindMeshBuffers(const CommandBuffer::BindMeshBuffers& command) {
+        state.bindVertexBuffer(VERTEX_BINDING_MESH, command.vbo, 0, command.vertexStride);
+        state.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, command.ebo);
+    }
+    void setUniformMatrix4(const CommandBuffer::UniformMatrix4& command) {
+        glUniformMatrix4fv(command.location, 1, GL_FALSE, command.v);
+    }
+    void setUniformVec4(const CommandBuffer::UniformVec4& command) {
+        glUniform4fv(command.location, 1, command.v);
+    }
+    void drawElements(const CommandBuffer::DrawElements& command) {
+        const void* indices = (const void*) (command.firstIndex * sizeof(GLuint));
+        if(command.instanceCount == 1)
+            glDrawElementsBaseVertex(GL_TRIANGLES, command.indexCount, GL_UNSIGNED_INT,
+                    indices, command.baseVertex);
+        else
+            glDrawElementsInstancedBaseVertex(GL_TRIANGLES, command.indexCount, GL_UNSIGNED_INT,
+                    indices, command.instanceCount, command.baseVertex);
+    }
+};
+
+void GLPractice::submitCommands(const CommandList& commands) {
+    CommandSubmitter submitter = { GLStateCache::get() };
+    commands.replay(submitter);
+}
@@ -0,0 +1,35 @@
+# ifndef SCENE_COMPONENTS_H
+# define SCENE_COMPONENTS_H
+
+#include <stdint.h>
+
+namespace GLPractice {
+
+// components of the scene entities besides Transform and the world
+// BoundingSphere, stored by EntityStore
+
+// a mesh of the scene, or the LOD chain when RENDER_LOD is set
+struct MeshRef {
+    uint32_t mesh;
+};
+
+struct Color {
+    float rgba[4];
+};
+
+enum RenderFlag {
+    // drawn as an instance of its mesh, culled with the other instances
+    RENDER_INSTANCED = 1,
+    // drawn at the level of detail its distance needs
+    RENDER_LOD = 2,
+    // may hide the instances behind it
+    RENDER_OCCLUDER = 4
+};
+
+struct RenderFlags {
+    uint32_t flags;
+};
+
+} // namespace GLPractice
+
+#endif // SCENE_COMPONENTS_H
@@ -0,0 +1,227 @@
+#include "SceneGraph.h"
+
+#include <algorithm>
+#include <atomic>
+#include <stdexcept>
+
+using namespace GLPractice;
+
+const uint32_t SceneGraph::NO_NODE;
+const unsigned SceneGraph::TASK_SIZE;
+
+SceneGraph::SceneGraph():
+    _nodeCount(0),
+    _orderValid(true),
+    _anyDirty(false),
+    _updatedCount(0)
+{ }
+
+uint32_t SceneGraph::indexOf(uint32_t node) const {
+    if(node >= _indices.size() || _indices[node] == NO_NODE)
+        throw std::runtime_error("unknown node in SceneGraph");
+    return _indices[node];
+}
+
+uint32_t SceneGraph::addNode(uint32_t parent, const Transform& local) {
+    uint32_t parentIndex = parent == NO_NODE ? NO_NODE : indexOf(parent);
+
+    uint32_t node;
+    if(!_freeHandles.empty()) {
+        node = _freeHandles.back();
+        _freeHandles.pop_back();
+    }
+    else {
+        node = _indices.size();
+        _indices.push_back(NO_NODE);
+    }
+
+    // appended for now, moved to its level by the next rebuild
+    _indices[node] = _handles.size();
+    _handles.push_back(node);
+    _parents.push_back(parentIndex);
+    _locals.push_back(local);
+    _worlds.push_back(MatrixIdentity());
+    _dirty.push_back(1);
+    _removed.push_back(0);
+
+    _nodeCount++;
+    _orderValid = false;
+    _anyDirty = true;
+    return node;
+}
+
+void SceneGraph::removeNode(uint32_t node) {
+    indexOf(node);
+    // in breadth first order a single pass reaches the whole subtree
+    if(!_orderValid)
+        rebuildOrder();
+
+    _removed[indexOf(node)] = 1;
+    for(uint32_t i = indexOf(node) + 1; i < _handles.size(); i++) {
+        if(_parents[i] != NO_NODE && _removed[_parents[i]])
+            _removed[i] = 1;
+    }
+
+    for(uint32_t i = 0; i < _handles.size(); i++) {
+        if(_removed[i] && _indices[_handles[i]] != NO_NODE) {
+            _indices[_handles[i]] = NO_NODE;
+            _freeHandles.push_back(_handles[i]);
+            _nodeCount--;
+        }
+    }
+    _orderValid = false;
+}
+
+void SceneGraph::setParent(uint32_t node, uint32_t parent) {
+    uint32_t index = indexOf(node);
+    uint32_t parentIndex = parent == NO_NODE ? NO_NODE : indexOf(parent);
+
+    for(uint32_t ancestor = parentIndex; ancestor != NO_NODE; ancestor = _parents[ancestor]) {
+        if(ancestor == index)
+            throw std::runtime_error("SceneGraph node can not be moved below itself");
+    }
+
+    _parents[index] = parentIndex;
+    _dirty[index] = 1;
+    _orderValid = false;
+    _anyDirty = true;
+}
+
+uint32_t SceneGraph::getParent(uint32_t node) const {
+    uint32_t parentIndex = _parents[indexOf(node)];
+    return parentIndex == NO_NODE ? NO_NODE : _handles[parentIndex];
+}
+
+const Transform& SceneGraph::getLocalTransform(uint32_t node) const {
+    return _locals[indexOf(node)];
+}
+
+void SceneGraph::setLocalTransform(uint32_t node, const Transform& local) {
+    uint32_t index = indexOf(node);
+    _locals[index] = local;
+    _dirty[index] = 1;
+    _anyDirty = true;
+}
+
+const Matrix& SceneGraph::getWorldMatrix(uint32_t node) const {
+    return _worlds[indexOf(node)];
+}
+
+void SceneGraph::rebuildOrder() {
+    unsigned size = _handles.size();
+
+    // children of each node as one array, counted first
+    _childStarts.assign(size + 1, 0);
+    for(uint32_t i = 0; i < size; i++) {
+        if(!_removed[i] && _parents[i] != NO_NODE)
+            _childStarts[_parents[i] + 1]++;
+    }
+    for(uint32_t i = 0; i < size; i++)
+        _childStarts[i + 1] += _childStarts[i];
+    _children.resize(_childStarts[size]);
+    _order.assign(_childStarts.begin(), _childStarts.end() - 1);
+    for(uint32_t i = 0; i < size; i++) {
+        if(!_removed[i] && _parents[i] != NO_NODE)
+            _children[_order[_parents[i]]++] = i;
+    }
+
+    // the roots are the first level, the children of a level the next one
+    _order.clear();
+    _levelStarts.clear();
+    for(uint32_t i = 0; i < size; i++) {
+        if(!_removed[i] && _parents[i] == NO_NODE)
+            _order.push_back(i);
+    }
+    uint32_t levelStart = 0;
+    while(levelStart < _order.size()) {
+        _levelStarts.push_back(levelStart);
+        uint32_t levelEnd = _order.size();
+        for(uint32_t i = levelStart; i < levelEnd; i++) {
+            uint32_t parent = _order[i];
+            _order.insert(_order.end(), _children.begin() + _childStarts[parent],
+                    _children.begin() + _childStarts[parent + 1]);
+        }
+        levelStart = levelEnd;
+    }
+    _levelStarts.push_back(_order.size());
+
+    // old position to new one, the counts are not needed any more
+    std::vector<uint32_t>& positions = _childStarts;
+    for(uint32_t i = 0; i < _order.size(); i++)
+        positions[_order[i]] = i;
+
+    unsigned count = _order.size();
+    std::vector<uint32_t> handles(count);
+    std::vector<uint32_t> parents(count);
+    std::vector<Transform> locals(count);
+    std::vector<Matrix> worlds(count);
+    std::vector<uint8_t> dirty(count);
+    for(uint32_t i = 0; i < count; i++) {
+        uint32_t old = _order[i];
+        handles[i] = _handles[old];
+        parents[i] = _parents[old] == NO_NODE ? NO_NODE : positions[_parents[old]];
+        locals[i] = _locals[old];
+        worlds[i] = _worlds[old];
+        dirty[i] = _dirty[old];
+        _indices[handles[i]] = i;
+    }
+    _handles.swap(handles);
+    _parents.swap(parents);
+    _locals.swap(locals);
+    _worlds.swap(worlds);
+    _dirty.swap(dirty);
+    _removed.assign(count, 0);
+    _orderValid = true;
+}
+
+void SceneGraph::update(const ParallelFor& parallelFor) {
+    if(!_orderValid)
+        rebuildOrder();
+
+    _updatedCount = 0;
+    if(!_anyDirty)
+        return;
+
+    // a node is recomputed when it changed or its parent was recomputed,
+    // which is known once the level above is done
+    std::atomic<unsigned> updatedCount(0);
+    for(unsigned level = 0; level + 1 < _levelStarts.size(); level++) {
+        uint32_t levelStart = _levelStarts[level];
+        uint32_t levelEnd = _levelStarts[level + 1];
+        unsigned taskCount = (levelEnd - levelStart + TASK_SIZE - 1) / TASK_SIZE;
+
+        parallelFor(taskCount, [&](unsigned task) {
+            uint32_t first = levelStart + task * TASK_SIZE;
+            uint32_t last = std::min(levelEnd, first + TASK_SIZE);
+            unsigned taskUpdatedCount = 0;
+            for(uint32_t i = first; i < last; i++) {
+                uint32_t parent = _parents[i];
+                if(parent != NO_NODE && _dirty[parent])
+                    _dirty[i] = 1;
+                if(!_dirty[i])
+                    continue;
+
+                Matrix local = _locals[i].toMatrix();
+                _worlds[i] = parent == NO_NODE ? local : _worlds[parent] * local;
+                taskUpdatedCount++;
+            }
+            updatedCount += taskUpdatedCount;
+        });
+    }
+
+    std::fill(_dirty.begin(), _dirty.end(), 0);
+    _anyDirty = false;
+    _updatedCount = updatedCount;
+}
+
+unsigned SceneGraph::nodeCount() const {
+    return _nodeCount;
+}
+
+unsigned SceneGraph::levelCount() const {
+    return _levelStarts.empty() ? 0 : _levelStarts.size() - 1;
+}
+
+unsigned SceneGraph::updatedCount() const {
+    return _updatedCount;
+}
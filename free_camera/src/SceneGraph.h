@@ -0,0 +1,84 @@
+# ifndef SCENE_GRAPH_H
+# define SCENE_GRAPH_H
+
+#include <stdint.h>
+#include <vector>
+#include "Parallel.h"
+#include "Transform.h"
+
+namespace GLPractice {
+
+// hierarchy of nodes, each with a local Transform relative to its parent
+// and the local to world matrix computed from it
+//
+// the nodes are stored breadth first in flat arrays, so every parent comes
+// before its children and each depth level is one range of the arrays.
+// update() walks the levels in order, splitting each one into tasks, and
+// only recomputes the nodes whose transform or some ancestor's changed.
+// the arrays are reordered in the next update() after the hierarchy changed,
+// nodes are named by handles which stay the same
+class SceneGraph {
+    public:
+        // parent of the root nodes
+        static const uint32_t NO_NODE = 0xffffffffu;
+        // nodes of a level computed by one task
+        static const unsigned TASK_SIZE = 1024;
+
+        SceneGraph();
+
+        // a new node under parent, or a root node with NO_NODE, returns its handle
+        uint32_t addNode(uint32_t parent = NO_NODE, const Transform& local = Transform());
+        // removes the node and all nodes below it
+        void removeNode(uint32_t node);
+        // moves the node with all nodes below it, throws if parent is below the node
+        void setParent(uint32_t node, uint32_t parent);
+        uint32_t getParent(uint32_t node) const;
+
+        const Transform& getLocalTransform(uint32_t node) const;
+        void setLocalTransform(uint32_t node, const Transform& local);
+        // as of the last update()
+        const Matrix& getWorldMatrix(uint32_t node) const;
+
+        // recompute the world matrices of the changed nodes and all nodes
+        // below them, the tasks of one level run through parallelFor
+        void update(const ParallelFor& parallelFor = serialFor);
+
+        unsigned nodeCount() const;
+        unsigned levelCount() const;
+        // nodes whose world matrix the last update() computed
+        unsigned updatedCount() const;
+
+    private:
+        void rebuildOrder();
+        uint32_t indexOf(uint32_t node) const;
+
+        // by position in breadth first order, until the next rebuild new
+        // nodes are appended and removed ones are only marked
+        std::vector<uint32_t> _handles;
+        std::vector<uint32_t> _parents;
+        std::vector<Transform> _locals;
+        std::vector<Matrix> _worlds;
+        // the local transform or the parent changed, and during
+        // update() the world matrix was recomputed
+        std::vector<uint8_t> _dirty;
+        std::vector<uint8_t> _removed;
+        // first position of each level, and the end of the last one
+        std::vector<uint32_t> _levelStarts;
+
+        // position of each handle, NO_NODE for free handles
+        std::vector<uint32_t> _indices;
+        std::vector<uint32_t> _freeHandles;
+        unsigned _nodeCount;
+        bool _orderValid;
+        bool _anyDirty;
+        unsigned _updatedCount;
+
+        // scratch space of rebuildOrder()
+        std::vector<uint32_t> _childStarts;
+        std::vector<uint32_t> _children;
+        std::vector<uint32_t> _order;
+};
+
+} // namespace GLPractice
+
+#endif // SCENE_GRAPH_H
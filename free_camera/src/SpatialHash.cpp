@@ -0,0 +1,309 @@
+#include "SpatialHash.h"
+
+#include <cfloat>
+#include <stdexcept>
+
+using namespace GLPractice;
+
+// the cells a key can tell apart on each axis, positions further out are
+// in the outermost cells, which reach to infinity on their outer side
+static const int32_t MIN_CELL = -(1 << 20);
+static const int32_t MAX_CELL = (1 << 20) - 1;
+
+static int32_t clampCell(float cell) {
+    return (int32_t) fminf(fmaxf(cell, (float) MIN_CELL), (float) MAX_CELL);
+}
+
+// 21 bits per axis, cells from MIN_CELL to MAX_CELL on each
+static uint64_t cellKey(int32_t x, int32_t y, int32_t z) {
+    const uint64_t mask = (1u << 21) - 1;
+    const int32_t offset = 1 << 20;
+    return ((uint64_t) ((x + offset) & mask) << 42) |
+        ((uint64_t) ((y + offset) & mask) << 21) |
+        (uint64_t) ((z + offset) & mask);
+}
+
+SpatialHash::SpatialHash(float cellSize):
+    _cellSize(cellSize),
+    _inverseCellSize(1.0f / cellSize),
+    _maxRadius(0.0f),
+    _liveCellCount(0)
+{
+    if(cellSize <= 0.0f)
+        throw std::runtime_error("cell size of SpatialHash must be positive");
+}
+
+void SpatialHash::clear() {
+    _cells.clear();
+    _freeCells.clear();
+    _cellLookup.clear();
+    _objects.clear();
+    _maxRadius = 0.0f;
+    _liveCellCount = 0;
+}
+
+void SpatialHash::cellCoordinates(const Vector3& position, int32_t& x, int32_t& y, int32_t& z) const {
+    x = clampCell(floorf(position.x * _inverseCellSize));
+    y = clampCell(floorf(position.y * _inverseCellSize));
+    z = clampCell(floorf(position.z * _inverseCellSize));
+}
+
+int32_t SpatialHash::findCell(int32_t x, int32_t y, int32_t z) const {
+    auto found = _cellLookup.find(cellKey(x, y, z));
+    return found == _cellLookup.end() ? -1 : found->second;
+}
+
+int32_t SpatialHash::findOrAddCell(int32_t x, int32_t y, int32_t z) {
+    uint64_t key = cellKey(x, y, z);
+    auto found = _cellLookup.find(key);
+    if(found != _cellLookup.end())
+        return found->second;
+
+    int32_t index;
+    if(!_freeCells.empty()) {
+        index = _freeCells.back();
+        _freeCells.pop_back();
+    }
+    else {
+        _cells.push_back(Cell());
+        index = _cells.size() - 1;
+    }
+
+    Cell& cell = _cells[index];
+    cell.x = x;
+    cell.y = y;
+    cell.z = z;
+    cell.head = -1;
+    cell.count = 0;
+    cell.maxRadius = 0.0f;
+    _cellLookup[key] = index;
+    _liveCellCount++;
+    return index;
+}
+
+void SpatialHash::link(uint32_t object, int32_t cellIndex) {
+    Object& entry = _objects[object];
+    Cell& cell = _cells[cellIndex];
+
+    entry.cell = cellIndex;
+    entry.previous = -1;
+    entry.next = cell.head;
+    if(cell.head >= 0)
+        _objects[cell.head].previous = object;
+    cell.head = object;
+    cell.count++;
+    cell.maxRadius = fmaxf(cell.maxRadius, entry.radius);
+}
+
+void SpatialHash::unlink(uint32_t object) {
+    Object& entry = _objects[object];
+    Cell& cell = _cells[entry.cell];
+
+    if(entry.previous >= 0)
+        _objects[entry.previous].next = entry.next;
+    else
+        cell.head = entry.next;
+    if(entry.next >= 0)
+        _objects[entry.next].previous = entry.previous;
+
+    // empty cells are dropped, so the grid only holds occupied ones
+    cell.count--;
+    if(cell.count == 0) {
+        _cellLookup.erase(cellKey(cell.x, cell.y, cell.z));
+        _freeCells.push_back(entry.cell);
+        _liveCellCount--;
+    }
+
+    entry.cell = -1;
+    entry.previous = -1;
+    entry.next = -1;
+}
+
+void SpatialHash::insert(uint32_t object, const Vector3& position, float radius) {
+    if(object >= _objects.size()) {
+        Object empty;
+        empty.position = Vector3Zero();
+        empty.radius = 0.0f;
+        empty.cell = -1;
+        empty.previous = -1;
+        empty.next = -1;
+        _objects.resize(object + 1, empty);
+    }
+
+    if(_objects[object].cell >= 0)
+        throw std::runtime_error("object is already in the SpatialHash");
+
+    _objects[object].position = position;
+    _objects[object].radius = radius;
+    _maxRadius = fmaxf(_maxRadius, radius);
+
+    int32_t x, y, z;
+    cellCoordinates(position, x, y, z);
+    link(object, findOrAddCell(x, y, z));
+}
+
+void SpatialHash::remove(uint32_t object) {
+    if(object >= _objects.size() || _objects[object].cell < 0)
+        throw std::runtime_error("object is not in the SpatialHash");
+
+    unlink(object);
+}
+
+void SpatialHash::update(uint32_t object, const Vector3& position, float radius) {
+    if(object >= _objects.size() || _objects[object].cell < 0) {
+        insert(object, position, radius);
+        return;
+    }
+
+    Object& entry = _objects[object];
+    entry.position = position;
+    entry.radius = radius;
+    _maxRadius = fmaxf(_maxRadius, radius);
+
+    int32_t x, y, z;
+    cellCoordinates(position, x, y, z);
+    Cell& cell = _cells[entry.cell];
+    if(cell.x == x && cell.y == y && cell.z == z) {
+        cell.maxRadius = fmaxf(cell.maxRadius, radius);
+        return;
+    }
+
+    unlink(object);
+    link(object, findOrAddCell(x, y, z));
+}
+
+BoundingBox SpatialHash::looseBounds(const Cell& cell) const {
+    BoundingBox box;
+    box.min.x = cell.x * _cellSize - cell.maxRadius;
+    box.min.y = cell.y * _cellSize - cell.maxRadius;
+    box.min.z = cell.z * _cellSize - cell.maxRadius;
+    box.max.x = (cell.x + 1) * _cellSize + cell.maxRadius;
+    box.max.y = (cell.y + 1) * _cellSize + cell.maxRadius;
+    box.max.z = (cell.z + 1) * _cellSize + cell.maxRadius;
+
+    // objects past the outermost cells are in them
+    box.min.x = cell.x == MIN_CELL ? -FLT_MAX : box.min.x;
+    box.min.y = cell.y == MIN_CELL ? -FLT_MAX : box.min.y;
+    box.min.z = cell.z == MIN_CELL ? -FLT_MAX : box.min.z;
+    box.max.x = cell.x == MAX_CELL ? FLT_MAX : box.max.x;
+    box.max.y = cell.y == MAX_CELL ? FLT_MAX : box.max.y;
+    box.max.z = cell.z == MAX_CELL ? FLT_MAX : box.max.z;
+    return box;
+}
+
+void SpatialHash::addCell(const Cell& cell, uint32_t* result, unsigned& count) const {
+    for(int32_t object = cell.head; object >= 0; object = _objects[object].next)
+        result[count++] = object;
+}
+
+void SpatialHash::cullCell(const Cell& cell, const Frustum& frustum, uint32_t* visible, unsigned& count) const {
+    BoundingBox bounds = looseBounds(cell);
+    if(!frustum.intersects(bounds))
+        return;
+
+    if(frustum.contains(bounds)) {
+        addCell(cell, visible, count);
+        return;
+    }
+
+    for(int32_t object = cell.head; object >= 0; object = _objects[object].next) {
+        BoundingSphere sphere;
+        sphere.center = _objects[object].position;
+        sphere.radius = _objects[object].radius;
+        visible[count] = object;
+        count += frustum.intersects(sphere) ? 1 : 0;
+    }
+}
+
+unsigned SpatialHash::cullFrustum(const Frustum& frustum, uint32_t* visible) const {
+    unsigned count = 0;
+
+    BoundingBox bounds = frustum.bounds();
+    Vector3 reach = { _maxRadius, _maxRadius, _maxRadius };
+    bounds.min = Vector3Subtract(bounds.min, reach);
+    bounds.max = Vector3Add(bounds.max, reach);
+
+    int32_t minX, minY, minZ, maxX, maxY, maxZ;
+    cellCoordinates(bounds.min, minX, minY, minZ);
+    cellCoordinates(bounds.max, maxX, maxY, maxZ);
+
+    if(rangeCellCount(minX, minY, minZ, maxX, maxY, maxZ) > _liveCellCount) {
+        for(const Cell& cell : _cells) {
+            if(cell.count > 0)
+                cullCell(cell, frustum, visible, count);
+        }
+        return count;
+    }
+
+    for(int32_t z = minZ; z <= maxZ; z++) {
+        for(int32_t y = minY; y <= maxY; y++) {
+            for(int32_t x = minX; x <= maxX; x++) {
+                int32_t cell = findCell(x, y, z);
+                if(cell >= 0)
+                    cullCell(_cells[cell], frustum, visible, count);
+            }
+        }
+    }
+    return count;
+}
+
+uint64_t SpatialHash::rangeCellCount(int32_t minX, int32_t minY, int32_t minZ,
+        int32_t maxX, int32_t maxY, int32_t maxZ) const {
+    return (uint64_t) (maxX - minX + 1) * (uint64_t) (maxY - minY + 1) * (uint64_t) (maxZ - minZ + 1);
+}
+
+unsigned SpatialHash::queryRadius(const Vector3& center, float radius, uint32_t* result) const {
+    unsigned count = 0;
+    float reach = radius + _maxRadius;
+
+    int32_t minX, minY, minZ, maxX, maxY, maxZ;
+    Vector3 offset = { reach, reach, reach };
+    cellCoordinates(Vector3Subtract(center, offset), minX, minY, minZ);
+    cellCoordinates(Vector3Add(center, offset), maxX, maxY, maxZ);
+
+    auto testCell = [&](const Cell& cell) {
+        for(int32_t object = cell.head; object >= 0; object = _objects[object].next) {
+            const Object& entry = _objects[object];
+            Vector3 delta = Vector3Subtract(entry.position, center);
+            float distance = radius + entry.radius;
+            result[count] = object;
+            count += Vector3DotProduct(delta, delta) <= distance * distance ? 1 : 0;
+        }
+    };
+
+    // look up the cells in range, unless there are fewer occupied cells
+    if(rangeCellCount(minX, minY, minZ, maxX, maxY, maxZ) > _liveCellCount) {
+        for(const Cell& cell : _cells) {
+            if(cell.count == 0)
+                continue;
+            if(cell.x < minX || cell.y < minY || cell.z < minZ ||
+                    cell.x > maxX || cell.y > maxY || cell.z > maxZ)
+                continue;
+            testCell(cell);
+        }
+        return count;
+    }
+
+    for(int32_t z = minZ; z <= maxZ; z++) {
+        for(int32_t y = minY; y <= maxY; y++) {
+            for(int32_t x = minX; x <= maxX; x++) {
+                int32_t cell = findCell(x, y, z);
+                if(cell >= 0)
+                    testCell(_cells[cell]);
+            }
+        }
+    }
+    return count;
+}
+
+unsigned SpatialHash::objectCount() const {
+    return _objects.size();
+}
+
+unsigned SpatialHash::cellCount() const {
+    return _liveCellCount;
+}
+
+float SpatialHash::cellSize() const {
+    return _cellSize;
+}
@@ -0,0 +1,88 @@
+# ifndef SPATIAL_HASH_H
+# define SPATIAL_HASH_H
+
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+#include "Culling.h"
+
+namespace GLPractice {
+
+// uniform grid of loose cells over object spheres, only the occupied
+// cells are stored, found through a hash of their coordinates
+//
+// an object is in the one cell holding its center, the cell bounds are
+// grown by the largest radius in it. so moving an object only relinks it
+// when it crosses into another cell, unlike a tree nothing else changes.
+class SpatialHash {
+    public:
+        // larger cells are relinked less often but test more objects per
+        // query, a few times the object size is usually a good start
+        explicit SpatialHash(float cellSize);
+
+        void clear();
+
+        void insert(uint32_t object, const Vector3& position, float radius);
+        void remove(uint32_t object);
+        // inserts objects not in the grid yet
+        void update(uint32_t object, const Vector3& position, float radius);
+
+        // the results need room for one entry per object id
+        //
+        // both visit the cells in range of the query, or all
+        // occupied cells if there are fewer of those
+        unsigned cullFrustum(const Frustum& frustum, uint32_t* visible) const;
+        // objects whose sphere touches the query sphere
+        unsigned queryRadius(const Vector3& center, float radius, uint32_t* result) const;
+
+        // one past the largest object id
+        unsigned objectCount() const;
+        unsigned cellCount() const;
+        float cellSize() const;
+
+    private:
+        struct Cell {
+            int32_t x;
+            int32_t y;
+            int32_t z;
+            // first object of the list linked through Object::next
+            int32_t head;
+            unsigned count;
+            float maxRadius;
+        };
+
+        struct Object {
+            Vector3 position;
+            float radius;
+            // -1 if not in the grid
+            int32_t cell;
+            int32_t previous;
+            int32_t next;
+        };
+
+        void cellCoordinates(const Vector3& position, int32_t& x, int32_t& y, int32_t& z) const;
+        int32_t findCell(int32_t x, int32_t y, int32_t z) const;
+        int32_t findOrAddCell(int32_t x, int32_t y, int32_t z);
+        void link(uint32_t object, int32_t cell);
+        void unlink(uint32_t object);
+        BoundingBox looseBounds(const Cell& cell) const;
+        uint64_t rangeCellCount(int32_t minX, int32_t minY, int32_t minZ,
+                int32_t maxX, int32_t maxY, int32_t maxZ) const;
+        void addCell(const Cell& cell, uint32_t* result, unsigned& count) const;
+        void cullCell(const Cell& cell, const Frustum& frustum, uint32_t* visible, unsigned& count) const;
+
+        float _cellSize;
+        float _inverseCellSize;
+        std::vector<Cell> _cells;
+        std::vector<int32_t> _freeCells;
+        // packed cell coordinates to the index in _cells
+        std::unordered_map<uint64_t, int32_t> _cellLookup;
+        std::vector<Object> _objects;
+        // largest radius ever inserted, how far queries look into neighbour cells
+        float _maxRadius;
+        unsigned _liveCellCount;
+};
+
+} // namespace GLPractice
+
+#endif // SPATIAL_HASH_H
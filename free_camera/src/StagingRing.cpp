@@ -0,0 +1,79 @@
+#include "StagingRing.h"
+
+#include <stdexcept>
+
+using namespace GLPractice;
+
+const size_t StagingRing::NO_SPACE;
+const size_t StagingRing::ALIGNMENT;
+
+StagingRing::StagingRing(size_t capacity, unsigned maxAllocations):
+    _capacity(capacity & ~(ALIGNMENT - 1)),
+    _head(0),
+    _tail(0),
+    _used(0),
+    _allocations(maxAllocations),
+    _firstAllocation(0),
+    _allocationCount(0)
+{ }
+
+size_t StagingRing::allocate(size_t size) {
+    size = (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+    if(size > _capacity)
+        throw std::runtime_error("allocation is larger than the staging ring");
+    if(_allocationCount == _allocations.size())
+        return NO_SPACE;
+
+    if(_allocationCount == 0) {
+        // empty, start over where nothing gets skipped
+        _head = 0;
+        _tail = 0;
+    }
+
+    size_t offset = _head;
+    size_t skipped = 0;
+    if(_allocationCount == 0 || _head > _tail) {
+        // free space after the head, then before the tail
+        if(_head + size > _capacity) {
+            if(_allocationCount > 0 && size > _tail)
+                return NO_SPACE;
+            skipped = _capacity - _head;
+            offset = 0;
+        }
+    }
+    else if(_head + size > _tail) {
+        // the head is behind the tail, only the space between them is free
+        return NO_SPACE;
+    }
+
+    _head = offset + size;
+    _used += skipped + size;
+    Allocation& allocation = _allocations[(_firstAllocation + _allocationCount) % _allocations.size()];
+    allocation.end = _head;
+    allocation.bytes = skipped + size;
+    _allocationCount++;
+    return offset;
+}
+
+void StagingRing::releaseOldest() {
+    if(_allocationCount == 0)
+        return;
+
+    const Allocation& allocation = _allocations[_firstAllocation];
+    _tail = allocation.end;
+    _used -= allocation.bytes;
+    _firstAllocation = (_firstAllocation + 1) % _allocations.size();
+    _allocationCount--;
+}
+
+size_t StagingRing::used() const {
+    return _used;
+}
+
+unsigned StagingRing::allocationCount() const {
+    return _allocationCount;
+}
+
+size_t StagingRing::capacity() const {
+    return _capacity;
+}
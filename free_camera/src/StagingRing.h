@@ -0,0 +1,50 @@
+# ifndef STAGING_RING_H
+# define STAGING_RING_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace GLPractice {
+
+// hands out the space of a staging buffer as a ring: allocations are taken
+// after the newest one, wrapping around to the start, and given back in
+// the order they were made, once the GPU is done reading them
+class StagingRing {
+    public:
+        static const size_t NO_SPACE = SIZE_MAX;
+        // of every allocation
+        static const size_t ALIGNMENT = 16;
+
+        // at most maxAllocations in use at the same time
+        StagingRing(size_t capacity, unsigned maxAllocations);
+
+        // offset of size free bytes, NO_SPACE until older ones are released
+        size_t allocate(size_t size);
+        // frees the oldest allocation
+        void releaseOldest();
+
+        // including the bytes skipped at the end when wrapping around
+        size_t used() const;
+        unsigned allocationCount() const;
+        size_t capacity() const;
+
+    private:
+        struct Allocation {
+            // the tail moves here once it is released
+            size_t end;
+            size_t bytes;
+        };
+
+        size_t _capacity;
+        size_t _head;
+        size_t _tail;
+        size_t _used;
+        std::vector<Allocation> _allocations;
+        unsigned _firstAllocation;
+        unsigned _allocationCount;
+};
+
+} // namespace GLPractice
+
+#endif // STAGING_RING_H
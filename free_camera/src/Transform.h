@@ -0,0 +1,73 @@
+# ifndef TRANSFORM_H
+# define TRANSFORM_H
+
+#include <vector>
+#include "../../thirdparty/raymath.h"
+
+namespace GLPractice {
+
+inline Matrix operator*(const Matrix& left, const Matrix& right) {
+    return MatrixMultiply(right, left);
+}
+
+struct Transform {
+    public:
+        Vector3 scale;
+        Quaternion rotation;
+        Vector3 translation;
+
+        Transform() {
+            rotation = QuaternionIdentity();
+            scale = Vector3One();
+            translation = Vector3Zero();
+        }
+
+        Matrix toMatrix() const {
+            Matrix mScale = MatrixScale(scale.x, scale.y, scale.z);
+            Matrix mRotate = QuaternionToMatrix(rotation);
+            Matrix mTranslate = MatrixTranslate(translation.x, translation.y, translation.z);
+
+            Matrix result = mTranslate * mRotate * mScale;
+            return result;
+        }
+};
+
+// transforms of many objects kept as one array per component (SoA),
+// so per-frame passes only stream through the components they use
+struct TransformArray {
+    public:
+        std::vector<Vector3> scale;
+        std::vector<Quaternion> rotation;
+        std::vector<Vector3> translation;
+
+        unsigned size() const {
+            return translation.size();
+        }
+
+        // new objects get the identity transform
+        void resize(unsigned count) {
+            scale.resize(count, Vector3One());
+            rotation.resize(count, QuaternionIdentity());
+            translation.resize(count, Vector3Zero());
+        }
+
+        // same result as Transform::toMatrix() for every object,
+        // written as column major float arrays ready for uploading
+        void toMatrices(float16* out) const {
+            for(unsigned i = 0; i < size(); i++) {
+                const Vector3& s = scale[i];
+                const Vector3& t = translation[i];
+                Matrix r = QuaternionToMatrix(rotation[i]);
+                float* m = out[i].v;
+
+                m[0] = r.m0 * s.x;  m[1] = r.m1 * s.x;  m[2] = r.m2 * s.x;   m[3] = 0.0f;
+                m[4] = r.m4 * s.y;  m[5] = r.m5 * s.y;  m[6] = r.m6 * s.y;   m[7] = 0.0f;
+                m[8] = r.m8 * s.z;  m[9] = r.m9 * s.z;  m[10] = r.m10 * s.z; m[11] = 0.0f;
+                m[12] = t.x;        m[13] = t.y;        m[14] = t.z;         m[15] = 1.0f;
+            }
+        }
+};
+
+} // namespace GLPractice
+
+#endif // TRANSFORM_H
@@ -0,0 +1,61 @@
+# ifndef TRIPLE_BUFFER_H
+# define TRIPLE_BUFFER_H
+
+#include <stdint.h>
+#include <atomic>
+
+namespace GLPractice {
+
+// hands values from one writing thread to one reading thread without locks
+// or waiting. the writer fills its back buffer and publishes it, swapping it
+// with the middle one, the reader swaps its front buffer with the middle one
+// when something new was published there. each side always owns one buffer,
+// so the reader gets the latest complete value and never a torn one, and
+// buffers skipped by the reader are simply written again
+template<typename T>
+class TripleBuffer {
+    public:
+        TripleBuffer():
+            _middle(1),
+            _back(0),
+            _front(2)
+        { }
+
+        // writer only, the buffer to fill, still holding what was
+        // published in it two publishes ago
+        T& back() { return _buffers[_back]; }
+
+        // writer only, the back buffer becomes the newest one
+        void publish() {
+            _back = _middle.exchange(_back | FRESH, std::memory_order_acq_rel) & INDEX_MASK;
+        }
+
+        // reader only, takes the newest buffer if one was published since
+        // the last call, false if the front buffer is still the newest
+        bool update() {
+            if(!(_middle.load(std::memory_order_relaxed) & FRESH))
+                return false;
+            _front = _middle.exchange(_front, std::memory_order_acq_rel) & INDEX_MASK;
+            return true;
+        }
+
+        // reader only, a default constructed value until something was published
+        const T& front() const { return _buffers[_front]; }
+
+        TripleBuffer(const TripleBuffer&) = delete;
+        TripleBuffer& operator=(const TripleBuffer&) = delete;
+
+    private:
+        // set in the middle index when the writer published it
+        static const uint8_t FRESH = 4;
+        static const uint8_t INDEX_MASK = 3;
+
+        T _buffers[3];
+        std::atomic<uint8_t> _middle;
+        uint8_t _back;
+        uint8_t _front;
+};
+
+} // namespace GLPractice
+
+#endif // TRIPLE_BUFFER_H
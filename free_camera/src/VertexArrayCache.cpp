@@ -0,0 +1,92 @@
+#include "common.h"
+
+#include <stdexcept>
+
+using namespace GLPractice;
+
+VertexLayout::VertexLayout():
+    attribCount(0)
+{
+    // zero everything, so unused entries compare equal
+    memset(attribs, 0, sizeof(attribs));
+    memset(divisors, 0, sizeof(divisors));
+}
+
+void VertexLayout::addAttrib(GLuint location, GLint components, GLuint relativeOffset, GLuint binding) {
+    if(attribCount >= MAX_ATTRIBS)
+        throw std::runtime_error("too many attribs in VertexLayout");
+    if(binding >= MAX_BINDINGS)
+        throw std::runtime_error("binding point out of range in VertexLayout");
+
+    Attrib& attrib = attribs[attribCount++];
+    attrib.location = location;
+    attrib.components = components;
+    attrib.relativeOffset = relativeOffset;
+    attrib.binding = binding;
+}
+
+void VertexLayout::setBindingDivisor(GLuint binding, GLuint divisor) {
+    if(binding >= MAX_BINDINGS)
+        throw std::runtime_error("binding point out of range in VertexLayout");
+
+    divisors[binding] = divisor;
+}
+
+bool VertexLayout::operator==(const VertexLayout& other) const {
+    return attribCount == other.attribCount &&
+        memcmp(attribs, other.attribs, sizeof(attribs)) == 0 &&
+        memcmp(divisors, other.divisors, sizeof(divisors)) == 0;
+}
+
+VertexArrayCache& VertexArrayCache::get() {
+    static VertexArrayCache cache;
+    return cache;
+}
+
+VertexArrayCache::VertexArrayCache()
+{ }
+
+GLuint VertexArrayCache::getVertexArray(const VertexLayout& layout) {
+    for(size_t i = 0; i < _layouts.size(); i++) {
+        if(_layouts[i] == layout)
+            return _vertexArrays[i].get();
+    }
+
+    if(!GLCaps::get().vertexAttribBinding)
+        throw std::runtime_error("vertex attrib binding is not avaliable for shared VAOs");
+
+    GLVertexArrayHandle vao(createVertexArray());
+
+    if(GLCaps::get().directStateAccess) {
+        for(unsigned i = 0; i < layout.attribCount; i++) {
+            const VertexLayout::Attrib& attrib = layout.attribs[i];
+            glVertexArrayAttribFormat(vao.get(), attrib.location, attrib.components,
+                    GL_FLOAT, GL_FALSE, attrib.relativeOffset);
+            glVertexArrayAttribBinding(vao.get(), attrib.location, attrib.binding);
+            glEnableVertexArrayAttrib(vao.get(), attrib.location);
+        }
+        for(GLuint binding = 0; binding < VertexLayout::MAX_BINDINGS; binding++)
+            glVertexArrayBindingDivisor(vao.get(), binding, layout.divisors[binding]);
+    }
+    else {
+        GLStateCache::get().bindVertexArray(vao.get());
+        for(unsigned i = 0; i < layout.attribCount; i++) {
+            const VertexLayout::Attrib& attrib = layout.attribs[i];
+            glVertexAttribFormat(attrib.location, attrib.components,
+                    GL_FLOAT, GL_FALSE, attrib.relativeOffset);
+            glVertexAttribBinding(attrib.location, attrib.binding);
+            glEnableVertexAttribArray(attrib.location);
+        }
+        for(GLuint binding = 0; binding < VertexLayout::MAX_BINDINGS; binding++)
+            glVertexBindingDivisor(binding, layout.divisors[binding]);
+    }
+
+    _layouts.push_back(layout);
+    _vertexArrays.push_back(std::move(vao));
+    return _vertexArrays.back().get();
+}
+
+void VertexArrayCache::clear() {
+    _layouts.clear();
+    _vertexArrays.clear();
+}
@@ -0,0 +1,226 @@
+#include "VisibilityCache.h"
+
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+using namespace GLPractice;
+
+// angle of the rotation taking one orientation to the other
+static float angleBetween(const Quaternion& a, const Quaternion& b) {
+    float cosHalf = fabsf(a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w);
+    return 2.0f * acosf(fminf(cosHalf, 1.0f));
+}
+
+VisibilityCache::VisibilityCache(float translationThreshold, float angleThreshold):
+    _translationThreshold(translationThreshold),
+    _angleThreshold(angleThreshold),
+    _valid(false),
+    _testedCount(0),
+    _fullPass(false),
+    _fullPassCount(0)
+{ }
+
+void VisibilityCache::setSpheres(const SphereArray& spheres) {
+    _spheres = spheres;
+    _states.assign(spheres.size(), STATE_HIDDEN);
+    _listIndices.assign(spheres.size(), 0);
+    _visibleObjects.clear();
+    _boundaryObjects.clear();
+    _boundarySpheres.resize(0);
+    _valid = false;
+}
+
+void VisibilityCache::update(unsigned object, const BoundingSphere& sphere) {
+    _spheres.set(object, sphere);
+    // sorted against the camera of the last full pass like the others,
+    // so it stays right until the next one
+    if(!_valid)
+        return;
+
+    setState(object, classify(sphere));
+    if(_states[object] == STATE_BOUNDARY)
+        _boundarySpheres.set(_listIndices[object], sphere);
+}
+
+void VisibilityCache::invalidate() {
+    _valid = false;
+}
+
+VisibilityCache::State VisibilityCache::classify(const BoundingSphere& sphere) const {
+    // how much any plane distance of the sphere can change
+    // while the camera stays within the thresholds
+    float band = _translationThreshold + _angleThreshold * Vector3Distance(sphere.center, _eye);
+
+    // the nearest plane decides, hidden when the sphere is far outside of it
+    float minDistance = band;
+    for(unsigned i = 0; i < Frustum::PLANE_COUNT; i++) {
+        const Plane& plane = _frustum.planes[i];
+        float distance = Vector3DotProduct(plane.normal, sphere.center) + plane.distance + sphere.radius;
+        minDistance = fminf(minDistance, distance);
+    }
+
+    if(minDistance < -band)
+        return STATE_HIDDEN;
+    return minDistance >= band ? STATE_VISIBLE : STATE_BOUNDARY;
+}
+
+void VisibilityCache::classifyAll() {
+    const float* xs = _spheres.x.data();
+    const float* ys = _spheres.y.data();
+    const float* zs = _spheres.z.data();
+    const float* rs = _spheres.radius.data();
+    unsigned size = objectCount();
+    unsigned i = 0;
+
+#if defined(__SSE2__)
+    // the same as classify(), 4 spheres at a time
+    for(; i + 4 <= size; i += 4) {
+        __m128 x = _mm_loadu_ps(xs + i);
+        __m128 y = _mm_loadu_ps(ys + i);
+        __m128 z = _mm_loadu_ps(zs + i);
+        __m128 radius = _mm_loadu_ps(rs + i);
+
+        __m128 dx = _mm_sub_ps(x, _mm_set1_ps(_eye.x));
+        __m128 dy = _mm_sub_ps(y, _mm_set1_ps(_eye.y));
+        __m128 dz = _mm_sub_ps(z, _mm_set1_ps(_eye.z));
+        __m128 eyeDistance = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)),
+                    _mm_mul_ps(dz, dz)));
+        __m128 band = _mm_add_ps(_mm_set1_ps(_translationThreshold),
+                _mm_mul_ps(_mm_set1_ps(_angleThreshold), eyeDistance));
+
+        __m128 minDistance = band;
+        for(unsigned p = 0; p < Frustum::PLANE_COUNT; p++) {
+            const Plane& plane = _frustum.planes[p];
+            __m128 distance = _mm_add_ps(
+                    _mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(plane.normal.x)),
+                        _mm_mul_ps(y, _mm_set1_ps(plane.normal.y))),
+                    _mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(plane.normal.z)),
+                        _mm_add_ps(_mm_set1_ps(plane.distance), radius)));
+            minDistance = _mm_min_ps(minDistance, distance);
+        }
+
+        unsigned hidden = _mm_movemask_ps(_mm_cmplt_ps(minDistance, _mm_sub_ps(_mm_setzero_ps(), band)));
+        unsigned visible = _mm_movemask_ps(_mm_cmpge_ps(minDistance, band));
+        for(unsigned lane = 0; lane < 4; lane++) {
+            if((hidden >> lane) & 1)
+                _states[i + lane] = STATE_HIDDEN;
+            else
+                _states[i + lane] = (visible >> lane) & 1 ? STATE_VISIBLE : STATE_BOUNDARY;
+        }
+    }
+#endif
+
+    // the remaining spheres
+    for(; i < size; i++)
+        _states[i] = classify(_spheres.get(i));
+
+    _visibleObjects.clear();
+    _boundaryObjects.clear();
+    _boundarySpheres.resize(0);
+    for(i = 0; i < size; i++) {
+        if(_states[i] == STATE_VISIBLE) {
+            _listIndices[i] = _visibleObjects.size();
+            _visibleObjects.push_back(i);
+        }
+        else if(_states[i] == STATE_BOUNDARY) {
+            addBoundary(i);
+        }
+    }
+}
+
+void VisibilityCache::addBoundary(unsigned object) {
+    unsigned index = _boundaryObjects.size();
+    _listIndices[object] = index;
+    _boundaryObjects.push_back(object);
+    _boundarySpheres.resize(index + 1);
+    _boundarySpheres.set(index, _spheres.get(object));
+}
+
+void VisibilityCache::setState(unsigned object, State state) {
+    if(_states[object] == state)
+        return;
+
+    removeFromList(object);
+    _states[object] = state;
+    if(state == STATE_VISIBLE) {
+        _listIndices[object] = _visibleObjects.size();
+        _visibleObjects.push_back(object);
+    }
+    else if(state == STATE_BOUNDARY) {
+        addBoundary(object);
+    }
+}
+
+void VisibilityCache::removeFromList(unsigned object) {
+    std::vector<uint32_t>* list = NULL;
+    if(_states[object] == STATE_VISIBLE)
+        list = &_visibleObjects;
+    else if(_states[object] == STATE_BOUNDARY)
+        list = &_boundaryObjects;
+    else
+        return;
+
+    // the last one takes its place
+    uint32_t index = _listIndices[object];
+    uint32_t last = list->back();
+    (*list)[index] = last;
+    _listIndices[last] = index;
+    list->pop_back();
+
+    if(list == &_boundaryObjects) {
+        _boundarySpheres.set(index, _boundarySpheres.get(list->size()));
+        _boundarySpheres.resize(list->size());
+    }
+}
+
+unsigned VisibilityCache::cull(const Frustum& frustum, const Vector3& eye, const Quaternion& rotation,
+        const Matrix& projection, uint32_t* visible) {
+    _fullPass = !_valid ||
+        memcmp(&projection, &_projection, sizeof(Matrix)) != 0 ||
+        Vector3Distance(eye, _eye) > _translationThreshold ||
+        angleBetween(rotation, _rotation) > _angleThreshold;
+
+    if(_fullPass) {
+        _frustum = frustum;
+        _eye = eye;
+        _rotation = rotation;
+        _projection = projection;
+        _valid = true;
+        _fullPassCount++;
+
+        classifyAll();
+    }
+
+    unsigned visibleCount = _visibleObjects.size();
+    if(visibleCount > 0)
+        memcpy(visible, _visibleObjects.data(), visibleCount * sizeof(uint32_t));
+
+    // the spheres near a plane are kept packed, so they are tested with SIMD too
+    _boundaryVisible.resize(_boundaryObjects.size());
+    unsigned boundaryCount = cullSpheres(frustum, _boundarySpheres, _boundaryVisible.data());
+    for(unsigned i = 0; i < boundaryCount; i++)
+        visible[visibleCount + i] = _boundaryObjects[_boundaryVisible[i]];
+    visibleCount += boundaryCount;
+
+    _testedCount = _fullPass ? objectCount() : _boundaryObjects.size();
+    return visibleCount;
+}
+
+unsigned VisibilityCache::objectCount() const {
+    return _spheres.size();
+}
+
+unsigned VisibilityCache::testedCount() const {
+    return _testedCount;
+}
+
+bool VisibilityCache::wasFullPass() const {
+    return _fullPass;
+}
+
+unsigned VisibilityCache::fullPassCount() const {
+    return _fullPassCount;
+}
@@ -0,0 +1,89 @@
+# ifndef VISIBILITY_CACHE_H
+# define VISIBILITY_CACHE_H
+
+#include <stdint.h>
+#include <vector>
+#include "Culling.h"
+
+namespace GLPractice {
+
+// frustum culling results kept from frame to frame, for a camera that
+// moves a little each frame
+//
+// a full pass sorts the spheres against the frustum of a reference camera:
+// those deep inside stay visible and those far outside stay hidden until
+// the camera moves or turns past the thresholds, only the ones near a plane
+// are tested every frame. the frustum planes move with the camera, so a
+// plane distance changes by at most the distance the eye moved plus the
+// angle it turned times the distance of the sphere, which is how deep
+// "deep" has to be. a camera past the thresholds, teleports included, or a
+// new projection makes the next pass a full one again
+class VisibilityCache {
+    public:
+        // how far the eye may move and how much it may turn, in radians,
+        // before everything is tested again. larger thresholds mean rarer
+        // full passes but more spheres tested every frame
+        VisibilityCache(float translationThreshold, float angleThreshold);
+
+        // all spheres changed, the next cull() is a full pass
+        void setSpheres(const SphereArray& spheres);
+        // one sphere moved, it is sorted again on its own
+        void update(unsigned object, const BoundingSphere& sphere);
+        // make the next cull() a full pass
+        void invalidate();
+
+        // write the indices of the spheres intersecting the frustum into visible,
+        // which needs room for objectCount() entries, returns the visible count.
+        // the frustum is the one of projection and of a camera at eye, looking
+        // along rotation, the visible ones come in no particular order
+        unsigned cull(const Frustum& frustum, const Vector3& eye, const Quaternion& rotation,
+                const Matrix& projection, uint32_t* visible);
+
+        unsigned objectCount() const;
+        // spheres tested by the last cull(), all of them after a full pass
+        unsigned testedCount() const;
+        bool wasFullPass() const;
+        unsigned fullPassCount() const;
+
+    private:
+        enum State : uint8_t {
+            STATE_HIDDEN,
+            STATE_VISIBLE,
+            // near a plane, tested every frame
+            STATE_BOUNDARY
+        };
+
+        State classify(const BoundingSphere& sphere) const;
+        void classifyAll();
+        void addBoundary(unsigned object);
+        void setState(unsigned object, State state);
+        void removeFromList(unsigned object);
+
+        float _translationThreshold;
+        float _angleThreshold;
+        SphereArray _spheres;
+        std::vector<State> _states;
+        // position of each object in the list of its state, hidden ones have none
+        std::vector<uint32_t> _listIndices;
+        std::vector<uint32_t> _visibleObjects;
+        std::vector<uint32_t> _boundaryObjects;
+        // spheres of _boundaryObjects, in the same order
+        SphereArray _boundarySpheres;
+        // indices into _boundaryObjects of the visible ones
+        std::vector<uint32_t> _boundaryVisible;
+
+        // the camera of the last full pass
+        bool _valid;
+        Frustum _frustum;
+        Vector3 _eye;
+        Quaternion _rotation;
+        Matrix _projection;
+
+        unsigned _testedCount;
+        bool _fullPass;
+        unsigned _fullPassCount;
+};
+
+} // namespace GLPractice
+
+#endif // VISIBILITY_CACHE_H
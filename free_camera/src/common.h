@@ -3,112 +3,880 @@
 
 #include <GL/glew.h>
 #include <string.h>
+#include <stdint.h>
+#include <atomic>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
 #include "../../thirdparty/raymath.h"
+#include "AssetReader.h"
+#include "CommandBuffer.h"
+#include "Culling.h"
+#include "JobSystem.h"
+#include "MPSCQueue.h"
+#include "StagingRing.h"
+#include "Transform.h"
 
 #define VERT_SHADER_POS_ATTRIB_NAME "pos"
+#define VERT_SHADER_INSTANCE_MODEL_ATTRIB_NAME "instanceModel"
+#define VERT_SHADER_INSTANCE_COLOR_ATTRIB_NAME "instanceColor"
+
+// buffer binding points of the VAOs shared through VertexArrayCache
+#define VERTEX_BINDING_MESH 0
+#define VERTEX_BINDING_INSTANCE_MODEL 1
+#define VERTEX_BINDING_INSTANCE_COLOR 2
 
 namespace GLPractice {
 
+// optional GL features of the current context,
+// filled by GLCaps::detect() once glewInit() succeeded
+struct GLCaps {
+    public:
+        bool separateShaderObjects; // GL 4.1, glProgramUniform*
+        bool baseInstance;          // GL 4.2, glDraw*BaseInstance
+        bool multiDrawIndirect;     // GL 4.3, glMultiDrawElementsIndirect
+        bool vertexAttribBinding;   // GL 4.3, glVertexAttribFormat, glBindVertexBuffer
+        bool directStateAccess;     // GL 4.5, glCreate*, glNamed*, glVertexArray*
+        bool computeShader;         // GL 4.3, glDispatchCompute, shader storage buffers
+        bool bufferStorage;         // GL 4.4, glBufferStorage, persistently mapped buffers
+
+        static void detect();
+        static const GLCaps& get();
+};
+
+// fixed-function states shared by a group of draws,
+// it can not be changed once created, make a new one instead
+class PipelineState {
+    public:
+        PipelineState(bool depthTest, bool depthWrite, bool cullFace,
+                bool blend, GLenum blendSrc, GLenum blendDst);
+
+        // depth tested and written, back faces culled, no blending
+        static PipelineState opaque();
+        // alpha blended over what is drawn, depth tested but not written
+        static PipelineState transparent();
+
+        bool depthTest() const { return _depthTest; }
+        bool depthWrite() const { return _depthWrite; }
+        bool cullFace() const { return _cullFace; }
+        bool blend() const { return _blend; }
+        GLenum blendSrc() const { return _blendSrc; }
+        GLenum blendDst() const { return _blendDst; }
+
+    private:
+        bool _depthTest;
+        bool _depthWrite;
+        bool _cullFace;
+        bool _blend;
+        GLenum _blendSrc;
+        GLenum _blendDst;
+};
+
+// shadow copy of the GL bindings and enable flags of the context,
+// binding what is already bound returns without calling GL
+//
+// every GL call changing these states must go through the cache,
+// or invalidate() must be called afterwards
+class GLStateCache {
+    public:
+        // the cache of the context, only use it from the context thread
+        static GLStateCache& get();
+
+        void useProgram(GLuint program);
+        // the element array buffer is part of the VAO,
+        // so it is forgotten when the VAO changes
+        void bindVertexArray(GLuint vao);
+        void bindBuffer(GLenum target, GLuint buffer);
+        // binds an indexed target, which binds the generic target as well
+        void bindBufferBase(GLenum target, GLuint index, GLuint buffer);
+        // buffer binding points are part of the VAO as well
+        void bindVertexBuffer(GLuint binding, GLuint buffer, GLintptr offset, GLsizei stride);
+        void bindTexture(GLuint unit, GLenum target, GLuint texture);
+        void setEnabled(GLenum cap, bool enabled);
+        void setDepthWrite(bool enabled);
+        // all four channels together
+        void setColorWrite(bool enabled);
+        void setDepthFunc(GLenum func);
+        void setBlendFunc(GLenum src, GLenum dst);
+        // only the states differing from the current ones are set
+        void applyPipelineState(const PipelineState& state);
+
+        // called by GLHandle deleters, GL unbinds deleted objects
+        void forgetProgram(GLuint program);
+        void forgetVertexArray(GLuint vao);
+        void forgetBuffer(GLuint buffer);
+        void forgetTexture(GLuint texture);
+        // forget everything, the next call of each state goes to GL
+        void invalidate();
+
+        unsigned getIssuedCallCount() const;
+        unsigned getSkippedCallCount() const;
+        void resetCallCounts();
+
+    private:
+        enum {
+            MAX_BUFFER_TARGETS = 10,
+            MAX_VERTEX_BUFFER_BINDINGS = 4,
+            MAX_TEXTURE_UNITS = 16,
+            MAX_TEXTURE_TARGETS = 4,
+            MAX_CAPS = 3
+        };
+
+        GLStateCache();
+        bool shouldSet(GLuint& shadow, GLuint value);
+
+        GLuint _program;
+        GLuint _vao;
+        GLuint _buffers[MAX_BUFFER_TARGETS];
+        GLuint _vertexBuffers[MAX_VERTEX_BUFFER_BINDINGS];
+        GLintptr _vertexBufferOffsets[MAX_VERTEX_BUFFER_BINDINGS];
+        GLsizei _vertexBufferStrides[MAX_VERTEX_BUFFER_BINDINGS];
+        GLuint _activeTextureUnit;
+        GLuint _textures[MAX_TEXTURE_UNITS][MAX_TEXTURE_TARGETS];
+        GLuint _caps[MAX_CAPS];
+        GLuint _depthWrite;
+        GLuint _colorWrite;
+        GLuint _depthFunc;
+        GLuint _blendSrc;
+        GLuint _blendDst;
+        unsigned _issuedCallCount;
+        unsigned _skippedCallCount;
+};
+
+// GL objects deleted by the context thread once the GPU finished the frames
+// that may still use them. any thread queues objects without locking, the
+// context thread puts a fence after each frame that queued some and deletes
+// them once it signaled, so neither a thread without the context nor a
+// draw still in flight is a problem
+class GLDeletionQueue {
+    public:
+        enum Type {
+            SHADER,
+            PROGRAM,
+            BUFFER,
+            VERTEX_ARRAY,
+            TEXTURE,
+            QUERY,
+            FRAMEBUFFER
+        };
+
+        static GLDeletionQueue& get();
+
+        // any thread
+        void enqueue(Type type, GLuint id);
+        // the context thread, once the commands of a frame were submitted
+        void endFrame();
+        // the context thread, deletes everything queued so far,
+        // waiting for the GPU, before the context goes away
+        void flush();
+
+        // queued and not deleted yet, context thread only
+        unsigned pendingCount() const;
+        unsigned deletedCount() const;
+
+    private:
+        // deletions queued between two frames without taking the lock
+        static const unsigned QUEUE_CAPACITY = 4096;
+        // fenced frames the GPU may be behind before endFrame() waits
+        static const unsigned MAX_FRAMES = 4;
+
+        struct Deletion {
+            Type type;
+            GLuint id;
+        };
+
+        struct Frame {
+            GLsync fence;
+            std::vector<Deletion> deletions;
+        };
+
+        GLDeletionQueue();
+        // moves the queued deletions to the given list
+        void collect(std::vector<Deletion>& deletions);
+        // deletes the objects of the oldest frame, when its fence
+        // signaled or after waiting for it, false if it did not signal
+        bool retireFrame(bool wait);
+        void deleteObjects(std::vector<Deletion>& deletions);
+
+        MPSCQueue<Deletion> _queue;
+        // taken only when the queue is full
+        std::mutex _overflowMutex;
+        std::vector<Deletion> _overflow;
+        std::atomic<bool> _overflowed;
+
+        Frame _frames[MAX_FRAMES];
+        unsigned _firstFrame;
+        unsigned _frameCount;
+        std::vector<Deletion> _flushDeletions;
+        unsigned _deletedCount;
+};
+
+// deleters used by GLHandle to release the GL object it owns,
+// the objects are deleted later by the GLDeletionQueue
+struct GLShaderDeleter {
+    static void destroy(GLuint id) { GLDeletionQueue::get().enqueue(GLDeletionQueue::SHADER, id); }
+};
+
+struct GLProgramDeleter {
+    static void destroy(GLuint id) { GLDeletionQueue::get().enqueue(GLDeletionQueue::PROGRAM, id); }
+};
+
+struct GLBufferDeleter {
+    static void destroy(GLuint id) { GLDeletionQueue::get().enqueue(GLDeletionQueue::BUFFER, id); }
+};
+
+struct GLVertexArrayDeleter {
+    static void destroy(GLuint id) { GLDeletionQueue::get().enqueue(GLDeletionQueue::VERTEX_ARRAY, id); }
+};
+
+struct GLTextureDeleter {
+    static void destroy(GLuint id) { GLDeletionQueue::get().enqueue(GLDeletionQueue::TEXTURE, id); }
+};
+
+struct GLQueryDeleter {
+    static void destroy(GLuint id) { GLDeletionQueue::get().enqueue(GLDeletionQueue::QUERY, id); }
+};
+
+struct GLFramebufferDeleter {
+    static void destroy(GLuint id) { GLDeletionQueue::get().enqueue(GLDeletionQueue::FRAMEBUFFER, id); }
+};
+
+// move-only owner of a GL object name
+// the object is deleted when the handle is destroyed or reset,
+// moving transfers the ownership and leaves the source empty
+template<typename Deleter>
+class GLHandle {
+    public:
+        GLHandle(): _objectId(0) { }
+        explicit GLHandle(GLuint objectId): _objectId(objectId) { }
+        ~GLHandle() { reset(); }
+
+        GLHandle(GLHandle&& other) noexcept: _objectId(other.release()) { }
+
+        GLHandle& operator=(GLHandle&& other) noexcept {
+            if(this != &other)
+                reset(other.release());
+            return *this;
+        }
+
+        GLuint get() const { return _objectId; }
+
+        // give up the ownership without deleting the object
+        GLuint release() {
+            GLuint objectId = _objectId;
+            _objectId = 0;
+            return objectId;
+        }
+
+        // delete the owned object and take the new one
+        void reset(GLuint objectId = 0) {
+            if(_objectId != 0)
+                Deleter::destroy(_objectId);
+            _objectId = objectId;
+        }
+
+        explicit operator bool() const { return _objectId != 0; }
+
+        // disable copying
+        GLHandle(const GLHandle& other) = delete;
+        GLHandle& operator=(const GLHandle& other) = delete;
+
+    private:
+        GLuint _objectId;
+};
+
+typedef GLHandle<GLShaderDeleter> GLShaderHandle;
+typedef GLHandle<GLProgramDeleter> GLProgramHandle;
+typedef GLHandle<GLBufferDeleter> GLBufferHandle;
+typedef GLHandle<GLVertexArrayDeleter> GLVertexArrayHandle;
+typedef GLHandle<GLTextureDeleter> GLTextureHandle;
+typedef GLHandle<GLFramebufferDeleter> GLFramebufferHandle;
+typedef GLHandle<GLQueryDeleter> GLQueryHandle;
+
+// vertex format of a VAO, the attrib formats and how fast each buffer
+// binding point advances, but not the buffers themselves
+struct VertexLayout {
+    public:
+        enum {
+            MAX_ATTRIBS = 8,
+            MAX_BINDINGS = 4
+        };
+
+        struct Attrib {
+            GLuint location;
+            GLint components;
+            GLuint relativeOffset;
+            GLuint binding;
+        };
+
+        VertexLayout();
+        // float attrib read at an offset into each vertex of the binding point
+        void addAttrib(GLuint location, GLint components, GLuint relativeOffset, GLuint binding);
+        // with divisor 1 the binding point advances once per instance
+        void setBindingDivisor(GLuint binding, GLuint divisor);
+        bool operator==(const VertexLayout& other) const;
+
+        unsigned attribCount;
+        Attrib attribs[MAX_ATTRIBS];
+        GLuint divisors[MAX_BINDINGS];
+};
+
+// one VAO per vertex layout, shared by all meshes having that layout
+//
+// the formats are set once with vertex attrib binding (GL 4.3), switching
+// meshes only rebinds the buffers through GLStateCache::bindVertexBuffer()
+// and the element buffer, instead of switching the VAO
+class VertexArrayCache {
+    public:
+        static VertexArrayCache& get();
+        // the VAO of the layout, created on first use
+        GLuint getVertexArray(const VertexLayout& layout);
+        // delete all VAOs while the context still exists
+        void clear();
+
+    private:
+        VertexArrayCache();
+        // there are only a few layouts, a linear search is the fastest
+        std::vector<VertexLayout> _layouts;
+        std::vector<GLVertexArrayHandle> _vertexArrays;
+};
+
+// query objects handed out and taken back instead of being
+// created and deleted each time an owner needs one. a query is
+// tied to the target it is first begun with, so the pool only
+// holds GL_ANY_SAMPLES_PASSED queries
+class QueryPool {
+    public:
+        static QueryPool& get();
+        // a GL_ANY_SAMPLES_PASSED query, created when none is free
+        GLuint acquire();
+        void release(GLuint query);
+        // delete all queries while the context still exists
+        void clear();
+
+    private:
+        QueryPool();
+        std::vector<GLQueryHandle> _queries;
+        std::vector<GLuint> _freeQueries;
+};
+
+// gives a query back to the QueryPool instead of deleting it
+struct GLPooledQueryDeleter {
+    static void destroy(GLuint id) { QueryPool::get().release(id); }
+};
+
+typedef GLHandle<GLPooledQueryDeleter> GLPooledQueryHandle;
+
+// buffer and vertex array setup, done with direct state access when
+// GLCaps::directStateAccess is set, so no binding is touched,
+// otherwise the objects are bound through GLStateCache
+GLuint createBuffer();
+GLuint createVertexArray();
+void setBufferData(GLuint buffer, GLsizeiptr size, const void* data, GLenum usage);
+void setBufferSubData(GLuint buffer, GLintptr offset, GLsizeiptr size, const void* data);
+// immutable storage, needs GLCaps::bufferStorage
+void setBufferStorage(GLuint buffer, GLsizeiptr size, const void* data, GLbitfield flags);
+void copyBufferSubData(GLuint source, GLuint destination, GLintptr sourceOffset,
+        GLintptr destinationOffset, GLsizeiptr size);
+void* mapBufferRange(GLuint buffer, GLintptr offset, GLsizeiptr length, GLbitfield access);
+void unmapBuffer(GLuint buffer);
+void setElementBuffer(GLuint vao, GLuint buffer);
+// float attrib read from the buffer, with divisor 1 it advances per instance
+void setVertexAttrib(GLuint vao, GLuint location, GLuint buffer,
+        GLint components, GLsizei stride, GLintptr offset, GLuint divisor);
+void enableVertexAttrib(GLuint vao, GLuint location);
+// point the 4 locations of a mat4 instance attrib at the model matrices
+// in the buffer, starting from the given instance
+void setInstanceModelAttrib(GLuint vao, GLuint location, GLuint buffer, GLuint firstInstance);
+
+// what a shader file is read into at once, larger ones are read all the same
+#define SHADER_BUFFER_SIZE (64 << 10)
+
 class GLShader{
     public:
         GLShader(const char* shaderCode, GLenum shaderType);
-        ~GLShader();
+        // code of the given length, not terminated
+        GLShader(const char* shaderCode, GLint length, GLenum shaderType);
         GLuint getObjectId() const;
         static GLShader shaderFromFile(const char* filePath, GLenum shaderType);
+        // a file handed out by an AssetReader, throws when it was not read
+        static GLShader shaderFromFile(const AssetReader::File& file, GLenum shaderType);
 
-    private:
-        GLuint _objectId;
+        // move only
+        GLShader(GLShader&& other) = default;
+        GLShader& operator=(GLShader&& other) = default;
+        GLShader(const GLShader& other) = delete;
+        GLShader& operator=(const GLShader& other) = delete;
 
-        //GLShader(const GLShader& other);
-        //GLShader& operator=(const GLShader& other);
+    private:
+        GLShaderHandle _object;
 };
 
 class GLProgram {
     public:
         GLProgram(const GLuint* shaders, unsigned shaderCount);
-        ~GLProgram();
         GLuint getObjectId() const;
         GLint GetAttribLocation(const GLchar* attribName) const;
         GLint GetUniformLocation(const GLchar* uniformName) const;
+        // uses glProgramUniform when available, so the program is not bound
+        void setUniformMatrix4(GLint location, const GLfloat* value) const;
 
-    private:
-        GLuint _objectId;
+        // move only
+        GLProgram(GLProgram&& other) = default;
+        GLProgram& operator=(GLProgram&& other) = default;
+        GLProgram(const GLProgram& other) = delete;
+        GLProgram& operator=(const GLProgram& other) = delete;
 
-        //GLProgram(const GLProgram& other);
-        //GLProgram& operator=(const GLProgram& other);
+    private:
+        GLProgramHandle _object;
 };
 
 class Mesh {
     public:
         Mesh();
-        ~Mesh();
         void setVertexData(const GLfloat* data, unsigned count);
         void setIndexData(const GLuint* data, unsigned count);
-        void getVertexData(GLfloat* buf);
-        void getIndexData(GLuint* buf);
-        unsigned getVertexCount();
-        unsigned getIndexCount();
-        GLuint vao();
-        GLuint vbo();
-        GLuint ebo();
+        void getVertexData(GLfloat* buf) const;
+        void getIndexData(GLuint* buf) const;
+        unsigned getVertexCount() const;
+        unsigned getIndexCount() const;
+        // bounds of the vertex data in local space
+        const BoundingBox& getBoundingBox() const;
+        const BoundingSphere& getBoundingSphere() const;
+        // 0 when the mesh is drawn through a shared VAO
+        GLuint vao() const;
+        GLuint vbo() const;
+        GLuint ebo() const;
         void load();
+        // creates the buffers for the data without filling
+        // them, for data copied into them afterwards
+        void allocateBuffers();
         void unload();
 
+        // move only
+        Mesh(Mesh&& other) = default;
+        Mesh& operator=(Mesh&& other) = default;
+        Mesh(const Mesh& other) = delete;
+        Mesh& operator=(const Mesh& other) = delete;
+
     private:
-        unsigned _vertexCount;
-        unsigned _indexCount;
-        GLfloat* _vertexData;
-        GLuint* _indexData;
-        GLuint _vao;
-        GLuint _vbo;
-        GLuint _ebo;
+        // the VAO of the buffers without vertex attrib binding
+        void setupVertexArray();
 
-        // disable copying
-        Mesh& operator=(const Mesh& other);
-        Mesh(const Mesh& other);
+        std::vector<GLfloat> _vertexData;
+        std::vector<GLuint> _indexData;
+        BoundingBox _boundingBox;
+        BoundingSphere _boundingSphere;
+        GLVertexArrayHandle _vao;
+        GLBufferHandle _vbo;
+        GLBufferHandle _ebo;
 };
 
-inline Matrix operator*(const Matrix& left, const Matrix& right) {
-    return MatrixMultiply(right, left);
-}
-
-struct Transform {
+// meshes loaded while frames go on. a job sets the data of a mesh on a
+// worker, another one writes it into a persistently mapped staging buffer,
+// and the context thread copies at most frameBudget bytes a frame from
+// there into the buffers of the meshes, so a large mesh never stalls a
+// frame. a fence after the copies of a frame tells when their staging
+// space is free again. meshes are handed out in the order of the requests,
+// once all of their data was copied. without GLCaps::bufferStorage the
+// budgeted copies are made with glBufferSubData from the data of the mesh
+class MeshStreamer {
     public:
-        Vector3 scale;
-        Quaternion rotation;
-        Vector3 translation;
+        // sets the vertex and index data of the mesh, on a worker
+        typedef std::function<void(Mesh& mesh)> LoadFunction;
+        // takes the mesh, drawable from now on, on the context thread
+        typedef std::function<void(Mesh& mesh)> ReadyFunction;
 
-        Transform() {
-            rotation = QuaternionIdentity();
-            scale = Vector3One();
-            translation = Vector3Zero();
-        }
+        // stagingSize bounds the largest mesh
+        MeshStreamer(size_t stagingSize, size_t frameBudget);
+        ~MeshStreamer();
 
-        Matrix toMatrix() {
-            Matrix mScale = MatrixScale(scale.x, scale.y, scale.z);
-            Matrix mRotate = QuaternionToMatrix(rotation);
-            Matrix mTranslate = MatrixTranslate(translation.x, translation.y, translation.z);
+        // the context thread, creates and maps the staging buffer
+        void load();
+        // the context thread, waits for the jobs and drops what is pending
+        void unload();
 
-            Matrix result = mTranslate * mRotate * mScale;
-            return result;
-        }
+        // any thread
+        void request(const LoadFunction& load, const ReadyFunction& ready);
+        // the context thread, once a frame. rethrows the exception of a
+        // load function
+        void update();
+
+        // requested and not handed out yet
+        unsigned pendingCount() const;
+        // bytes copied by the last update()
+        size_t copiedBytes() const;
+
+        MeshStreamer(const MeshStreamer&) = delete;
+        MeshStreamer& operator=(const MeshStreamer&) = delete;
+
+    private:
+        // requests with data in the staging buffer at the same time
+        static const unsigned MAX_STAGED = 64;
+
+        enum State {
+            LOADING,
+            LOADED,
+            STAGING,
+            STAGED,
+            FAILED
+        };
+
+        struct Request {
+            Mesh mesh;
+            LoadFunction load;
+            ReadyFunction ready;
+            std::atomic<int> state;
+            std::exception_ptr error;
+            // vertex data followed by index data
+            size_t size;
+            size_t stagingOffset;
+            // the data without a staging buffer
+            std::vector<uint8_t> data;
+            size_t copied;
+        };
+
+        struct FencedCopies {
+            GLsync fence;
+            // staging allocations the copies before the fence read
+            unsigned allocationCount;
+        };
+
+        static void loadRequest(Request* request, bool keepData);
+        void stageRequests();
+        void copyRequests();
+        // bytes begin to end of the vertex data followed by the index data
+        void copyRange(Request& request, size_t begin, size_t end);
+        void copyToBuffer(Request& request, GLuint buffer, size_t begin, size_t offset, size_t size);
+        // releases the staging space of signaled fences
+        void retireCopies(bool wait);
+
+        size_t _frameBudget;
+        GLBufferHandle _staging;
+        uint8_t* _stagingMemory;
+        StagingRing _ring;
+        JobCounter _jobs;
+        std::mutex _incomingMutex;
+        std::vector<std::unique_ptr<Request> > _incoming;
+        // in the order of the requests
+        std::deque<std::unique_ptr<Request> > _requests;
+        std::deque<FencedCopies> _fences;
+        std::atomic<unsigned> _pendingCount;
+        size_t _copiedBytes;
 };
 
+// the mesh and program are not owned by the renderer,
+// they must outlive it and stay at the same address
+//
+// when the program declares the instanceModel attribute, the renderer
+// draws all instances passed to updateInstances() with one draw call
 class MeshRenderer {
     public:
         MeshRenderer(Mesh*, GLProgram*);
         ~MeshRenderer();
         void load();
         void unload();
+        void render() const;
+
+        bool isInstanced() const;
+        unsigned getInstanceCount() const;
+        // upload the model matrices of all instances, called every frame
+        void updateInstances(const TransformArray& transforms);
+        // optional RGBA color per instance, white is used if not set,
+        // can be updated every frame together with the instances
+        void setInstanceColors(const GLfloat* rgba, unsigned instanceCount);
+
+        // with occlusion queries on, queryOcclusion() draws the bounding box
+        // of the mesh for every instance into an any samples passed query,
+        // and the next render() is skipped by the GPU when no sample passed.
+        // the result is never read back, a query still running draws
+        void setOcclusionQuery(bool enabled);
+        bool hasOcclusionQuery() const;
+        // call once all occluders of the frame are drawn,
+        // leaves the opaque pipeline state bound
+        void queryOcclusion();
+
+        // move only
+        MeshRenderer(MeshRenderer&& other) = default;
+        MeshRenderer& operator=(MeshRenderer&& other) = default;
+        MeshRenderer(const MeshRenderer& other) = delete;
+        MeshRenderer& operator=(const MeshRenderer& other) = delete;
+
     private:
         Mesh* _mesh;
         GLProgram* _shaderProgram;
 
-        // disable copying
-        MeshRenderer(const MeshRenderer& other);
-        MeshRenderer& operator=(const MeshRenderer& other);
+        VertexLayout vertexLayout() const;
+        void loadOcclusionProxy();
+
+        // the VAO shared with other renderers of the same layout
+        // or the one of the mesh without vertex attrib binding
+        GLuint _vao;
+        // attrib locations in the program, -1 if not declared
+        GLint _posLocation;
+        GLint _instanceModelLocation;
+        GLint _instanceColorLocation;
+        GLBufferHandle _instanceModelBuffer;
+        GLBufferHandle _instanceColorBuffer;
+        unsigned _instanceCount;
+        unsigned _instanceCapacity;
+        unsigned _instanceColorCount;
+
+        // box around the mesh drawn in the occlusion query,
+        // its VAO is 0 when the shared one of the renderer is used
+        GLBufferHandle _proxyVbo;
+        GLBufferHandle _proxyEbo;
+        GLVertexArrayHandle _proxyVao;
+        GLPooledQueryHandle _occlusionQuery;
+        bool _occlusionQueryIssued;
+};
+
+// where a mesh lives inside a GeometryArena
+struct MeshRange {
+    GLuint firstIndex;
+    GLuint indexCount;
+    GLint baseVertex;
 };
 
+// vertex and index data of many meshes packed into one VBO and EBO,
+// so they can all be drawn without switching buffers
+class GeometryArena {
+    public:
+        GeometryArena();
+        // copy the mesh data into the arena, only valid before load()
+        MeshRange add(const Mesh& mesh);
+        void load();
+        void unload();
+        // 0 when the arena is drawn through a shared VAO
+        GLuint vao() const;
+        GLuint vbo() const;
+        GLuint ebo() const;
+
+        // move only
+        GeometryArena(GeometryArena&& other) = default;
+        GeometryArena& operator=(GeometryArena&& other) = default;
+        GeometryArena(const GeometryArena& other) = delete;
+        GeometryArena& operator=(const GeometryArena& other) = delete;
+
+    private:
+        std::vector<GLfloat> _vertexData;
+        std::vector<GLuint> _indexData;
+        GLVertexArrayHandle _vao;
+        GLBufferHandle _vbo;
+        GLBufferHandle _ebo;
+};
+
+// layout required by glMultiDrawElementsIndirect
+struct DrawElementsIndirectCommand {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLuint baseInstance;
+};
+
+// draws every object added in a frame with one glMultiDrawElementsIndirect,
+// falling back to a loop of draws when the context is older than GL 4.3
+//
+// the per-draw model matrix is an instance attrib, baseInstance of each
+// command selects it, so the shaders of MeshRenderer can be reused
+class IndirectRenderer {
+    public:
+        IndirectRenderer(GeometryArena*, GLProgram*);
+        void load();
+        void unload();
+
+        // start collecting the draws of a new frame
+        void clear();
+        void addDraw(const MeshRange& range, const float16& model);
+        unsigned getDrawCount() const;
+        unsigned getCommandCount() const;
+        void render();
+
+        // move only
+        IndirectRenderer(IndirectRenderer&& other) = default;
+        IndirectRenderer& operator=(IndirectRenderer&& other) = default;
+        IndirectRenderer(const IndirectRenderer& other) = delete;
+        IndirectRenderer& operator=(const IndirectRenderer& other) = delete;
+
+    private:
+        GeometryArena* _arena;
+        GLProgram* _shaderProgram;
+        GLuint _vao;
+        GLint _instanceModelLocation;
+        GLint _instanceColorLocation;
+        std::vector<DrawElementsIndirectCommand> _commands;
+        std::vector<float16> _drawData;
+        GLBufferHandle _commandBuffer;
+        GLBufferHandle _drawDataBuffer;
+};
+
+// farthest depth pyramid of the last drawn frame, for hierarchical Z culling
+//
+// after a frame is drawn its depth is copied out of the default framebuffer,
+// then a compute shader fills each level of an R32F texture with the
+// farthest depth of the texels it covers in the level above. level 0 is the
+// framebuffer size rounded down to powers of two. needs GL 4.3
+class DepthPyramid {
+    public:
+        // reduceProgram is linked from shaders/depthPyramid.comp
+        explicit DepthPyramid(GLProgram* reduceProgram);
+        void unload();
+
+        // copy the depth drawn with viewProjection and rebuild the levels,
+        // the textures follow the size of the framebuffer
+        void capture(unsigned framebufferWidth, unsigned framebufferHeight, const Matrix& viewProjection);
+        // drop the captured depth, for frames it was not kept up to date
+        void invalidate();
+        bool isValid() const;
+
+        GLuint texture() const;
+        unsigned levelCount() const;
+        // the matrix the captured depth was drawn with
+        const Matrix& viewProjection() const;
+
+        // move only
+        DepthPyramid(DepthPyramid&& other) = default;
+        DepthPyramid& operator=(DepthPyramid&& other) = default;
+        DepthPyramid(const DepthPyramid& other) = delete;
+        DepthPyramid& operator=(const DepthPyramid& other) = delete;
+
+    private:
+        void resize(unsigned framebufferWidth, unsigned framebufferHeight);
+
+        GLProgram* _reduceProgram;
+        GLint _sourceLevelLocation;
+        GLTextureHandle _depthTexture;
+        GLFramebufferHandle _depthFramebuffer;
+        GLTextureHandle _pyramidTexture;
+        unsigned _framebufferWidth;
+        unsigned _framebufferHeight;
+        unsigned _width;
+        unsigned _height;
+        unsigned _levelCount;
+        Matrix _viewProjection;
+        bool _valid;
+};
+
+// culls the instances of one mesh on the GPU and draws what is left
+// with glDrawElementsIndirect, the CPU never reads the results back
+//
+// a compute shader tests the world bounding sphere of each instance against
+// the frustum and the DepthPyramid of the last frame, appends the model and
+// color of the visible ones to the output buffers and counts them in the
+// instanceCount of the indirect command. needs GL 4.3
+class GPUCuller {
+    public:
+        // cullProgram is linked from shaders/cullInstances.comp,
+        // drawProgram is an instanced MeshRenderer program with colors
+        GPUCuller(GeometryArena*, const MeshRange& range, GLProgram* cullProgram, GLProgram* drawProgram);
+        void load();
+        void unload();
+
+        // upload the instances, only needed when they change
+        void setInstances(const float16* models, const GLfloat* rgba, const SphereArray& spheres);
+        unsigned getInstanceCount() const;
+        // without a pyramid, or with an invalid one, only the frustum is tested
+        void cull(const Frustum& frustum, const DepthPyramid* pyramid);
+        void render();
+
+        // move only
+        GPUCuller(GPUCuller&& other) = default;
+        GPUCuller& operator=(GPUCuller&& other) = default;
+        GPUCuller(const GPUCuller& other) = delete;
+        GPUCuller& operator=(const GPUCuller& other) = delete;
+
+    private:
+        GeometryArena* _arena;
+        MeshRange _range;
+        GLProgram* _cullProgram;
+        GLProgram* _drawProgram;
+        GLuint _vao;
+        GLint _instanceCountLocation;
+        GLint _frustumPlanesLocation;
+        GLint _hiZLocation;
+        GLint _depthViewProjectionLocation;
+        GLint _depthPyramidLevelsLocation;
+        unsigned _instanceCount;
+        // xyz center and radius of each sphere
+        std::vector<GLfloat> _boundsData;
+        GLBufferHandle _boundsBuffer;
+        GLBufferHandle _modelBuffer;
+        GLBufferHandle _colorBuffer;
+        GLBufferHandle _visibleModelBuffer;
+        GLBufferHandle _visibleColorBuffer;
+        GLBufferHandle _commandBuffer;
+};
+
+// one draw call waiting in a RenderQueue
+struct DrawItem {
+    GLuint program;
+    GLint modelLocation;
+    GLuint vao;
+    // bound to VERTEX_BINDING_MESH when the VAO is shared between meshes,
+    // 0 when the VAO has its own buffers
+    GLuint vbo;
+    GLsizei vertexStride;
+    GLuint ebo;
+    GLuint indexCount;
+    GLuint firstIndex;
+    GLint baseVertex;
+    float16 model;
+};
+
+// collects the draws of a frame, sorts them by a 64 bit key and submits
+// them in that order, so consecutive draws sharing state skip rebinding
+//
+// opaque key:      | pass 2 | program 10 | material 12 | vao 12 | depth 28 |
+// transparent key: | pass 2 | inverted depth 28 | program 10 | material 12 | vao 12 |
+//
+// opaque draws are grouped by state and then go roughly front to back
+// for early depth rejection, transparent draws go back to front
+class RenderQueue {
+    public:
+        enum Pass {
+            PASS_OPAQUE = 0,
+            PASS_TRANSPARENT = 1
+        };
+
+        RenderQueue();
+        // start collecting the draws of a new frame
+        void clear();
+        // depth is the view depth of the object normalized to [0, 1]
+        void push(Pass pass, GLuint material, float depth, const DrawItem& item);
+        void sort();
+        void submit();
+        unsigned size() const;
+
+        // binds done by the last submit(), for checking the sort order
+        unsigned getProgramBindCount() const;
+        unsigned getVertexArrayBindCount() const;
+
+        static uint64_t makeKey(Pass pass, GLuint program, GLuint material, GLuint vao, float depth);
+
+    private:
+        std::vector<uint64_t> _keys;
+        std::vector<uint32_t> _order;
+        std::vector<DrawItem> _items;
+        // ping-pong buffers of the radix sort
+        std::vector<uint64_t> _sortKeys;
+        std::vector<uint32_t> _sortOrder;
+        unsigned _programBindCount;
+        unsigned _vertexArrayBindCount;
+};
+
+// sort the keys in ascending order and reorder the values with them,
+// tmpKeys and tmpValues are scratch space of the same count
+void radixSort(uint64_t* keys, uint32_t* values, size_t count,
+        uint64_t* tmpKeys, uint32_t* tmpValues);
+
+// replays commands recorded on any thread through the GLStateCache,
+// on the context thread
+void submitCommands(const CommandList& commands);
+
 struct Camera {
     public:
         float fov; // field of view, in radians
@@ -119,11 +887,11 @@ struct Camera {
         Vector3 position;
         Quaternion rotation;
 
-        Matrix projectionMatrix() {
+        Matrix projectionMatrix() const {
             return MatrixPerspective(fov, aspect, near, far);
         }
 
-        Matrix viewMatrix() {
+        Matrix viewMatrix() const {
             Vector3 forwardDir = Vector3Zero();
             forwardDir.z = 1;
             forwardDir = Vector3RotateByQuaternion(forwardDir, rotation);
@@ -137,6 +905,10 @@ struct Camera {
             return MatrixLookAt(position, target, upDir);
         }
 
+        Frustum frustum() const {
+            return Frustum::fromMatrix(projectionMatrix() * viewMatrix());
+        }
+
         Camera() {
             fov = 45.0f * DEG2RAD;
             aspect = 4.0f / 3.0f;
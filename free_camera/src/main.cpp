@@ -1,45 +1,264 @@
 #include "common.h"
+#include "AllocationCounter.h"
+#include "BVH.h"
+#include "EntityStore.h"
+#include "FrameArena.h"
+#include "FrameGraph.h"
+#include "JobSystem.h"
+#include "LODManager.h"
+#include "OcclusionBuffer.h"
+#include "Pool.h"
+#include "SceneComponents.h"
+#include "SceneGraph.h"
+#include "SpatialHash.h"
+#include "TripleBuffer.h"
+#include "VisibilityCache.h"
 
 #include <GLFW/glfw3.h>
 
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <chrono>
+#include <exception>
+#include <map>
 #include <stdexcept>
 #include <iostream>
 #include <string>
-#include <unordered_set>
+#include <thread>
+#include <vector>
 
 #define WINDOW_WIDTH 800
 #define WINDOW_HEIGHT 600
 
 using namespace GLPractice;
 
-Transform g_modelTransform;
+#define INSTANCE_GRID_SIZE 32
+#define INSTANCE_GRID_SPACING 2.0f
+
+// the world matrix of the group node is applied to the cubes and spheres
+SceneGraph g_sceneGraph;
+uint32_t g_groupNode = SceneGraph::NO_NODE;
+// the cubes and spheres, each with a Transform relative to the group,
+// a MeshRef, RenderFlags and its world BoundingSphere, the cubes with a Color
+EntityStore g_entities;
+// the cubes in the order of the culling structures
+std::vector<uint32_t> g_instanceEntities;
+
+// world bounds of the cubes and what is left of them after culling,
+// recomputed when the group transform moves
+SphereArray g_instanceSpheres;
+std::vector<BoundingBox> g_instanceBoxes;
+BVH g_instanceBVH;
+SpatialHash g_instanceGrid(4.0f * INSTANCE_GRID_SPACING);
+// results kept while the camera moves less than half a unit and turns less than 2 degrees
+VisibilityCache g_visibilityCache(0.5f, 2.0f * DEG2RAD);
+Transform g_instanceBoundsTransform;
+bool g_instanceBoundsValid = false;
+std::vector<uint32_t> g_visibleInstances;
+
+// the nearest visible cubes hide the ones behind them, switched by O key
+#define OCCLUDER_COUNT 16
+bool g_occlusionCulling = true;
+OcclusionBuffer g_occlusionBuffer(256, 128);
+std::vector<GLfloat> g_occluderPositions;
+std::vector<GLuint> g_occluderIndices;
+std::vector<std::pair<float, uint32_t> > g_occluderCandidates;
+TransformArray g_visibleTransforms;
+std::vector<GLfloat> g_visibleColors;
 Camera g_camera;
 
-GLProgram* g_program = NULL;
-Mesh* g_mesh = NULL;
-MeshRenderer* g_meshRenderer = NULL;
+// a row of spheres going into the distance, each drawn
+// with the level of detail its distance needs
+#define LOD_SPHERE_COUNT 64
+#define LOD_LEVEL_COUNT 5
+LODManager g_lodManager;
+// the spheres in the order of the LODManager objects
+std::vector<uint32_t> g_lodEntities;
+// finest level first, one instanced renderer per level. the meshes are
+// streamed in, a level is drawn once its mesh arrived
+std::vector<PoolHandle> g_lodMeshes;
+std::vector<MeshRenderer> g_lodRenderers;
+std::vector<TransformArray> g_lodLevelTransforms;
+// the data of each level until its mesh was loaded
+std::vector<GLfloat> g_lodVertexData[LOD_LEVEL_COUNT];
+std::vector<GLuint> g_lodIndexData[LOD_LEVEL_COUNT];
+// of the finest level, the simulation does not wait for the meshes
+BoundingSphere g_lodLocalSphere;
+
+// loads meshes on the workers, uploading a few at a time
+// each frame through a staging buffer
+#define STREAMING_STAGING_SIZE (1 << 20)
+#define STREAMING_FRAME_BUDGET (64 << 10)
+MeshStreamer g_meshStreamer(STREAMING_STAGING_SIZE, STREAMING_FRAME_BUDGET);
+
+// all meshes, they stay in their slot of the pool, so the
+// renderers can keep pointers to them
+#define MESH_POOL_SIZE 16
+Pool<Mesh> g_meshPool(MESH_POOL_SIZE);
+// renderers keep pointers into g_programs, so it is filled
+// before any renderer is created and not resized afterwards
+std::vector<GLProgram> g_programs;
+// the meshes MeshRef of the cubes indexes
+std::vector<PoolHandle> g_meshes;
+std::vector<MeshRenderer> g_meshRenderers;
 GLFWwindow* g_window = NULL;
 
-std::unordered_set<void(*)()> g_prerenderCallbacks;
+// indices into g_programs, the compute programs
+// are only loaded when GLCaps::computeShader is set
+enum {
+    PROGRAM_INSTANCED = 0,
+    PROGRAM_PLAIN = 1,
+    PROGRAM_CULL_INSTANCES = 2,
+    PROGRAM_DEPTH_PYRAMID = 3
+};
+// the programs drawing with the camera uniforms come first
+#define DRAW_PROGRAM_COUNT 2
+
+// ways of submitting the cubes, switched by M key
+enum RenderMode {
+    RENDER_MODE_INSTANCED,
+    RENDER_MODE_INDIRECT,
+    RENDER_MODE_QUEUE,
+    RENDER_MODE_COMMANDS,
+    RENDER_MODE_GPU,
+    RENDER_MODE_COUNT
+};
+RenderMode g_renderMode = RENDER_MODE_INSTANCED;
+
+// ways of culling the cubes, switched by B key
+enum CullMode {
+    CULL_MODE_FLAT,
+    CULL_MODE_BVH,
+    CULL_MODE_GRID,
+    CULL_MODE_CACHED,
+    CULL_MODE_COUNT
+};
+CullMode g_cullMode = CULL_MODE_BVH;
+
+// all meshes packed for the indirect submission mode
+GeometryArena g_arena;
+std::vector<MeshRange> g_meshRanges;
+std::vector<IndirectRenderer> g_indirectRenderers;
+std::vector<float16> g_instanceMatrices;
+
+// the draw of a cube for the queue and command modes, set up
+// while the main thread still has the context
+DrawItem g_cubeDraw;
+
+// one sorted draw per cube for the queue submission mode
+RenderQueue g_renderQueue;
+
+// the same draws recorded by the workers for the command mode, front to back
+#define COMMAND_TASK_SIZE 256
+
+// cubes culled by a compute shader against the frustum and the depth of
+// the last frame for the GPU mode, empty without GL 4.3
+std::vector<GPUCuller> g_gpuCullers;
+std::vector<DepthPyramid> g_depthPyramids;
+// changes each time the bounds of the cubes are recomputed
+unsigned g_instanceBoundsVersion = 0;
+// the matrix of the frame being drawn, kept with its depth
+Matrix g_frameViewProjection;
+
+// everything the render thread needs of a simulated frame, copied out so
+// the simulation can go on with the next one while it is drawn
+struct FrameSnapshot {
+    // 0 until the first frame was published
+    uint64_t frame = 0;
+    Camera camera;
+    Matrix groupMatrix;
+    int framebufferWidth = 0;
+    int framebufferHeight = 0;
+    RenderMode renderMode = RENDER_MODE_INSTANCED;
+    bool occlusionCulling = false;
+    bool occlusionQueries = false;
+
+    TransformArray visibleTransforms;
+    std::vector<GLfloat> visibleColors;
+    std::vector<TransformArray> lodLevelTransforms;
+    // the draws of the command mode, kept with the snapshot
+    // and only recorded again when the visible cubes changed
+    CommandList commands;
+
+    // all cubes for the GPU mode, only gathered again when
+    // g_instanceBoundsVersion changed since this snapshot had them
+    unsigned instanceVersion = 0;
+    std::vector<float16> instanceMatrices;
+    std::vector<GLfloat> instanceColors;
+    SphereArray instanceSpheres;
+};
+
+// the simulation runs input, movement, transforms and culling on the main
+// thread, the render thread owns the GL context and draws the newest frame
+TripleBuffer<FrameSnapshot> g_frames;
+uint64_t g_simulatedFrames = 0;
+std::thread g_renderThread;
+std::atomic<bool> g_renderStop(false);
+// thrown on the render thread, rethrown on the main thread
+std::exception_ptr g_renderError;
+// the version of the cubes the GPU cullers have
+unsigned g_uploadedInstanceVersion = 0;
+
+// the simulation steps at a fixed rate, however fast frames are drawn
+#define SIMULATION_RATE 60
+
+// the work of a simulated frame on the workers of the job system
+FrameGraph g_frameGraph;
+// data needed during a single simulated frame, freed at the start of the next
+#define FRAME_ARENA_SIZE (1 << 20)
+FrameArena g_frameArena(FRAME_ARENA_SIZE);
+// heap allocations and simulated frames since the timings were printed, of
+// the simulation thread alone and of all threads, the job workers included
+uint64_t g_simulationAllocations = 0;
+uint64_t g_frameAllocations = 0;
+unsigned g_allocationFrames = 0;
+// heap allocations of the render thread and the frames it drew since then
+std::atomic<uint64_t> g_renderAllocations(0);
+std::atomic<unsigned> g_renderedFrames(0);
+// runs while a movement key is held
+unsigned g_moveTask = 0;
+// read at the start of each frame, the tasks can not ask GLFW
+int g_framebufferWidth = 0;
+int g_framebufferHeight = 0;
+// switched by V key, applied to the renderers by the render thread
+bool g_occlusionQueries = false;
 
 std::string g_vShaderPath = "../shaders/vShader.vert";
 std::string g_fShaderPath = "../shaders/fShader.frag";
+std::string g_vShaderInstancedPath = "../shaders/vShaderInstanced.vert";
+std::string g_cullShaderPath = "../shaders/cullInstances.comp";
+std::string g_depthPyramidShaderPath = "../shaders/depthPyramid.comp";
 
 void appRelease(){
-    if(!g_program){
-        delete g_program;
-        g_program = NULL;
+    // the render thread hands the context back once it stopped
+    if(g_renderThread.joinable()) {
+        g_renderStop.store(true);
+        g_renderThread.join();
     }
-    if(!g_mesh){
-        delete g_mesh;
-        g_mesh = NULL;
-    }
-    if(!g_meshRenderer) {
-        delete g_meshRenderer;
-        g_meshRenderer = NULL;
-    }
-    if(!g_window) {
+    if(g_window)
+        glfwMakeContextCurrent(g_window);
+
+    // GL objects are released while the context still exists
+    g_gpuCullers.clear();
+    g_depthPyramids.clear();
+    g_indirectRenderers.clear();
+    g_meshStreamer.unload();
+    g_lodRenderers.clear();
+    g_lodMeshes.clear();
+    g_arena.unload();
+    g_meshRenderers.clear();
+    g_meshes.clear();
+    g_meshPool.clear();
+    g_programs.clear();
+    VertexArrayCache::get().clear();
+    QueryPool::get().clear();
+
+    if(g_window) {
+        // everything released above was only queued for deletion
+        GLDeletionQueue::get().flush();
         glfwDestroyWindow(g_window);
+        g_window = NULL;
     }
     glfwTerminate();
 }
@@ -58,12 +277,117 @@ void printMatrix(Matrix mat) {
     std::cout << std::endl;
 }
 
+// all shader files are read at once, each compiled as soon as it arrived
 void loadShaders() {
-    const GLShader& vShader = GLShader::shaderFromFile(g_vShaderPath.c_str(), GL_VERTEX_SHADER);
-    const GLShader& fShader = GLShader::shaderFromFile(g_fShaderPath.c_str(), GL_FRAGMENT_SHADER);
-    GLuint shaders[2] {vShader.getObjectId(), fShader.getObjectId()};
+    enum {
+        SHADER_VERTEX,
+        SHADER_VERTEX_INSTANCED,
+        SHADER_FRAGMENT,
+        SHADER_CULL_INSTANCES,
+        SHADER_DEPTH_PYRAMID,
+        SHADER_COUNT
+    };
+    struct ShaderFile {
+        const std::string* path;
+        GLenum type;
+        std::unique_ptr<GLShader> shader;
+    } files[SHADER_COUNT] = {
+        { &g_vShaderPath, GL_VERTEX_SHADER, NULL },
+        { &g_vShaderInstancedPath, GL_VERTEX_SHADER, NULL },
+        { &g_fShaderPath, GL_FRAGMENT_SHADER, NULL },
+        { &g_cullShaderPath, GL_COMPUTE_SHADER, NULL },
+        { &g_depthPyramidShaderPath, GL_COMPUTE_SHADER, NULL },
+    };
+    unsigned fileCount = GLCaps::get().computeShader ? SHADER_COUNT : SHADER_CULL_INSTANCES;
+
+    AssetReader reader(fileCount, SHADER_BUFFER_SIZE);
+    for(unsigned i = 0; i < fileCount; i++) {
+        reader.read(*files[i].path, [&files, i](const AssetReader::File& file) {
+            files[i].shader.reset(new GLShader(GLShader::shaderFromFile(file, files[i].type)));
+        });
+    }
+    reader.wait();
+
+    GLuint instancedShaders[2] {files[SHADER_VERTEX_INSTANCED].shader->getObjectId(),
+        files[SHADER_FRAGMENT].shader->getObjectId()};
+    g_programs.emplace_back(instancedShaders, 2);
+
+    GLuint shaders[2] {files[SHADER_VERTEX].shader->getObjectId(), files[SHADER_FRAGMENT].shader->getObjectId()};
+    g_programs.emplace_back(shaders, 2);
+
+    if(!GLCaps::get().computeShader)
+        return;
+
+    GLuint cullShaders[1] {files[SHADER_CULL_INSTANCES].shader->getObjectId()};
+    g_programs.emplace_back(cullShaders, 1);
+
+    GLuint depthPyramidShaders[1] {files[SHADER_DEPTH_PYRAMID].shader->getObjectId()};
+    g_programs.emplace_back(depthPyramidShaders, 1);
+}
+
+// an icosahedron subdivided the given number of times, in the unit cube
+// like the cube mesh, returns how far its triangles get inside the sphere
+float generateSphere(unsigned subdivisions, std::vector<GLfloat>& vertexData, std::vector<GLuint>& indexData) {
+    const float t = (1.0f + sqrtf(5.0f)) / 2.0f;
+    std::vector<Vector3> points {
+        { -1.0f, t, 0.0f }, { 1.0f, t, 0.0f }, { -1.0f, -t, 0.0f }, { 1.0f, -t, 0.0f },
+        { 0.0f, -1.0f, t }, { 0.0f, 1.0f, t }, { 0.0f, -1.0f, -t }, { 0.0f, 1.0f, -t },
+        { t, 0.0f, -1.0f }, { t, 0.0f, 1.0f }, { -t, 0.0f, -1.0f }, { -t, 0.0f, 1.0f },
+    };
+    for(Vector3& point : points)
+        point = Vector3Normalize(point);
+
+    indexData.assign({
+        0, 11, 5,   0, 5, 1,    0, 1, 7,    0, 7, 10,   0, 10, 11,
+        1, 5, 9,    5, 11, 4,   11, 10, 2,  10, 7, 6,   7, 1, 8,
+        3, 9, 4,    3, 4, 2,    3, 2, 6,    3, 6, 8,    3, 8, 9,
+        4, 9, 5,    2, 4, 11,   6, 2, 10,   8, 6, 7,    9, 8, 1,
+    });
+
+    // each triangle becomes 4, sharing the new points on their edges
+    for(unsigned s = 0; s < subdivisions; s++) {
+        std::map<uint64_t, GLuint> midpoints;
+        auto midpoint = [&](GLuint a, GLuint b) {
+            uint64_t key = ((uint64_t) std::min(a, b) << 32) | std::max(a, b);
+            auto found = midpoints.find(key);
+            if(found != midpoints.end())
+                return found->second;
+
+            GLuint index = points.size();
+            points.push_back(Vector3Normalize(Vector3Add(points[a], points[b])));
+            midpoints[key] = index;
+            return index;
+        };
+
+        std::vector<GLuint> subdivided;
+        subdivided.reserve(indexData.size() * 4);
+        for(unsigned i = 0; i < indexData.size(); i += 3) {
+            GLuint a = indexData[i];
+            GLuint b = indexData[i + 1];
+            GLuint c = indexData[i + 2];
+            GLuint ab = midpoint(a, b);
+            GLuint bc = midpoint(b, c);
+            GLuint ca = midpoint(c, a);
+            subdivided.insert(subdivided.end(), { a, ab, ca,  b, bc, ab,  c, ca, bc,  ab, bc, ca });
+        }
+        indexData.swap(subdivided);
+    }
 
-    g_program = new GLProgram(shaders, 2);
+    // the centers of the triangles are the farthest inside
+    float error = 0.0f;
+    for(unsigned i = 0; i < indexData.size(); i += 3) {
+        Vector3 center = Vector3Add(Vector3Add(points[indexData[i]], points[indexData[i + 1]]),
+                points[indexData[i + 2]]);
+        error = std::max(error, 1.0f - Vector3Length(center) / 3.0f);
+    }
+
+    vertexData.clear();
+    for(const Vector3& point : points) {
+        vertexData.push_back(0.5f + 0.5f * point.x);
+        vertexData.push_back(0.5f + 0.5f * point.y);
+        vertexData.push_back(0.5f + 0.5f * point.z);
+    }
+    return 0.5f * error;
 }
 
 void loadMeshData() {
@@ -107,57 +431,605 @@ void loadMeshData() {
         //0, 3,
     };
 
-    g_mesh = new Mesh();
-    g_mesh->setVertexData(vertexData, sizeof(vertexData) / sizeof(GLfloat));
-    g_mesh->setIndexData(indexData, sizeof(indexData) / sizeof(GLuint));
-    g_mesh->load();
+    Mesh cube;
+    cube.setVertexData(vertexData, sizeof(vertexData) / sizeof(GLfloat));
+    cube.setIndexData(indexData, sizeof(indexData) / sizeof(GLuint));
+    cube.load();
+    g_meshes.push_back(g_meshPool.create(std::move(cube)));
+
+    // the cube is also the occluder shape on the CPU
+    g_occluderPositions.assign(vertexData, vertexData + sizeof(vertexData) / sizeof(GLfloat));
+    g_occluderIndices.assign(indexData, indexData + sizeof(indexData) / sizeof(GLuint));
+
+    g_meshRenderers.reserve(g_meshes.size());
+    for(PoolHandle mesh : g_meshes)
+        g_meshRenderers.emplace_back(&g_meshPool.at(mesh), &g_programs[PROGRAM_INSTANCED]);
+
+    // a grid of cubes in the XZ plane, tinted by their position in the grid
+    for(unsigned i = 0; i < INSTANCE_GRID_SIZE * INSTANCE_GRID_SIZE; i++) {
+        unsigned x = i % INSTANCE_GRID_SIZE;
+        unsigned z = i / INSTANCE_GRID_SIZE;
+        Transform transform;
+        transform.translation.x = (x - INSTANCE_GRID_SIZE / 2.0f) * INSTANCE_GRID_SPACING;
+        transform.translation.z = z * INSTANCE_GRID_SPACING;
+
+        uint32_t entity = g_entities.create();
+        g_entities.add<Transform>(entity, transform);
+        g_entities.add<MeshRef>(entity, MeshRef{ 0 });
+        g_entities.add<RenderFlags>(entity, RenderFlags{ RENDER_INSTANCED | RENDER_OCCLUDER });
+        g_entities.add<Color>(entity, Color{ { (float) x / INSTANCE_GRID_SIZE, 1.0f, (float) z / INSTANCE_GRID_SIZE, 1.0f } });
+        // the bounds are computed before the first culling
+        g_entities.add<BoundingSphere>(entity);
+    }
 
-    g_meshRenderer = new MeshRenderer(g_mesh, g_program);
-}
+    for(PoolHandle mesh : g_meshes)
+        g_meshRanges.push_back(g_arena.add(g_meshPool.at(mesh)));
+    g_arena.load();
+    g_indirectRenderers.emplace_back(&g_arena, &g_programs[PROGRAM_INSTANCED]);
+
+    // the finest sphere has 5120 triangles, the coarsest 20
+    LODLevel levels[LOD_LEVEL_COUNT];
+    for(unsigned level = 0; level < LOD_LEVEL_COUNT; level++) {
+        levels[level].error = generateSphere(LOD_LEVEL_COUNT - 1 - level,
+                g_lodVertexData[level], g_lodIndexData[level]);
+        levels[level].triangleCount = g_lodIndexData[level].size() / 3;
+    }
+    g_lodLocalSphere = computeBoundingSphere(g_lodVertexData[0].data(), g_lodVertexData[0].size() / 3);
+    g_lodLevelTransforms.resize(LOD_LEVEL_COUNT);
+
+    // the pool slots are created here, the render thread only fills them
+    // while the simulation reads the pool. the meshes arrive in the order
+    // they were requested, so the renderer of each level is at its index
+    g_meshStreamer.load();
+    g_lodRenderers.reserve(LOD_LEVEL_COUNT);
+    for(unsigned level = 0; level < LOD_LEVEL_COUNT; level++) {
+        g_lodMeshes.push_back(g_meshPool.create());
+        g_meshStreamer.request([level](Mesh& sphere) {
+            sphere.setVertexData(g_lodVertexData[level].data(), g_lodVertexData[level].size());
+            sphere.setIndexData(g_lodIndexData[level].data(), g_lodIndexData[level].size());
+            std::vector<GLfloat>().swap(g_lodVertexData[level]);
+            std::vector<GLuint>().swap(g_lodIndexData[level]);
+        }, [level](Mesh& sphere) {
+            Mesh& mesh = g_meshPool.at(g_lodMeshes[level]);
+            mesh = std::move(sphere);
+            g_lodRenderers.emplace_back(&mesh, &g_programs[PROGRAM_INSTANCED]);
+        });
+    }
 
-void updateUniform() {
-    glUseProgram(g_program->getObjectId());
+    unsigned chain = g_lodManager.addChain(levels, LOD_LEVEL_COUNT);
+    for(unsigned i = 0; i < LOD_SPHERE_COUNT; i++) {
+        Transform transform;
+        transform.scale = Vector3{ 2.0f, 2.0f, 2.0f };
+        transform.translation = Vector3{ -1.0f, 4.0f, i * 3.0f };
+
+        uint32_t entity = g_entities.create();
+        g_entities.add<Transform>(entity, transform);
+        g_entities.add<MeshRef>(entity, MeshRef{ chain });
+        g_entities.add<RenderFlags>(entity, RenderFlags{ RENDER_LOD });
+        g_entities.add<BoundingSphere>(entity);
+        g_lodEntities.push_back(entity);
+        // the bounds are set before each update
+        g_lodManager.addObject(chain, g_lodLocalSphere, 1.0f);
+    }
 
-    GLint modelUniformLoc = g_program->GetUniformLocation("model");
-    GLint viewUniformLoc = g_program->GetUniformLocation("view");
-    GLint projUniformLoc = g_program->GetUniformLocation("projection");
+    if(GLCaps::get().computeShader && GLCaps::get().vertexAttribBinding) {
+        g_gpuCullers.emplace_back(&g_arena, g_meshRanges.front(),
+                &g_programs[PROGRAM_CULL_INSTANCES], &g_programs[PROGRAM_INSTANCED]);
+        g_depthPyramids.emplace_back(&g_programs[PROGRAM_DEPTH_PYRAMID]);
+    }
+}
 
+void updateUniform(const FrameSnapshot& frame) {
     // rotate this model around Y axis by frame
     //Vector3 yAxis = Vector3Zero();
     //yAxis.y = 1.0f;
-    //g_modelTransform.rotation =
-        //QuaternionMultiply(g_modelTransform.rotation, QuaternionFromAxisAngle(yAxis, 0.05f * DEG2RAD));
-
-    // setting value for each Uniform variable
-    float16 modelMatrix = MatrixToFloatV(g_modelTransform.toMatrix());
-    glUniformMatrix4fv(modelUniformLoc, 1, GL_FALSE, modelMatrix.v);
-    float16 viewMatrix = MatrixToFloatV(g_camera.viewMatrix());
-    glUniformMatrix4fv(viewUniformLoc, 1, GL_FALSE, viewMatrix.v);
-    float16 projMatrix = MatrixToFloatV(g_camera.projectionMatrix());
-    glUniformMatrix4fv(projUniformLoc, 1, GL_FALSE, projMatrix.v);
-
-    glUseProgram(0);
+    //Transform group = g_sceneGraph.getLocalTransform(g_groupNode);
+    //group.rotation = QuaternionMultiply(group.rotation, QuaternionFromAxisAngle(yAxis, 0.05f * DEG2RAD));
+    //g_sceneGraph.setLocalTransform(g_groupNode, group);
+
+    float16 modelMatrix = MatrixToFloatV(frame.groupMatrix);
+    float16 viewMatrix = MatrixToFloatV(frame.camera.viewMatrix());
+    float16 projMatrix = MatrixToFloatV(frame.camera.projectionMatrix());
+
+    g_frameViewProjection = frame.camera.projectionMatrix() * frame.camera.viewMatrix();
+
+    for(unsigned i = 0; i < DRAW_PROGRAM_COUNT; i++) {
+        const GLProgram& program = g_programs[i];
+        GLint modelUniformLoc = program.GetUniformLocation("model");
+        GLint viewUniformLoc = program.GetUniformLocation("view");
+        GLint projUniformLoc = program.GetUniformLocation("projection");
+
+        // setting value for each Uniform variable
+        // the plain program gets its model matrix for each draw instead
+        program.setUniformMatrix4(modelUniformLoc, modelMatrix.v);
+        program.setUniformMatrix4(viewUniformLoc, viewMatrix.v);
+        program.setUniformMatrix4(projUniformLoc, projMatrix.v);
+    }
+}
+
+// world bounds of every cube, the BVH is built once and refit afterwards,
+// the grid relinks only the cubes that moved into another cell
+void updateInstanceBounds() {
+    const Transform& group = g_sceneGraph.getLocalTransform(g_groupNode);
+
+    g_instanceEntities.clear();
+    g_instanceBoxes.clear();
+    g_entities.each<Transform, MeshRef, RenderFlags, BoundingSphere>([&](uint32_t entity,
+                const Transform& transform, const MeshRef& mesh, const RenderFlags& flags, BoundingSphere& sphere) {
+        if(!(flags.flags & RENDER_INSTANCED))
+            return;
+
+        const Mesh& instanceMesh = g_meshPool.at(g_meshes[mesh.mesh]);
+        sphere = transformSphere(instanceMesh.getBoundingSphere(), transform.scale,
+                transform.rotation, transform.translation);
+        sphere = transformSphere(sphere, group.scale, group.rotation, group.translation);
+        BoundingBox box = transformBox(instanceMesh.getBoundingBox(), transform.scale,
+                transform.rotation, transform.translation);
+        g_instanceBoxes.push_back(transformBox(box, group.scale, group.rotation, group.translation));
+        g_instanceEntities.push_back(entity);
+    });
+
+    g_instanceSpheres.resize(g_instanceEntities.size());
+    for(unsigned i = 0; i < g_instanceEntities.size(); i++) {
+        BoundingSphere sphere = g_entities.get<BoundingSphere>(g_instanceEntities[i]);
+        g_instanceSpheres.set(i, sphere);
+        g_instanceGrid.update(i, sphere.center, sphere.radius);
+    }
+
+    // every sphere moved with the group, the cache starts over
+    g_visibilityCache.setSpheres(g_instanceSpheres);
+
+    if(g_instanceBVH.objectCount() != g_instanceBoxes.size())
+        g_instanceBVH.build(g_instanceBoxes.data(), g_instanceBoxes.size());
+    else
+        g_instanceBVH.refit(g_instanceBoxes.data());
+
+    g_instanceBoundsTransform = group;
+    g_instanceBoundsValid = true;
+    g_instanceBoundsVersion++;
+}
+
+// recompute the bounds when the group transform moved
+void refreshInstanceBounds() {
+    if(!g_instanceBoundsValid ||
+            memcmp(&g_instanceBoundsTransform, &g_sceneGraph.getLocalTransform(g_groupNode),
+                sizeof(Transform)) != 0)
+        updateInstanceBounds();
+}
+
+// draw the cubes nearest to the camera into the occlusion buffer and
+// drop the other visible cubes hidden behind them, returns the new count
+unsigned occlusionCullInstances() {
+    g_occluderCandidates.clear();
+    unsigned occluderCount = 0;
+    for(uint32_t instance : g_visibleInstances) {
+        // the cubes that can not hide others go last
+        float distance = FLT_MAX;
+        if(g_entities.get<RenderFlags>(g_instanceEntities[instance]).flags & RENDER_OCCLUDER) {
+            BoundingSphere sphere = g_instanceSpheres.get(instance);
+            distance = Vector3Distance(sphere.center, g_camera.position) - sphere.radius;
+            occluderCount++;
+        }
+        g_occluderCandidates.push_back(std::make_pair(distance, instance));
+    }
+
+    occluderCount = std::min(occluderCount, (unsigned) OCCLUDER_COUNT);
+    std::nth_element(g_occluderCandidates.begin(), g_occluderCandidates.begin() + occluderCount,
+            g_occluderCandidates.end());
+
+    g_occlusionBuffer.begin(g_camera.projectionMatrix() * g_camera.viewMatrix());
+    const Matrix& groupMatrix = g_sceneGraph.getWorldMatrix(g_groupNode);
+    for(unsigned i = 0; i < occluderCount; i++) {
+        uint32_t instance = g_occluderCandidates[i].second;
+        const Transform& transform = g_entities.get<Transform>(g_instanceEntities[instance]);
+        g_occlusionBuffer.addOccluder(g_occluderPositions.data(), g_occluderIndices.data(),
+                g_occluderIndices.size(), groupMatrix * transform.toMatrix());
+    }
+    g_occlusionBuffer.rasterize(jobFor);
+
+    // the occluders come first and stay, the rest is tested against them
+    for(unsigned i = 0; i < g_occluderCandidates.size(); i++)
+        g_visibleInstances[i] = g_occluderCandidates[i].second;
+
+    unsigned visibleCount = occluderCount + g_occlusionBuffer.cullBoxes(g_instanceBoxes.data(),
+            g_visibleInstances.data() + occluderCount, g_visibleInstances.size() - occluderCount,
+            g_visibleInstances.data() + occluderCount, jobFor);
+    g_visibleInstances.resize(visibleCount);
+    return visibleCount;
+}
+
+// test the cubes against the camera frustum and
+// gather the transforms and colors of the visible ones
+void cullInstances() {
+    refreshInstanceBounds();
+
+    Frustum frustum = g_camera.frustum();
+    g_visibleInstances.resize(g_instanceEntities.size());
+    unsigned visibleCount = 0;
+    switch(g_cullMode) {
+        case CULL_MODE_BVH:
+            visibleCount = g_instanceBVH.cullFrustum(frustum, g_visibleInstances.data());
+            break;
+        case CULL_MODE_GRID:
+            visibleCount = g_instanceGrid.cullFrustum(frustum, g_visibleInstances.data());
+            break;
+        case CULL_MODE_CACHED:
+            visibleCount = g_visibilityCache.cull(frustum, g_camera.position, g_camera.rotation,
+                    g_camera.projectionMatrix(), g_visibleInstances.data());
+            break;
+        default:
+            visibleCount = cullSpheres(frustum, g_instanceSpheres, g_visibleInstances.data());
+            break;
+    }
+    g_visibleInstances.resize(visibleCount);
+
+    if(g_occlusionCulling)
+        visibleCount = occlusionCullInstances();
+
+    g_visibleTransforms.resize(visibleCount);
+    g_visibleColors.resize(visibleCount * 4);
+    for(unsigned i = 0; i < visibleCount; i++) {
+        uint32_t entity = g_instanceEntities[g_visibleInstances[i]];
+        const Transform& transform = g_entities.get<Transform>(entity);
+        g_visibleTransforms.scale[i] = transform.scale;
+        g_visibleTransforms.rotation[i] = transform.rotation;
+        g_visibleTransforms.translation[i] = transform.translation;
+        memcpy(&g_visibleColors[i * 4], g_entities.get<Color>(entity).rgba, 4 * sizeof(GLfloat));
+    }
+}
+
+// the draw of the cube with the plain program, its model matrix
+// is set for each cube
+DrawItem makeCubeDraw() {
+    const GLProgram& program = g_programs[PROGRAM_PLAIN];
+    const Mesh& mesh = g_meshPool.at(g_meshes.front());
+
+    DrawItem item;
+    item.program = program.getObjectId();
+    item.modelLocation = program.GetUniformLocation("model");
+    if(GLCaps::get().vertexAttribBinding) {
+        VertexLayout layout;
+        layout.addAttrib(program.GetAttribLocation(VERT_SHADER_POS_ATTRIB_NAME), 3, 0, VERTEX_BINDING_MESH);
+        item.vao = VertexArrayCache::get().getVertexArray(layout);
+        item.vbo = mesh.vbo();
+        item.ebo = mesh.ebo();
+    }
+    else {
+        // the VAO of the mesh set up by its MeshRenderer
+        item.vao = mesh.vao();
+        item.vbo = 0;
+        item.ebo = 0;
+    }
+    item.vertexStride = 3 * sizeof(GLfloat);
+    item.indexCount = mesh.getIndexCount();
+    item.firstIndex = 0;
+    item.baseVertex = 0;
+    return item;
+}
+
+// fill the draw queue with one draw of the cube for each visible instance
+void buildRenderQueue(const FrameSnapshot& frame) {
+    DrawItem item = g_cubeDraw;
+
+    const Camera& camera = frame.camera;
+    const TransformArray& transforms = frame.visibleTransforms;
+    Vector3 forwardDir = Vector3Zero();
+    forwardDir.z = 1.0f;
+    forwardDir = Vector3RotateByQuaternion(forwardDir, camera.rotation);
+
+    g_renderQueue.clear();
+    Transform transform;
+    for(unsigned i = 0; i < transforms.size(); i++) {
+        transform.scale = transforms.scale[i];
+        transform.rotation = transforms.rotation[i];
+        transform.translation = transforms.translation[i];
+        Matrix modelMatrix = frame.groupMatrix * transform.toMatrix();
+        item.model = MatrixToFloatV(modelMatrix);
+
+        Vector3 position = Vector3Zero();
+        position = Vector3Transform(position, modelMatrix);
+        float depth = Vector3DotProduct(Vector3Subtract(position, camera.position), forwardDir);
+        depth = (depth - camera.near) / (camera.far - camera.near);
+
+        g_renderQueue.push(RenderQueue::PASS_OPAQUE, 0, depth, item);
+    }
+    g_renderQueue.sort();
+}
+
+// the cubes are culled by a compute shader, the CPU only keeps
+// their bounds and uploads them again after they moved
+void gpuCullInstances(const FrameSnapshot& frame) {
+    if(frame.instanceVersion != g_uploadedInstanceVersion) {
+        for(GPUCuller& culler : g_gpuCullers)
+            culler.setInstances(frame.instanceMatrices.data(), frame.instanceColors.data(),
+                    frame.instanceSpheres);
+        g_uploadedInstanceVersion = frame.instanceVersion;
+    }
+
+    const DepthPyramid* pyramid = frame.occlusionCulling ? &g_depthPyramids.front() : NULL;
+    Frustum frustum = frame.camera.frustum();
+    for(GPUCuller& culler : g_gpuCullers)
+        culler.cull(frustum, pyramid);
+}
+
+// pick the level of every sphere and sort the spheres by level
+void selectLevelsOfDetail() {
+    const BoundingSphere& localSphere = g_lodLocalSphere;
+    const Transform& group = g_sceneGraph.getLocalTransform(g_groupNode);
+    const Vector3& groupScale = group.scale;
+    for(unsigned i = 0; i < g_lodEntities.size(); i++) {
+        const Transform& transform = g_entities.get<Transform>(g_lodEntities[i]);
+        const Vector3& scale = transform.scale;
+        BoundingSphere& sphere = g_entities.get<BoundingSphere>(g_lodEntities[i]);
+        sphere = transformSphere(localSphere, scale, transform.rotation, transform.translation);
+        sphere = transformSphere(sphere, groupScale, group.rotation, group.translation);
+        float errorScale = std::max(fabsf(scale.x), std::max(fabsf(scale.y), fabsf(scale.z))) *
+            std::max(fabsf(groupScale.x), std::max(fabsf(groupScale.y), fabsf(groupScale.z)));
+        g_lodManager.setBounds(i, sphere, errorScale);
+    }
+
+    g_lodManager.update(g_camera.position, g_camera.fov, g_framebufferHeight, jobFor);
+
+    // count the spheres of each level first, then place them
+    unsigned levelCounts[LOD_LEVEL_COUNT] = { 0 };
+    for(unsigned i = 0; i < g_lodEntities.size(); i++)
+        levelCounts[g_lodManager.level(i)]++;
+    for(unsigned level = 0; level < LOD_LEVEL_COUNT; level++) {
+        g_lodLevelTransforms[level].resize(levelCounts[level]);
+        levelCounts[level] = 0;
+    }
+    for(unsigned i = 0; i < g_lodEntities.size(); i++) {
+        unsigned level = g_lodManager.level(i);
+        TransformArray& transforms = g_lodLevelTransforms[level];
+        unsigned slot = levelCounts[level]++;
+        const Transform& transform = g_entities.get<Transform>(g_lodEntities[i]);
+        transforms.scale[slot] = transform.scale;
+        transforms.rotation[slot] = transform.rotation;
+        transforms.translation[slot] = transform.translation;
+    }
+}
+
+// hand each level renderer its spheres
+void updateLevelsOfDetail(const FrameSnapshot& frame) {
+    for(unsigned level = 0; level < g_lodRenderers.size(); level++)
+        g_lodRenderers[level].updateInstances(frame.lodLevelTransforms[level]);
 }
 
-void render() {
+// the CPU side of the cubes, the GPU mode culls them itself
+// and only needs their bounds
+void updateVisibleInstances() {
+    if(g_renderMode == RENDER_MODE_GPU)
+        refreshInstanceBounds();
+    else
+        cullInstances();
+}
+
+// record the draws of the visible cubes front to back into the snapshot
+// to publish, spread over the workers
+void recordCommands() {
+    CommandList& commands = g_frames.back().commands;
+    if(g_renderMode != RENDER_MODE_COMMANDS) {
+        commands.invalidate();
+        return;
+    }
+
+    const Matrix& groupMatrix = g_sceneGraph.getWorldMatrix(g_groupNode);
+    Vector3 forwardDir = Vector3Zero();
+    forwardDir.z = 1.0f;
+    forwardDir = Vector3RotateByQuaternion(forwardDir, g_camera.rotation);
+
+    // the sort keys and the visible cubes in their order, for this frame only
+    unsigned count = g_visibleTransforms.size();
+    uint64_t* keys = g_frameArena.allocate<uint64_t>(count);
+    uint32_t* order = g_frameArena.allocate<uint32_t>(count);
+    for(unsigned i = 0; i < count; i++) {
+        Vector3 position = Vector3Transform(g_visibleTransforms.translation[i], groupMatrix);
+        float depth = Vector3DotProduct(Vector3Subtract(position, g_camera.position), forwardDir);
+        depth = (depth - g_camera.near) / (g_camera.far - g_camera.near);
+        keys[i] = RenderQueue::makeKey(RenderQueue::PASS_OPAQUE, g_cubeDraw.program, 0,
+                g_cubeDraw.vao, depth);
+        order[i] = i;
+    }
+    radixSort(keys, order, count, g_frameArena.allocate<uint64_t>(count),
+            g_frameArena.allocate<uint32_t>(count));
+
+    // the same cubes in the same order under the same group
+    // make the same commands, FNV-1a over both
+    uint64_t key = 14695981039346656037ull;
+    auto hash = [&key](const void* data, size_t size) {
+        for(size_t i = 0; i < size; i++)
+            key = (key ^ ((const uint8_t*) data)[i]) * 1099511628211ull;
+    };
+    hash(&groupMatrix, sizeof(Matrix));
+    for(unsigned i = 0; i < count; i++)
+        hash(&g_visibleInstances[order[i]], sizeof(uint32_t));
+
+    // captured by reference, small enough for std::function to keep inline
+    struct Recording {
+        const Matrix* groupMatrix;
+        const uint32_t* order;
+        unsigned count;
+    } recording = { &groupMatrix, order, count };
+
+    unsigned taskCount = (count + COMMAND_TASK_SIZE - 1) / COMMAND_TASK_SIZE;
+    commands.record(key, taskCount, [&recording](unsigned task, CommandBuffer& buffer) {
+        const DrawItem& item = g_cubeDraw;
+        buffer.bindProgram(item.program);
+        buffer.bindVertexArray(item.vao);
+        if(item.vbo)
+            buffer.bindMeshBuffers(item.vbo, item.ebo, item.vertexStride);
+
+        unsigned last = std::min((task + 1) * COMMAND_TASK_SIZE, recording.count);
+        Transform transform;
+        for(unsigned i = task * COMMAND_TASK_SIZE; i < last; i++) {
+            unsigned visible = recording.order[i];
+            transform.scale = g_visibleTransforms.scale[visible];
+            transform.rotation = g_visibleTransforms.rotation[visible];
+            transform.translation = g_visibleTransforms.translation[visible];
+            float16 model = MatrixToFloatV(*recording.groupMatrix * transform.toMatrix());
+            buffer.setUniformMatrix4(item.modelLocation, model.v);
+            buffer.drawElements(item.indexCount, item.firstIndex, item.baseVertex);
+        }
+    }, jobFor);
+}
+
+// copy what the render thread needs into the back snapshot and publish it
+void publishFrame() {
+    FrameSnapshot& frame = g_frames.back();
+    frame.frame = ++g_simulatedFrames;
+    frame.camera = g_camera;
+    frame.groupMatrix = g_sceneGraph.getWorldMatrix(g_groupNode);
+    frame.framebufferWidth = g_framebufferWidth;
+    frame.framebufferHeight = g_framebufferHeight;
+    frame.renderMode = g_renderMode;
+    frame.occlusionCulling = g_occlusionCulling;
+    frame.occlusionQueries = g_occlusionQueries;
+
+    frame.visibleTransforms = g_visibleTransforms;
+    frame.visibleColors = g_visibleColors;
+    frame.lodLevelTransforms = g_lodLevelTransforms;
+
+    if(g_renderMode == RENDER_MODE_GPU && frame.instanceVersion != g_instanceBoundsVersion) {
+        frame.instanceMatrices.resize(g_instanceEntities.size());
+        frame.instanceColors.resize(g_instanceEntities.size() * 4);
+        for(unsigned i = 0; i < g_instanceEntities.size(); i++) {
+            uint32_t entity = g_instanceEntities[i];
+            frame.instanceMatrices[i] = MatrixToFloatV(g_entities.get<Transform>(entity).toMatrix());
+            memcpy(&frame.instanceColors[i * 4], g_entities.get<Color>(entity).rgba, 4 * sizeof(GLfloat));
+        }
+        frame.instanceSpheres = g_instanceSpheres;
+        frame.instanceVersion = g_instanceBoundsVersion;
+    }
+
+    g_frames.publish();
+}
+
+// hand the visible cubes to the renderers of the current mode
+void updateInstances(const FrameSnapshot& frame) {
+    if(frame.renderMode == RENDER_MODE_GPU) {
+        gpuCullInstances(frame);
+        return;
+    }
+
+    if(frame.renderMode == RENDER_MODE_QUEUE) {
+        buildRenderQueue(frame);
+        return;
+    }
+
+    // recorded by the simulation, nothing to upload
+    if(frame.renderMode == RENDER_MODE_COMMANDS)
+        return;
+
+    const TransformArray& transforms = frame.visibleTransforms;
+    if(frame.renderMode == RENDER_MODE_INDIRECT) {
+        // one draw per object, merged into indirect commands
+        g_instanceMatrices.resize(transforms.size());
+        transforms.toMatrices(g_instanceMatrices.data());
+
+        for(IndirectRenderer& renderer : g_indirectRenderers) {
+            renderer.clear();
+            for(const float16& model : g_instanceMatrices)
+                renderer.addDraw(g_meshRanges.front(), model);
+        }
+        return;
+    }
+
+    for(MeshRenderer& renderer : g_meshRenderers) {
+        if(!renderer.isInstanced())
+            continue;
+
+        renderer.updateInstances(transforms);
+        if(transforms.size() > 0)
+            renderer.setInstanceColors(frame.visibleColors.data(), transforms.size());
+    }
+}
+
+void render(const FrameSnapshot& frame) {
     // using grey color to clear
     glClearColor(0.8f, 0.8f, 0.8f, 1.0f);
     // clear color and depth info since last draw
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    // setup defore drawing
-    glUseProgram(g_program->getObjectId());
-    glBindVertexArray(g_mesh->vao());
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, g_mesh->ebo());
-
     // draw some primitives
-    //glDrawArrays(GL_TRIANGLES, 0, 4);
-    glDrawElements(GL_TRIANGLES, 3 * 12, GL_UNSIGNED_INT, 0);
+    switch(frame.renderMode) {
+        case RENDER_MODE_INDIRECT:
+            for(IndirectRenderer& renderer : g_indirectRenderers)
+                renderer.render();
+            break;
+        case RENDER_MODE_QUEUE:
+            g_renderQueue.submit();
+            break;
+        case RENDER_MODE_COMMANDS:
+            submitCommands(frame.commands);
+            break;
+        case RENDER_MODE_GPU:
+            for(GPUCuller& culler : g_gpuCullers)
+                culler.render();
+            break;
+        default:
+            for(const MeshRenderer& renderer : g_meshRenderers)
+                renderer.render();
+            // the boxes are tested once everything is drawn,
+            // deciding about the draws of the next frame
+            for(MeshRenderer& renderer : g_meshRenderers)
+                renderer.queryOcclusion();
+            break;
+    }
 
-    // reset bindings after drawing
-    glBindVertexArray(0);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-    glUseProgram(0);
+    for(const MeshRenderer& renderer : g_lodRenderers)
+        renderer.render();
+
+    // the next frame is culled against the depth of this one,
+    // in the other modes it would get out of date
+    for(DepthPyramid& pyramid : g_depthPyramids) {
+        if(frame.renderMode == RENDER_MODE_GPU)
+            pyramid.capture(frame.framebufferWidth, frame.framebufferHeight, g_frameViewProjection);
+        else
+            pyramid.invalidate();
+    }
+}
+
+// all GL work of a snapshot, on the render thread
+void renderFrame(const FrameSnapshot& frame) {
+    for(MeshRenderer& renderer : g_meshRenderers) {
+        if(renderer.hasOcclusionQuery() != frame.occlusionQueries)
+            renderer.setOcclusionQuery(frame.occlusionQueries);
+    }
+
+    updateUniform(frame);
+    updateInstances(frame);
+    updateLevelsOfDetail(frame);
+    render(frame);
+}
+
+// draws the newest snapshot until stopped, again when nothing newer came yet
+void renderMain() {
+    glfwMakeContextCurrent(g_window);
+    try {
+        while(!g_renderStop.load()) {
+            g_frames.update();
+            const FrameSnapshot& frame = g_frames.front();
+            if(frame.frame == 0) {
+                std::this_thread::yield();
+                continue;
+            }
+
+            uint64_t allocations = threadAllocationCount();
+            // the meshes streamed in so far are drawn from this frame on
+            g_meshStreamer.update();
+            renderFrame(frame);
+            glfwSwapBuffers(g_window);
+            // objects released while drawing are deleted once the GPU is done
+            GLDeletionQueue::get().endFrame();
+            g_renderAllocations += threadAllocationCount() - allocations;
+            g_renderedFrames++;
+        }
+    }
+    catch(...) {
+        g_renderError = std::current_exception();
+        glfwSetWindowShouldClose(g_window, GL_TRUE);
+    }
+    glfwMakeContextCurrent(NULL);
 }
 
 void onError(int errorCode, const char* msg) {
@@ -186,6 +1058,60 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
     if(!window || window != g_window)
         return;
 
+    // Use M key to switch between instanced, indirect, queued, recorded and GPU culled drawing
+    if(key == GLFW_KEY_M && action == GLFW_PRESS) {
+        g_renderMode = (RenderMode) ((g_renderMode + 1) % RENDER_MODE_COUNT);
+        if(g_renderMode == RENDER_MODE_GPU && g_gpuCullers.empty())
+            g_renderMode = (RenderMode) ((g_renderMode + 1) % RENDER_MODE_COUNT);
+        return;
+    }
+
+    // Use O key to turn occlusion culling on and off
+    if(key == GLFW_KEY_O && action == GLFW_PRESS) {
+        g_occlusionCulling = !g_occlusionCulling;
+        return;
+    }
+
+    // Use V key to turn the occlusion queries of the renderers on and off
+    if(key == GLFW_KEY_V && action == GLFW_PRESS) {
+        g_occlusionQueries = !g_occlusionQueries;
+        return;
+    }
+
+    // Use L key to print how many triangles the levels of detail saved
+    if(key == GLFW_KEY_L && action == GLFW_PRESS) {
+        std::cout << "LOD: " << g_lodManager.triangleCount() << " triangles drawn, "
+            << g_lodManager.trianglesSaved() << " saved, "
+            << g_lodManager.levelChangeCount() << " level changes" << std::endl;
+        return;
+    }
+
+    // Use T key to print how long each simulation task took on average
+    if(key == GLFW_KEY_T && action == GLFW_PRESS) {
+        std::cout << "frame tasks: " << g_frameGraph.averageFrameMs() << " ms" << std::endl;
+        for(unsigned task = 0; task < g_frameGraph.taskCount(); task++)
+            std::cout << "  " << g_frameGraph.taskName(task) << ": "
+                << g_frameGraph.averageTaskMs(task) << " ms" << std::endl;
+        unsigned frames = std::max(1u, g_allocationFrames);
+        unsigned renderedFrames = std::max(1u, g_renderedFrames.exchange(0));
+        std::cout << "heap allocations per frame: " << (double) g_simulationAllocations / frames
+            << " on the simulation thread, " << (double) g_frameAllocations / frames
+            << " on all threads, frame arena: " << g_frameArena.highWater() << " bytes at most" << std::endl
+            << "heap allocations per drawn frame: " << (double) g_renderAllocations.exchange(0) / renderedFrames
+            << " on the render thread" << std::endl;
+        g_frameGraph.resetTimings();
+        g_simulationAllocations = 0;
+        g_frameAllocations = 0;
+        g_allocationFrames = 0;
+        return;
+    }
+
+    // Use B key to switch between flat, BVH, grid and cached culling
+    if(key == GLFW_KEY_B && action == GLFW_PRESS) {
+        g_cullMode = (CullMode) ((g_cullMode + 1) % CULL_MODE_COUNT);
+        return;
+    }
+
     // Use WASDQE keys to move the camera
     if( key != GLFW_KEY_W &&
         key != GLFW_KEY_A &&
@@ -196,7 +1122,7 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
         return;
 
     if(action == GLFW_PRESS) {
-        g_prerenderCallbacks.insert(move);
+        g_frameGraph.setEnabled(g_moveTask, true);
         moveVelocityRaw = Vector3Zero();
         switch(key) {
             case GLFW_KEY_W:
@@ -222,7 +1148,7 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
         }
     }
     else if (action == GLFW_RELEASE) {
-        g_prerenderCallbacks.erase(move);
+        g_frameGraph.setEnabled(g_moveTask, false);
     }
 }
 
@@ -326,13 +1252,13 @@ void appInit(){
         throw std::runtime_error("glewInit failed");
     if(!GLEW_VERSION_3_3)
         throw std::runtime_error("OpenGL 3.3 API is not avaliable.");
+    GLCaps::detect();
 
     // enable depth testing
     // default: choose fragment having smaller depth
-    glEnable(GL_DEPTH_TEST);
     // enable face culling
     // default: remain front face, which is counter-clockwise
-    glEnable(GL_CULL_FACE);
+    GLStateCache::get().applyPipelineState(PipelineState::opaque());
 
     // setup viewport
     int bufWidth, bufHeight;
@@ -347,51 +1273,87 @@ void appInit(){
     //g_camera.rotation = QuaternionFromAxisAngle(xAxis, 30.0f * DEG2RAD);
 
     // setup model transform
-    g_modelTransform.translation.z = 5.0f;
-    g_modelTransform.translation.x = 0.0f;
-    g_modelTransform.translation.y = -2.0f;
+    Transform group;
+    group.translation.z = 5.0f;
+    group.translation.x = 0.0f;
+    group.translation.y = -2.0f;
+    g_groupNode = g_sceneGraph.addNode(SceneGraph::NO_NODE, group);
 
     // load data for redering
     loadShaders();
     loadMeshData();
+    g_cubeDraw = makeCubeDraw();
 
     // show some system info
     printGLInfo();
 
-    // add pre-render callbacks
-    g_prerenderCallbacks.insert(updateUniform);
+    // the simulation tasks, in an order their dependencies allow
+    g_moveTask = g_frameGraph.addTask("move", move, {}, { "camera" });
+    g_frameGraph.setEnabled(g_moveTask, false);
+    g_frameGraph.addTask("sceneGraph", []() { g_sceneGraph.update(jobFor); }, {}, { "worldMatrices" });
+    g_frameGraph.addTask("cullInstances", updateVisibleInstances,
+            { "camera", "worldMatrices" }, { "visibleInstances" });
+    g_frameGraph.addTask("selectLevelsOfDetail", selectLevelsOfDetail,
+            { "camera", "worldMatrices" }, { "lodLevels" });
+    g_frameGraph.addTask("recordCommands", recordCommands,
+            { "camera", "worldMatrices", "visibleInstances" }, { "commands" });
+    g_frameGraph.addTask("publishFrame", publishFrame,
+            { "camera", "worldMatrices", "visibleInstances", "lodLevels", "commands" }, { "frames" });
+
+    // from here on the context belongs to the render thread
+    glfwMakeContextCurrent(NULL);
+    g_renderThread = std::thread(renderMain);
 }
 
 void appMain() {
     appInit();
 
+    const std::chrono::microseconds tick(1000000 / SIMULATION_RATE);
+    std::chrono::steady_clock::time_point nextTick = std::chrono::steady_clock::now();
     while(!glfwWindowShouldClose(g_window)) {
         glfwPollEvents();
 
-        for(void(*func)() : g_prerenderCallbacks) {
-            if(func)
-                func();
-        }
-
-        render();
-
-        glfwSwapBuffers(g_window);
+        glfwGetFramebufferSize(g_window, &g_framebufferWidth, &g_framebufferHeight);
+        // the count of all threads takes in the render thread too,
+        // the count of this thread only the tasks it ran itself
+        uint64_t allocations = allocationCount();
+        uint64_t simulationAllocations = threadAllocationCount();
+        g_frameArena.reset();
+        g_frameGraph.execute(JobSystem::get());
+        g_simulationAllocations += threadAllocationCount() - simulationAllocations;
+        g_frameAllocations += allocationCount() - allocations;
+        g_allocationFrames++;
+
+        // a slow tick is not caught up with, the next one just starts later
+        nextTick = std::max(nextTick + tick, std::chrono::steady_clock::now());
+        std::this_thread::sleep_until(nextTick);
     }
 
     appRelease();
+    if(g_renderError)
+        std::rethrow_exception(g_renderError);
 }
 
 int main(int argc, char* argv[]) {
     try {
         if(argc >= 3) {
             g_vShaderPath = argv[1];
-            g_vShaderPath = argv[2];
+            g_fShaderPath = argv[2];
+            if(argc >= 4)
+                g_vShaderInstancedPath = argv[3];
+            if(argc >= 6) {
+                g_cullShaderPath = argv[4];
+                g_depthPyramidShaderPath = argv[5];
+            }
         }
         else {
             std::cout << "No shader path provided." << std::endl
                 << "Use default shader path:" << std::endl
                 << g_vShaderPath << std::endl
-                << g_fShaderPath << std::endl;
+                << g_fShaderPath << std::endl
+                << g_vShaderInstancedPath << std::endl
+                << g_cullShaderPath << std::endl
+                << g_depthPyramidShaderPath << std::endl;
         }
 
         appMain();